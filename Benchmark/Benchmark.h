@@ -0,0 +1,22 @@
+#pragma once
+
+#include "Vulkan.h"
+
+#include <vector>
+
+const uint32_t BENCH_WIDTH = 800;
+const uint32_t BENCH_HEIGHT = 600;
+const uint32_t WARMUP_FRAMES = 10;
+const uint32_t MEASURED_FRAMES = 100;
+const uint32_t MAX_UPLOAD_FRAMES = 1000; // Frames to wait for the instances to reach the GPU
+
+// instanceCount quads on a square grid filling the screen, shaded by position. seed shifts the colors so
+// consecutive grids differ.
+std::vector<InstanceData> MakeInstanceGrid(uint32_t instanceCount, uint32_t seed = 0);
+
+// Draws until everything uploaded has reached the GPU, false if it takes more than MAX_UPLOAD_FRAMES
+bool WaitForDrawData(Vulkan& vulkan, uint32_t& frames);
+
+// Fixed headless scenarios reported as JSON, see the usage in BenchmarkSuite.cpp. args excludes --suite.
+// Returns the process exit code: 0, 1 on failure, 2 when a scenario regressed against the baseline.
+int RunBenchmarkSuite(int argc, char** argv);
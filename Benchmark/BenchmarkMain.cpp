@@ -0,0 +1,389 @@
+#include "Benchmark.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+std::vector<InstanceData> MakeInstanceGrid(uint32_t instanceCount, uint32_t seed)
+{
+	uint32_t columns = (uint32_t)ceil(sqrt((double)instanceCount));
+	float cell = 2.0f / columns;
+
+	std::vector<InstanceData> instances(instanceCount);
+	for (uint32_t i = 0; i < instanceCount; ++i)
+	{
+		uint32_t x = i % columns;
+		uint32_t y = i / columns;
+
+		instances[i].offset[0] = -1.0f + (x + 0.5f) * cell;
+		instances[i].offset[1] = -1.0f + (y + 0.5f) * cell;
+		instances[i].scale = cell * 0.8f;
+		instances[i].color = 0xFF000000 | ((((x + seed) % columns) * 255 / columns) << 8) | (y * 255 / columns);
+	}
+
+	return instances;
+}
+
+bool WaitForDrawData(Vulkan& vulkan, uint32_t& frames)
+{
+	frames = 0;
+	while (!vulkan.IsDrawDataReady())
+	{
+		if (++frames > MAX_UPLOAD_FRAMES)
+		{
+			return false;
+		}
+
+		vulkan.DrawFrame();
+	}
+
+	return true;
+}
+
+static const char* RecordModeName(RecordMode mode)
+{
+	switch (mode)
+	{
+	case RecordMode::Static:
+		return "static";
+	case RecordMode::Dynamic:
+		return "dynamic";
+	case RecordMode::Threaded:
+		return "threaded";
+	}
+
+	return "unknown";
+}
+
+// Records the draw list fresh every frame and reports how much CPU time each draw cost to record
+static void BenchmarkRecording(Vulkan& vulkan, RecordMode mode, uint32_t drawCount)
+{
+	const Mesh& triangle = vulkan.GetBuiltinMesh(BuiltinMesh::Triangle);
+
+	vulkan.SetRecordMode(mode);
+	vulkan.SetDrawList(std::vector<DrawCommand>(drawCount, DrawCommand{ triangle.indexCount, 1, triangle.firstIndex, triangle.vertexOffset, 0 }));
+
+	for (uint32_t i = 0; i < WARMUP_FRAMES; ++i)
+	{
+		vulkan.DrawFrame();
+	}
+
+	FrameSyncStats before = vulkan.GetFrameSyncStats();
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	for (uint32_t i = 0; i < MEASURED_FRAMES; ++i)
+	{
+		vulkan.DrawFrame();
+	}
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+	const FrameSyncStats& after = vulkan.GetFrameSyncStats();
+
+	double recordMs = after.totalRecordMs - before.totalRecordMs;
+	uint64_t draws = after.recordedDraws - before.recordedDraws;
+	double fenceWaitMs = after.totalFenceWaitMs - before.totalFenceWaitMs;
+
+	printf("%-9s draws %7u  record %8.3f ms/frame  %7.2f ns/draw  fence wait %8.3f ms/frame  frame %8.3f ms\n",
+		RecordModeName(mode), drawCount,
+		recordMs / MEASURED_FRAMES,
+		draws > 0 ? recordMs * 1000000.0 / draws : 0.0,
+		fenceWaitMs / MEASURED_FRAMES,
+		elapsed.count() / MEASURED_FRAMES);
+}
+
+// One indexed draw of instanceCount quads on a grid, timed once the instances have been uploaded
+static bool BenchmarkInstancing(Vulkan& vulkan, uint32_t instanceCount)
+{
+	std::vector<InstanceData> instances = MakeInstanceGrid(instanceCount);
+
+	// The previous sweep step may still be uploading
+	for (uint32_t i = 0; i < MAX_UPLOAD_FRAMES && !vulkan.IsDrawDataReady(); ++i)
+	{
+		vulkan.DrawFrame();
+	}
+
+	const Mesh& quad = vulkan.GetBuiltinMesh(BuiltinMesh::Quad);
+
+	vulkan.SetRecordMode(RecordMode::Static);
+	vulkan.SetDrawList(std::vector<DrawCommand>(1, DrawCommand{ quad.indexCount, instanceCount, quad.firstIndex, quad.vertexOffset, 0 }));
+
+	if (!vulkan.SetInstances(instances))
+	{
+		fprintf(stderr, "Unable to set %u instances\n", instanceCount);
+		return false;
+	}
+
+	uint32_t uploadFrames;
+	if (!WaitForDrawData(vulkan, uploadFrames))
+	{
+		fprintf(stderr, "Instances never finished uploading\n");
+		return false;
+	}
+
+	for (uint32_t i = 0; i < WARMUP_FRAMES; ++i)
+	{
+		vulkan.DrawFrame();
+	}
+
+	FrameSyncStats before = vulkan.GetFrameSyncStats();
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	for (uint32_t i = 0; i < MEASURED_FRAMES; ++i)
+	{
+		vulkan.DrawFrame();
+	}
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+	double fenceWaitMs = vulkan.GetFrameSyncStats().totalFenceWaitMs - before.totalFenceWaitMs;
+	double frameMs = elapsed.count() / MEASURED_FRAMES;
+
+	printf("instances %8u  upload frames %4u  frame %8.3f ms  fence wait %8.3f ms/frame  %7.3f ns/instance\n",
+		instanceCount, uploadFrames, frameMs, fenceWaitMs / MEASURED_FRAMES, frameMs * 1000000.0 / instanceCount);
+
+	return true;
+}
+
+// Objects scattered over twice the screen in each direction, so about a quarter survive the GPU cull
+static bool BenchmarkCulling(Vulkan& vulkan, uint32_t objectCount)
+{
+	std::vector<Mesh> meshes = { vulkan.GetBuiltinMesh(BuiltinMesh::Triangle), vulkan.GetBuiltinMesh(BuiltinMesh::Quad) };
+
+	// Same scene every run
+	srand(objectCount);
+
+	std::vector<GpuObject> objects(objectCount);
+	for (GpuObject& object : objects)
+	{
+		object = GpuObject();
+		object.instance.offset[0] = -2.0f + 4.0f * rand() / RAND_MAX;
+		object.instance.offset[1] = -2.0f + 4.0f * rand() / RAND_MAX;
+		object.instance.scale = 0.02f;
+		object.instance.color = 0xFF000000 | (rand() & 0xFFFFFF);
+		object.mesh = rand() % meshes.size();
+	}
+
+	for (uint32_t i = 0; i < MAX_UPLOAD_FRAMES && !vulkan.IsDrawDataReady(); ++i)
+	{
+		vulkan.DrawFrame();
+	}
+
+	vulkan.SetRecordMode(RecordMode::Static);
+	vulkan.SetGpuDriven(true);
+
+	if (!vulkan.SetGpuScene(meshes, objects))
+	{
+		fprintf(stderr, "Unable to set %u GPU objects\n", objectCount);
+		return false;
+	}
+
+	uint32_t uploadFrames;
+	if (!WaitForDrawData(vulkan, uploadFrames))
+	{
+		fprintf(stderr, "GPU objects never finished uploading\n");
+		return false;
+	}
+
+	for (uint32_t i = 0; i < WARMUP_FRAMES; ++i)
+	{
+		vulkan.DrawFrame();
+	}
+
+	FrameSyncStats before = vulkan.GetFrameSyncStats();
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	for (uint32_t i = 0; i < MEASURED_FRAMES; ++i)
+	{
+		vulkan.DrawFrame();
+	}
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+	double fenceWaitMs = vulkan.GetFrameSyncStats().totalFenceWaitMs - before.totalFenceWaitMs;
+	const CullingStats& stats = vulkan.GetCullingStats();
+
+	printf("objects %8u  visible %8u  culled %8u  draws %2u  frame %8.3f ms  fence wait %8.3f ms/frame\n",
+		objectCount, stats.visible, stats.culled, stats.draws, elapsed.count() / MEASURED_FRAMES, fenceWaitMs / MEASURED_FRAMES);
+
+	return true;
+}
+
+// Cold starts with the cache file disabled, so every run compiles the same pipelines from scratch
+static bool BenchmarkPipelineCompiles(uint32_t workerCount)
+{
+	Vulkan vulkan;
+	vulkan.SetPipelineWorkerCount(workerCount);
+	vulkan.SetPipelineCacheEnabled(false);
+
+	if (!vulkan.InitializeHeadless(BENCH_WIDTH, BENCH_HEIGHT))
+	{
+		fprintf(stderr, "Unable to initialize headless vulkan\n");
+		return false;
+	}
+
+	vulkan.WaitForPipelines();
+
+	const StartupStats& startup = vulkan.GetStartupStats();
+	PipelineCompileStats compiles = vulkan.GetPipelineCompileStats();
+
+	printf("workers %2u  pipelines %3u  startup %8.3f ms  critical wait %8.3f ms  all ready %8.3f ms  compile work %8.3f ms  speedup %5.2fx\n",
+		compiles.workers, compiles.compiled,
+		startup.startupMs,
+		startup.criticalPipelineMs,
+		compiles.wallMs,
+		compiles.compileMs,
+		compiles.Speedup());
+
+	vulkan.Shutdown();
+
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	// Every return below goes through exit, which writes out whatever is left in the log
+	Log::Initialize();
+	atexit(Log::Shutdown);
+
+	if (argc > 1 && strcmp(argv[1], "--suite") == 0)
+	{
+		return RunBenchmarkSuite(argc - 2, argv + 2);
+	}
+
+	if (argc > 1 && strcmp(argv[1], "--pipelines") == 0)
+	{
+		std::vector<uint32_t> workerCounts = { 1, 2, 4, 8 };
+
+		if (argc > 2)
+		{
+			workerCounts.clear();
+			for (int i = 2; i < argc; ++i)
+			{
+				workerCounts.push_back((uint32_t)strtoul(argv[i], nullptr, 10));
+			}
+		}
+
+		for (uint32_t workerCount : workerCounts)
+		{
+			if (!BenchmarkPipelineCompiles(workerCount))
+			{
+				return 1;
+			}
+		}
+
+		return 0;
+	}
+
+	if (argc > 1 && strcmp(argv[1], "--instances") == 0)
+	{
+		std::vector<uint32_t> instanceCounts = { 1000, 10000, 100000, 1000000 };
+
+		if (argc > 2)
+		{
+			instanceCounts.clear();
+			for (int i = 2; i < argc; ++i)
+			{
+				instanceCounts.push_back((uint32_t)strtoul(argv[i], nullptr, 10));
+			}
+		}
+
+		Vulkan vulkan;
+
+		if (!vulkan.InitializeHeadless(BENCH_WIDTH, BENCH_HEIGHT))
+		{
+			fprintf(stderr, "Unable to initialize headless vulkan\n");
+			return 1;
+		}
+
+		int result = 0;
+		for (uint32_t instanceCount : instanceCounts)
+		{
+			if (!BenchmarkInstancing(vulkan, instanceCount))
+			{
+				result = 1;
+				break;
+			}
+		}
+
+		vulkan.Shutdown();
+
+		return result;
+	}
+
+	if (argc > 1 && strcmp(argv[1], "--culling") == 0)
+	{
+		std::vector<uint32_t> objectCounts = { 10000, 100000, 1000000 };
+
+		if (argc > 2)
+		{
+			objectCounts.clear();
+			for (int i = 2; i < argc; ++i)
+			{
+				objectCounts.push_back((uint32_t)strtoul(argv[i], nullptr, 10));
+			}
+		}
+
+		Vulkan vulkan;
+
+		if (!vulkan.InitializeHeadless(BENCH_WIDTH, BENCH_HEIGHT))
+		{
+			fprintf(stderr, "Unable to initialize headless vulkan\n");
+			return 1;
+		}
+
+		if (!vulkan.IsGpuDrivenSupported())
+		{
+			fprintf(stderr, "GPU driven drawing is not supported on this device\n");
+			vulkan.Shutdown();
+			return 1;
+		}
+
+		int result = 0;
+		for (uint32_t objectCount : objectCounts)
+		{
+			if (!BenchmarkCulling(vulkan, objectCount))
+			{
+				result = 1;
+				break;
+			}
+		}
+
+		vulkan.Shutdown();
+
+		return result;
+	}
+
+	std::vector<uint32_t> drawCounts = { 1000, 10000, 50000, 100000 };
+
+	if (argc > 1)
+	{
+		drawCounts.clear();
+		for (int i = 1; i < argc; ++i)
+		{
+			drawCounts.push_back((uint32_t)strtoul(argv[i], nullptr, 10));
+		}
+	}
+
+	Vulkan vulkan;
+
+	if (!vulkan.InitializeHeadless(BENCH_WIDTH, BENCH_HEIGHT))
+	{
+		fprintf(stderr, "Unable to initialize headless vulkan\n");
+		return 1;
+	}
+
+	for (uint32_t drawCount : drawCounts)
+	{
+		BenchmarkRecording(vulkan, RecordMode::Dynamic, drawCount);
+		BenchmarkRecording(vulkan, RecordMode::Threaded, drawCount);
+	}
+
+	vulkan.Shutdown();
+
+	return 0;
+}
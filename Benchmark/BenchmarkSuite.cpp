@@ -0,0 +1,621 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+// Benchmark --suite [scenario...] [--frames N] [--icd icd.json] [--output results.json]
+//                   [--baseline baseline.json] [--threshold percent]
+//
+// Runs each scenario on a fresh headless device for a fixed number of frames and writes the results as JSON,
+// to stdout unless --output is given. --icd points the loader at one driver, e.g. a software rasterizer's
+// manifest, so runs on different machines are comparable. With a baseline, a scenario whose frame, record
+// or submit times got more than the threshold slower than the baseline's fails the run.
+
+const uint32_t SUITE_DEFAULT_FRAMES = 300;
+const double SUITE_DEFAULT_THRESHOLD = 10.0; // Percent
+
+// Smaller differences are timer noise on scenarios that only take microseconds
+const double SUITE_MIN_REGRESSION_MS = 0.05;
+
+const uint32_t SUITE_DRAWS = 10000;
+const uint32_t SUITE_INSTANCES = 100000;
+const uint32_t SUITE_UPLOAD_INSTANCES = 20000;
+const uint32_t SUITE_CHURN_DRAWS = 1000;
+const uint32_t SUITE_PARTICLES = 262144;
+const uint32_t SUITE_CHURN_BUFFERS = 1024;
+const VkDeviceSize SUITE_CHURN_BUFFER_SIZE = 256 * 1024; // 1024 of them span four default memory blocks
+const uint32_t SUITE_SCRATCH_BUFFERS = 64;
+const VkDeviceSize SUITE_SCRATCH_BUFFER_SIZE = 16 * 1024;
+const uint32_t SUITE_DEFRAGMENT_INTERVAL = 30; // Frames
+
+const int EXIT_REGRESSED = 2;
+
+struct Scenario
+{
+	const char* name;
+	uint32_t count; // Whatever the scenario scales with, draws or instances
+	bool (*setup)(Vulkan& vulkan, uint32_t count);
+	// Optional, called before every measured frame. True if it changed anything.
+	bool (*update)(Vulkan& vulkan, uint32_t count, uint32_t frame);
+	// Optional, called before the device is shut down
+	void (*teardown)(Vulkan& vulkan);
+};
+
+struct Percentiles
+{
+	double p50 = 0.0;
+	double p95 = 0.0;
+	double p99 = 0.0;
+};
+
+struct ScenarioResult
+{
+	std::string name;
+	uint32_t count = 0;
+	uint32_t frames = 0;
+	uint32_t updates = 0;
+	double fps = 0.0;
+	Percentiles frameMs; // CPU time of the whole DrawFrame call, plus the scenario's update
+	Percentiles recordMs;
+	Percentiles submitMs;
+};
+
+static bool SetupTriangle(Vulkan& vulkan, uint32_t count)
+{
+	// The default scene is already the triangle
+	vulkan.SetRecordMode(RecordMode::Dynamic);
+	return true;
+}
+
+static bool SetupDraws(Vulkan& vulkan, uint32_t count)
+{
+	const Mesh& triangle = vulkan.GetBuiltinMesh(BuiltinMesh::Triangle);
+
+	vulkan.SetRecordMode(RecordMode::Dynamic);
+	vulkan.SetDrawList(std::vector<DrawCommand>(count, DrawCommand{ triangle.indexCount, 1, triangle.firstIndex, triangle.vertexOffset, 0 }));
+
+	return true;
+}
+
+static bool SetupInstances(Vulkan& vulkan, uint32_t count)
+{
+	const Mesh& quad = vulkan.GetBuiltinMesh(BuiltinMesh::Quad);
+
+	vulkan.SetRecordMode(RecordMode::Static);
+	vulkan.SetDrawList(std::vector<DrawCommand>(1, DrawCommand{ quad.indexCount, count, quad.firstIndex, quad.vertexOffset, 0 }));
+
+	return vulkan.SetInstances(MakeInstanceGrid(count));
+}
+
+static bool SetupUploads(Vulkan& vulkan, uint32_t count)
+{
+	if (!SetupInstances(vulkan, count))
+	{
+		return false;
+	}
+
+	vulkan.SetRecordMode(RecordMode::Dynamic);
+	return true;
+}
+
+// The instance grid again, multisampled and depth tested, resolved inside the render pass
+static bool SetupMsaaDepth(Vulkan& vulkan, uint32_t count)
+{
+	vulkan.SetMultisampling(VK_SAMPLE_COUNT_4_BIT);
+	vulkan.SetDepthBuffer(true);
+
+	return SetupInstances(vulkan, count);
+}
+
+// The instance grid with a particle simulation stepped on the compute queue alongside every frame
+static bool SetupAsyncCompute(Vulkan& vulkan, uint32_t count)
+{
+	return SetupInstances(vulkan, SUITE_INSTANCES) && vulkan.SetParticleCount(count);
+}
+
+// The memory-churn scenario's buffers, the scenario callbacks are plain functions
+static std::vector<AllocatedBuffer> s_churnBuffers;
+static std::vector<AllocatedBuffer> s_scratchBuffers;
+
+static bool CreateChurnBuffers(MemoryAllocator& allocator, uint32_t count)
+{
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		AllocatedBuffer buffer;
+		if (!allocator.CreateBuffer(SUITE_CHURN_BUFFER_SIZE, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, AllocationStrategy::Buddy, buffer))
+		{
+			return false;
+		}
+
+		s_churnBuffers.push_back(buffer);
+	}
+
+	return true;
+}
+
+// Destroys all but every keep-th buffer, leaving holes all over the blocks
+static uint32_t ReleaseChurnBuffers(MemoryAllocator& allocator, uint32_t keep)
+{
+	uint32_t released = 0;
+
+	for (size_t i = s_churnBuffers.size(); i > 0; --i)
+	{
+		if ((i - 1) % keep != 0)
+		{
+			allocator.DestroyBuffer(s_churnBuffers[i - 1]);
+			s_churnBuffers.erase(s_churnBuffers.begin() + (i - 1));
+			released++;
+		}
+	}
+
+	return released;
+}
+
+// The triangle, with buddy blocks fragmented up front and compacted every SUITE_DEFRAGMENT_INTERVAL frames,
+// plus per frame scratch buffers from a linear pool that is reset rather than freed
+static bool SetupMemoryChurn(Vulkan& vulkan, uint32_t count)
+{
+	MemoryAllocator& allocator = vulkan.GetAllocator();
+
+	if (!SetupTriangle(vulkan, count) || !CreateChurnBuffers(allocator, count))
+	{
+		return false;
+	}
+
+	// Only one in four survives, so every block is mostly empty
+	ReleaseChurnBuffers(allocator, 4);
+
+	return true;
+}
+
+static bool UpdateMemoryChurn(Vulkan& vulkan, uint32_t count, uint32_t frame)
+{
+	MemoryAllocator& allocator = vulkan.GetAllocator();
+
+	// The GPU never sees the scratch buffers, so last frame's can all go at once
+	if (!s_scratchBuffers.empty())
+	{
+		allocator.ResetLinear(s_scratchBuffers[0].allocation.memoryType, ResourceKind::Linear);
+	}
+
+	for (auto& buffer : s_scratchBuffers)
+	{
+		allocator.DestroyBuffer(buffer);
+	}
+	s_scratchBuffers.clear();
+
+	for (uint32_t i = 0; i < SUITE_SCRATCH_BUFFERS; ++i)
+	{
+		AllocatedBuffer buffer;
+		if (!allocator.CreateBuffer(SUITE_SCRATCH_BUFFER_SIZE, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, AllocationStrategy::Linear, buffer))
+		{
+			break;
+		}
+
+		memset(buffer.allocation.mapped, (int)frame, (size_t)SUITE_SCRATCH_BUFFER_SIZE);
+		s_scratchBuffers.push_back(buffer);
+	}
+
+	if (frame % SUITE_DEFRAGMENT_INTERVAL != 0)
+	{
+		return true;
+	}
+
+	// Punch new holes, refill some of them and compact what is left on the compute queue
+	uint32_t released = ReleaseChurnBuffers(allocator, 2);
+	CreateChurnBuffers(allocator, released / 2);
+
+	std::vector<AllocatedBuffer*> buffers;
+	for (auto& buffer : s_churnBuffers)
+	{
+		buffers.push_back(&buffer);
+	}
+
+	std::vector<AllocatedBuffer> retired;
+	AsyncCompute& compute = vulkan.GetCompute();
+	ComputeTicket ticket = compute.Submit("Defragment", [&](VkCommandBuffer commandBuffer) { allocator.Defragment(commandBuffer, buffers, retired); });
+
+	// Nothing ran if the submit failed, so the old buffers can go either way
+	if (ticket != 0)
+	{
+		compute.Wait(ticket);
+	}
+
+	for (auto& buffer : retired)
+	{
+		allocator.DestroyBuffer(buffer);
+	}
+
+	return true;
+}
+
+static void TeardownMemoryChurn(Vulkan& vulkan)
+{
+	MemoryAllocator& allocator = vulkan.GetAllocator();
+
+	for (auto& buffer : s_churnBuffers)
+	{
+		allocator.DestroyBuffer(buffer);
+	}
+	for (auto& buffer : s_scratchBuffers)
+	{
+		allocator.DestroyBuffer(buffer);
+	}
+
+	s_churnBuffers.clear();
+	s_scratchBuffers.clear();
+}
+
+// A new set of instances as soon as the last one has landed
+static bool UpdateUploads(Vulkan& vulkan, uint32_t count, uint32_t frame)
+{
+	return vulkan.IsDrawDataReady() && vulkan.SetInstances(MakeInstanceGrid(count, frame));
+}
+
+// Every frame draws with a different one of the warmed up pipeline variants
+static bool UpdatePipelineChurn(Vulkan& vulkan, uint32_t count, uint32_t frame)
+{
+	const VkCullModeFlags cullModes[] = { VK_CULL_MODE_NONE, VK_CULL_MODE_BACK_BIT, VK_CULL_MODE_FRONT_BIT };
+	const VkFrontFace frontFaces[] = { VK_FRONT_FACE_CLOCKWISE, VK_FRONT_FACE_COUNTER_CLOCKWISE };
+	const BlendMode blendModes[] = { BlendMode::Opaque, BlendMode::Alpha, BlendMode::Additive };
+
+	return vulkan.SetPipelineVariant(cullModes[frame % 3], frontFaces[(frame / 3) % 2], blendModes[(frame / 6) % 3]);
+}
+
+static const Scenario SCENARIOS[] = {
+	{ "triangle", 1, SetupTriangle, nullptr },
+	{ "draws", SUITE_DRAWS, SetupDraws, nullptr },
+	{ "instances", SUITE_INSTANCES, SetupInstances, nullptr },
+	{ "msaa-depth", SUITE_INSTANCES, SetupMsaaDepth, nullptr },
+	{ "upload-heavy", SUITE_UPLOAD_INSTANCES, SetupUploads, UpdateUploads },
+	{ "pipeline-churn", SUITE_CHURN_DRAWS, SetupDraws, UpdatePipelineChurn },
+	{ "async-compute", SUITE_PARTICLES, SetupAsyncCompute, nullptr },
+	{ "memory-churn", SUITE_CHURN_BUFFERS, SetupMemoryChurn, UpdateMemoryChurn, TeardownMemoryChurn },
+};
+
+// Nearest rank, sorts samples
+static Percentiles ComputePercentiles(std::vector<double>& samples)
+{
+	Percentiles result;
+	if (samples.empty())
+	{
+		return result;
+	}
+
+	std::sort(samples.begin(), samples.end());
+
+	auto rank = [&samples](double percentile)
+	{
+		size_t index = (size_t)ceil(percentile / 100.0 * samples.size());
+		return samples[std::min(std::max<size_t>(index, 1), samples.size()) - 1];
+	};
+
+	result.p50 = rank(50.0);
+	result.p95 = rank(95.0);
+	result.p99 = rank(99.0);
+
+	return result;
+}
+
+static bool RunScenario(const Scenario& scenario, uint32_t frames, ScenarioResult& result)
+{
+	Vulkan vulkan;
+
+	if (!vulkan.InitializeHeadless(BENCH_WIDTH, BENCH_HEIGHT))
+	{
+		fprintf(stderr, "Unable to initialize headless vulkan\n");
+		return false;
+	}
+
+	// Variants still compiling would show up as hitches in the first frames that use them
+	vulkan.WaitForPipelines();
+
+	uint32_t uploadFrames;
+	bool ready = scenario.setup(vulkan, scenario.count) && WaitForDrawData(vulkan, uploadFrames);
+
+	if (!ready)
+	{
+		fprintf(stderr, "Unable to set up the %s scenario\n", scenario.name);
+		if (scenario.teardown != nullptr)
+		{
+			scenario.teardown(vulkan);
+		}
+		vulkan.Shutdown();
+		return false;
+	}
+
+	for (uint32_t i = 0; i < WARMUP_FRAMES; ++i)
+	{
+		vulkan.DrawFrame();
+	}
+
+	std::vector<double> frameMs, recordMs, submitMs;
+	frameMs.reserve(frames);
+	recordMs.reserve(frames);
+	submitMs.reserve(frames);
+
+	result = ScenarioResult();
+	result.name = scenario.name;
+	result.count = scenario.count;
+	result.frames = frames;
+
+	auto runStart = std::chrono::high_resolution_clock::now();
+
+	for (uint32_t i = 0; i < frames; ++i)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+
+		if (scenario.update != nullptr && scenario.update(vulkan, scenario.count, i))
+		{
+			result.updates++;
+		}
+
+		vulkan.DrawFrame();
+
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+		frameMs.push_back(elapsed.count());
+
+		const FrameSyncStats& stats = vulkan.GetFrameSyncStats();
+		recordMs.push_back(stats.lastRecordMs);
+		submitMs.push_back(stats.lastSubmitMs);
+	}
+
+	std::chrono::duration<double> total = std::chrono::high_resolution_clock::now() - runStart;
+
+	result.fps = total.count() > 0.0 ? frames / total.count() : 0.0;
+	result.frameMs = ComputePercentiles(frameMs);
+	result.recordMs = ComputePercentiles(recordMs);
+	result.submitMs = ComputePercentiles(submitMs);
+
+	if (scenario.teardown != nullptr)
+	{
+		scenario.teardown(vulkan);
+	}
+	vulkan.Shutdown();
+
+	return true;
+}
+
+static void WriteResults(FILE* file, uint32_t frames, const std::vector<ScenarioResult>& results)
+{
+	fprintf(file, "{\n  \"frames\": %u,\n  \"scenarios\": [\n", frames);
+
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const ScenarioResult& result = results[i];
+
+		fprintf(file, "    {\n");
+		fprintf(file, "      \"name\": \"%s\",\n", result.name.c_str());
+		fprintf(file, "      \"count\": %u,\n", result.count);
+		fprintf(file, "      \"updates\": %u,\n", result.updates);
+		fprintf(file, "      \"fps\": %.3f,\n", result.fps);
+		fprintf(file, "      \"frameP50Ms\": %.6f,\n", result.frameMs.p50);
+		fprintf(file, "      \"frameP95Ms\": %.6f,\n", result.frameMs.p95);
+		fprintf(file, "      \"frameP99Ms\": %.6f,\n", result.frameMs.p99);
+		fprintf(file, "      \"recordP50Ms\": %.6f,\n", result.recordMs.p50);
+		fprintf(file, "      \"recordP95Ms\": %.6f,\n", result.recordMs.p95);
+		fprintf(file, "      \"recordP99Ms\": %.6f,\n", result.recordMs.p99);
+		fprintf(file, "      \"submitP50Ms\": %.6f,\n", result.submitMs.p50);
+		fprintf(file, "      \"submitP95Ms\": %.6f,\n", result.submitMs.p95);
+		fprintf(file, "      \"submitP99Ms\": %.6f\n", result.submitMs.p99);
+		fprintf(file, "    }%s\n", i + 1 < results.size() ? "," : "");
+	}
+
+	fprintf(file, "  ]\n}\n");
+}
+
+// Only reads what WriteResults writes: one flat object per scenario, found by its name
+static bool ReadBaseline(const char* filename, std::vector<std::pair<std::string, std::string>>& scenarios)
+{
+	std::ifstream file(filename);
+	if (!file)
+	{
+		fprintf(stderr, "Unable to open baseline %s\n", filename);
+		return false;
+	}
+
+	std::stringstream stream;
+	stream << file.rdbuf();
+	std::string text = stream.str();
+
+	const std::string nameKey = "\"name\": \"";
+	size_t position = 0;
+
+	while ((position = text.find(nameKey, position)) != std::string::npos)
+	{
+		size_t nameStart = position + nameKey.size();
+		size_t nameEnd = text.find('"', nameStart);
+		size_t objectEnd = text.find('}', nameStart);
+
+		if (nameEnd == std::string::npos || objectEnd == std::string::npos)
+		{
+			break;
+		}
+
+		scenarios.push_back(std::make_pair(text.substr(nameStart, nameEnd - nameStart), text.substr(nameEnd, objectEnd - nameEnd)));
+		position = objectEnd;
+	}
+
+	return true;
+}
+
+static bool FindNumber(const std::string& object, const char* key, double& value)
+{
+	std::string quoted = std::string("\"") + key + "\":";
+	size_t position = object.find(quoted);
+	if (position == std::string::npos)
+	{
+		return false;
+	}
+
+	value = strtod(object.c_str() + position + quoted.size(), nullptr);
+	return true;
+}
+
+// True if anything regressed. Missing scenarios and metrics are reported but don't fail the run.
+static bool CompareToBaseline(const std::vector<ScenarioResult>& results, const std::vector<std::pair<std::string, std::string>>& baseline, double threshold)
+{
+	struct Compared
+	{
+		const char* key;
+		double value;
+	};
+
+	bool regressed = false;
+
+	for (const ScenarioResult& result : results)
+	{
+		auto found = std::find_if(baseline.begin(), baseline.end(), [&result](const std::pair<std::string, std::string>& entry) { return entry.first == result.name; });
+		if (found == baseline.end())
+		{
+			fprintf(stderr, "%-16s not in the baseline\n", result.name.c_str());
+			continue;
+		}
+
+		const Compared metrics[] = {
+			{ "frameP50Ms", result.frameMs.p50 },
+			{ "frameP95Ms", result.frameMs.p95 },
+			{ "recordP50Ms", result.recordMs.p50 },
+			{ "submitP50Ms", result.submitMs.p50 },
+		};
+
+		for (const Compared& metric : metrics)
+		{
+			double base;
+			if (!FindNumber(found->second, metric.key, base))
+			{
+				fprintf(stderr, "%-16s %-12s not in the baseline\n", result.name.c_str(), metric.key);
+				continue;
+			}
+
+			double change = base > 0.0 ? (metric.value - base) * 100.0 / base : 0.0;
+			bool worse = change > threshold && metric.value - base > SUITE_MIN_REGRESSION_MS;
+			regressed |= worse;
+
+			fprintf(stderr, "%-16s %-12s %10.4f ms -> %10.4f ms  %+7.1f%%%s\n", result.name.c_str(), metric.key, base, metric.value, change,
+				worse ? "  REGRESSED" : "");
+		}
+	}
+
+	return regressed;
+}
+
+static void SetIcd(const char* manifest)
+{
+	// The loader reads it when the instance is created
+#ifdef _WIN32
+	_putenv_s("VK_ICD_FILENAMES", manifest);
+#else
+	setenv("VK_ICD_FILENAMES", manifest, 1);
+#endif
+}
+
+int RunBenchmarkSuite(int argc, char** argv)
+{
+	uint32_t frames = SUITE_DEFAULT_FRAMES;
+	double threshold = SUITE_DEFAULT_THRESHOLD;
+	const char* output = nullptr;
+	const char* baselineFile = nullptr;
+	std::vector<std::string> selected;
+
+	for (int i = 0; i < argc; ++i)
+	{
+		bool hasValue = i + 1 < argc;
+
+		if (strcmp(argv[i], "--frames") == 0 && hasValue)
+		{
+			frames = std::max(1u, (uint32_t)strtoul(argv[++i], nullptr, 10));
+		}
+		else if (strcmp(argv[i], "--threshold") == 0 && hasValue)
+		{
+			threshold = strtod(argv[++i], nullptr);
+		}
+		else if (strcmp(argv[i], "--output") == 0 && hasValue)
+		{
+			output = argv[++i];
+		}
+		else if (strcmp(argv[i], "--baseline") == 0 && hasValue)
+		{
+			baselineFile = argv[++i];
+		}
+		else if (strcmp(argv[i], "--icd") == 0 && hasValue)
+		{
+			SetIcd(argv[++i]);
+		}
+		else if (argv[i][0] != '-')
+		{
+			selected.push_back(argv[i]);
+		}
+		else
+		{
+			fprintf(stderr, "Unknown suite option %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	// Read up front so a bad path fails before the run rather than after it
+	std::vector<std::pair<std::string, std::string>> baseline;
+	if (baselineFile != nullptr && !ReadBaseline(baselineFile, baseline))
+	{
+		return 1;
+	}
+
+	std::vector<ScenarioResult> results;
+
+	for (const Scenario& scenario : SCENARIOS)
+	{
+		if (!selected.empty() && std::find(selected.begin(), selected.end(), scenario.name) == selected.end())
+		{
+			continue;
+		}
+
+		ScenarioResult result;
+		if (!RunScenario(scenario, frames, result))
+		{
+			return 1;
+		}
+
+		fprintf(stderr, "%-16s count %7u  %9.1f fps  frame p50 %8.3f p95 %8.3f p99 %8.3f ms  record p50 %8.3f ms  submit p50 %8.3f ms\n",
+			result.name.c_str(), result.count, result.fps, result.frameMs.p50, result.frameMs.p95, result.frameMs.p99,
+			result.recordMs.p50, result.submitMs.p50);
+
+		results.push_back(result);
+	}
+
+	if (results.empty())
+	{
+		fprintf(stderr, "No scenario matched\n");
+		return 1;
+	}
+
+	FILE* file = output != nullptr ? fopen(output, "w") : stdout;
+	if (file == nullptr)
+	{
+		fprintf(stderr, "Unable to open %s\n", output);
+		return 1;
+	}
+
+	WriteResults(file, frames, results);
+
+	if (file != stdout)
+	{
+		fclose(file);
+	}
+
+	if (baselineFile != nullptr && CompareToBaseline(results, baseline, threshold))
+	{
+		fprintf(stderr, "Regressed more than %.1f%% against %s\n", threshold, baselineFile);
+		return EXIT_REGRESSED;
+	}
+
+	return 0;
+}
@@ -1,3 +1,29 @@
-C:\VulkanSDK\1.0.21.1\Bin\glslangValidator.exe -V vs.vert
-C:\VulkanSDK\1.0.21.1\Bin\glslangValidator.exe -V fs.frag
-pause
\ No newline at end of file
+@echo off
+rem Compiles every shader next to this script and turns the SPIR-V into headers for EMBED_SHADERS builds.
+rem Release builds run it before compiling with nopause and the SDK path, run by hand it keeps the window open
+rem and takes the SDK from VULKAN_SDK.
+setlocal
+cd /d "%~dp0"
+
+if not "%~2"=="" set "VULKAN_SDK=%~2"
+
+if "%VULKAN_SDK%"=="" (
+	echo VULKAN_SDK isn't set, install the Vulkan SDK or point it at one
+	goto failed
+)
+
+set GLSLANG="%VULKAN_SDK%\Bin\glslangValidator.exe"
+
+%GLSLANG% -V vs.vert || goto failed
+%GLSLANG% -V fs.frag || goto failed
+%GLSLANG% -V particles.comp -o particles.spv || goto failed
+%GLSLANG% -V cull.comp -o cull.spv || goto failed
+%GLSLANG% -V compact.comp -o compact.spv || goto failed
+powershell -NoProfile -ExecutionPolicy Bypass -File embedShaders.ps1 || goto failed
+
+if not "%1"=="nopause" pause
+exit /b 0
+
+:failed
+if not "%1"=="nopause" pause
+exit /b 1
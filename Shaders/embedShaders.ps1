@@ -0,0 +1,31 @@
+# Turns every .spv next to this script into Embedded\<name>.h for builds with EMBED_SHADERS defined.
+# Words are written as they sit in the file, so the arrays are SPIR-V in the host's byte order.
+$out = Join-Path $PSScriptRoot "Embedded"
+New-Item -ItemType Directory -Force -Path $out | Out-Null
+
+foreach ($spv in Get-ChildItem -Path $PSScriptRoot -Filter *.spv)
+{
+    $name = [IO.Path]::GetFileNameWithoutExtension($spv.Name)
+    $bytes = [IO.File]::ReadAllBytes($spv.FullName)
+
+    if ($bytes.Length % 4 -ne 0)
+    {
+        Write-Error "$($spv.Name) is not a whole number of words"
+        exit 1
+    }
+
+    $text = New-Object Text.StringBuilder
+    [void]$text.Append("// Generated from $($spv.Name) by embedShaders.ps1, do not edit`n")
+    [void]$text.Append("#pragma once`n`n#include <cstdint>`n`n")
+    [void]$text.Append("alignas(16) constexpr uint32_t $($name)_spv[] = {`n")
+
+    for ($i = 0; $i -lt $bytes.Length; $i += 4)
+    {
+        if (($i / 4) % 8 -eq 0) { [void]$text.Append("`t") }
+        [void]$text.Append(("0x{0:x8}," -f [BitConverter]::ToUInt32($bytes, $i)))
+        if (($i / 4) % 8 -eq 7) { [void]$text.Append("`n") } else { [void]$text.Append(" ") }
+    }
+
+    [void]$text.Append("`n};`n")
+    [IO.File]::WriteAllText((Join-Path $out "$name.h"), $text.ToString())
+}
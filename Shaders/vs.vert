@@ -1,16 +1,17 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inInstance; // xy offset, z scale
+layout(location = 2) in vec4 inColor;
+
+layout(location = 0) out vec4 fragColor;
+
 out gl_PerVertex {
     vec4 gl_Position;
 };
 
-vec2 positions[3] = vec2[](
-    vec2(0.0, -0.5),
-    vec2(0.5, 0.5),
-    vec2(-0.5, 0.5)
-);
-
 void main() {
-    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
+    gl_Position = vec4(inPosition * inInstance.z + inInstance.xy, 0.0, 1.0);
+    fragColor = inColor;
 }
\ No newline at end of file
@@ -0,0 +1,419 @@
+#include "AsyncCompute.h"
+#include "Log.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <limits>
+
+static uint64_t ValidBitsMask(uint32_t validBits)
+{
+	return validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+}
+
+bool AsyncCompute::Initialize(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t computeFamily, uint32_t graphicsFamily, VkQueue computeQueue, uint32_t framesInFlight)
+{
+	m_device = device;
+	m_computeQueue = computeQueue;
+	m_computeFamily = computeFamily;
+	m_graphicsFamily = graphicsFamily;
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	uint32_t familyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> families(familyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+
+	uint32_t computeBits = families[m_computeFamily].timestampValidBits;
+	uint32_t graphicsBits = families[m_graphicsFamily].timestampValidBits;
+
+	m_timestamps = computeBits > 0 && graphicsBits > 0;
+	m_timestampPeriod = properties.limits.timestampPeriod;
+	m_computeMask = ValidBitsMask(computeBits);
+	m_graphicsMask = ValidBitsMask(graphicsBits);
+
+	if (m_timestamps)
+	{
+		VkQueryPoolCreateInfo queryInfo = {};
+		queryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+
+		queryInfo.queryCount = MAX_COMPUTE_BATCHES * 2;
+		if (vkCreateQueryPool(m_device, &queryInfo, nullptr, &m_computeQueries) != VK_SUCCESS)
+		{
+			LOG_ERROR("Unable to create the compute timestamp query pool");
+			return false;
+		}
+
+		queryInfo.queryCount = framesInFlight * 2;
+		if (vkCreateQueryPool(m_device, &queryInfo, nullptr, &m_graphicsQueries) != VK_SUCCESS)
+		{
+			LOG_ERROR("Unable to create the frame timestamp query pool");
+			return false;
+		}
+	}
+	else
+	{
+		LOG_INFO("Queue timestamps unsupported, compute overlap won't be measured");
+	}
+
+	m_graphicsWritten.assign(framesInFlight, false);
+
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.queueFamilyIndex = m_computeFamily;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+	VkSemaphoreCreateInfo semaphoreInfo = {};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	m_batches.resize(MAX_COMPUTE_BATCHES);
+
+	for (auto& batch : m_batches)
+	{
+		if (vkCreateCommandPool(m_device, &poolInfo, nullptr, &batch.pool) != VK_SUCCESS)
+		{
+			LOG_ERROR("Unable to create the compute command pool");
+			return false;
+		}
+
+		VkCommandBufferAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = batch.pool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+
+		if (vkAllocateCommandBuffers(m_device, &allocInfo, &batch.commandBuffer) != VK_SUCCESS)
+		{
+			LOG_ERROR("Unable to allocate the compute command buffer");
+			return false;
+		}
+
+		if (vkCreateFence(m_device, &fenceInfo, nullptr, &batch.fence) != VK_SUCCESS ||
+			vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &batch.computeDone) != VK_SUCCESS ||
+			vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &batch.graphicsDone) != VK_SUCCESS)
+		{
+			LOG_ERROR("Unable to create the compute sync objects");
+			return false;
+		}
+	}
+
+	LOG_INFO("Compute on queue family %u%s", m_computeFamily, IsDedicated() ? " (async)" : " (shared with graphics)");
+
+	return true;
+}
+
+void AsyncCompute::Shutdown()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	vkQueueWaitIdle(m_computeQueue);
+
+	Retire();
+	LogStats();
+
+	for (auto& batch : m_batches)
+	{
+		vkDestroySemaphore(m_device, batch.graphicsDone, nullptr);
+		vkDestroySemaphore(m_device, batch.computeDone, nullptr);
+		vkDestroyFence(m_device, batch.fence, nullptr);
+		vkDestroyCommandPool(m_device, batch.pool, nullptr);
+	}
+	m_batches.clear();
+	m_deferred.clear();
+
+	if (m_computeQueries != VK_NULL_HANDLE)
+	{
+		vkDestroyQueryPool(m_device, m_computeQueries, nullptr);
+		m_computeQueries = VK_NULL_HANDLE;
+	}
+
+	if (m_graphicsQueries != VK_NULL_HANDLE)
+	{
+		vkDestroyQueryPool(m_device, m_graphicsQueries, nullptr);
+		m_graphicsQueries = VK_NULL_HANDLE;
+	}
+
+	m_device = VK_NULL_HANDLE;
+}
+
+ComputeTicket AsyncCompute::Submit(const char* name, const RecordFn& record, bool waitForGraphics, VkPipelineStageFlags graphicsWaitStages)
+{
+	Retire();
+
+	auto it = std::find_if(m_batches.begin(), m_batches.end(), [](const ComputeBatch& batch) { return batch.state == BatchState::Free; });
+	if (it == m_batches.end())
+	{
+		return 0;
+	}
+
+	ComputeBatch& batch = *it;
+	uint32_t index = (uint32_t)(it - m_batches.begin());
+
+	vkResetCommandPool(m_device, batch.pool, 0);
+	vkResetFences(m_device, 1, &batch.fence);
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	vkBeginCommandBuffer(batch.commandBuffer, &beginInfo);
+
+	if (m_timestamps)
+	{
+		vkCmdResetQueryPool(batch.commandBuffer, m_computeQueries, index * 2, 2);
+		vkCmdWriteTimestamp(batch.commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_computeQueries, index * 2);
+	}
+
+	record(batch.commandBuffer);
+
+	if (m_timestamps)
+	{
+		vkCmdWriteTimestamp(batch.commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_computeQueries, index * 2 + 1);
+	}
+
+	if (vkEndCommandBuffer(batch.commandBuffer) != VK_SUCCESS)
+	{
+		LOG_ERROR("Unable to record compute batch %s", name);
+		return 0;
+	}
+
+	batch.ticket = ++m_nextTicket;
+	batch.name = name;
+	batch.graphicsWaitStages = graphicsWaitStages;
+	batch.graphicsFence = VK_NULL_HANDLE;
+
+	if (waitForGraphics)
+	{
+		batch.state = BatchState::Deferred;
+		m_deferred.push_back(index);
+	}
+	else if (!SubmitBatch(batch))
+	{
+		return 0;
+	}
+
+	return batch.ticket;
+}
+
+bool AsyncCompute::SubmitBatch(ComputeBatch& batch)
+{
+	// Everything waits, including the first timestamp, so the timeline doesn't count time spent blocked
+	VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.waitSemaphoreCount = batch.state == BatchState::Deferred ? 1 : 0;
+	submitInfo.pWaitSemaphores = &batch.graphicsDone;
+	submitInfo.pWaitDstStageMask = &waitStage;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &batch.commandBuffer;
+	submitInfo.signalSemaphoreCount = batch.graphicsWaitStages != 0 ? 1 : 0;
+	submitInfo.pSignalSemaphores = &batch.computeDone;
+
+	if (vkQueueSubmit(m_computeQueue, 1, &submitInfo, batch.fence) != VK_SUCCESS)
+	{
+		LOG_ERROR("Unable to submit compute batch %s", batch.name);
+		batch.state = BatchState::Free;
+		return false;
+	}
+
+	batch.submittedNs = PROFILE_NOW_NS();
+
+	batch.state = BatchState::Submitted;
+	batch.awaitingGraphics = batch.graphicsWaitStages != 0;
+
+	return true;
+}
+
+bool AsyncCompute::IsComplete(ComputeTicket ticket)
+{
+	Retire();
+
+	for (const auto& batch : m_batches)
+	{
+		if (batch.state != BatchState::Free && batch.ticket == ticket)
+		{
+			return false;
+		}
+	}
+
+	return ticket != 0 && ticket <= m_nextTicket;
+}
+
+bool AsyncCompute::Wait(ComputeTicket ticket)
+{
+	for (auto& batch : m_batches)
+	{
+		if (batch.ticket != ticket || batch.state == BatchState::Free)
+		{
+			continue;
+		}
+
+		if (batch.state == BatchState::Deferred)
+		{
+			LOG_ERROR("Compute batch %s is still waiting for a graphics frame", batch.name);
+			return false;
+		}
+
+		vkWaitForFences(m_device, 1, &batch.fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+	}
+
+	Retire();
+
+	return true;
+}
+
+void AsyncCompute::BeginGraphicsFrame(VkCommandBuffer commandBuffer, uint32_t frame)
+{
+	if (m_timestamps)
+	{
+		vkCmdResetQueryPool(commandBuffer, m_graphicsQueries, frame * 2, 2);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_graphicsQueries, frame * 2);
+	}
+}
+
+void AsyncCompute::EndGraphicsFrame(VkCommandBuffer commandBuffer, uint32_t frame)
+{
+	if (m_timestamps)
+	{
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_graphicsQueries, frame * 2 + 1);
+		m_graphicsWritten[frame] = true;
+	}
+}
+
+void AsyncCompute::CollectGraphicsFrame(uint32_t frame)
+{
+	if (m_timestamps && m_graphicsWritten[frame])
+	{
+		AddInterval(m_graphicsHistory, "Frame", m_graphicsQueries, frame * 2, m_graphicsMask);
+		m_graphicsWritten[frame] = false;
+	}
+}
+
+void AsyncCompute::GetGraphicsSync(VkFence graphicsFence, std::vector<VkSemaphore>& waits, std::vector<VkPipelineStageFlags>& waitStages, std::vector<VkSemaphore>& signals)
+{
+	for (auto& batch : m_batches)
+	{
+		if (batch.state == BatchState::Submitted && batch.awaitingGraphics)
+		{
+			waits.push_back(batch.computeDone);
+			waitStages.push_back(batch.graphicsWaitStages);
+			batch.awaitingGraphics = false;
+			batch.graphicsFence = graphicsFence;
+		}
+	}
+
+	for (uint32_t index : m_deferred)
+	{
+		signals.push_back(m_batches[index].graphicsDone);
+	}
+}
+
+void AsyncCompute::SubmitDeferred()
+{
+	for (uint32_t index : m_deferred)
+	{
+		SubmitBatch(m_batches[index]);
+	}
+
+	m_deferred.clear();
+}
+
+void AsyncCompute::Retire()
+{
+	for (uint32_t i = 0; i < m_batches.size(); ++i)
+	{
+		ComputeBatch& batch = m_batches[i];
+
+		if (batch.state != BatchState::Submitted || batch.awaitingGraphics)
+		{
+			continue;
+		}
+
+		if (vkGetFenceStatus(m_device, batch.fence) != VK_SUCCESS)
+		{
+			continue;
+		}
+
+		// computeDone can't be signaled again until the graphics submit waiting on it has run
+		if (batch.graphicsFence != VK_NULL_HANDLE && vkGetFenceStatus(m_device, batch.graphicsFence) != VK_SUCCESS)
+		{
+			continue;
+		}
+
+		if (m_timestamps && AddInterval(m_computeHistory, batch.name, m_computeQueries, i * 2, m_computeMask))
+		{
+			PROFILE_COMPUTE_EVENT(batch.name, batch.submittedNs, m_computeHistory.back().endNs - m_computeHistory.back().beginNs);
+		}
+
+		batch.state = BatchState::Free;
+		batch.graphicsFence = VK_NULL_HANDLE;
+	}
+}
+
+bool AsyncCompute::AddInterval(std::deque<GpuInterval>& history, const char* name, VkQueryPool pool, uint32_t firstQuery, uint64_t mask)
+{
+	// The owning fence has signaled, so this never stalls
+	uint64_t timestamps[2];
+	if (vkGetQueryPoolResults(m_device, pool, firstQuery, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+	{
+		return false;
+	}
+
+	GpuInterval interval;
+	interval.name = name;
+	interval.beginNs = (uint64_t)((timestamps[0] & mask) * m_timestampPeriod);
+	interval.endNs = (uint64_t)((timestamps[1] & mask) * m_timestampPeriod);
+
+	if (history.size() == COMPUTE_TIMELINE_HISTORY)
+	{
+		history.pop_front();
+	}
+	history.push_back(interval);
+
+	return true;
+}
+
+ComputeOverlapStats AsyncCompute::GetOverlapStats() const
+{
+	ComputeOverlapStats stats;
+
+	for (const auto& compute : m_computeHistory)
+	{
+		uint64_t overlapped = 0;
+		for (const auto& frame : m_graphicsHistory)
+		{
+			uint64_t begin = std::max(compute.beginNs, frame.beginNs);
+			uint64_t end = std::min(compute.endNs, frame.endNs);
+			if (end > begin)
+			{
+				overlapped += end - begin;
+			}
+		}
+
+		// Frames in flight can overlap each other, don't count the same nanosecond twice
+		uint64_t duration = compute.endNs - compute.beginNs;
+		overlapped = std::min(overlapped, duration);
+
+		stats.batches++;
+		stats.computeMs += duration / 1000000.0;
+		stats.overlappedMs += overlapped / 1000000.0;
+	}
+
+	return stats;
+}
+
+void AsyncCompute::LogStats() const
+{
+	ComputeOverlapStats stats = GetOverlapStats();
+
+	LOG_INFO("Compute: %u batches, %.3fms GPU, %.1f%% overlapped with graphics", stats.batches, stats.computeMs, stats.OverlapRatio() * 100.0);
+}
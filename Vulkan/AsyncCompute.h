@@ -0,0 +1,131 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <deque>
+#include <functional>
+#include <vector>
+
+typedef uint64_t ComputeTicket;
+
+// Compute batches that can be recorded or in flight at once, each owns a command buffer, fence and semaphores
+const uint32_t MAX_COMPUTE_BATCHES = 8;
+
+// GPU intervals kept per queue for the overlap report
+const size_t COMPUTE_TIMELINE_HISTORY = 512;
+
+struct ComputePipeline
+{
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+	VkPipeline pipeline = VK_NULL_HANDLE;
+};
+
+struct ComputeOverlapStats
+{
+	uint32_t batches = 0;
+	double computeMs = 0.0;		// GPU time spent in compute batches
+	double overlappedMs = 0.0;	// Part of that which ran while a graphics frame was executing
+
+	double OverlapRatio() const
+	{
+		return computeMs > 0.0 ? overlappedMs / computeMs : 0.0;
+	}
+};
+
+// Runs compute batches on their own queue, a compute only family when the device has one. Batches are
+// recorded and submitted by the caller whenever it likes, DrawFrame only gets involved when a batch has to
+// wait for graphics or graphics has to wait for it. Both queues are timestamped so we can see how much of
+// the compute work actually ran alongside a frame, and profiled builds put the batches on their own track in
+// the profiler's trace. Not thread safe, call everything from the render thread.
+class AsyncCompute
+{
+public:
+	typedef std::function<void(VkCommandBuffer commandBuffer)> RecordFn;
+
+	bool Initialize(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t computeFamily, uint32_t graphicsFamily, VkQueue computeQueue, uint32_t framesInFlight);
+	void Shutdown();
+
+	// Records the batch right away and submits it unless it waits for graphics. waitForGraphics holds the
+	// submit until the next graphics frame is submitted and makes the batch wait for that frame. Non zero
+	// graphicsWaitStages makes the next graphics frame wait for the batch at those stages.
+	// name must be a string literal. Returns 0 when every batch is still in flight.
+	ComputeTicket Submit(const char* name, const RecordFn& record, bool waitForGraphics = false, VkPipelineStageFlags graphicsWaitStages = 0);
+
+	bool IsComplete(ComputeTicket ticket);
+
+	// Blocks until the batch has finished, batches still waiting for a graphics frame can't be waited on
+	bool Wait(ComputeTicket ticket);
+
+	// DrawFrame hooks. Begin goes into a command buffer submitted ahead of the frame, End into one after it.
+	void BeginGraphicsFrame(VkCommandBuffer commandBuffer, uint32_t frame);
+	void EndGraphicsFrame(VkCommandBuffer commandBuffer, uint32_t frame);
+	void CollectGraphicsFrame(uint32_t frame); // Once the frame's fence has signaled
+
+	// Appends what the next graphics submit has to wait on and signal. graphicsFence is that submit's fence.
+	void GetGraphicsSync(VkFence graphicsFence, std::vector<VkSemaphore>& waits, std::vector<VkPipelineStageFlags>& waitStages, std::vector<VkSemaphore>& signals);
+	// Submits the batches that were waiting for graphics, right after the graphics submit
+	void SubmitDeferred();
+
+	bool IsDedicated() const { return m_computeFamily != m_graphicsFamily; }
+
+	ComputeOverlapStats GetOverlapStats() const;
+	void LogStats() const;
+
+private:
+	enum class BatchState
+	{
+		Free,
+		Deferred,	// Recorded, waiting for the next graphics submit
+		Submitted
+	};
+
+	struct ComputeBatch
+	{
+		VkCommandPool pool = VK_NULL_HANDLE;
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		VkFence fence = VK_NULL_HANDLE;
+		VkSemaphore computeDone = VK_NULL_HANDLE;	// Graphics waits on this
+		VkSemaphore graphicsDone = VK_NULL_HANDLE;	// This waits on graphics
+
+		BatchState state = BatchState::Free;
+		ComputeTicket ticket = 0;
+		const char* name = nullptr;
+		VkPipelineStageFlags graphicsWaitStages = 0;
+		bool awaitingGraphics = false;				// computeDone hasn't been handed to a graphics submit yet
+		VkFence graphicsFence = VK_NULL_HANDLE;		// The submit that waits on computeDone
+		uint64_t submittedNs = 0;					// Profiler time of the submit, anchors the batch in the trace
+	};
+
+	struct GpuInterval
+	{
+		const char* name;
+		uint64_t beginNs;
+		uint64_t endNs;
+	};
+
+	void Retire();
+	bool SubmitBatch(ComputeBatch& batch);
+	bool AddInterval(std::deque<GpuInterval>& history, const char* name, VkQueryPool pool, uint32_t firstQuery, uint64_t mask);
+
+private:
+	VkDevice m_device = VK_NULL_HANDLE;
+	VkQueue m_computeQueue = VK_NULL_HANDLE;
+	uint32_t m_computeFamily = 0;
+	uint32_t m_graphicsFamily = 0;
+
+	std::vector<ComputeBatch> m_batches;
+	std::vector<uint32_t> m_deferred;	// Submitted in order once graphics has been
+	ComputeTicket m_nextTicket = 0;
+
+	// Timestamps on both queues are assumed to share the device's time base, which holds on every
+	// desktop driver we run on even though Vulkan 1.0 doesn't promise it
+	bool m_timestamps = false;
+	double m_timestampPeriod = 1.0; // Nanoseconds per tick
+	uint64_t m_computeMask = ~0ull;
+	uint64_t m_graphicsMask = ~0ull;
+	VkQueryPool m_computeQueries = VK_NULL_HANDLE;	// Two per batch
+	VkQueryPool m_graphicsQueries = VK_NULL_HANDLE;	// Two per frame in flight
+	std::vector<bool> m_graphicsWritten;
+
+	std::deque<GpuInterval> m_computeHistory;
+	std::deque<GpuInterval> m_graphicsHistory;
+};
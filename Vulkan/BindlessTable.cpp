@@ -0,0 +1,255 @@
+#include "BindlessTable.h"
+#include "Log.h"
+
+#include <algorithm>
+
+static const VkShaderStageFlags BINDLESS_STAGES = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+
+bool BindlessTable::Initialize(VkDevice device, DescriptorLayoutCache& layouts, const VkPhysicalDeviceLimits& limits, uint32_t framesInFlight, VkBuffer defaultBuffer,
+	const VkDescriptorImageInfo& defaultImage, uint32_t reservedResources, uint32_t bufferCapacity, uint32_t imageCapacity)
+{
+	m_device = device;
+	m_defaultBuffer = defaultBuffer;
+	m_defaultImage = defaultImage;
+	m_stats = BindlessStats();
+
+	// Every stage the set is visible to counts it against its own limits, whether it reads it or not. The
+	// per stage resource limit is shared with every other set in the pipeline layout and, for fragment
+	// shaders, with the subpass's color attachments.
+	uint32_t reserved = reservedResources + limits.maxColorAttachments;
+	uint32_t resources = limits.maxPerStageResources > reserved ? limits.maxPerStageResources - reserved : 0;
+
+	bufferCapacity = std::min({ bufferCapacity, limits.maxPerStageDescriptorStorageBuffers, limits.maxDescriptorSetStorageBuffers, resources });
+	imageCapacity = std::min({ imageCapacity, limits.maxPerStageDescriptorSampledImages, limits.maxPerStageDescriptorSamplers,
+		limits.maxDescriptorSetSampledImages, limits.maxDescriptorSetSamplers, resources - bufferCapacity });
+
+	std::vector<VkDescriptorSetLayoutBinding> bindings(2);
+	bindings[0].binding = BINDLESS_BUFFER_BINDING;
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[0].descriptorCount = bufferCapacity;
+	bindings[0].stageFlags = BINDLESS_STAGES;
+	bindings[1].binding = BINDLESS_IMAGE_BINDING;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindings[1].descriptorCount = imageCapacity;
+	bindings[1].stageFlags = BINDLESS_STAGES;
+
+	m_layout = layouts.Get(bindings);
+	if (m_layout == VK_NULL_HANDLE)
+	{
+		return false;
+	}
+
+	std::vector<VkDescriptorPoolSize> poolSizes;
+	if (bufferCapacity > 0)
+	{
+		poolSizes.push_back({ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, bufferCapacity * framesInFlight });
+	}
+	if (imageCapacity > 0)
+	{
+		poolSizes.push_back({ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageCapacity * framesInFlight });
+	}
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = framesInFlight;
+	poolInfo.poolSizeCount = (uint32_t)poolSizes.size();
+	poolInfo.pPoolSizes = poolSizes.data();
+
+	if (vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &m_pool) != VK_SUCCESS)
+	{
+		LOG_ERROR("Unable to create the bindless descriptor pool");
+		return false;
+	}
+
+	std::vector<VkDescriptorSetLayout> setLayouts(framesInFlight, m_layout);
+	m_sets.resize(framesInFlight);
+
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = m_pool;
+	allocInfo.descriptorSetCount = framesInFlight;
+	allocInfo.pSetLayouts = setLayouts.data();
+
+	if (vkAllocateDescriptorSets(m_device, &allocInfo, m_sets.data()) != VK_SUCCESS)
+	{
+		LOG_ERROR("Unable to allocate the bindless descriptor sets");
+		return false;
+	}
+
+	m_buffers.assign(bufferCapacity, VkDescriptorBufferInfo{ m_defaultBuffer, 0, VK_WHOLE_SIZE });
+	m_images.assign(imageCapacity, m_defaultImage);
+
+	// Handed out lowest first
+	m_freeBuffers.clear();
+	for (uint32_t i = bufferCapacity; i > 0; --i)
+	{
+		m_freeBuffers.push_back(i - 1);
+	}
+
+	m_freeImages.clear();
+	for (uint32_t i = imageCapacity; i > 0; --i)
+	{
+		m_freeImages.push_back(i - 1);
+	}
+
+	m_pending.assign(framesInFlight, std::vector<Change>());
+
+	// Every slot starts out at the defaults, in one write per binding and set
+	for (uint32_t frame = 0; frame < framesInFlight; ++frame)
+	{
+		m_writes.clear();
+
+		VkWriteDescriptorSet write = {};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = m_sets[frame];
+
+		if (bufferCapacity > 0)
+		{
+			write.dstBinding = BINDLESS_BUFFER_BINDING;
+			write.descriptorCount = bufferCapacity;
+			write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			write.pBufferInfo = m_buffers.data();
+			m_writes.push_back(write);
+		}
+
+		if (imageCapacity > 0)
+		{
+			write.dstBinding = BINDLESS_IMAGE_BINDING;
+			write.descriptorCount = imageCapacity;
+			write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			write.pBufferInfo = nullptr;
+			write.pImageInfo = m_images.data();
+			m_writes.push_back(write);
+		}
+
+		vkUpdateDescriptorSets(m_device, (uint32_t)m_writes.size(), m_writes.data(), 0, nullptr);
+	}
+
+	LOG_INFO("Bindless table: %u buffers, %u images", bufferCapacity, imageCapacity);
+
+	return true;
+}
+
+void BindlessTable::Shutdown()
+{
+	// The sets go with the pool, the layout belongs to the cache
+	if (m_pool != VK_NULL_HANDLE)
+	{
+		vkDestroyDescriptorPool(m_device, m_pool, nullptr);
+		m_pool = VK_NULL_HANDLE;
+	}
+
+	m_sets.clear();
+	m_pending.clear();
+	m_layout = VK_NULL_HANDLE;
+}
+
+uint32_t BindlessTable::AddBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+{
+	if (m_freeBuffers.empty())
+	{
+		LOG_ERROR("Bindless table is out of buffer slots");
+		return INVALID_BINDLESS_SLOT;
+	}
+
+	uint32_t slot = m_freeBuffers.back();
+	m_freeBuffers.pop_back();
+
+	m_buffers[slot] = VkDescriptorBufferInfo{ buffer, offset, range };
+	m_stats.buffers++;
+	QueueChange(BINDLESS_BUFFER_BINDING, slot);
+
+	return slot;
+}
+
+uint32_t BindlessTable::AddImage(VkImageView view, VkSampler sampler, VkImageLayout layout)
+{
+	if (m_freeImages.empty())
+	{
+		LOG_ERROR("Bindless table is out of image slots");
+		return INVALID_BINDLESS_SLOT;
+	}
+
+	uint32_t slot = m_freeImages.back();
+	m_freeImages.pop_back();
+
+	m_images[slot] = VkDescriptorImageInfo{ sampler, view, layout };
+	m_stats.images++;
+	QueueChange(BINDLESS_IMAGE_BINDING, slot);
+
+	return slot;
+}
+
+void BindlessTable::RemoveBuffer(uint32_t slot)
+{
+	if (slot >= m_buffers.size() || m_buffers[slot].buffer == m_defaultBuffer)
+	{
+		return;
+	}
+
+	m_buffers[slot] = VkDescriptorBufferInfo{ m_defaultBuffer, 0, VK_WHOLE_SIZE };
+	m_freeBuffers.push_back(slot);
+	m_stats.buffers--;
+	QueueChange(BINDLESS_BUFFER_BINDING, slot);
+}
+
+void BindlessTable::RemoveImage(uint32_t slot)
+{
+	if (slot >= m_images.size() || m_images[slot].imageView == m_defaultImage.imageView)
+	{
+		return;
+	}
+
+	m_images[slot] = m_defaultImage;
+	m_freeImages.push_back(slot);
+	m_stats.images--;
+	QueueChange(BINDLESS_IMAGE_BINDING, slot);
+}
+
+void BindlessTable::BeginFrame(uint32_t frame)
+{
+	std::vector<Change>& pending = m_pending[frame];
+	if (pending.empty())
+	{
+		return;
+	}
+
+	m_writes.clear();
+
+	for (const Change& change : pending)
+	{
+		VkWriteDescriptorSet write = {};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = m_sets[frame];
+		write.dstBinding = change.binding;
+		write.dstArrayElement = change.slot;
+		write.descriptorCount = 1;
+
+		if (change.binding == BINDLESS_BUFFER_BINDING)
+		{
+			write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			write.pBufferInfo = &m_buffers[change.slot];
+		}
+		else
+		{
+			write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			write.pImageInfo = &m_images[change.slot];
+		}
+
+		m_writes.push_back(write);
+	}
+
+	// A slot changed more than once is written more than once, the last write wins
+	vkUpdateDescriptorSets(m_device, (uint32_t)m_writes.size(), m_writes.data(), 0, nullptr);
+
+	m_stats.writes += m_writes.size();
+	pending.clear();
+}
+
+void BindlessTable::QueueChange(uint32_t binding, uint32_t slot)
+{
+	for (auto& pending : m_pending)
+	{
+		pending.push_back(Change{ binding, slot });
+	}
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "DescriptorLayoutCache.h"
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+const uint32_t DEFAULT_BINDLESS_BUFFERS = 1024;
+const uint32_t DEFAULT_BINDLESS_IMAGES = 1024;
+
+// Binding 0 is an array of storage buffers, binding 1 an array of combined image samplers
+const uint32_t BINDLESS_BUFFER_BINDING = 0;
+const uint32_t BINDLESS_IMAGE_BINDING = 1;
+
+const uint32_t INVALID_BINDLESS_SLOT = ~0u;
+
+struct BindlessStats
+{
+	uint32_t buffers = 0;
+	uint32_t images = 0;
+	uint64_t writes = 0; // Descriptors written into the per frame copies
+};
+
+// One big descriptor set holding every buffer and image by slot, bound once per pass so draws only pass
+// slot indices around. Our headers predate descriptor indexing, so a set can't be updated while a frame in
+// flight may still be using it: every frame in flight has its own copy, and adding or removing a resource
+// is queued and written into each copy once its frame's fence has signaled. Removed resources may still be
+// read by frames in flight, keep them alive for framesInFlight more frames. Our headers have no partially
+// bound descriptors, so every slot must stay valid: unused slots point at a default buffer or image.
+// Not thread safe, call everything from the render thread.
+class BindlessTable
+{
+public:
+	// The capacities are clamped to the device's descriptor limits, leaving room in maxPerStageResources for
+	// reservedResources descriptors in the pipelines' other sets and for the color attachments
+	bool Initialize(VkDevice device, DescriptorLayoutCache& layouts, const VkPhysicalDeviceLimits& limits, uint32_t framesInFlight, VkBuffer defaultBuffer,
+		const VkDescriptorImageInfo& defaultImage, uint32_t reservedResources, uint32_t bufferCapacity = DEFAULT_BINDLESS_BUFFERS, uint32_t imageCapacity = DEFAULT_BINDLESS_IMAGES);
+	void Shutdown();
+
+	// INVALID_BINDLESS_SLOT once the table is full
+	uint32_t AddBuffer(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+	uint32_t AddImage(VkImageView view, VkSampler sampler, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	void RemoveBuffer(uint32_t slot);
+	void RemoveImage(uint32_t slot);
+
+	// Once the frame's fence has signaled, writes the changes its copy hasn't seen yet
+	void BeginFrame(uint32_t frame);
+
+	VkDescriptorSetLayout GetLayout() const { return m_layout; }
+	VkDescriptorSet GetSet(uint32_t frame) const { return m_sets[frame]; }
+
+	uint32_t GetBufferCapacity() const { return (uint32_t)m_buffers.size(); }
+	uint32_t GetImageCapacity() const { return (uint32_t)m_images.size(); }
+	const BindlessStats& GetStats() const { return m_stats; }
+
+private:
+	struct Change
+	{
+		uint32_t binding;
+		uint32_t slot;
+	};
+
+	void QueueChange(uint32_t binding, uint32_t slot);
+
+private:
+	VkDevice m_device = VK_NULL_HANDLE;
+	VkDescriptorSetLayout m_layout = VK_NULL_HANDLE; // Owned by the layout cache
+	VkDescriptorPool m_pool = VK_NULL_HANDLE;
+	std::vector<VkDescriptorSet> m_sets; // One per frame in flight
+
+	VkBuffer m_defaultBuffer = VK_NULL_HANDLE;
+	VkDescriptorImageInfo m_defaultImage = {};
+	std::vector<VkDescriptorBufferInfo> m_buffers;
+	std::vector<VkDescriptorImageInfo> m_images;
+	std::vector<uint32_t> m_freeBuffers;
+	std::vector<uint32_t> m_freeImages;
+
+	std::vector<std::vector<Change>> m_pending; // Per frame in flight
+
+	// Reused by BeginFrame so writing changes doesn't allocate
+	std::vector<VkWriteDescriptorSet> m_writes;
+
+	BindlessStats m_stats;
+};
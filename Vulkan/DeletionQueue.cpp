@@ -0,0 +1,233 @@
+#include "DeletionQueue.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <utility>
+
+void DeletionQueue::Initialize(VkDevice device, MemoryAllocator& allocator, uint32_t framesInFlight)
+{
+	m_device = device;
+	m_allocator = &allocator;
+	m_frames.assign(framesInFlight, Frame());
+	m_current = 0;
+	m_pending = 0;
+	m_stats = DeletionStats();
+}
+
+void DeletionQueue::Shutdown()
+{
+	if (m_allocator == nullptr)
+	{
+		return;
+	}
+
+	for (Frame& frame : m_frames)
+	{
+		Destroy(frame);
+	}
+
+	m_frames.clear();
+	m_allocator = nullptr;
+}
+
+void DeletionQueue::BeginFrame(uint32_t frame)
+{
+	Destroy(m_frames[frame]);
+	m_current = frame;
+}
+
+void DeletionQueue::RetireBuffer(VkBuffer buffer)
+{
+	if (buffer != VK_NULL_HANDLE)
+	{
+		m_frames[m_current].buffers.push_back(buffer);
+		Retired();
+	}
+}
+
+void DeletionQueue::RetireBuffer(AllocatedBuffer& buffer)
+{
+	if (buffer.buffer != VK_NULL_HANDLE)
+	{
+		m_frames[m_current].allocatedBuffers.push_back(buffer);
+		buffer = AllocatedBuffer();
+		Retired();
+	}
+}
+
+void DeletionQueue::RetireImage(VkImage image)
+{
+	if (image != VK_NULL_HANDLE)
+	{
+		m_frames[m_current].images.push_back(image);
+		Retired();
+	}
+}
+
+void DeletionQueue::RetireImageView(VkImageView view)
+{
+	if (view != VK_NULL_HANDLE)
+	{
+		m_frames[m_current].views.push_back(view);
+		Retired();
+	}
+}
+
+void DeletionQueue::RetireFramebuffer(VkFramebuffer framebuffer)
+{
+	if (framebuffer != VK_NULL_HANDLE)
+	{
+		m_frames[m_current].framebuffers.push_back(framebuffer);
+		Retired();
+	}
+}
+
+void DeletionQueue::RetirePipeline(VkPipeline pipeline)
+{
+	if (pipeline != VK_NULL_HANDLE)
+	{
+		m_frames[m_current].pipelines.push_back(pipeline);
+		Retired();
+	}
+}
+
+void DeletionQueue::RetireRenderPass(VkRenderPass renderPass)
+{
+	if (renderPass != VK_NULL_HANDLE)
+	{
+		m_frames[m_current].renderPasses.push_back(renderPass);
+		Retired();
+	}
+}
+
+void DeletionQueue::RetireSwapChain(VkSwapchainKHR swapChain)
+{
+	if (swapChain != VK_NULL_HANDLE)
+	{
+		m_frames[m_current].swapChains.push_back(swapChain);
+		Retired();
+	}
+}
+
+void DeletionQueue::RetireAllocation(Allocation& allocation)
+{
+	if (allocation.memory != VK_NULL_HANDLE)
+	{
+		m_frames[m_current].allocations.push_back(allocation);
+		allocation = Allocation();
+		Retired();
+	}
+}
+
+void DeletionQueue::RetireCommandBuffers(VkCommandPool pool, std::vector<VkCommandBuffer>& commandBuffers)
+{
+	if (!commandBuffers.empty())
+	{
+		m_frames[m_current].commandBuffers.push_back(CommandBuffers{ pool, std::move(commandBuffers) });
+		commandBuffers.clear();
+		Retired();
+	}
+}
+
+uint32_t DeletionQueue::GetPendingCount() const
+{
+	return m_pending;
+}
+
+void DeletionQueue::LogStats() const
+{
+	LOG_INFO("Deletion queue: %llu retired, %llu destroyed, peak of %u waiting",
+		(unsigned long long)m_stats.retired, (unsigned long long)m_stats.destroyed, m_stats.peakPending);
+}
+
+void DeletionQueue::Destroy(Frame& frame)
+{
+	uint32_t count = 0;
+
+	for (CommandBuffers& commandBuffers : frame.commandBuffers)
+	{
+		vkFreeCommandBuffers(m_device, commandBuffers.pool, (uint32_t)commandBuffers.buffers.size(), commandBuffers.buffers.data());
+	}
+	count += (uint32_t)frame.commandBuffers.size();
+
+	for (VkFramebuffer framebuffer : frame.framebuffers)
+	{
+		vkDestroyFramebuffer(m_device, framebuffer, nullptr);
+	}
+	count += (uint32_t)frame.framebuffers.size();
+
+	for (VkImageView view : frame.views)
+	{
+		vkDestroyImageView(m_device, view, nullptr);
+	}
+	count += (uint32_t)frame.views.size();
+
+	for (VkPipeline pipeline : frame.pipelines)
+	{
+		vkDestroyPipeline(m_device, pipeline, nullptr);
+	}
+	count += (uint32_t)frame.pipelines.size();
+
+	for (VkRenderPass renderPass : frame.renderPasses)
+	{
+		vkDestroyRenderPass(m_device, renderPass, nullptr);
+	}
+	count += (uint32_t)frame.renderPasses.size();
+
+	for (VkSwapchainKHR swapChain : frame.swapChains)
+	{
+		vkDestroySwapchainKHR(m_device, swapChain, nullptr);
+	}
+	count += (uint32_t)frame.swapChains.size();
+
+	for (VkImage image : frame.images)
+	{
+		vkDestroyImage(m_device, image, nullptr);
+	}
+	count += (uint32_t)frame.images.size();
+
+	for (VkBuffer buffer : frame.buffers)
+	{
+		vkDestroyBuffer(m_device, buffer, nullptr);
+	}
+	count += (uint32_t)frame.buffers.size();
+
+	for (AllocatedBuffer& buffer : frame.allocatedBuffers)
+	{
+		m_allocator->DestroyBuffer(buffer);
+	}
+	count += (uint32_t)frame.allocatedBuffers.size();
+
+	for (Allocation& allocation : frame.allocations)
+	{
+		m_allocator->Free(allocation);
+	}
+	count += (uint32_t)frame.allocations.size();
+
+	if (count == 0)
+	{
+		return;
+	}
+
+	// clear keeps the capacity, so a slot that retires every frame stops allocating
+	frame.commandBuffers.clear();
+	frame.framebuffers.clear();
+	frame.views.clear();
+	frame.pipelines.clear();
+	frame.renderPasses.clear();
+	frame.swapChains.clear();
+	frame.images.clear();
+	frame.buffers.clear();
+	frame.allocatedBuffers.clear();
+	frame.allocations.clear();
+
+	m_pending -= count;
+	m_stats.destroyed += count;
+}
+
+void DeletionQueue::Retired()
+{
+	m_pending++;
+	m_stats.retired++;
+	m_stats.peakPending = std::max(m_stats.peakPending, m_pending);
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "MemoryAllocator.h"
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+struct DeletionStats
+{
+	uint64_t retired = 0;	// Everything ever queued
+	uint64_t destroyed = 0;
+	uint32_t peakPending = 0;	// Most waiting at once
+};
+
+// Resources that frames in flight may still be using, destroyed once the GPU is done with them instead of
+// waiting for it. Anything retired goes into the frame slot last begun and is destroyed the next time that
+// slot begins, after its fence has signaled. Frames are submitted in order to one queue, so that fence covers
+// every frame recorded before it as well.
+// Methods are named per type rather than overloaded, non-dispatchable handles are all uint64_t on 32-bit builds.
+// Render thread only.
+class DeletionQueue
+{
+public:
+	void Initialize(VkDevice device, MemoryAllocator& allocator, uint32_t framesInFlight);
+	// Destroys everything still queued, the caller has waited for the device to go idle
+	void Shutdown();
+
+	// Once the frame's fence has signaled, what was retired while the slot was last in use goes
+	void BeginFrame(uint32_t frame);
+
+	void RetireBuffer(VkBuffer buffer);
+	void RetireBuffer(AllocatedBuffer& buffer);	// Goes back to the allocator, buffer is left empty
+	void RetireImage(VkImage image);
+	void RetireImageView(VkImageView view);
+	void RetireFramebuffer(VkFramebuffer framebuffer);
+	void RetirePipeline(VkPipeline pipeline);
+	void RetireRenderPass(VkRenderPass renderPass);
+	void RetireSwapChain(VkSwapchainKHR swapChain);
+	void RetireAllocation(Allocation& allocation);	// Left empty
+	void RetireCommandBuffers(VkCommandPool pool, std::vector<VkCommandBuffer>& commandBuffers);	// Left empty
+
+	uint32_t GetPendingCount() const;
+	const DeletionStats& GetStats() const { return m_stats; }
+	void LogStats() const;
+
+private:
+	struct CommandBuffers
+	{
+		VkCommandPool pool;
+		std::vector<VkCommandBuffer> buffers;
+	};
+
+	// Grouped by type so a frame is destroyed in dependency order: users before what they use, memory last
+	struct Frame
+	{
+		std::vector<CommandBuffers> commandBuffers;
+		std::vector<VkFramebuffer> framebuffers;
+		std::vector<VkImageView> views;
+		std::vector<VkPipeline> pipelines;
+		std::vector<VkRenderPass> renderPasses;
+		std::vector<VkSwapchainKHR> swapChains;
+		std::vector<VkImage> images;
+		std::vector<VkBuffer> buffers;
+		std::vector<AllocatedBuffer> allocatedBuffers;
+		std::vector<Allocation> allocations;
+	};
+
+	void Destroy(Frame& frame);
+	void Retired();
+
+	VkDevice m_device = VK_NULL_HANDLE;
+	MemoryAllocator* m_allocator = nullptr;
+
+	std::vector<Frame> m_frames;
+	uint32_t m_current = 0;
+	uint32_t m_pending = 0;
+
+	DeletionStats m_stats;
+};
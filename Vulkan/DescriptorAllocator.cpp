@@ -0,0 +1,148 @@
+#include "DescriptorAllocator.h"
+#include "Log.h"
+
+// Descriptors per set a pool is sized for, by type. Allocate only counts sets, a set that needs more of
+// a type than this can run the pool out of it before the set count says it is full.
+static const VkDescriptorPoolSize DESCRIPTORS_PER_SET[] = {
+	{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2 },
+	{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 2 },
+	{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 8 },
+	{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1 },
+	{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4 },
+	{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 }
+};
+
+bool FrameDescriptorAllocator::Initialize(VkDevice device, uint32_t framesInFlight, uint32_t setsPerPool)
+{
+	m_device = device;
+	m_setsPerPool = setsPerPool;
+	m_frames.assign(framesInFlight, Frame());
+	m_frame = 0;
+	m_stats = DescriptorAllocatorStats();
+
+	// One pool per frame up front, that is all most frames ever need
+	for (Frame& frame : m_frames)
+	{
+		VkDescriptorPool pool = CreatePool();
+		if (pool == VK_NULL_HANDLE)
+		{
+			return false;
+		}
+
+		frame.pools.push_back(pool);
+	}
+
+	return true;
+}
+
+void FrameDescriptorAllocator::Shutdown()
+{
+	for (Frame& frame : m_frames)
+	{
+		for (VkDescriptorPool pool : frame.pools)
+		{
+			vkDestroyDescriptorPool(m_device, pool, nullptr);
+		}
+	}
+
+	m_frames.clear();
+}
+
+void FrameDescriptorAllocator::BeginFrame(uint32_t frame)
+{
+	m_frame = frame;
+	Frame& current = m_frames[frame];
+
+	// Only the pools the last use of this slot touched have anything to reset
+	for (uint32_t i = 0; i <= current.current && i < current.pools.size(); ++i)
+	{
+		vkResetDescriptorPool(m_device, current.pools[i], 0);
+	}
+
+	current.current = 0;
+	current.poolSets = 0;
+	current.frameSets = 0;
+}
+
+VkDescriptorSet FrameDescriptorAllocator::Allocate(VkDescriptorSetLayout layout)
+{
+	Frame& frame = m_frames[m_frame];
+
+	// Vulkan 1.0 doesn't promise an error for allocating past a pool's maxSets, so a full pool is never asked
+	if (frame.poolSets == m_setsPerPool)
+	{
+		if (frame.current + 1 == frame.pools.size())
+		{
+			VkDescriptorPool pool = CreatePool();
+			if (pool == VK_NULL_HANDLE)
+			{
+				return VK_NULL_HANDLE;
+			}
+
+			frame.pools.push_back(pool);
+		}
+
+		// Pools past the last one a frame used were reset along with it, or are new
+		frame.current++;
+		frame.poolSets = 0;
+	}
+
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = frame.pools[frame.current];
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &layout;
+
+	VkDescriptorSet set;
+	if (vkAllocateDescriptorSets(m_device, &allocInfo, &set) != VK_SUCCESS)
+	{
+		LOG_ERROR("Unable to allocate a frame descriptor set");
+		return VK_NULL_HANDLE;
+	}
+
+	frame.poolSets++;
+	frame.frameSets++;
+	m_stats.sets++;
+
+	if (frame.frameSets > m_stats.peakSetsPerFrame)
+	{
+		m_stats.peakSetsPerFrame = frame.frameSets;
+	}
+
+	return set;
+}
+
+void FrameDescriptorAllocator::LogStats() const
+{
+	LOG_INFO("Frame descriptors: %llu sets, %u pools, peak of %u sets in a frame", (unsigned long long)m_stats.sets, m_stats.pools, m_stats.peakSetsPerFrame);
+}
+
+VkDescriptorPool FrameDescriptorAllocator::CreatePool()
+{
+	const uint32_t typeCount = sizeof(DESCRIPTORS_PER_SET) / sizeof(DESCRIPTORS_PER_SET[0]);
+
+	VkDescriptorPoolSize poolSizes[typeCount];
+	for (uint32_t i = 0; i < typeCount; ++i)
+	{
+		poolSizes[i].type = DESCRIPTORS_PER_SET[i].type;
+		poolSizes[i].descriptorCount = DESCRIPTORS_PER_SET[i].descriptorCount * m_setsPerPool;
+	}
+
+	// No FREE_DESCRIPTOR_SET_BIT, the pool is only ever reset as a whole
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = m_setsPerPool;
+	poolInfo.poolSizeCount = typeCount;
+	poolInfo.pPoolSizes = poolSizes;
+
+	VkDescriptorPool pool;
+	if (vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &pool) != VK_SUCCESS)
+	{
+		LOG_ERROR("Unable to create a frame descriptor pool");
+		return VK_NULL_HANDLE;
+	}
+
+	m_stats.pools++;
+
+	return pool;
+}
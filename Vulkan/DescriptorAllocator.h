@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+// Sets one frame descriptor pool holds before the frame moves on to another one
+const uint32_t DEFAULT_DESCRIPTOR_SETS_PER_POOL = 1024;
+
+struct DescriptorAllocatorStats
+{
+	uint64_t sets = 0;
+	uint32_t pools = 0;
+	uint32_t peakSetsPerFrame = 0;
+};
+
+// Descriptor sets that live for one frame. Every frame in flight has its own pools, sets are carved out
+// of them in order and never freed one by one: once the frame's fence has signaled BeginFrame resets
+// the frame's pools as a whole. A frame that has filled a pool with setsPerPool sets moves on to the next
+// one, creating it if it has to, and keeps it for later frames. Pools are sized by set count, so no set may
+// need more of a descriptor type than DESCRIPTORS_PER_SET allows. Not thread safe, call everything from the
+// render thread.
+class FrameDescriptorAllocator
+{
+public:
+	bool Initialize(VkDevice device, uint32_t framesInFlight, uint32_t setsPerPool = DEFAULT_DESCRIPTOR_SETS_PER_POOL);
+	void Shutdown();
+
+	void BeginFrame(uint32_t frame);
+
+	// Valid until this frame slot comes around again, VK_NULL_HANDLE if there was no pool to take it
+	VkDescriptorSet Allocate(VkDescriptorSetLayout layout);
+
+	const DescriptorAllocatorStats& GetStats() const { return m_stats; }
+	void LogStats() const;
+
+private:
+	struct Frame
+	{
+		std::vector<VkDescriptorPool> pools;
+		uint32_t current = 0;
+		uint32_t poolSets = 0;	// In the current pool
+		uint32_t frameSets = 0;
+	};
+
+	VkDescriptorPool CreatePool();
+
+private:
+	VkDevice m_device = VK_NULL_HANDLE;
+	uint32_t m_setsPerPool = DEFAULT_DESCRIPTOR_SETS_PER_POOL;
+	std::vector<Frame> m_frames;
+	uint32_t m_frame = 0;
+
+	DescriptorAllocatorStats m_stats;
+};
@@ -0,0 +1,120 @@
+#include "DescriptorLayoutCache.h"
+#include "Log.h"
+
+#include <algorithm>
+
+void DescriptorLayoutCache::Initialize(VkDevice device)
+{
+	m_device = device;
+	m_entries.clear();
+	m_lookups = 0;
+	m_hits = 0;
+}
+
+void DescriptorLayoutCache::Shutdown()
+{
+	for (const Entry& entry : m_entries)
+	{
+		vkDestroyDescriptorSetLayout(m_device, entry.layout, nullptr);
+	}
+
+	m_entries.clear();
+}
+
+VkDescriptorSetLayout DescriptorLayoutCache::Get(const std::vector<VkDescriptorSetLayoutBinding>& bindings)
+{
+	m_lookups++;
+
+	for (const auto& binding : bindings)
+	{
+		if (binding.pImmutableSamplers != nullptr)
+		{
+			LOG_ERROR("Cached descriptor set layouts can't have immutable samplers");
+			return VK_NULL_HANDLE;
+		}
+	}
+
+	std::vector<VkDescriptorSetLayoutBinding> sorted = bindings;
+	std::sort(sorted.begin(), sorted.end(), [](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b)
+	{
+		return a.binding < b.binding;
+	});
+
+	uint64_t hash = Hash(sorted);
+
+	for (const Entry& entry : m_entries)
+	{
+		if (entry.hash == hash && Equal(entry.bindings, sorted))
+		{
+			m_hits++;
+			return entry.layout;
+		}
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = (uint32_t)sorted.size();
+	layoutInfo.pBindings = sorted.data();
+
+	VkDescriptorSetLayout layout;
+	if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &layout) != VK_SUCCESS)
+	{
+		LOG_ERROR("Unable to create a descriptor set layout with %u bindings", (uint32_t)sorted.size());
+		return VK_NULL_HANDLE;
+	}
+
+	m_entries.push_back(Entry{ hash, sorted, layout });
+
+	return layout;
+}
+
+void DescriptorLayoutCache::LogStats() const
+{
+	LOG_INFO("Descriptor layouts: %u layouts, %llu lookups, %llu hits", (uint32_t)m_entries.size(), (unsigned long long)m_lookups, (unsigned long long)m_hits);
+}
+
+uint64_t DescriptorLayoutCache::Hash(const std::vector<VkDescriptorSetLayoutBinding>& bindings)
+{
+	// FNV-1a over the fields, the struct has padding that mustn't leak into the hash
+	uint64_t hash = 14695981039346656037ull;
+
+	auto mix = [&hash](uint64_t value)
+	{
+		for (uint32_t i = 0; i < 8; ++i)
+		{
+			hash ^= (value >> (i * 8)) & 0xFF;
+			hash *= 1099511628211ull;
+		}
+	};
+
+	for (const auto& binding : bindings)
+	{
+		mix(binding.binding);
+		mix(binding.descriptorType);
+		mix(binding.descriptorCount);
+		mix(binding.stageFlags);
+	}
+
+	return hash;
+}
+
+bool DescriptorLayoutCache::Equal(const std::vector<VkDescriptorSetLayoutBinding>& a, const std::vector<VkDescriptorSetLayoutBinding>& b)
+{
+	if (a.size() != b.size())
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < a.size(); ++i)
+	{
+		if (a[i].binding != b[i].binding ||
+			a[i].descriptorType != b[i].descriptorType ||
+			a[i].descriptorCount != b[i].descriptorCount ||
+			a[i].stageFlags != b[i].stageFlags)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+// Descriptor set layouts by binding description. Get hands back the same layout for the same bindings
+// in any order, so sets allocated for one user are compatible with every pipeline layout built from the
+// same description. Owns every layout it returns. Layouts are few, a hash and a scan finds them.
+// Not thread safe, call everything from the render thread.
+class DescriptorLayoutCache
+{
+public:
+	void Initialize(VkDevice device);
+	void Shutdown();
+
+	// VK_NULL_HANDLE if the layout couldn't be created. Immutable samplers aren't supported.
+	VkDescriptorSetLayout Get(const std::vector<VkDescriptorSetLayoutBinding>& bindings);
+
+	uint32_t GetCount() const { return (uint32_t)m_entries.size(); }
+	void LogStats() const;
+
+private:
+	struct Entry
+	{
+		uint64_t hash;
+		std::vector<VkDescriptorSetLayoutBinding> bindings; // Sorted by binding
+		VkDescriptorSetLayout layout;
+	};
+
+	static uint64_t Hash(const std::vector<VkDescriptorSetLayoutBinding>& bindings);
+	static bool Equal(const std::vector<VkDescriptorSetLayoutBinding>& a, const std::vector<VkDescriptorSetLayoutBinding>& b);
+
+private:
+	VkDevice m_device = VK_NULL_HANDLE;
+	std::vector<Entry> m_entries;
+	uint64_t m_lookups = 0;
+	uint64_t m_hits = 0;
+};
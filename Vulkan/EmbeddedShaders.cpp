@@ -0,0 +1,39 @@
+#include "EmbeddedShaders.h"
+
+#ifdef EMBED_SHADERS
+
+#include "../Shaders/Embedded/vert.h"
+#include "../Shaders/Embedded/frag.h"
+#include "../Shaders/Embedded/particles.h"
+#include "../Shaders/Embedded/cull.h"
+#include "../Shaders/Embedded/compact.h"
+
+static const EmbeddedShader EMBEDDED_SHADERS[] = {
+	{ "vert", vert_spv, sizeof(vert_spv) },
+	{ "frag", frag_spv, sizeof(frag_spv) },
+	{ "particles", particles_spv, sizeof(particles_spv) },
+	{ "cull", cull_spv, sizeof(cull_spv) },
+	{ "compact", compact_spv, sizeof(compact_spv) },
+};
+
+const EmbeddedShader* FindEmbeddedShader(const std::string& name)
+{
+	for (const auto& shader : EMBEDDED_SHADERS)
+	{
+		if (name == shader.name)
+		{
+			return &shader;
+		}
+	}
+
+	return nullptr;
+}
+
+#else
+
+const EmbeddedShader* FindEmbeddedShader(const std::string&)
+{
+	return nullptr;
+}
+
+#endif
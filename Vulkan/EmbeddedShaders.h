@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct EmbeddedShader
+{
+	const char* name;
+	const uint32_t* code;
+	size_t size; // Bytes
+};
+
+// SPIR-V compiled into the executable. Only builds with EMBED_SHADERS have any, the arrays are generated
+// into Shaders/Embedded by compileShaders.bat.
+const EmbeddedShader* FindEmbeddedShader(const std::string& name);
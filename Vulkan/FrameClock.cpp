@@ -0,0 +1,138 @@
+#include "FrameClock.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+static_assert((FRAME_CLOCK_HISTORY & (FRAME_CLOCK_HISTORY - 1)) == 0, "FRAME_CLOCK_HISTORY must be a power of two");
+
+int64_t FrameClock::Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void FrameClock::Initialize()
+{
+	m_start = Now();
+	m_last = m_start;
+	m_frameTime = 0;
+	m_averageNs = 0.0;
+
+	for (auto& frame : m_frames)
+	{
+		frame.store(0, std::memory_order_relaxed);
+	}
+
+	m_written.store(0, std::memory_order_relaxed);
+	m_hitches.store(0, std::memory_order_relaxed);
+}
+
+bool FrameClock::Tick()
+{
+	int64_t now = Now();
+	m_frameTime = now - m_last;
+	m_last = now;
+
+	uint64_t written = m_written.load(std::memory_order_relaxed);
+	m_frames[written & (FRAME_CLOCK_HISTORY - 1)].store(m_frameTime, std::memory_order_relaxed);
+	// Publishes the frame, readers only trust slots the count says are written
+	m_written.store(written + 1, std::memory_order_release);
+
+	bool hitch = written > 0 && m_frameTime > FRAME_CLOCK_MIN_HITCH_NS && m_frameTime > m_averageNs * FRAME_CLOCK_HITCH_FACTOR;
+
+	if (hitch)
+	{
+		m_hitches.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// Hitches count too, otherwise a lasting drop in frame rate would be a hitch every frame from then on
+	m_averageNs = written == 0 ? (double)m_frameTime : m_averageNs + (m_frameTime - m_averageNs) * FRAME_CLOCK_AVERAGE_WEIGHT;
+
+	return hitch;
+}
+
+void FrameClock::Restart()
+{
+	m_last = Now();
+}
+
+double FrameClock::GetElapsedSeconds() const
+{
+	return (Now() - m_start) / 1000000000.0;
+}
+
+FrameTimeStats FrameClock::GetStats() const
+{
+	FrameTimeStats stats;
+
+	uint64_t written = m_written.load(std::memory_order_acquire);
+	uint64_t first = written > FRAME_CLOCK_HISTORY ? written - FRAME_CLOCK_HISTORY : 0;
+
+	int64_t frames[FRAME_CLOCK_HISTORY];
+	uint32_t count = 0;
+
+	for (uint64_t i = first; i < written; ++i)
+	{
+		frames[count++] = m_frames[i & (FRAME_CLOCK_HISTORY - 1)].load(std::memory_order_relaxed);
+	}
+
+	// Slots Tick has wrapped around to since the copy started may hold newer frames, drop them
+	std::atomic_thread_fence(std::memory_order_acquire);
+	uint64_t writtenAfter = m_written.load(std::memory_order_relaxed);
+	uint32_t overwritten = (uint32_t)std::min<uint64_t>(count, writtenAfter > written ? writtenAfter - written : 0);
+
+	int64_t* begin = frames + overwritten;
+	int64_t* end = frames + count;
+	count -= overwritten;
+
+	stats.frames = writtenAfter;
+	stats.hitches = m_hitches.load(std::memory_order_relaxed);
+	stats.samples = count;
+
+	if (count == 0)
+	{
+		return stats;
+	}
+
+	std::sort(begin, end);
+
+	int64_t sum = 0;
+	for (int64_t* frame = begin; frame != end; ++frame)
+	{
+		sum += *frame;
+	}
+
+	double average = (double)sum / count;
+	double variance = 0.0;
+	for (int64_t* frame = begin; frame != end; ++frame)
+	{
+		variance += (*frame - average) * (*frame - average);
+	}
+
+	// Nearest rank
+	auto percentile = [begin, count](uint32_t p)
+	{
+		uint32_t rank = std::max(1u, (p * count + 99) / 100);
+		return begin[rank - 1] / 1000000.0;
+	};
+
+	stats.minMs = begin[0] / 1000000.0;
+	stats.maxMs = end[-1] / 1000000.0;
+	stats.averageMs = average / 1000000.0;
+	stats.stdDevMs = sqrt(variance / count) / 1000000.0;
+	stats.p50Ms = percentile(50);
+	stats.p95Ms = percentile(95);
+	stats.p99Ms = percentile(99);
+
+	return stats;
+}
+
+void FrameClock::LogStats() const
+{
+	FrameTimeStats stats = GetStats();
+
+	LOG_INFO("Frame times over the last %u frames: min %.3fms avg %.3fms p50 %.3fms p95 %.3fms p99 %.3fms max %.3fms stddev %.3fms, %llu hitches in %llu frames",
+		stats.samples, stats.minMs, stats.averageMs, stats.p50Ms, stats.p95Ms, stats.p99Ms, stats.maxMs, stats.stdDevMs,
+		(unsigned long long)stats.hitches, (unsigned long long)stats.frames);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Recent frames kept for the statistics, a power of two
+const uint32_t FRAME_CLOCK_HISTORY = 256;
+
+// A frame this many times the running average is a hitch, as long as it's also over the minimum below
+const double FRAME_CLOCK_HITCH_FACTOR = 2.0;
+const int64_t FRAME_CLOCK_MIN_HITCH_NS = 4000000;
+
+// Weight of the newest frame in the running average hitches are measured against
+const double FRAME_CLOCK_AVERAGE_WEIGHT = 0.05;
+
+struct FrameTimeStats
+{
+	uint32_t samples = 0;	// Up to FRAME_CLOCK_HISTORY of the newest frames
+	double minMs = 0.0;
+	double maxMs = 0.0;
+	double averageMs = 0.0;
+	double stdDevMs = 0.0;
+	double p50Ms = 0.0;
+	double p95Ms = 0.0;
+	double p99Ms = 0.0;
+	uint64_t frames = 0;	// Since Initialize
+	uint64_t hitches = 0;
+};
+
+// Frame times from std::chrono::steady_clock, kept as integer nanoseconds. Tick is called once per frame by
+// the thread that owns the clock. It writes the frame into a ring of recent frames without locking, and
+// GetStats can read the ring from any thread at the same time.
+class FrameClock
+{
+public:
+	void Initialize();
+
+	// Ends the frame, true if it was a hitch
+	bool Tick();
+
+	// Restarts the current frame, so time spent not rendering (minimized) isn't counted as one
+	void Restart();
+
+	int64_t GetFrameTimeNs() const { return m_frameTime; }
+	double GetFrameTimeMs() const { return m_frameTime / 1000000.0; }
+	double GetElapsedSeconds() const;
+	uint64_t GetFrameCount() const { return m_written.load(std::memory_order_relaxed); }
+	uint64_t GetHitchCount() const { return m_hitches.load(std::memory_order_relaxed); }
+
+	// Min, average, percentiles and standard deviation over the frames still in the ring
+	FrameTimeStats GetStats() const;
+	void LogStats() const;
+
+	static int64_t Now();
+
+private:
+	int64_t m_start = 0;
+	int64_t m_last = 0;
+	int64_t m_frameTime = 0;
+	double m_averageNs = 0.0; // Exponential running average
+
+	std::atomic<int64_t> m_frames[FRAME_CLOCK_HISTORY];
+	std::atomic<uint64_t> m_written{ 0 };
+	std::atomic<uint64_t> m_hitches{ 0 };
+};
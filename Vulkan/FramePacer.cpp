@@ -0,0 +1,121 @@
+#include "FramePacer.h"
+#include "FrameClock.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+const char* GetPresentPolicyName(PresentPolicy policy)
+{
+	switch (policy)
+	{
+	case PresentPolicy::VSync:
+		return "vsync";
+	case PresentPolicy::LowLatency:
+		return "low latency";
+	case PresentPolicy::Immediate:
+		return "immediate";
+	case PresentPolicy::Capped:
+		return "capped";
+	}
+
+	return "unknown";
+}
+
+void FramePacer::Initialize(const FramePacingSettings& settings)
+{
+	m_settings = settings;
+	m_settings.spinNs = std::max<int64_t>(0, m_settings.spinNs);
+	m_nextFrame = 0;
+	m_inputTime = 0;
+	m_stats = LatencyStats();
+
+	UpdateInterval();
+}
+
+void FramePacer::SetPolicy(PresentPolicy policy)
+{
+	m_settings.policy = policy;
+	UpdateInterval();
+}
+
+void FramePacer::SetTargetFps(double targetFps)
+{
+	m_settings.targetFps = targetFps;
+	UpdateInterval();
+}
+
+void FramePacer::UpdateInterval()
+{
+	m_intervalNs = m_settings.policy == PresentPolicy::Capped && m_settings.targetFps > 0.0 ? (int64_t)(1000000000.0 / m_settings.targetFps) : 0;
+
+	// The next frame goes right away and the cadence starts from there
+	m_nextFrame = 0;
+}
+
+void FramePacer::WaitForNextFrame()
+{
+	if (m_intervalNs == 0)
+	{
+		return;
+	}
+
+	int64_t now = FrameClock::Now();
+	if (m_nextFrame == 0)
+	{
+		m_nextFrame = now;
+	}
+
+	if (now < m_nextFrame)
+	{
+		int64_t waitStart = now;
+
+		// Sleeping is cheap but coarse, so it stops short and the last stretch is spun
+		if (m_nextFrame - now > m_settings.spinNs)
+		{
+			std::this_thread::sleep_for(std::chrono::nanoseconds(m_nextFrame - now - m_settings.spinNs));
+		}
+
+		while ((now = FrameClock::Now()) < m_nextFrame)
+		{
+		}
+
+		m_stats.limiterWaits++;
+		m_stats.totalLimiterWaitMs += (now - waitStart) / 1000000.0;
+		m_stats.maxLimiterLateMs = std::max(m_stats.maxLimiterLateMs, (now - m_nextFrame) / 1000000.0);
+	}
+
+	// A frame that ran long is made up by the next one's deadline, but more than a whole interval behind
+	// starts the cadence over instead of rushing out a burst of frames
+	m_nextFrame = std::max(m_nextFrame, now - m_intervalNs) + m_intervalNs;
+}
+
+void FramePacer::MarkInput()
+{
+	m_inputTime = FrameClock::Now();
+}
+
+void FramePacer::MarkPresented()
+{
+	if (m_inputTime == 0)
+	{
+		return;
+	}
+
+	double latencyMs = (FrameClock::Now() - m_inputTime) / 1000000.0;
+	m_inputTime = 0;
+
+	m_stats.minMs = m_stats.frames == 0 ? latencyMs : std::min(m_stats.minMs, latencyMs);
+	m_stats.maxMs = std::max(m_stats.maxMs, latencyMs);
+	m_stats.lastMs = latencyMs;
+	m_stats.totalMs += latencyMs;
+	m_stats.frames++;
+}
+
+void FramePacer::LogStats() const
+{
+	LOG_INFO("Frame pacing (%s): input to present min %.3fms avg %.3fms max %.3fms over %llu frames, limiter held %llu frames for %.3fms, worst %.3fms late",
+		GetPresentPolicyName(m_settings.policy), m_stats.minMs, m_stats.AverageMs(), m_stats.maxMs, (unsigned long long)m_stats.frames,
+		(unsigned long long)m_stats.limiterWaits, m_stats.totalLimiterWaitMs, m_stats.maxLimiterLateMs);
+}
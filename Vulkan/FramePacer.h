@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+
+// The limiter sleeps until this long before the deadline and spins the rest, sleeps overshoot by up to a
+// scheduler tick (about 1ms on Linux, up to 15.6ms on Windows without timeBeginPeriod)
+const int64_t FRAME_PACER_DEFAULT_SPIN_NS = 2000000;
+
+enum class PresentPolicy
+{
+	VSync,		// FIFO, never tears, every queued image adds up to a refresh of latency
+	LowLatency,	// Mailbox, newer frames replace the queued one so the CPU never blocks on vblank. Falls back to FIFO.
+	Immediate,	// Presents without waiting for vblank, tears. Falls back to mailbox, then FIFO.
+	Capped		// Mailbox, or immediate, paced by the CPU limiter at the target frame rate
+};
+
+const char* GetPresentPolicyName(PresentPolicy policy);
+
+struct FramePacingSettings
+{
+	PresentPolicy policy = PresentPolicy::LowLatency;
+	double targetFps = 0.0;			// Capped only, 0 leaves it uncapped
+	uint32_t maxQueuedFrames = 0;	// Frames the CPU may record ahead of the GPU, 0 allows one per frame in flight
+	int64_t spinNs = FRAME_PACER_DEFAULT_SPIN_NS;
+};
+
+// Input to present is measured from MarkInput, right after the events are polled, to the return of the
+// present call. Vulkan 1.0 can't tell when the image actually reaches the screen, so queued images and the
+// display's scan out come on top.
+struct LatencyStats
+{
+	uint64_t frames = 0;
+	double lastMs = 0.0;
+	double minMs = 0.0;
+	double maxMs = 0.0;
+	double totalMs = 0.0;
+	uint64_t limiterWaits = 0;		// Frames the limiter held back
+	double totalLimiterWaitMs = 0.0;
+	double maxLimiterLateMs = 0.0;	// Worst overshoot of a deadline, how much the spin window needs to grow
+
+	double AverageMs() const
+	{
+		return frames > 0 ? totalMs / frames : 0.0;
+	}
+};
+
+// Paces the main loop. The loop calls WaitForNextFrame before polling events, so the frame is built from
+// input sampled as late as possible, MarkInput once they are polled, and MarkPresented once the frame is
+// presented. The present mode and queue depth are applied by the renderer, the pacer only keeps them.
+class FramePacer
+{
+public:
+	void Initialize(const FramePacingSettings& settings);
+
+	const FramePacingSettings& GetSettings() const { return m_settings; }
+	PresentPolicy GetPolicy() const { return m_settings.policy; }
+	void SetPolicy(PresentPolicy policy);
+	void SetTargetFps(double targetFps);
+
+	// Blocks until the next frame is due. Only waits in the capped policy with a target set.
+	void WaitForNextFrame();
+
+	void MarkInput();
+	void MarkPresented();
+
+	const LatencyStats& GetStats() const { return m_stats; }
+	void LogStats() const;
+
+private:
+	void UpdateInterval();
+
+private:
+	FramePacingSettings m_settings;
+	int64_t m_intervalNs = 0;	// 0 when uncapped
+	int64_t m_nextFrame = 0;
+	int64_t m_inputTime = 0;	// 0 until the frame's events are polled
+
+	LatencyStats m_stats;
+};
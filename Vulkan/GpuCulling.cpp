@@ -0,0 +1,325 @@
+#include "GpuCulling.h"
+#include "Log.h"
+
+#include <cstddef>
+
+static const uint32_t CULLING_BINDING_COUNT = 6;
+
+bool GpuCulling::Initialize(VkDevice device, MemoryAllocator& allocator, DeletionQueue& deletions, UploadManager& uploads, DescriptorLayoutCache& layouts, FrameDescriptorAllocator& descriptors, uint32_t framesInFlight, const VkPhysicalDeviceFeatures& features, DrawIndexedIndirectCountFn drawIndirectCount)
+{
+	m_device = device;
+	m_allocator = &allocator;
+	m_deletions = &deletions;
+	m_uploads = &uploads;
+	m_descriptors = &descriptors;
+	m_multiDrawIndirect = features.multiDrawIndirect == VK_TRUE;
+	m_drawIndirectCount = drawIndirectCount;
+	m_stats = CullingStats();
+
+	if (!features.drawIndirectFirstInstance)
+	{
+		LOG_ERROR("GPU culling needs drawIndirectFirstInstance");
+		return false;
+	}
+
+	// Objects, meshes, mesh commands, visible instances, packed draw commands, counters
+	std::vector<VkDescriptorSetLayoutBinding> bindings(CULLING_BINDING_COUNT);
+	for (uint32_t i = 0; i < CULLING_BINDING_COUNT; ++i)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	m_setLayout = layouts.Get(bindings);
+	if (m_setLayout == VK_NULL_HANDLE)
+	{
+		return false;
+	}
+
+	if (!m_allocator->CreateBuffer(sizeof(Counters), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, AllocationStrategy::Buddy, m_counters) ||
+		!m_allocator->CreateBuffer(framesInFlight * sizeof(Counters), VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, AllocationStrategy::Buddy, m_statsReadback))
+	{
+		LOG_ERROR("Unable to create the culling counters");
+		return false;
+	}
+
+	m_statsPending.assign(framesInFlight, false);
+
+	LOG_INFO("GPU culling draws with %s",
+		m_drawIndirectCount != nullptr ? "an indirect count" : m_multiDrawIndirect ? "multi draw indirect" : "one indirect draw per mesh");
+
+	return true;
+}
+
+void GpuCulling::Shutdown()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	m_allocator->DestroyBuffer(m_objects);
+	m_allocator->DestroyBuffer(m_meshes);
+	m_allocator->DestroyBuffer(m_commandTemplate);
+	m_allocator->DestroyBuffer(m_meshCommands);
+	m_allocator->DestroyBuffer(m_drawCommands);
+	m_allocator->DestroyBuffer(m_counters);
+	m_allocator->DestroyBuffer(m_visible);
+	m_allocator->DestroyBuffer(m_statsReadback);
+
+	m_setLayout = VK_NULL_HANDLE;
+	m_objectCount = 0;
+	m_meshCount = 0;
+	m_device = VK_NULL_HANDLE;
+}
+
+void GpuCulling::SetPipelines(const ComputePipeline& cull, const ComputePipeline& compact)
+{
+	m_cull = cull;
+	m_compact = compact;
+}
+
+UploadTicket GpuCulling::SetScene(const std::vector<Mesh>& meshes, const std::vector<GpuObject>& objects, bool& recreated)
+{
+	recreated = false;
+
+	if (meshes.empty() || objects.empty())
+	{
+		LOG_ERROR("GPU culling needs at least one mesh and one object");
+		return 0;
+	}
+
+	// Each mesh gets a range of the visible list big enough for every one of its objects
+	std::vector<uint32_t> objectsPerMesh(meshes.size(), 0);
+	for (const auto& object : objects)
+	{
+		if (object.mesh >= meshes.size())
+		{
+			LOG_ERROR("GPU object refers to mesh %u of %u", object.mesh, (uint32_t)meshes.size());
+			return 0;
+		}
+
+		objectsPerMesh[object.mesh]++;
+	}
+
+	std::vector<GpuMesh> gpuMeshes(meshes.size());
+	std::vector<VkDrawIndexedIndirectCommand> commands(meshes.size());
+	uint32_t instanceBase = 0;
+
+	for (size_t i = 0; i < meshes.size(); ++i)
+	{
+		GpuMesh& gpuMesh = gpuMeshes[i];
+		gpuMesh = GpuMesh();
+		gpuMesh.indexCount = meshes[i].indexCount;
+		gpuMesh.firstIndex = meshes[i].firstIndex;
+		gpuMesh.vertexOffset = meshes[i].vertexOffset;
+		gpuMesh.instanceBase = instanceBase;
+		gpuMesh.radius = meshes[i].radius;
+
+		VkDrawIndexedIndirectCommand& command = commands[i];
+		command.indexCount = meshes[i].indexCount;
+		command.instanceCount = 0;
+		command.firstIndex = meshes[i].firstIndex;
+		command.vertexOffset = meshes[i].vertexOffset;
+		command.firstInstance = instanceBase;
+
+		instanceBase += objectsPerMesh[i];
+	}
+
+	VkDeviceSize commandsSize = commands.size() * sizeof(VkDrawIndexedIndirectCommand);
+
+	// Pre-recorded draws bake in the mesh count as well as the buffers
+	recreated = meshes.size() != m_meshCount;
+
+	// The uploads land on the transfer queue while frames in flight may still be culling from the old tables, so
+	// those always go into new buffers. What the culling writes is only touched on the graphics queue, in order.
+	if (!ReplaceBuffer(m_objects, objects.size() * sizeof(GpuObject), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT) ||
+		!ReplaceBuffer(m_meshes, gpuMeshes.size() * sizeof(GpuMesh), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT) ||
+		!ReplaceBuffer(m_commandTemplate, commandsSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT) ||
+		!EnsureBuffer(m_meshCommands, commandsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, recreated) ||
+		!EnsureBuffer(m_drawCommands, commandsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, recreated) ||
+		!EnsureBuffer(m_visible, objects.size() * sizeof(InstanceData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, recreated))
+	{
+		LOG_ERROR("Unable to create the GPU culling buffers");
+		m_objectCount = 0;
+		m_meshCount = 0;
+		return 0;
+	}
+
+	m_objectCount = (uint32_t)objects.size();
+	m_meshCount = (uint32_t)meshes.size();
+
+	if (m_uploads->UploadBuffer(m_objects.buffer, 0, objects.data(), objects.size() * sizeof(GpuObject), VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT) == 0 ||
+		m_uploads->UploadBuffer(m_meshes.buffer, 0, gpuMeshes.data(), gpuMeshes.size() * sizeof(GpuMesh), VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT) == 0)
+	{
+		return 0;
+	}
+
+	return m_uploads->UploadBuffer(m_commandTemplate.buffer, 0, commands.data(), commandsSize, VK_ACCESS_TRANSFER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+}
+
+void GpuCulling::RecordCulling(VkCommandBuffer commandBuffer, uint32_t frame)
+{
+	if (m_objectCount == 0 || m_cull.pipeline == VK_NULL_HANDLE || m_compact.pipeline == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	VkDescriptorSet descriptorSet = WriteDescriptors();
+	if (descriptorSet == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	// The last frame's draws and stats copy may still be reading what is about to be overwritten
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+	VkBufferCopy copy = {};
+	copy.size = m_meshCount * sizeof(VkDrawIndexedIndirectCommand);
+	vkCmdCopyBuffer(commandBuffer, m_commandTemplate.buffer, m_meshCommands.buffer, 1, &copy);
+
+	Counters counters = {};
+	counters.objects = m_objectCount;
+	vkCmdUpdateBuffer(commandBuffer, m_counters.buffer, 0, sizeof(Counters), (const uint32_t*)&counters);
+
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	PushConstants constants = { m_objectCount, m_meshCount };
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_cull.pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_cull.layout, 0, 1, &descriptorSet, 0, nullptr);
+	vkCmdPushConstants(commandBuffer, m_cull.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+	vkCmdDispatch(commandBuffer, (m_objectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_compact.pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_compact.layout, 0, 1, &descriptorSet, 0, nullptr);
+	vkCmdPushConstants(commandBuffer, m_compact.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+	vkCmdDispatch(commandBuffer, (m_meshCount + COMPACT_GROUP_SIZE - 1) / COMPACT_GROUP_SIZE, 1, 1);
+
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	copy.srcOffset = 0;
+	copy.dstOffset = frame * sizeof(Counters);
+	copy.size = sizeof(Counters);
+	vkCmdCopyBuffer(commandBuffer, m_counters.buffer, m_statsReadback.buffer, 1, &copy);
+
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	m_statsPending[frame] = true;
+}
+
+void GpuCulling::RecordDraws(VkCommandBuffer commandBuffer) const
+{
+	if (m_objectCount == 0)
+	{
+		return;
+	}
+
+	VkDeviceSize offset = 0;
+	vkCmdBindVertexBuffers(commandBuffer, INSTANCE_BINDING, 1, &m_visible.buffer, &offset);
+
+	uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+
+	if (m_drawIndirectCount != nullptr)
+	{
+		m_drawIndirectCount(commandBuffer, m_drawCommands.buffer, 0, m_counters.buffer, offsetof(Counters, drawCount), m_meshCount, stride);
+	}
+	else if (m_multiDrawIndirect)
+	{
+		// Meshes that lost every object are still issued, with no instances
+		vkCmdDrawIndexedIndirect(commandBuffer, m_meshCommands.buffer, 0, m_meshCount, stride);
+	}
+	else
+	{
+		for (uint32_t i = 0; i < m_meshCount; ++i)
+		{
+			vkCmdDrawIndexedIndirect(commandBuffer, m_meshCommands.buffer, i * stride, 1, stride);
+		}
+	}
+}
+
+void GpuCulling::CollectStats(uint32_t frame)
+{
+	if (frame >= m_statsPending.size() || !m_statsPending[frame])
+	{
+		return;
+	}
+
+	const Counters& counters = ((const Counters*)m_statsReadback.allocation.mapped)[frame];
+
+	m_stats.objects = counters.objects;
+	m_stats.visible = counters.visible;
+	m_stats.culled = counters.objects - counters.visible;
+	m_stats.draws = counters.drawCount;
+
+	m_statsPending[frame] = false;
+}
+
+bool GpuCulling::EnsureBuffer(AllocatedBuffer& buffer, VkDeviceSize size, VkBufferUsageFlags usage, bool& recreated)
+{
+	if (buffer.buffer != VK_NULL_HANDLE && buffer.size >= size)
+	{
+		return true;
+	}
+
+	recreated = true;
+
+	return ReplaceBuffer(buffer, size, usage);
+}
+
+bool GpuCulling::ReplaceBuffer(AllocatedBuffer& buffer, VkDeviceSize size, VkBufferUsageFlags usage)
+{
+	m_deletions->RetireBuffer(buffer);
+
+	return m_allocator->CreateBuffer(size, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, AllocationStrategy::Buddy, buffer);
+}
+
+VkDescriptorSet GpuCulling::WriteDescriptors()
+{
+	VkDescriptorSet descriptorSet = m_descriptors->Allocate(m_setLayout);
+	if (descriptorSet == VK_NULL_HANDLE)
+	{
+		return VK_NULL_HANDLE;
+	}
+
+	const AllocatedBuffer* buffers[CULLING_BINDING_COUNT] = { &m_objects, &m_meshes, &m_meshCommands, &m_visible, &m_drawCommands, &m_counters };
+
+	VkDescriptorBufferInfo bufferInfos[CULLING_BINDING_COUNT];
+	VkWriteDescriptorSet writes[CULLING_BINDING_COUNT] = {};
+
+	for (uint32_t i = 0; i < CULLING_BINDING_COUNT; ++i)
+	{
+		bufferInfos[i].buffer = buffers[i]->buffer;
+		bufferInfos[i].offset = 0;
+		bufferInfos[i].range = VK_WHOLE_SIZE;
+
+		writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[i].dstSet = descriptorSet;
+		writes[i].dstBinding = i;
+		writes[i].descriptorCount = 1;
+		writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writes[i].pBufferInfo = &bufferInfos[i];
+	}
+
+	vkUpdateDescriptorSets(m_device, CULLING_BINDING_COUNT, writes, 0, nullptr);
+
+	return descriptorSet;
+}
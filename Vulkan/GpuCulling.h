@@ -0,0 +1,129 @@
+#pragma once
+
+#include "AsyncCompute.h"
+#include "DeletionQueue.h"
+#include "DescriptorAllocator.h"
+#include "DescriptorLayoutCache.h"
+#include "MemoryAllocator.h"
+#include "MeshBuffer.h"
+#include "UploadManager.h"
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+// VK_KHR_draw_indirect_count and VK_AMD_draw_indirect_count share this signature. Our SDK's headers
+// predate both, so the entry point is looked up at runtime.
+typedef void (VKAPI_PTR *DrawIndexedIndirectCountFn)(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, VkBuffer countBuffer, VkDeviceSize countBufferOffset, uint32_t maxDrawCount, uint32_t stride);
+
+// One entry of the object table, mesh indexes the meshes handed to SetScene
+struct GpuObject
+{
+	InstanceData instance;
+	uint32_t mesh;
+	uint32_t padding[3];
+};
+
+struct CullingStats
+{
+	uint32_t objects = 0;
+	uint32_t visible = 0;
+	uint32_t culled = 0;
+	uint32_t draws = 0; // Indirect draws that had at least one instance
+};
+
+// GPU driven drawing of an object table. Every frame a compute pass culls the objects against the view,
+// appends the survivors to a per mesh range of an instance buffer and counts them into one
+// VkDrawIndexedIndirectCommand per mesh, a second pass packs the non empty commands and counts them.
+// Drawing is then a single indirect draw no matter how many objects there are: with a count buffer when
+// the driver has draw_indirect_count, otherwise every mesh's command with multiDrawIndirect. The passes'
+// descriptor set comes from the frame descriptor allocator each frame, so it always names the current buffers.
+// Everything runs on the graphics queue inside the frame. Not thread safe, call everything from the render thread.
+class GpuCulling
+{
+public:
+	static const uint32_t CULL_GROUP_SIZE = 256;
+	static const uint32_t COMPACT_GROUP_SIZE = 64;
+
+	struct PushConstants
+	{
+		uint32_t objectCount;
+		uint32_t meshCount;
+	};
+
+	// Needs drawIndirectFirstInstance, each mesh's instances start at their own offset
+	bool Initialize(VkDevice device, MemoryAllocator& allocator, DeletionQueue& deletions, UploadManager& uploads, DescriptorLayoutCache& layouts, FrameDescriptorAllocator& descriptors, uint32_t framesInFlight, const VkPhysicalDeviceFeatures& features, DrawIndexedIndirectCountFn drawIndirectCount);
+	void Shutdown();
+
+	// Both pipelines use this layout and PushConstants
+	VkDescriptorSetLayout GetSetLayout() const { return m_setLayout; }
+	void SetPipelines(const ComputePipeline& cull, const ComputePipeline& compact);
+
+	// Uploads the tables into new buffers and retires the old ones, frames in flight may still be culling
+	// from them. Returns the last upload's ticket or 0 on failure. recreated is set when the buffers the
+	// draws read moved and command buffers that draw from them are stale.
+	UploadTicket SetScene(const std::vector<Mesh>& meshes, const std::vector<GpuObject>& objects, bool& recreated);
+
+	// Outside a render pass, before anything that draws
+	void RecordCulling(VkCommandBuffer commandBuffer, uint32_t frame);
+	// Inside the render pass with the mesh buffers bound
+	void RecordDraws(VkCommandBuffer commandBuffer) const;
+
+	// Once the frame's fence has signaled
+	void CollectStats(uint32_t frame);
+	const CullingStats& GetStats() const { return m_stats; }
+
+	bool UsesDrawCount() const { return m_drawIndirectCount != nullptr; }
+
+private:
+	struct GpuMesh
+	{
+		uint32_t indexCount;
+		uint32_t firstIndex;
+		int32_t vertexOffset;
+		uint32_t instanceBase;
+		float radius;
+		uint32_t padding[3];
+	};
+
+	struct Counters
+	{
+		uint32_t drawCount;
+		uint32_t visible;
+		uint32_t objects; // Written with the reset so the stats match the frame they were read back for
+		uint32_t padding;
+	};
+
+	bool EnsureBuffer(AllocatedBuffer& buffer, VkDeviceSize size, VkBufferUsageFlags usage, bool& recreated);
+	bool ReplaceBuffer(AllocatedBuffer& buffer, VkDeviceSize size, VkBufferUsageFlags usage);
+	// VK_NULL_HANDLE if the frame's descriptors ran out
+	VkDescriptorSet WriteDescriptors();
+
+private:
+	VkDevice m_device = VK_NULL_HANDLE;
+	MemoryAllocator* m_allocator = nullptr;
+	DeletionQueue* m_deletions = nullptr;
+	UploadManager* m_uploads = nullptr;
+	FrameDescriptorAllocator* m_descriptors = nullptr;
+	bool m_multiDrawIndirect = false;
+	DrawIndexedIndirectCountFn m_drawIndirectCount = nullptr;
+
+	VkDescriptorSetLayout m_setLayout = VK_NULL_HANDLE; // Owned by the layout cache
+	ComputePipeline m_cull;
+	ComputePipeline m_compact;
+
+	uint32_t m_objectCount = 0;
+	uint32_t m_meshCount = 0;
+
+	AllocatedBuffer m_objects;			// GpuObject per object
+	AllocatedBuffer m_meshes;			// GpuMesh per mesh
+	AllocatedBuffer m_commandTemplate;	// Every mesh's command with no instances, copied over m_meshCommands each frame
+	AllocatedBuffer m_meshCommands;		// One command per mesh, in mesh order
+	AllocatedBuffer m_drawCommands;		// The non empty ones, packed
+	AllocatedBuffer m_counters;
+	AllocatedBuffer m_visible;			// InstanceData, a range per mesh sized for all of its objects
+
+	AllocatedBuffer m_statsReadback;	// Counters per frame in flight
+	std::vector<bool> m_statsPending;
+
+	CullingStats m_stats;
+};
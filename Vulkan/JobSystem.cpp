@@ -0,0 +1,192 @@
+#include "JobSystem.h"
+
+namespace
+{
+	// Set on worker threads only, several pools can be alive at once
+	struct WorkerSlot
+	{
+		const JobSystem* system;
+		uint32_t threadIndex;
+	};
+
+	thread_local WorkerSlot s_worker = { nullptr, INVALID_THREAD_INDEX };
+}
+
+bool JobSystem::Initialize(uint32_t workerCount)
+{
+	if (workerCount == 0)
+	{
+		uint32_t hardwareThreads = std::thread::hardware_concurrency();
+		workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+	}
+
+	m_ownerThread = std::this_thread::get_id();
+
+	m_queues.clear();
+	for (uint32_t i = 0; i < workerCount + 1; ++i)
+	{
+		m_queues.emplace_back(new WorkQueue());
+	}
+
+	m_running = true;
+
+	for (uint32_t i = 1; i <= workerCount; ++i)
+	{
+		m_threads.emplace_back(&JobSystem::WorkerLoop, this, i);
+	}
+
+	return true;
+}
+
+void JobSystem::Shutdown()
+{
+	if (!m_running)
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_running = false;
+	}
+	m_wake.notify_all();
+
+	for (auto& thread : m_threads)
+	{
+		thread.join();
+	}
+
+	m_threads.clear();
+	m_queues.clear();
+}
+
+void JobSystem::Submit(Job job, JobCounter* counter)
+{
+	if (counter != nullptr)
+	{
+		counter->count++;
+	}
+
+	// Our own queue keeps the work cache local, unknown threads spread it around
+	uint32_t queueIndex = GetThreadIndex();
+	if (queueIndex >= m_queues.size())
+	{
+		queueIndex = m_nextQueue++ % (uint32_t)m_queues.size();
+	}
+
+	// Counted before it's published, otherwise a thread could pop it and decrement first
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_queued++;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_queues[queueIndex]->mutex);
+		m_queues[queueIndex]->tasks.push_back(Task{ std::move(job), counter });
+	}
+
+	m_wake.notify_one();
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+	uint32_t threadIndex = GetThreadIndex();
+
+	while (counter.count > 0)
+	{
+		if (threadIndex >= m_queues.size() || !TryRunOne(threadIndex))
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+void JobSystem::ParallelFor(uint32_t count, const std::function<void(uint32_t index, uint32_t threadIndex)>& fn)
+{
+	JobCounter counter;
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		Submit([&fn, i](uint32_t threadIndex) { fn(i, threadIndex); }, &counter);
+	}
+
+	Wait(counter);
+}
+
+uint32_t JobSystem::GetThreadIndex() const
+{
+	if (s_worker.system == this)
+	{
+		return s_worker.threadIndex;
+	}
+
+	return std::this_thread::get_id() == m_ownerThread ? 0 : INVALID_THREAD_INDEX;
+}
+
+bool JobSystem::TryRunOne(uint32_t threadIndex)
+{
+	Task task;
+	bool found = Pop(threadIndex, false, task);
+
+	for (uint32_t i = 1; !found && i < m_queues.size(); ++i)
+	{
+		found = Pop((threadIndex + i) % (uint32_t)m_queues.size(), true, task);
+	}
+
+	if (!found)
+	{
+		return false;
+	}
+
+	task.job(threadIndex);
+
+	if (task.counter != nullptr)
+	{
+		task.counter->count--;
+	}
+
+	return true;
+}
+
+bool JobSystem::Pop(uint32_t queueIndex, bool steal, Task& task)
+{
+	WorkQueue& queue = *m_queues[queueIndex];
+
+	std::lock_guard<std::mutex> lock(queue.mutex);
+
+	if (queue.tasks.empty())
+	{
+		return false;
+	}
+
+	if (steal)
+	{
+		task = std::move(queue.tasks.front());
+		queue.tasks.pop_front();
+	}
+	else
+	{
+		task = std::move(queue.tasks.back());
+		queue.tasks.pop_back();
+	}
+
+	m_queued--;
+
+	return true;
+}
+
+void JobSystem::WorkerLoop(uint32_t threadIndex)
+{
+	s_worker = { this, threadIndex };
+
+	while (m_running)
+	{
+		if (TryRunOne(threadIndex))
+		{
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		m_wake.wait(lock, [this]() { return m_queued > 0 || !m_running; });
+	}
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+const uint32_t INVALID_THREAD_INDEX = 0xFFFFFFFF;
+
+struct JobCounter
+{
+	std::atomic<uint32_t> count{ 0 };
+};
+
+// Work stealing thread pool. Every thread has its own queue, owners pop the newest job and idle threads
+// steal the oldest from someone else. Thread 0 is the thread that called Initialize, it only runs jobs
+// while it is inside Wait or ParallelFor. Jobs get the index of the thread running them so they can
+// use per-thread resources such as command pools.
+class JobSystem
+{
+public:
+	typedef std::function<void(uint32_t threadIndex)> Job;
+
+	// workerCount 0 picks one worker per hardware thread, minus the calling thread
+	bool Initialize(uint32_t workerCount = 0);
+	void Shutdown();
+
+	void Submit(Job job, JobCounter* counter = nullptr);
+
+	// Runs jobs on the calling thread until counter reaches zero
+	void Wait(JobCounter& counter);
+
+	// Calls fn(index, threadIndex) for every index in [0, count) and returns when all calls are done
+	void ParallelFor(uint32_t count, const std::function<void(uint32_t index, uint32_t threadIndex)>& fn);
+
+	// Runs fn(threadIndex) as a job and hands its result back through a future. Blocking on the future
+	// doesn't run jobs on the calling thread, use Wait with a counter for that.
+	template <typename F>
+	auto Async(F fn) -> std::future<decltype(fn(0u))>
+	{
+		typedef decltype(fn(0u)) Result;
+
+		auto task = std::make_shared<std::packaged_task<Result(uint32_t)>>(std::move(fn));
+		std::future<Result> future = task->get_future();
+
+		Submit([task](uint32_t threadIndex) { (*task)(threadIndex); });
+
+		return future;
+	}
+
+	uint32_t GetThreadCount() const { return (uint32_t)m_queues.size(); }
+
+	// The calling thread's index in this pool, INVALID_THREAD_INDEX if it isn't one of ours. A thread can be
+	// thread 0 of several pools but a worker of only one.
+	uint32_t GetThreadIndex() const;
+
+private:
+	struct Task
+	{
+		Job job;
+		JobCounter* counter;
+	};
+
+	struct WorkQueue
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	bool TryRunOne(uint32_t threadIndex);
+	bool Pop(uint32_t queueIndex, bool steal, Task& task);
+	void WorkerLoop(uint32_t threadIndex);
+
+private:
+	std::vector<std::unique_ptr<WorkQueue>> m_queues;
+	std::vector<std::thread> m_threads;
+	std::thread::id m_ownerThread;	// Thread 0
+
+	std::atomic<bool> m_running{ false };
+	std::atomic<uint32_t> m_queued{ 0 };
+	std::atomic<uint32_t> m_nextQueue{ 0 };
+
+	std::mutex m_sleepMutex;
+	std::condition_variable m_wake;
+};
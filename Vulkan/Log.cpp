@@ -0,0 +1,294 @@
+#include "Log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#endif
+
+namespace
+{
+	struct LogRecord
+	{
+		std::atomic<uint64_t> sequence;
+		int64_t timestamp; // steady_clock nanoseconds
+		uint32_t thread;
+		uint16_t length;
+		LogLevel level;
+		uint8_t padding;
+		char text[LOG_RECORD_SIZE - 24];
+	};
+
+	static_assert(sizeof(LogRecord) == LOG_RECORD_SIZE, "LogRecord must be LOG_RECORD_SIZE bytes");
+	static_assert((LOG_RING_CAPACITY & (LOG_RING_CAPACITY - 1)) == 0, "LOG_RING_CAPACITY must be a power of two");
+
+	const uint64_t RING_MASK = LOG_RING_CAPACITY - 1;
+
+	// A bounded queue where each record's sequence says whose turn it is: the writer of position pos waits
+	// for lap, the reader for lap + 1, where lap is pos rounded down to the ring size. Sequences are stored
+	// relative to the record's index so the zero initialized ring starts out empty.
+	LogRecord g_records[LOG_RING_CAPACITY];
+	alignas(64) std::atomic<uint64_t> g_writePosition{ 0 };
+	alignas(64) std::atomic<uint64_t> g_readPosition{ 0 }; // Only the flusher moves it
+
+	alignas(64) std::atomic<uint64_t> g_written{ 0 };
+	std::atomic<uint64_t> g_dropped{ 0 };
+	std::atomic<uint64_t> g_truncated{ 0 };
+
+	std::atomic<uint32_t> g_nextThread{ 0 };
+	thread_local uint32_t t_thread = ~0u;
+
+	std::thread g_flusher;
+	std::atomic<bool> g_running{ false };
+	FILE* g_file = nullptr;
+	int64_t g_origin = 0;
+
+	const char* const LEVEL_NAMES[] = { "Debug", "Info", "Warning", "Error" };
+
+	int64_t Now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// Null when the ring is full, the record is the caller's until Publish
+	LogRecord* Claim(uint64_t& lap)
+	{
+		uint64_t position = g_writePosition.load(std::memory_order_relaxed);
+
+		while (true)
+		{
+			LogRecord& record = g_records[position & RING_MASK];
+			lap = position & ~RING_MASK;
+
+			int64_t turn = (int64_t)(record.sequence.load(std::memory_order_acquire) - lap);
+
+			if (turn == 0)
+			{
+				if (g_writePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				{
+					return &record;
+				}
+			}
+			else if (turn < 0)
+			{
+				// Still holds a record from the previous lap the flusher hasn't got to
+				g_dropped.fetch_add(1, std::memory_order_relaxed);
+				return nullptr;
+			}
+			else
+			{
+				position = g_writePosition.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	void Publish(LogRecord& record, LogLevel level, uint64_t lap)
+	{
+		if (t_thread == ~0u)
+		{
+			t_thread = g_nextThread.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		record.timestamp = Now();
+		record.thread = t_thread;
+		record.level = level;
+		record.sequence.store(lap + 1, std::memory_order_release);
+	}
+
+	void Output(const char* line, size_t length)
+	{
+		fwrite(line, 1, length, g_file != nullptr ? g_file : stderr);
+#ifdef _WIN32
+		OutputDebugStringA(line);
+#endif
+	}
+
+	// Single consumer: the flusher, or whoever holds the ring once it has stopped. True if anything was written.
+	bool Drain()
+	{
+		char line[LOG_RECORD_SIZE + 64];
+		bool wrote = false;
+
+		while (true)
+		{
+			uint64_t position = g_readPosition.load(std::memory_order_relaxed);
+			LogRecord& record = g_records[position & RING_MASK];
+			uint64_t lap = position & ~RING_MASK;
+
+			if (record.sequence.load(std::memory_order_acquire) != lap + 1)
+			{
+				break;
+			}
+
+			// Records from before Initialize show up at 0
+			double seconds = std::max<int64_t>(record.timestamp - g_origin, 0) / 1000000000.0;
+			int length = snprintf(line, sizeof(line), "[%11.6f] [T%u] %s: %.*s\n", seconds, record.thread, LEVEL_NAMES[(uint32_t)record.level],
+				(int)record.length, record.text);
+
+			// The record can be reused as soon as its text has been copied out
+			record.sequence.store(lap + LOG_RING_CAPACITY, std::memory_order_release);
+			g_readPosition.store(position + 1, std::memory_order_release);
+
+			Output(line, std::min((size_t)length, sizeof(line) - 1));
+			wrote = true;
+		}
+
+		if (wrote)
+		{
+			fflush(g_file != nullptr ? g_file : stderr);
+		}
+
+		return wrote;
+	}
+
+	void FlusherMain()
+	{
+		while (g_running.load(std::memory_order_acquire))
+		{
+			if (!Drain())
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(LOG_FLUSH_INTERVAL_MS));
+			}
+		}
+	}
+}
+
+namespace Log
+{
+	bool Initialize(const char* filename)
+	{
+		if (g_running)
+		{
+			return true;
+		}
+
+		if (filename != nullptr)
+		{
+			g_file = fopen(filename, "w");
+			if (g_file == nullptr)
+			{
+				fprintf(stderr, "Unable to open log file %s\n", filename);
+				return false;
+			}
+		}
+
+		g_origin = Now();
+		g_running = true;
+		g_flusher = std::thread(FlusherMain);
+
+		return true;
+	}
+
+	void Shutdown()
+	{
+		if (g_running.exchange(false))
+		{
+			g_flusher.join();
+		}
+
+		Drain();
+
+		LogStats stats = GetStats();
+		if (stats.dropped > 0)
+		{
+			char line[128];
+			int length = snprintf(line, sizeof(line), "Log: %llu records dropped, the ring was full\n", (unsigned long long)stats.dropped);
+			Output(line, (size_t)length);
+		}
+
+		if (g_file != nullptr)
+		{
+			fclose(g_file);
+			g_file = nullptr;
+		}
+	}
+
+	void Flush()
+	{
+		if (!g_running)
+		{
+			Drain();
+			return;
+		}
+
+		uint64_t target = g_writePosition.load(std::memory_order_acquire);
+
+		// A record claimed but not published yet holds the flusher up until its writer is done with it
+		while (g_readPosition.load(std::memory_order_acquire) < target && g_running)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	void Write(LogLevel level, const char* text, size_t length)
+	{
+		uint64_t lap;
+		LogRecord* record = Claim(lap);
+		if (record == nullptr)
+		{
+			return;
+		}
+
+		if (length > sizeof(record->text))
+		{
+			length = sizeof(record->text);
+			g_truncated.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		memcpy(record->text, text, length);
+		record->length = (uint16_t)length;
+		g_written.fetch_add(1, std::memory_order_relaxed);
+
+		Publish(*record, level, lap);
+	}
+
+	void Writef(LogLevel level, const char* format, ...)
+	{
+		uint64_t lap;
+		LogRecord* record = Claim(lap);
+		if (record == nullptr)
+		{
+			return;
+		}
+
+		va_list args;
+		va_start(args, format);
+		int length = vsnprintf(record->text, sizeof(record->text), format, args);
+		va_end(args);
+
+		if (length < 0)
+		{
+			length = 0;
+		}
+		else if (length >= (int)sizeof(record->text))
+		{
+			// vsnprintf keeps the last byte for the terminator
+			length = sizeof(record->text) - 1;
+			g_truncated.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		record->length = (uint16_t)length;
+		g_written.fetch_add(1, std::memory_order_relaxed);
+
+		Publish(*record, level, lap);
+	}
+
+	LogStats GetStats()
+	{
+		LogStats stats;
+		stats.written = g_written.load(std::memory_order_relaxed);
+		stats.dropped = g_dropped.load(std::memory_order_relaxed);
+		stats.truncated = g_truncated.load(std::memory_order_relaxed);
+
+		return stats;
+	}
+}
@@ -1,34 +1,86 @@
 #pragma once
 
-#include <vector>
-#include <string>
-#include <Windows.h>
+#include <cstdint>
+#include <cstddef>
 
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARNING 2
+#define LOG_LEVEL_ERROR 3
+
+// Anything below this level is compiled out, arguments and all
+#ifndef LOG_MIN_LEVEL
+#ifdef _DEBUG
+#define LOG_MIN_LEVEL LOG_LEVEL_DEBUG
+#else
+#define LOG_MIN_LEVEL LOG_LEVEL_INFO
+#endif
+#endif
+
+enum class LogLevel : uint8_t
+{
+	Debug = LOG_LEVEL_DEBUG,
+	Info = LOG_LEVEL_INFO,
+	Warning = LOG_LEVEL_WARNING,
+	Error = LOG_LEVEL_ERROR
+};
+
+// Records waiting for the flusher, a power of two. Logging into a full ring drops the record rather than wait.
+const uint32_t LOG_RING_CAPACITY = 4096;
+
+// Bytes per record, the text gets what the header leaves and longer messages are cut off
+const uint32_t LOG_RECORD_SIZE = 256;
+
+// How long the flusher sleeps when the ring is empty
+const uint32_t LOG_FLUSH_INTERVAL_MS = 5;
+
+struct LogStats
+{
+	uint64_t written = 0;
+	uint64_t dropped = 0;	// The ring was full
+	uint64_t truncated = 0;
+};
+
+// Logging formats straight into a fixed size record of a lock free ring buffer, any thread can log and
+// nothing blocks or allocates. A background thread writes the records out to stderr or a file, and to the
+// debugger output on Windows. Records logged before Initialize wait in the ring until it is called.
 namespace Log
 {
-	static std::vector<std::string> LOGS;
-
-	static void Output(std::string s)
-	{
-		std::string ss = s + "\n";
-		OutputDebugStringA(ss.c_str());
-	}
-
-	static void Info(std::string s)
-	{
-		Output(s);
-	}
-
-	static void Error(std::string s)
-	{
-		Output("Error: " + s);
-	}
-
-	static void Print()
-	{
-		for (unsigned int i = 0; i < LOGS.size(); ++i)
-		{
-			Output(LOGS[i]);
-		}
-	}
-}
\ No newline at end of file
+	// Starts the flusher, a null filename writes to stderr
+	bool Initialize(const char* filename = nullptr);
+	// Writes out everything left and stops the flusher
+	void Shutdown();
+
+	// Blocks until everything logged before the call has been written out
+	void Flush();
+
+	void Write(LogLevel level, const char* text, size_t length);
+	void Writef(LogLevel level, const char* format, ...);
+
+	LogStats GetStats();
+}
+
+// printf style, formatted directly into the record
+#if LOG_MIN_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) Log::Writef(LogLevel::Debug, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) ((void)0)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(...) Log::Writef(LogLevel::Info, __VA_ARGS__)
+#else
+#define LOG_INFO(...) ((void)0)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_WARNING
+#define LOG_WARNING(...) Log::Writef(LogLevel::Warning, __VA_ARGS__)
+#else
+#define LOG_WARNING(...) ((void)0)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) Log::Writef(LogLevel::Error, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) ((void)0)
+#endif
@@ -0,0 +1,166 @@
+#include "MappedFile.h"
+#include "Log.h"
+
+#include <utility>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+MappedFile::MappedFile(MappedFile&& other)
+{
+	Swap(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other)
+{
+	if (this != &other)
+	{
+		Close();
+		Swap(other);
+	}
+
+	return *this;
+}
+
+void MappedFile::Swap(MappedFile& other)
+{
+#ifdef _WIN32
+	std::swap(m_file, other.m_file);
+	std::swap(m_mapping, other.m_mapping);
+#else
+	std::swap(m_fd, other.m_fd);
+#endif
+	std::swap(m_data, other.m_data);
+	std::swap(m_size, other.m_size);
+}
+
+#ifdef _WIN32
+
+bool MappedFile::Open(const std::string& filename)
+{
+	Close();
+
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		LOG_ERROR("Unable to open file: %s", filename.c_str());
+		return false;
+	}
+	m_file = file;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+	{
+		LOG_ERROR("Unable to map empty file: %s", filename.c_str());
+		Close();
+		return false;
+	}
+
+	m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_mapping == nullptr)
+	{
+		LOG_ERROR("Unable to create a file mapping for: %s", filename.c_str());
+		Close();
+		return false;
+	}
+
+	m_data = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+	if (m_data == nullptr)
+	{
+		LOG_ERROR("Unable to map a view of: %s", filename.c_str());
+		Close();
+		return false;
+	}
+
+	m_size = (size_t)size.QuadPart;
+
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (m_data != nullptr)
+	{
+		UnmapViewOfFile(m_data);
+	}
+
+	if (m_mapping != nullptr)
+	{
+		CloseHandle(m_mapping);
+	}
+
+	if (m_file != nullptr)
+	{
+		CloseHandle(m_file);
+	}
+
+	m_file = nullptr;
+	m_mapping = nullptr;
+	m_data = nullptr;
+	m_size = 0;
+}
+
+#else
+
+bool MappedFile::Open(const std::string& filename)
+{
+	Close();
+
+	m_fd = open(filename.c_str(), O_RDONLY);
+	if (m_fd < 0)
+	{
+		LOG_ERROR("Unable to open file: %s", filename.c_str());
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(m_fd, &info) != 0 || info.st_size == 0)
+	{
+		LOG_ERROR("Unable to map empty file: %s", filename.c_str());
+		Close();
+		return false;
+	}
+
+	void* data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+	if (data == MAP_FAILED)
+	{
+		LOG_ERROR("Unable to map: %s", filename.c_str());
+		Close();
+		return false;
+	}
+
+	m_data = data;
+	m_size = (size_t)info.st_size;
+
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (m_data != nullptr)
+	{
+		munmap(const_cast<void*>(m_data), m_size);
+	}
+
+	if (m_fd >= 0)
+	{
+		close(m_fd);
+	}
+
+	m_fd = -1;
+	m_data = nullptr;
+	m_size = 0;
+}
+
+#endif
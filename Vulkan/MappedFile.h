@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+
+// Read only memory mapping of a whole file. The view is page aligned and stays valid until Close,
+// nothing is copied onto the heap.
+class MappedFile
+{
+public:
+	MappedFile() {}
+	~MappedFile();
+
+	MappedFile(MappedFile&& other);
+	MappedFile& operator=(MappedFile&& other);
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool Open(const std::string& filename);
+	void Close();
+
+	const void* GetData() const { return m_data; }
+	size_t GetSize() const { return m_size; }
+	bool IsOpen() const { return m_data != nullptr; }
+
+private:
+	void Swap(MappedFile& other);
+
+private:
+#ifdef _WIN32
+	void* m_file = nullptr;		// HANDLE, kept as void* so Windows.h stays out of the header
+	void* m_mapping = nullptr;
+#else
+	int m_fd = -1;
+#endif
+	const void* m_data = nullptr;
+	size_t m_size = 0;
+};
@@ -0,0 +1,520 @@
+#include "MemoryAllocator.h"
+#include "Log.h"
+
+#include <algorithm>
+
+bool MemoryAllocator::Initialize(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize blockSize)
+{
+	m_device = device;
+
+	// Buddy arenas need a power of two
+	m_blockSize = MIN_BUDDY_BLOCK_SIZE;
+	while (m_blockSize < blockSize)
+	{
+		m_blockSize <<= 1;
+	}
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &m_memoryProperties);
+
+	m_bufferImageGranularity = properties.limits.bufferImageGranularity;
+	m_maxAllocationCount = properties.limits.maxMemoryAllocationCount;
+	m_deviceAllocationCount = 0;
+
+	return true;
+}
+
+void MemoryAllocator::Shutdown()
+{
+	for (auto& pool : m_pools)
+	{
+		for (auto& block : pool.blocks)
+		{
+			if (!block->arena->IsEmpty())
+			{
+				LOG_ERROR("Memory block freed with %u live allocations", block->arena->GetAllocationCount());
+			}
+
+			DestroyBlock(block.get());
+		}
+		pool.blocks.clear();
+	}
+
+	m_pools.clear();
+}
+
+bool MemoryAllocator::Allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, AllocationStrategy strategy, ResourceKind kind, Allocation& allocation)
+{
+	uint32_t memoryType;
+	if (!FindMemoryType(requirements.memoryTypeBits, properties, memoryType))
+	{
+		LOG_ERROR("No memory type matches the requested properties");
+		return false;
+	}
+
+	MemoryPool& pool = GetPool(memoryType, strategy, kind);
+
+	// Big resources get their own block instead of wasting most of a shared one. So do lazily allocated
+	// ones, the driver commits their memory per block as it's touched and shared blocks would hide that.
+	if (requirements.size > m_blockSize / 2 || (properties & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != 0)
+	{
+		MemoryBlock* block = CreateBlock(pool, requirements.size, true);
+		if (block == nullptr)
+		{
+			return false;
+		}
+
+		VkDeviceSize offset;
+		block->arena->Allocate(requirements.size, requirements.alignment, offset);
+		block->bytesRequested = requirements.size;
+
+		allocation.memory = block->memory;
+		allocation.offset = offset;
+		allocation.size = requirements.size;
+		allocation.mapped = block->mapped;
+		allocation.memoryType = memoryType;
+		allocation.block = block;
+		allocation.blockResets = block->resets;
+
+		return true;
+	}
+
+	if (!AllocateFromPool(pool, requirements.size, requirements.alignment, nullptr, true, allocation))
+	{
+		LOG_ERROR("Out of device memory in memory type %u", memoryType);
+		return false;
+	}
+
+	return true;
+}
+
+void MemoryAllocator::Free(Allocation& allocation)
+{
+	MemoryBlock* block = allocation.block;
+	if (block == nullptr)
+	{
+		return;
+	}
+
+	// Already dropped by ResetLinear, its range may belong to a newer allocation by now
+	if (allocation.blockResets != block->resets)
+	{
+		allocation = Allocation();
+		return;
+	}
+
+	block->arena->Free(allocation.offset);
+	block->bytesRequested -= allocation.size;
+
+	allocation = Allocation();
+
+	if (!block->arena->IsEmpty())
+	{
+		return;
+	}
+
+	// Keep one empty shared block around per pool so a free/alloc pattern doesn't hit the driver every time
+	MemoryPool& pool = m_pools[block->poolIndex];
+
+	bool keep = false;
+	if (!block->dedicated)
+	{
+		keep = true;
+		for (auto& other : pool.blocks)
+		{
+			if (other.get() != block && !other->dedicated && other->arena->IsEmpty())
+			{
+				keep = false;
+				break;
+			}
+		}
+	}
+
+	if (keep)
+	{
+		return;
+	}
+
+	DestroyBlock(block);
+
+	pool.blocks.erase(std::remove_if(pool.blocks.begin(), pool.blocks.end(),
+		[block](const std::unique_ptr<MemoryBlock>& b) { return b.get() == block; }), pool.blocks.end());
+}
+
+bool MemoryAllocator::AllocateForBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties, AllocationStrategy strategy, Allocation& allocation)
+{
+	VkMemoryRequirements requirements;
+	vkGetBufferMemoryRequirements(m_device, buffer, &requirements);
+
+	if (!Allocate(requirements, properties, strategy, ResourceKind::Linear, allocation))
+	{
+		return false;
+	}
+
+	if (vkBindBufferMemory(m_device, buffer, allocation.memory, allocation.offset) != VK_SUCCESS)
+	{
+		LOG_ERROR("Unable to bind buffer memory");
+		Free(allocation);
+		return false;
+	}
+
+	return true;
+}
+
+bool MemoryAllocator::AllocateForImage(VkImage image, VkImageTiling tiling, VkMemoryPropertyFlags properties, Allocation& allocation)
+{
+	VkMemoryRequirements requirements;
+	vkGetImageMemoryRequirements(m_device, image, &requirements);
+
+	ResourceKind kind = tiling == VK_IMAGE_TILING_OPTIMAL ? ResourceKind::Optimal : ResourceKind::Linear;
+
+	if (!Allocate(requirements, properties, AllocationStrategy::Buddy, kind, allocation))
+	{
+		return false;
+	}
+
+	if (vkBindImageMemory(m_device, image, allocation.memory, allocation.offset) != VK_SUCCESS)
+	{
+		LOG_ERROR("Unable to bind image memory");
+		Free(allocation);
+		return false;
+	}
+
+	return true;
+}
+
+bool MemoryAllocator::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, AllocationStrategy strategy, AllocatedBuffer& buffer)
+{
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	bufferInfo.usage = usage;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (vkCreateBuffer(m_device, &bufferInfo, nullptr, &buffer.buffer) != VK_SUCCESS)
+	{
+		LOG_ERROR("Unable to create buffer of size %llu", (unsigned long long)size);
+		return false;
+	}
+
+	if (!AllocateForBuffer(buffer.buffer, properties, strategy, buffer.allocation))
+	{
+		vkDestroyBuffer(m_device, buffer.buffer, nullptr);
+		buffer.buffer = VK_NULL_HANDLE;
+		return false;
+	}
+
+	buffer.size = size;
+	buffer.usage = usage;
+	buffer.properties = properties;
+	buffer.strategy = strategy;
+
+	return true;
+}
+
+void MemoryAllocator::DestroyBuffer(AllocatedBuffer& buffer)
+{
+	if (buffer.buffer != VK_NULL_HANDLE)
+	{
+		vkDestroyBuffer(m_device, buffer.buffer, nullptr);
+	}
+
+	Free(buffer.allocation);
+
+	buffer = AllocatedBuffer();
+}
+
+uint32_t MemoryAllocator::Defragment(VkCommandBuffer commandBuffer, const std::vector<AllocatedBuffer*>& buffers, std::vector<AllocatedBuffer>& retired)
+{
+	uint32_t moved = 0;
+
+	for (AllocatedBuffer* buffer : buffers)
+	{
+		MemoryBlock* source = buffer->allocation.block;
+
+		// Only buddy blocks that are mostly empty are worth evacuating, and the copy needs both transfer bits
+		if (source == nullptr || source->dedicated ||
+			buffer->strategy != AllocationStrategy::Buddy ||
+			(buffer->usage & (VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT)) != (VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT) ||
+			source->arena->GetUsed() * 2 > source->arena->GetSize())
+		{
+			continue;
+		}
+
+		VkBufferCreateInfo bufferInfo = {};
+		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferInfo.size = buffer->size;
+		bufferInfo.usage = buffer->usage;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		AllocatedBuffer target = *buffer;
+		target.allocation = Allocation();
+
+		if (vkCreateBuffer(m_device, &bufferInfo, nullptr, &target.buffer) != VK_SUCCESS)
+		{
+			continue;
+		}
+
+		VkMemoryRequirements requirements;
+		vkGetBufferMemoryRequirements(m_device, target.buffer, &requirements);
+
+		MemoryPool& pool = m_pools[source->poolIndex];
+
+		if (!AllocateFromPool(pool, requirements.size, requirements.alignment, source, false, target.allocation))
+		{
+			vkDestroyBuffer(m_device, target.buffer, nullptr);
+			continue;
+		}
+
+		vkBindBufferMemory(m_device, target.buffer, target.allocation.memory, target.allocation.offset);
+
+		VkBufferCopy region = {};
+		region.srcOffset = 0;
+		region.dstOffset = 0;
+		region.size = buffer->size;
+
+		vkCmdCopyBuffer(commandBuffer, buffer->buffer, target.buffer, 1, &region);
+
+		retired.push_back(*buffer);
+		*buffer = target;
+		moved++;
+	}
+
+	if (moved > 0)
+	{
+		// Later users of the moved buffers must see the copies
+		VkMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	return moved;
+}
+
+void MemoryAllocator::ResetLinear(uint32_t memoryType, ResourceKind kind)
+{
+	MemoryPool& pool = GetPool(memoryType, AllocationStrategy::Linear, kind);
+
+	for (auto& block : pool.blocks)
+	{
+		block->arena->Reset();
+		block->bytesRequested = 0;
+		block->resets++;
+	}
+}
+
+bool MemoryAllocator::FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, uint32_t& memoryType) const
+{
+	for (uint32_t i = 0; i < m_memoryProperties.memoryTypeCount; ++i)
+	{
+		if ((typeFilter & (1 << i)) && (m_memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+		{
+			memoryType = i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+MemoryStats MemoryAllocator::GetStats() const
+{
+	MemoryStats stats;
+
+	for (const auto& pool : m_pools)
+	{
+		for (const auto& block : pool.blocks)
+		{
+			AccumulateStats(*block, stats);
+		}
+	}
+
+	return stats;
+}
+
+MemoryStats MemoryAllocator::GetStats(uint32_t memoryType) const
+{
+	MemoryStats stats;
+
+	for (const auto& pool : m_pools)
+	{
+		if (pool.memoryType != memoryType)
+		{
+			continue;
+		}
+
+		for (const auto& block : pool.blocks)
+		{
+			AccumulateStats(*block, stats);
+		}
+	}
+
+	return stats;
+}
+
+void MemoryAllocator::LogStats() const
+{
+	MemoryStats stats = GetStats();
+
+	LOG_INFO("Device memory: %u blocks (%u/%u driver allocations), %u allocations, %llu requested / %llu used / %llu reserved bytes, fragmentation %.3f",
+		stats.blockCount, m_deviceAllocationCount, m_maxAllocationCount, stats.allocationCount,
+		(unsigned long long)stats.bytesRequested, (unsigned long long)stats.bytesUsed, (unsigned long long)stats.bytesReserved, stats.Fragmentation());
+}
+
+MemoryAllocator::MemoryPool& MemoryAllocator::GetPool(uint32_t memoryType, AllocationStrategy strategy, ResourceKind kind)
+{
+	// Without a granularity requirement linear and optimal resources can share blocks
+	if (m_bufferImageGranularity <= 1)
+	{
+		kind = ResourceKind::Linear;
+	}
+
+	for (auto& pool : m_pools)
+	{
+		if (pool.memoryType == memoryType && pool.strategy == strategy && pool.kind == kind)
+		{
+			return pool;
+		}
+	}
+
+	MemoryPool pool;
+	pool.memoryType = memoryType;
+	pool.strategy = strategy;
+	pool.kind = kind;
+
+	m_pools.push_back(std::move(pool));
+
+	return m_pools.back();
+}
+
+MemoryBlock* MemoryAllocator::CreateBlock(MemoryPool& pool, VkDeviceSize size, bool dedicated)
+{
+	if (m_deviceAllocationCount >= m_maxAllocationCount)
+	{
+		LOG_ERROR("Reached maxMemoryAllocationCount");
+		return nullptr;
+	}
+
+	VkMemoryAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = size;
+	allocInfo.memoryTypeIndex = pool.memoryType;
+
+	std::unique_ptr<MemoryBlock> block(new MemoryBlock());
+
+	if (vkAllocateMemory(m_device, &allocInfo, nullptr, &block->memory) != VK_SUCCESS)
+	{
+		LOG_ERROR("Unable to allocate a device memory block of %llu bytes", (unsigned long long)size);
+		return nullptr;
+	}
+
+	m_deviceAllocationCount++;
+
+	if (m_memoryProperties.memoryTypes[pool.memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+	{
+		if (vkMapMemory(m_device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped) != VK_SUCCESS)
+		{
+			block->mapped = nullptr;
+		}
+	}
+
+	block->dedicated = dedicated;
+	block->poolIndex = &pool - m_pools.data();
+
+	if (dedicated || pool.strategy == AllocationStrategy::Linear)
+	{
+		block->arena.reset(new LinearArena(size));
+	}
+	else
+	{
+		block->arena.reset(new BuddyArena(size, MIN_BUDDY_BLOCK_SIZE));
+	}
+
+	pool.blocks.push_back(std::move(block));
+
+	return pool.blocks.back().get();
+}
+
+void MemoryAllocator::DestroyBlock(MemoryBlock* block)
+{
+	if (block->mapped != nullptr)
+	{
+		vkUnmapMemory(m_device, block->memory);
+	}
+
+	vkFreeMemory(m_device, block->memory, nullptr);
+	m_deviceAllocationCount--;
+}
+
+bool MemoryAllocator::AllocateFromPool(MemoryPool& pool, VkDeviceSize size, VkDeviceSize alignment, const MemoryBlock* exclude, bool allowNewBlock, Allocation& allocation)
+{
+	// Fullest blocks first, keeps sparse blocks draining so they can be released
+	std::vector<MemoryBlock*> candidates;
+	for (auto& block : pool.blocks)
+	{
+		if (block.get() != exclude && !block->dedicated)
+		{
+			candidates.push_back(block.get());
+		}
+	}
+
+	std::sort(candidates.begin(), candidates.end(), [](const MemoryBlock* a, const MemoryBlock* b)
+	{
+		return a->arena->GetUsed() > b->arena->GetUsed();
+	});
+
+	MemoryBlock* target = nullptr;
+	VkDeviceSize offset = 0;
+
+	for (MemoryBlock* block : candidates)
+	{
+		if (block->arena->Allocate(size, alignment, offset))
+		{
+			target = block;
+			break;
+		}
+	}
+
+	if (target == nullptr)
+	{
+		if (!allowNewBlock)
+		{
+			return false;
+		}
+
+		target = CreateBlock(pool, m_blockSize, false);
+		if (target == nullptr || !target->arena->Allocate(size, alignment, offset))
+		{
+			return false;
+		}
+	}
+
+	target->bytesRequested += size;
+
+	allocation.memory = target->memory;
+	allocation.offset = offset;
+	allocation.size = size;
+	allocation.mapped = target->mapped != nullptr ? (char*)target->mapped + offset : nullptr;
+	allocation.memoryType = pool.memoryType;
+	allocation.block = target;
+	allocation.blockResets = target->resets;
+
+	return true;
+}
+
+void MemoryAllocator::AccumulateStats(const MemoryBlock& block, MemoryStats& stats) const
+{
+	stats.blockCount++;
+	stats.allocationCount += block.arena->GetAllocationCount();
+	stats.bytesReserved += block.arena->GetSize();
+	stats.bytesUsed += block.arena->GetUsed();
+	stats.bytesRequested += block.bytesRequested;
+	stats.largestFreeRange = std::max(stats.largestFreeRange, block.arena->GetLargestFree());
+
+	VkDeviceSize freeBytes = block.arena->GetSize() - block.arena->GetUsed();
+	stats.scatteredFreeBytes += freeBytes - std::min(freeBytes, block.arena->GetLargestFree());
+}
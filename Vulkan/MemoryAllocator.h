@@ -0,0 +1,133 @@
+#pragma once
+
+#include "MemoryArena.h"
+
+#include <memory>
+#include <string>
+
+const VkDeviceSize DEFAULT_MEMORY_BLOCK_SIZE = 64 * 1024 * 1024;
+const VkDeviceSize MIN_BUDDY_BLOCK_SIZE = 256;
+
+enum class AllocationStrategy
+{
+	Buddy,	// General purpose, long lived resources
+	Linear	// Ring for transient and streaming data
+};
+
+// bufferImageGranularity only matters between linear and optimal resources, so they get separate pools
+enum class ResourceKind
+{
+	Linear,	// Buffers and linear tiled images
+	Optimal	// Optimal tiled images
+};
+
+struct MemoryBlock
+{
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	void* mapped = nullptr;
+	bool dedicated = false;
+	VkDeviceSize bytesRequested = 0;
+	std::unique_ptr<MemoryArena> arena;
+	size_t poolIndex = 0;
+	uint32_t resets = 0; // Linear blocks only, allocations from before a reset are stale
+};
+
+struct Allocation
+{
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+	void* mapped = nullptr; // Host visible memory is persistently mapped, this already includes the offset
+	uint32_t memoryType = 0;
+
+	MemoryBlock* block = nullptr;
+	uint32_t blockResets = 0; // The block's reset count when this was allocated
+};
+
+struct AllocatedBuffer
+{
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkDeviceSize size = 0;
+	VkBufferUsageFlags usage = 0;
+	VkMemoryPropertyFlags properties = 0;
+	AllocationStrategy strategy = AllocationStrategy::Buddy;
+	Allocation allocation;
+};
+
+struct MemoryStats
+{
+	uint32_t blockCount = 0;
+	uint32_t allocationCount = 0;
+	VkDeviceSize bytesReserved = 0;	// Device memory actually allocated from the driver
+	VkDeviceSize bytesUsed = 0;		// Sub-allocated, including buddy rounding
+	VkDeviceSize bytesRequested = 0;	// What callers asked for
+	VkDeviceSize largestFreeRange = 0;
+	VkDeviceSize scatteredFreeBytes = 0;	// Free bytes outside their block's largest free range
+
+	// 0 when every block's free space is one contiguous range, approaching 1 as it gets scattered. Per
+	// block, free space split across blocks isn't fragmentation.
+	float Fragmentation() const
+	{
+		VkDeviceSize freeBytes = bytesReserved - bytesUsed;
+		return freeBytes > 0 ? (float)scatteredFreeBytes / (float)freeBytes : 0.0f;
+	}
+};
+
+class MemoryAllocator
+{
+public:
+	bool Initialize(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize blockSize = DEFAULT_MEMORY_BLOCK_SIZE);
+	void Shutdown();
+
+	bool Allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, AllocationStrategy strategy, ResourceKind kind, Allocation& allocation);
+	void Free(Allocation& allocation);
+
+	bool AllocateForBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties, AllocationStrategy strategy, Allocation& allocation);
+	bool AllocateForImage(VkImage image, VkImageTiling tiling, VkMemoryPropertyFlags properties, Allocation& allocation);
+
+	bool CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, AllocationStrategy strategy, AllocatedBuffer& buffer);
+	void DestroyBuffer(AllocatedBuffer& buffer);
+
+	// Moves buddy allocated buffers out of sparsely used blocks into fuller ones. Copies are recorded into
+	// commandBuffer and the moved entries are updated in place. The old buffers are appended to retired and
+	// must be destroyed with DestroyBuffer once commandBuffer has finished executing.
+	uint32_t Defragment(VkCommandBuffer commandBuffer, const std::vector<AllocatedBuffer*>& buffers, std::vector<AllocatedBuffer>& retired);
+
+	// Drops every allocation in a linear pool at once, e.g. per frame scratch memory. Freeing one of them
+	// afterwards does nothing.
+	void ResetLinear(uint32_t memoryType, ResourceKind kind);
+
+	bool FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, uint32_t& memoryType) const;
+
+	MemoryStats GetStats() const;
+	MemoryStats GetStats(uint32_t memoryType) const;
+	void LogStats() const;
+
+	VkDeviceSize GetBufferImageGranularity() const { return m_bufferImageGranularity; }
+
+private:
+	struct MemoryPool
+	{
+		uint32_t memoryType;
+		AllocationStrategy strategy;
+		ResourceKind kind;
+		std::vector<std::unique_ptr<MemoryBlock>> blocks;
+	};
+
+	MemoryPool& GetPool(uint32_t memoryType, AllocationStrategy strategy, ResourceKind kind);
+	MemoryBlock* CreateBlock(MemoryPool& pool, VkDeviceSize size, bool dedicated);
+	void DestroyBlock(MemoryBlock* block);
+	bool AllocateFromPool(MemoryPool& pool, VkDeviceSize size, VkDeviceSize alignment, const MemoryBlock* exclude, bool allowNewBlock, Allocation& allocation);
+
+	void AccumulateStats(const MemoryBlock& block, MemoryStats& stats) const;
+
+private:
+	VkDevice m_device = VK_NULL_HANDLE;
+	VkPhysicalDeviceMemoryProperties m_memoryProperties;
+	VkDeviceSize m_bufferImageGranularity = 1;
+	VkDeviceSize m_blockSize = DEFAULT_MEMORY_BLOCK_SIZE;
+	uint32_t m_maxAllocationCount = 0;
+	uint32_t m_deviceAllocationCount = 0;
+
+	std::vector<MemoryPool> m_pools;
+};
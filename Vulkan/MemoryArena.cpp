@@ -0,0 +1,221 @@
+#include "MemoryArena.h"
+
+#include <algorithm>
+
+BuddyArena::BuddyArena(VkDeviceSize size, VkDeviceSize minBlockSize)
+	: m_minBlockSize(minBlockSize)
+{
+	m_size = size;
+
+	m_maxOrder = 0;
+	while (BlockSize(m_maxOrder + 1) >= m_minBlockSize)
+	{
+		m_maxOrder++;
+	}
+
+	m_freeLists.resize(m_maxOrder + 1);
+	Reset();
+}
+
+bool BuddyArena::Allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset)
+{
+	VkDeviceSize needed = std::max(std::max(size, alignment), m_minBlockSize);
+	if (needed > m_size)
+	{
+		return false;
+	}
+
+	// Smallest block (largest order) that still fits the request
+	uint32_t order = m_maxOrder;
+	while (BlockSize(order) < needed)
+	{
+		order--;
+	}
+
+	uint32_t found = order;
+	while (m_freeLists[found].empty())
+	{
+		if (found == 0)
+		{
+			return false;
+		}
+		found--;
+	}
+
+	VkDeviceSize blockOffset = *m_freeLists[found].begin();
+	m_freeLists[found].erase(m_freeLists[found].begin());
+
+	// Split down, returning the upper halves to the free lists
+	while (found < order)
+	{
+		found++;
+		m_freeLists[found].insert(blockOffset + BlockSize(found));
+	}
+
+	m_allocated[blockOffset] = order;
+	m_used += BlockSize(order);
+
+	offset = blockOffset;
+	return true;
+}
+
+void BuddyArena::Free(VkDeviceSize offset)
+{
+	auto it = m_allocated.find(offset);
+	if (it == m_allocated.end())
+	{
+		return;
+	}
+
+	uint32_t order = it->second;
+	m_allocated.erase(it);
+	m_used -= BlockSize(order);
+
+	while (order > 0)
+	{
+		VkDeviceSize buddy = offset ^ BlockSize(order);
+
+		auto buddyIt = m_freeLists[order].find(buddy);
+		if (buddyIt == m_freeLists[order].end())
+		{
+			break;
+		}
+
+		m_freeLists[order].erase(buddyIt);
+		offset = std::min(offset, buddy);
+		order--;
+	}
+
+	m_freeLists[order].insert(offset);
+}
+
+void BuddyArena::Reset()
+{
+	for (auto& freeList : m_freeLists)
+	{
+		freeList.clear();
+	}
+
+	m_allocated.clear();
+	m_used = 0;
+
+	m_freeLists[0].insert(0);
+}
+
+VkDeviceSize BuddyArena::GetLargestFree() const
+{
+	for (uint32_t order = 0; order <= m_maxOrder; ++order)
+	{
+		if (!m_freeLists[order].empty())
+		{
+			return BlockSize(order);
+		}
+	}
+
+	return 0;
+}
+
+LinearArena::LinearArena(VkDeviceSize size)
+{
+	m_size = size;
+}
+
+bool LinearArena::Allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset)
+{
+	if (size == 0 || size > m_size)
+	{
+		return false;
+	}
+
+	VkDeviceSize candidate;
+
+	if (m_ranges.empty())
+	{
+		candidate = 0;
+	}
+	else
+	{
+		const Range& oldest = m_ranges.front();
+		const Range& newest = m_ranges.back();
+
+		if (newest.offset >= oldest.offset)
+		{
+			// Not wrapped, free space is after the newest and before the oldest
+			candidate = AlignUp(newest.end, alignment);
+			if (candidate + size > m_size)
+			{
+				if (size > oldest.offset)
+				{
+					return false;
+				}
+				candidate = 0;
+			}
+		}
+		else
+		{
+			// Wrapped, the only gap is between the newest and the oldest
+			candidate = AlignUp(newest.end, alignment);
+			if (candidate + size > oldest.offset)
+			{
+				return false;
+			}
+		}
+	}
+
+	Range range;
+	range.offset = candidate;
+	range.end = candidate + size;
+	range.freed = false;
+	m_ranges.push_back(range);
+
+	m_used += size;
+	m_liveCount++;
+
+	offset = candidate;
+	return true;
+}
+
+void LinearArena::Free(VkDeviceSize offset)
+{
+	for (auto& range : m_ranges)
+	{
+		if (range.offset == offset && !range.freed)
+		{
+			range.freed = true;
+			m_used -= range.end - range.offset;
+			m_liveCount--;
+			break;
+		}
+	}
+
+	// Out of order frees are held until everything older has been released
+	while (!m_ranges.empty() && m_ranges.front().freed)
+	{
+		m_ranges.pop_front();
+	}
+}
+
+void LinearArena::Reset()
+{
+	m_ranges.clear();
+	m_used = 0;
+	m_liveCount = 0;
+}
+
+VkDeviceSize LinearArena::GetLargestFree() const
+{
+	if (m_ranges.empty())
+	{
+		return m_size;
+	}
+
+	const Range& oldest = m_ranges.front();
+	const Range& newest = m_ranges.back();
+
+	if (newest.offset >= oldest.offset)
+	{
+		return std::max(m_size - newest.end, oldest.offset);
+	}
+
+	return oldest.offset - newest.end;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <deque>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+// Offset bookkeeping for one VkDeviceMemory block. Arenas never touch the device,
+// the MemoryAllocator owns the memory and asks an arena where things go.
+class MemoryArena
+{
+public:
+	virtual ~MemoryArena() {}
+
+	virtual bool Allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset) = 0;
+	virtual void Free(VkDeviceSize offset) = 0;
+	virtual void Reset() = 0;
+
+	virtual VkDeviceSize GetUsed() const = 0;
+	virtual VkDeviceSize GetLargestFree() const = 0;
+	virtual uint32_t GetAllocationCount() const = 0;
+
+	VkDeviceSize GetSize() const { return m_size; }
+	bool IsEmpty() const { return GetAllocationCount() == 0; }
+
+protected:
+	VkDeviceSize m_size = 0;
+};
+
+// Power of two buddy allocator. Blocks are naturally aligned to their size, so any alignment up to
+// the block size comes for free and freed neighbours merge back together.
+class BuddyArena : public MemoryArena
+{
+public:
+	BuddyArena(VkDeviceSize size, VkDeviceSize minBlockSize);
+
+	bool Allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset) override;
+	void Free(VkDeviceSize offset) override;
+	void Reset() override;
+
+	VkDeviceSize GetUsed() const override { return m_used; }
+	VkDeviceSize GetLargestFree() const override;
+	uint32_t GetAllocationCount() const override { return (uint32_t)m_allocated.size(); }
+
+private:
+	VkDeviceSize BlockSize(uint32_t order) const { return m_size >> order; }
+
+private:
+	VkDeviceSize m_minBlockSize;
+	uint32_t m_maxOrder;
+	VkDeviceSize m_used = 0;
+
+	std::vector<std::set<VkDeviceSize>> m_freeLists; // Indexed by order, order 0 is the whole arena
+	std::unordered_map<VkDeviceSize, uint32_t> m_allocated; // Offset to order
+};
+
+// Ring allocator for transient and streaming data. Allocation is a pointer bump, frees are expected
+// roughly in allocation order and space is reclaimed from the oldest live allocation.
+class LinearArena : public MemoryArena
+{
+public:
+	explicit LinearArena(VkDeviceSize size);
+
+	bool Allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset) override;
+	void Free(VkDeviceSize offset) override;
+	void Reset() override;
+
+	VkDeviceSize GetUsed() const override { return m_used; }
+	VkDeviceSize GetLargestFree() const override;
+	uint32_t GetAllocationCount() const override { return m_liveCount; }
+
+private:
+	struct Range
+	{
+		VkDeviceSize offset;
+		VkDeviceSize end;
+		bool freed;
+	};
+
+	VkDeviceSize m_used = 0;
+	uint32_t m_liveCount = 0;
+	std::deque<Range> m_ranges; // Oldest first
+};
+
+inline VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+	return alignment > 1 ? (value + alignment - 1) & ~(alignment - 1) : value;
+}
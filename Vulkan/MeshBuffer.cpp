@@ -0,0 +1,105 @@
+#include "MeshBuffer.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+bool MeshBuffer::Initialize(MemoryAllocator& allocator, UploadManager& uploads, uint32_t vertexCapacity, uint32_t indexCapacity)
+{
+	m_allocator = &allocator;
+	m_uploads = &uploads;
+	m_vertexCapacity = vertexCapacity;
+	m_indexCapacity = indexCapacity;
+	m_vertexCount = 0;
+	m_indexCount = 0;
+	m_lastTicket = 0;
+
+	if (!m_allocator->CreateBuffer(vertexCapacity * sizeof(Vertex), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, AllocationStrategy::Buddy, m_vertexBuffer) ||
+		!m_allocator->CreateBuffer(indexCapacity * sizeof(uint32_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, AllocationStrategy::Buddy, m_indexBuffer))
+	{
+		LOG_ERROR("Unable to create the mesh buffers");
+		return false;
+	}
+
+	return AddBuiltinMeshes();
+}
+
+void MeshBuffer::Shutdown()
+{
+	if (m_allocator == nullptr)
+	{
+		return;
+	}
+
+	m_allocator->DestroyBuffer(m_vertexBuffer);
+	m_allocator->DestroyBuffer(m_indexBuffer);
+
+	m_allocator = nullptr;
+}
+
+bool MeshBuffer::AddMesh(const Vertex* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount, Mesh& mesh)
+{
+	if (m_vertexCount + vertexCount > m_vertexCapacity || m_indexCount + indexCount > m_indexCapacity)
+	{
+		LOG_ERROR("Mesh buffers are full");
+		return false;
+	}
+
+	UploadTicket vertexTicket = m_uploads->UploadBuffer(m_vertexBuffer.buffer, m_vertexCount * sizeof(Vertex), vertices, vertexCount * sizeof(Vertex),
+		VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+	UploadTicket indexTicket = m_uploads->UploadBuffer(m_indexBuffer.buffer, m_indexCount * sizeof(uint32_t), indices, indexCount * sizeof(uint32_t),
+		VK_ACCESS_INDEX_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+
+	if (vertexTicket == 0 || indexTicket == 0)
+	{
+		return false;
+	}
+
+	// Indices stay relative to the mesh, vertexOffset moves them to where its vertices landed
+	mesh.indexCount = indexCount;
+	mesh.firstIndex = m_indexCount;
+	mesh.vertexOffset = (int32_t)m_vertexCount;
+	mesh.radius = 0.0f;
+
+	for (uint32_t i = 0; i < vertexCount; ++i)
+	{
+		const float* position = vertices[i].position;
+		mesh.radius = std::max(mesh.radius, sqrtf(position[0] * position[0] + position[1] * position[1]));
+	}
+
+	m_vertexCount += vertexCount;
+	m_indexCount += indexCount;
+	m_lastTicket = indexTicket;
+
+	return true;
+}
+
+void MeshBuffer::Bind(VkCommandBuffer commandBuffer) const
+{
+	VkDeviceSize offset = 0;
+	vkCmdBindVertexBuffers(commandBuffer, VERTEX_BINDING, 1, &m_vertexBuffer.buffer, &offset);
+	vkCmdBindIndexBuffer(commandBuffer, m_indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+}
+
+bool MeshBuffer::DescribeVertexInput(PipelineKey& key)
+{
+	return key.AddVertexBinding(VERTEX_BINDING, sizeof(Vertex), VK_VERTEX_INPUT_RATE_VERTEX) &&
+		key.AddVertexBinding(INSTANCE_BINDING, sizeof(InstanceData), VK_VERTEX_INPUT_RATE_INSTANCE) &&
+		key.AddVertexAttribute(0, VERTEX_BINDING, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, position)) &&
+		key.AddVertexAttribute(1, INSTANCE_BINDING, VK_FORMAT_R32G32B32_SFLOAT, offsetof(InstanceData, offset)) &&
+		key.AddVertexAttribute(2, INSTANCE_BINDING, VK_FORMAT_R8G8B8A8_UNORM, offsetof(InstanceData, color));
+}
+
+bool MeshBuffer::AddBuiltinMeshes()
+{
+	// Clockwise in framebuffer space, which is what the default pipeline culls against
+	const Vertex triangleVertices[] = { { 0.0f, -0.5f }, { 0.5f, 0.5f }, { -0.5f, 0.5f } };
+	const uint32_t triangleIndices[] = { 0, 1, 2 };
+
+	const Vertex quadVertices[] = { { -0.5f, -0.5f }, { 0.5f, -0.5f }, { 0.5f, 0.5f }, { -0.5f, 0.5f } };
+	const uint32_t quadIndices[] = { 0, 1, 2, 2, 3, 0 };
+
+	return AddMesh(triangleVertices, 3, triangleIndices, 3, m_builtinMeshes[(uint32_t)BuiltinMesh::Triangle]) &&
+		AddMesh(quadVertices, 4, quadIndices, 6, m_builtinMeshes[(uint32_t)BuiltinMesh::Quad]);
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "MemoryAllocator.h"
+#include "PipelineKey.h"
+#include "UploadManager.h"
+
+#include <vulkan/vulkan.h>
+
+const uint32_t DEFAULT_MESH_VERTEX_CAPACITY = 64 * 1024;
+const uint32_t DEFAULT_MESH_INDEX_CAPACITY = 256 * 1024;
+
+// Vertex buffer binding 0 advances per vertex, binding 1 per instance
+const uint32_t VERTEX_BINDING = 0;
+const uint32_t INSTANCE_BINDING = 1;
+
+struct Vertex
+{
+	float position[2];
+};
+
+// 16 bytes so a million instances still fit in the staging ring in one go
+struct InstanceData
+{
+	float offset[2];
+	float scale;
+	uint32_t color; // RGBA8, red in the lowest byte
+};
+
+// A range of the shared vertex and index buffers, drawn with vkCmdDrawIndexed
+struct Mesh
+{
+	uint32_t indexCount = 0;
+	uint32_t firstIndex = 0;
+	int32_t vertexOffset = 0;
+	float radius = 0.0f; // Bounding circle around the mesh origin, for culling
+};
+
+enum class BuiltinMesh
+{
+	Triangle,
+	Quad,
+	Count
+};
+
+// Every mesh lives in one device local vertex buffer and one index buffer, so a frame binds geometry once
+// no matter how many meshes it draws. Meshes are appended through the upload manager and never freed.
+class MeshBuffer
+{
+public:
+	bool Initialize(MemoryAllocator& allocator, UploadManager& uploads, uint32_t vertexCapacity = DEFAULT_MESH_VERTEX_CAPACITY, uint32_t indexCapacity = DEFAULT_MESH_INDEX_CAPACITY);
+	void Shutdown();
+
+	bool AddMesh(const Vertex* vertices, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount, Mesh& mesh);
+
+	const Mesh& GetBuiltinMesh(BuiltinMesh mesh) const { return m_builtinMeshes[(uint32_t)mesh]; }
+
+	// Binds the vertex and index buffers, instances go in INSTANCE_BINDING
+	void Bind(VkCommandBuffer commandBuffer) const;
+
+	// The newest upload, everything added so far is on the GPU once it completes
+	UploadTicket GetLastTicket() const { return m_lastTicket; }
+
+	// Vertex input for Vertex at VERTEX_BINDING and InstanceData at INSTANCE_BINDING
+	static bool DescribeVertexInput(PipelineKey& key);
+
+private:
+	bool AddBuiltinMeshes();
+
+private:
+	MemoryAllocator* m_allocator = nullptr;
+	UploadManager* m_uploads = nullptr;
+
+	AllocatedBuffer m_vertexBuffer;
+	AllocatedBuffer m_indexBuffer;
+	uint32_t m_vertexCapacity = 0;
+	uint32_t m_indexCapacity = 0;
+	uint32_t m_vertexCount = 0;
+	uint32_t m_indexCount = 0;
+	UploadTicket m_lastTicket = 0;
+
+	Mesh m_builtinMeshes[(uint32_t)BuiltinMesh::Count];
+};
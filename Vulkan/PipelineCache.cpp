@@ -0,0 +1,382 @@
+#include "PipelineCache.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+static const uint32_t PIPELINE_CACHE_MAGIC = 0x43504B56; // "VKPC"
+static const uint32_t PIPELINE_CACHE_FILE_VERSION = 1;
+
+// VK_EXT_pipeline_creation_feedback, our SDK's headers predate it
+static const VkStructureType STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO = (VkStructureType)1000192000;
+static const uint32_t PIPELINE_CREATION_FEEDBACK_VALID_BIT = 0x1;
+static const uint32_t PIPELINE_CREATION_FEEDBACK_CACHE_HIT_BIT = 0x2;
+
+struct PipelineCreationFeedback
+{
+	uint32_t flags;
+	uint64_t duration;
+};
+
+struct PipelineCreationFeedbackCreateInfo
+{
+	VkStructureType sType;
+	const void* pNext;
+	PipelineCreationFeedback* pPipelineCreationFeedback;
+	uint32_t pipelineStageCreationFeedbackCount;
+	PipelineCreationFeedback* pPipelineStageCreationFeedbacks;
+};
+
+bool PipelineCache::Initialize(VkPhysicalDevice physicalDevice, VkDevice device, const std::string& filename, bool creationFeedback)
+{
+	m_device = device;
+	m_filename = filename;
+	m_creationFeedback = creationFeedback;
+	m_stats = PipelineCacheStats();
+
+	vkGetPhysicalDeviceProperties(physicalDevice, &m_deviceProperties);
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	std::vector<char> blob;
+	if (!m_filename.empty() && LoadFile(blob))
+	{
+		m_stats.loadedFromDisk = true;
+	}
+
+	VkPipelineCacheCreateInfo createInfo = {};
+	createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	createInfo.initialDataSize = blob.size();
+	createInfo.pInitialData = blob.empty() ? nullptr : blob.data();
+
+	VkResult result = vkCreatePipelineCache(m_device, &createInfo, nullptr, &m_cache);
+	if (result != VK_SUCCESS && !blob.empty())
+	{
+		// The driver gets the final say on the blob, fall back to an empty cache rather than failing
+		LOG_ERROR("Driver rejected the pipeline cache from %s, starting cold", m_filename.c_str());
+		m_stats.loadedFromDisk = false;
+
+		createInfo.initialDataSize = 0;
+		createInfo.pInitialData = nullptr;
+		result = vkCreatePipelineCache(m_device, &createInfo, nullptr, &m_cache);
+	}
+
+	if (result != VK_SUCCESS)
+	{
+		LOG_ERROR("Unable to create the pipeline cache");
+		return false;
+	}
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	m_stats.loadMs = elapsed.count();
+
+	// What the driver kept of the file, compared with the size at save this is how much the run added
+	m_stats.loadedBytes = GetDataSize();
+
+	return true;
+}
+
+void PipelineCache::Shutdown()
+{
+	if (m_cache == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	Save();
+	LogStats();
+
+	vkDestroyPipelineCache(m_device, m_cache, nullptr);
+	m_cache = VK_NULL_HANDLE;
+}
+
+bool PipelineCache::Save()
+{
+	if (m_filename.empty())
+	{
+		return false;
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	size_t dataSize = GetDataSize();
+	if (dataSize == 0)
+	{
+		return false;
+	}
+
+	std::vector<char> file(sizeof(PipelineCacheFileHeader) + dataSize);
+	char* data = file.data() + sizeof(PipelineCacheFileHeader);
+
+	if (vkGetPipelineCacheData(m_device, m_cache, &dataSize, data) != VK_SUCCESS)
+	{
+		LOG_ERROR("Unable to read back the pipeline cache data");
+		return false;
+	}
+	file.resize(sizeof(PipelineCacheFileHeader) + dataSize);
+
+	PipelineCacheFileHeader header = {};
+	header.magic = PIPELINE_CACHE_MAGIC;
+	header.fileVersion = PIPELINE_CACHE_FILE_VERSION;
+	header.vendorID = m_deviceProperties.vendorID;
+	header.deviceID = m_deviceProperties.deviceID;
+	header.driverVersion = m_deviceProperties.driverVersion;
+	memcpy(header.pipelineCacheUUID, m_deviceProperties.pipelineCacheUUID, VK_UUID_SIZE);
+	header.dataSize = dataSize;
+	header.checksum = Checksum(file.data() + sizeof(PipelineCacheFileHeader), dataSize);
+
+	memcpy(file.data(), &header, sizeof(header));
+
+	if (!WriteFileAtomic(file))
+	{
+		return false;
+	}
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	m_stats.saveMs = elapsed.count();
+	m_stats.savedBytes = dataSize;
+
+	return true;
+}
+
+VkResult PipelineCache::CreateGraphicsPipeline(const VkGraphicsPipelineCreateInfo& createInfo, VkPipeline* pipeline)
+{
+	return CreateTracked(createInfo.stageCount, createInfo.pNext, [&](const void* pNext)
+	{
+		VkGraphicsPipelineCreateInfo info = createInfo;
+		info.pNext = pNext;
+		return vkCreateGraphicsPipelines(m_device, m_cache, 1, &info, nullptr, pipeline);
+	});
+}
+
+VkResult PipelineCache::CreateComputePipeline(const VkComputePipelineCreateInfo& createInfo, VkPipeline* pipeline)
+{
+	return CreateTracked(1, createInfo.pNext, [&](const void* pNext)
+	{
+		VkComputePipelineCreateInfo info = createInfo;
+		info.pNext = pNext;
+		return vkCreateComputePipelines(m_device, m_cache, 1, &info, nullptr, pipeline);
+	});
+}
+
+VkResult PipelineCache::CreateTracked(uint32_t stageCount, const void* next, const std::function<VkResult(const void* pNext)>& create)
+{
+	// The extension wants feedback for every stage, we only read the pipeline's
+	PipelineCreationFeedback pipelineFeedback = {};
+	std::vector<PipelineCreationFeedback> stageFeedback(stageCount);
+
+	PipelineCreationFeedbackCreateInfo feedbackInfo = {};
+	feedbackInfo.sType = STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO;
+	feedbackInfo.pNext = next;
+	feedbackInfo.pPipelineCreationFeedback = &pipelineFeedback;
+	feedbackInfo.pipelineStageCreationFeedbackCount = stageCount;
+	feedbackInfo.pPipelineStageCreationFeedbacks = stageFeedback.data();
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	VkResult result = create(m_creationFeedback ? &feedbackInfo : next);
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+	if (result != VK_SUCCESS)
+	{
+		return result;
+	}
+
+	std::lock_guard<std::mutex> lock(m_statsMutex);
+	m_stats.pipelines++;
+	m_stats.totalCompileMs += elapsed.count();
+	m_stats.maxCompileMs = std::max(m_stats.maxCompileMs, elapsed.count());
+
+	// Drivers may leave the feedback invalid, those pipelines count as neither
+	if (pipelineFeedback.flags & PIPELINE_CREATION_FEEDBACK_VALID_BIT)
+	{
+		if (pipelineFeedback.flags & PIPELINE_CREATION_FEEDBACK_CACHE_HIT_BIT)
+		{
+			m_stats.hits++;
+		}
+		else
+		{
+			m_stats.misses++;
+		}
+	}
+
+	return result;
+}
+
+void PipelineCache::LogStats() const
+{
+	double averageMs = m_stats.pipelines > 0 ? m_stats.totalCompileMs / m_stats.pipelines : 0.0;
+
+	LOG_INFO("Pipeline cache: %s, %llu bytes after loading in %.3fms, %llu bytes saved in %.3fms",
+		m_stats.loadedFromDisk ? "warm" : "cold", (unsigned long long)m_stats.loadedBytes, m_stats.loadMs, (unsigned long long)m_stats.savedBytes, m_stats.saveMs);
+	LOG_INFO("Pipeline cache: %u pipelines, compile %.3fms total, %.3fms average, %.3fms slowest", m_stats.pipelines, m_stats.totalCompileMs, averageMs, m_stats.maxCompileMs);
+
+	if (m_creationFeedback)
+	{
+		LOG_INFO("Pipeline cache: hits %u misses %u", m_stats.hits, m_stats.misses);
+	}
+}
+
+bool PipelineCache::LoadFile(std::vector<char>& blob)
+{
+	std::ifstream file(m_filename, std::ios::ate | std::ios::binary);
+
+	if (!file.is_open())
+	{
+		LOG_INFO("No pipeline cache at %s, starting cold", m_filename.c_str());
+		return false;
+	}
+
+	size_t fileSize = (size_t)file.tellg();
+	std::vector<char> contents(fileSize);
+
+	file.seekg(0);
+	file.read(contents.data(), fileSize);
+	file.close();
+
+	if (!ValidateBlob(contents, blob))
+	{
+		LOG_INFO("Discarding stale pipeline cache %s", m_filename.c_str());
+		blob.clear();
+		return false;
+	}
+
+	return true;
+}
+
+bool PipelineCache::ValidateBlob(const std::vector<char>& file, std::vector<char>& blob)
+{
+	if (file.size() < sizeof(PipelineCacheFileHeader))
+	{
+		return false;
+	}
+
+	PipelineCacheFileHeader header;
+	memcpy(&header, file.data(), sizeof(header));
+
+	if (header.magic != PIPELINE_CACHE_MAGIC || header.fileVersion != PIPELINE_CACHE_FILE_VERSION)
+	{
+		return false;
+	}
+
+	// A cache built by another GPU or driver version is useless at best
+	if (header.vendorID != m_deviceProperties.vendorID ||
+		header.deviceID != m_deviceProperties.deviceID ||
+		header.driverVersion != m_deviceProperties.driverVersion ||
+		memcmp(header.pipelineCacheUUID, m_deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+	{
+		return false;
+	}
+
+	const char* data = file.data() + sizeof(PipelineCacheFileHeader);
+	size_t dataSize = file.size() - sizeof(PipelineCacheFileHeader);
+
+	if (header.dataSize != dataSize || header.checksum != Checksum(data, dataSize))
+	{
+		return false;
+	}
+
+	// Check the driver's own header too (VkPipelineCacheHeaderVersionOne layout)
+	const size_t driverHeaderSize = 16 + VK_UUID_SIZE;
+	if (dataSize < driverHeaderSize)
+	{
+		return false;
+	}
+
+	uint32_t headerLength;
+	uint32_t headerVersion;
+	uint32_t vendorID;
+	uint32_t deviceID;
+	memcpy(&headerLength, data, 4);
+	memcpy(&headerVersion, data + 4, 4);
+	memcpy(&vendorID, data + 8, 4);
+	memcpy(&deviceID, data + 12, 4);
+
+	if (headerLength < driverHeaderSize ||
+		headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+		vendorID != m_deviceProperties.vendorID ||
+		deviceID != m_deviceProperties.deviceID ||
+		memcmp(data + 16, m_deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+	{
+		return false;
+	}
+
+	blob.assign(data, data + dataSize);
+
+	return true;
+}
+
+bool PipelineCache::WriteFileAtomic(const std::vector<char>& file)
+{
+	// Write next to the real file then swap it in, a crash mid write must never leave a torn cache behind
+	std::string tempFilename = m_filename + ".tmp";
+
+	{
+		std::ofstream out(tempFilename, std::ios::binary | std::ios::trunc);
+		if (!out.is_open())
+		{
+			LOG_ERROR("Unable to open %s for writing", tempFilename.c_str());
+			return false;
+		}
+
+		out.write(file.data(), file.size());
+		out.flush();
+
+		if (!out.good())
+		{
+			LOG_ERROR("Unable to write the pipeline cache to %s", tempFilename.c_str());
+			out.close();
+			std::remove(tempFilename.c_str());
+			return false;
+		}
+	}
+
+#ifdef _WIN32
+	BOOL moved = MoveFileExA(tempFilename.c_str(), m_filename.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+	bool moved = std::rename(tempFilename.c_str(), m_filename.c_str()) == 0;
+#endif
+
+	if (!moved)
+	{
+		LOG_ERROR("Unable to replace the pipeline cache at %s", m_filename.c_str());
+		std::remove(tempFilename.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+size_t PipelineCache::GetDataSize() const
+{
+	size_t dataSize = 0;
+
+	if (vkGetPipelineCacheData(m_device, m_cache, &dataSize, nullptr) != VK_SUCCESS)
+	{
+		return 0;
+	}
+
+	return dataSize;
+}
+
+uint64_t PipelineCache::Checksum(const char* data, size_t size)
+{
+	// FNV-1a, only has to catch truncated or corrupted files
+	uint64_t hash = 14695981039346656037ull;
+
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= (uint8_t)data[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Optional, tells us whether the cache had each pipeline. Without it there's only the compile times.
+const char* const PIPELINE_CREATION_FEEDBACK_EXTENSION = "VK_EXT_pipeline_creation_feedback";
+
+// Written in front of the driver's blob so we can reject caches from another device or driver
+// before handing them to vkCreatePipelineCache
+struct PipelineCacheFileHeader
+{
+	uint32_t magic;
+	uint32_t fileVersion;
+	uint32_t vendorID;
+	uint32_t deviceID;
+	uint32_t driverVersion;
+	uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+	uint64_t dataSize;
+	uint64_t checksum;
+};
+
+struct PipelineCacheStats
+{
+	bool loadedFromDisk = false;
+	size_t loadedBytes = 0;	// Cache data once the driver has taken the file
+	size_t savedBytes = 0;
+	uint32_t pipelines = 0;
+	uint32_t hits = 0;		// Only counted with creation feedback
+	uint32_t misses = 0;
+	double totalCompileMs = 0.0;
+	double maxCompileMs = 0.0;
+	double loadMs = 0.0;
+	double saveMs = 0.0;
+};
+
+class PipelineCache
+{
+public:
+	// An empty filename keeps the cache in memory only. creationFeedback is whether the device was created
+	// with PIPELINE_CREATION_FEEDBACK_EXTENSION.
+	bool Initialize(VkPhysicalDevice physicalDevice, VkDevice device, const std::string& filename, bool creationFeedback);
+	void Shutdown();
+
+	bool Save();
+
+	// Creates the pipeline through the cache and records how long it took and, with creation feedback,
+	// whether the cache already had it. Safe to call from several threads.
+	VkResult CreateGraphicsPipeline(const VkGraphicsPipelineCreateInfo& createInfo, VkPipeline* pipeline);
+	VkResult CreateComputePipeline(const VkComputePipelineCreateInfo& createInfo, VkPipeline* pipeline);
+
+	VkPipelineCache GetCache() const { return m_cache; }
+	const PipelineCacheStats& GetStats() const { return m_stats; }
+
+	void LogStats() const;
+
+private:
+	bool LoadFile(std::vector<char>& blob);
+	bool ValidateBlob(const std::vector<char>& file, std::vector<char>& blob);
+	bool WriteFileAtomic(const std::vector<char>& file);
+
+	size_t GetDataSize() const;
+	// create gets the pNext to put in the create info, the caller's chain with the feedback in front
+	VkResult CreateTracked(uint32_t stageCount, const void* next, const std::function<VkResult(const void* pNext)>& create);
+
+	static uint64_t Checksum(const char* data, size_t size);
+
+private:
+	VkDevice m_device = VK_NULL_HANDLE;
+	VkPipelineCache m_cache = VK_NULL_HANDLE;
+	VkPhysicalDeviceProperties m_deviceProperties;
+	std::string m_filename;
+	bool m_creationFeedback = false;
+
+	std::mutex m_statsMutex;
+	PipelineCacheStats m_stats;
+};
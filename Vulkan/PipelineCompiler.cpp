@@ -0,0 +1,249 @@
+#include "PipelineCompiler.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <chrono>
+
+bool PipelineCompiler::Initialize(VkDevice device, PipelineCache& cache, uint32_t workerCount)
+{
+	m_device = device;
+	m_cache = &cache;
+	m_stats = PipelineCompileStats();
+	m_idle = true;
+
+	// Compiling is all the workers do, so unlike the recording pool they get every hardware thread
+	if (workerCount == 0)
+	{
+		workerCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	if (!m_jobs.Initialize(workerCount))
+	{
+		return false;
+	}
+
+	m_stats.workers = workerCount;
+
+	return true;
+}
+
+void PipelineCompiler::Shutdown()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	WaitIdle();
+	m_jobs.Shutdown();
+
+	m_device = VK_NULL_HANDLE;
+}
+
+std::shared_future<VkPipeline> PipelineCompiler::Compile(const PipelineKey& key, VkPipelineCreateFlags flags, std::shared_future<VkPipeline> base)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_statsMutex);
+		if (m_idle)
+		{
+			m_firstSubmit = std::chrono::high_resolution_clock::now();
+			m_idle = false;
+		}
+	}
+
+	m_pending.count++;
+
+	return m_jobs.Async([this, key, flags, base](uint32_t) -> VkPipeline
+	{
+		// Waiting on the base isn't compile time, it was submitted first so it is already on another worker
+		VkPipeline basePipeline = base.valid() ? base.get() : VK_NULL_HANDLE;
+
+		VkPipelineCreateFlags createFlags = flags;
+		if (basePipeline == VK_NULL_HANDLE)
+		{
+			createFlags &= ~VK_PIPELINE_CREATE_DERIVATIVE_BIT;
+		}
+
+		auto start = std::chrono::high_resolution_clock::now();
+
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		VkResult result = CreateGraphicsPipeline(*m_cache, key, createFlags, basePipeline, &pipeline);
+
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+		if (result != VK_SUCCESS)
+		{
+			LOG_ERROR("Unable to compile a pipeline");
+			pipeline = VK_NULL_HANDLE;
+		}
+
+		OnCompiled(elapsed.count(), result == VK_SUCCESS);
+
+		return pipeline;
+	}).share();
+}
+
+void PipelineCompiler::OnCompiled(double compileMs, bool succeeded)
+{
+	std::lock_guard<std::mutex> lock(m_statsMutex);
+
+	m_stats.compileMs += compileMs;
+	if (succeeded)
+	{
+		m_stats.compiled++;
+	}
+	else
+	{
+		m_stats.failed++;
+	}
+
+	// Wall time covers the whole burst, from the first submit while idle to the last pipeline out
+	std::chrono::duration<double, std::milli> wall = std::chrono::high_resolution_clock::now() - m_firstSubmit;
+	m_stats.wallMs = wall.count();
+
+	if (--m_pending.count == 0)
+	{
+		m_idle = true;
+	}
+}
+
+void PipelineCompiler::WaitIdle()
+{
+	// The workers do the compiling, the calling thread just waits for them
+	while (m_pending.count > 0)
+	{
+		std::this_thread::yield();
+	}
+}
+
+PipelineCompileStats PipelineCompiler::GetStats()
+{
+	std::lock_guard<std::mutex> lock(m_statsMutex);
+	return m_stats;
+}
+
+void PipelineCompiler::LogStats()
+{
+	PipelineCompileStats stats = GetStats();
+
+	LOG_INFO("Pipeline compiles: %u compiled, %u failed on %u workers, %.3fms of work in %.3fms (%.2fx)",
+		stats.compiled, stats.failed, stats.workers, stats.compileMs, stats.wallMs, stats.Speedup());
+}
+
+VkResult PipelineCompiler::CreateGraphicsPipeline(PipelineCache& cache, const PipelineKey& key, VkPipelineCreateFlags flags, VkPipeline basePipeline, VkPipeline* pipeline)
+{
+	VkPipelineShaderStageCreateInfo shaderStages[2] = {};
+	shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	shaderStages[0].module = key.vertexShader;
+	shaderStages[0].pName = "main";
+
+	shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	shaderStages[1].module = key.fragmentShader;
+	shaderStages[1].pName = "main";
+
+	VkVertexInputBindingDescription bindings[MAX_PIPELINE_VERTEX_BINDINGS];
+	for (uint32_t i = 0; i < key.bindingCount; ++i)
+	{
+		bindings[i].binding = key.bindings[i].binding;
+		bindings[i].stride = key.bindings[i].stride;
+		bindings[i].inputRate = (VkVertexInputRate)key.bindings[i].inputRate;
+	}
+
+	VkVertexInputAttributeDescription attributes[MAX_PIPELINE_VERTEX_ATTRIBUTES];
+	for (uint32_t i = 0; i < key.attributeCount; ++i)
+	{
+		attributes[i].location = key.attributes[i].location;
+		attributes[i].binding = key.attributes[i].binding;
+		attributes[i].format = key.attributes[i].format;
+		attributes[i].offset = key.attributes[i].offset;
+	}
+
+	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
+	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vertexInputInfo.vertexBindingDescriptionCount = key.bindingCount;
+	vertexInputInfo.pVertexBindingDescriptions = bindings;
+	vertexInputInfo.vertexAttributeDescriptionCount = key.attributeCount;
+	vertexInputInfo.pVertexAttributeDescriptions = attributes;
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssembly.topology = key.topology;
+	inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+	// Set when recording, so resizing never needs a new pipeline
+	VkPipelineViewportStateCreateInfo viewportState = {};
+	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportState.viewportCount = 1;
+	viewportState.scissorCount = 1;
+
+	VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+	VkPipelineDynamicStateCreateInfo dynamicState = {};
+	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.dynamicStateCount = 2;
+	dynamicState.pDynamicStates = dynamicStates;
+
+	VkPipelineRasterizationStateCreateInfo rasterizer = {};
+	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizer.depthClampEnable = VK_FALSE;
+	rasterizer.rasterizerDiscardEnable = VK_FALSE;
+	rasterizer.polygonMode = key.polygonMode;
+	rasterizer.lineWidth = 1.0f;
+	rasterizer.cullMode = key.cullMode;
+	rasterizer.frontFace = key.frontFace;
+	rasterizer.depthBiasEnable = VK_FALSE;
+
+	VkPipelineMultisampleStateCreateInfo multisampling = {};
+	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampling.sampleShadingEnable = VK_FALSE;
+	multisampling.rasterizationSamples = (VkSampleCountFlagBits)key.samples;
+
+	// Ignored by subpasses without a depth attachment
+	VkPipelineDepthStencilStateCreateInfo depthStencil = {};
+	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthStencil.depthTestEnable = key.depthTest ? VK_TRUE : VK_FALSE;
+	depthStencil.depthWriteEnable = key.depthWrite ? VK_TRUE : VK_FALSE;
+	depthStencil.depthCompareOp = key.depthCompareOp;
+	depthStencil.depthBoundsTestEnable = VK_FALSE;
+	depthStencil.stencilTestEnable = VK_FALSE;
+
+	VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
+	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	colorBlendAttachment.blendEnable = key.blendMode != BlendMode::Opaque ? VK_TRUE : VK_FALSE;
+	colorBlendAttachment.srcColorBlendFactor = key.blendMode == BlendMode::Alpha ? VK_BLEND_FACTOR_SRC_ALPHA : VK_BLEND_FACTOR_ONE;
+	colorBlendAttachment.dstColorBlendFactor = key.blendMode == BlendMode::Alpha ? VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA : VK_BLEND_FACTOR_ONE;
+	colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+	colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+	colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+	VkPipelineColorBlendStateCreateInfo colorBlending = {};
+	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlending.logicOpEnable = VK_FALSE;
+	colorBlending.logicOp = VK_LOGIC_OP_COPY;
+	colorBlending.attachmentCount = 1;
+	colorBlending.pAttachments = &colorBlendAttachment;
+
+	VkGraphicsPipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineInfo.flags = flags;
+	pipelineInfo.stageCount = 2;
+	pipelineInfo.pStages = shaderStages;
+	pipelineInfo.pVertexInputState = &vertexInputInfo;
+	pipelineInfo.pInputAssemblyState = &inputAssembly;
+	pipelineInfo.pViewportState = &viewportState;
+	pipelineInfo.pRasterizationState = &rasterizer;
+	pipelineInfo.pMultisampleState = &multisampling;
+	pipelineInfo.pDepthStencilState = &depthStencil;
+	pipelineInfo.pColorBlendState = &colorBlending;
+	pipelineInfo.pDynamicState = &dynamicState;
+	pipelineInfo.layout = key.layout;
+	pipelineInfo.renderPass = key.renderPass;
+	pipelineInfo.subpass = key.subpass;
+	pipelineInfo.basePipelineHandle = basePipeline;
+	pipelineInfo.basePipelineIndex = -1;
+
+	return cache.CreateGraphicsPipeline(pipelineInfo, pipeline);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "JobSystem.h"
+#include "PipelineCache.h"
+#include "PipelineKey.h"
+
+#include <vulkan/vulkan.h>
+#include <chrono>
+#include <future>
+#include <mutex>
+
+struct PipelineCompileStats
+{
+	uint32_t workers = 0;
+	uint32_t compiled = 0;
+	uint32_t failed = 0;
+	double compileMs = 0.0;	// Summed over every pipeline, what one thread would have taken
+	double wallMs = 0.0;	// First submit to last pipeline done
+
+	double Speedup() const
+	{
+		return wallMs > 0.0 ? compileMs / wallMs : 0.0;
+	}
+};
+
+// Compiles pipelines on its own worker threads into the shared pipeline cache, so startup only blocks on
+// the ones it needs right away. The caller owns the pipelines it gets back, failures come back as
+// VK_NULL_HANDLE. Shader modules, layouts and render passes in a key must outlive its future.
+class PipelineCompiler
+{
+public:
+	// workerCount 0 picks one per hardware thread
+	bool Initialize(VkDevice device, PipelineCache& cache, uint32_t workerCount = 0);
+	void Shutdown(); // Waits for anything still compiling
+
+	// A valid base makes the job wait for that pipeline and derive from it when flags ask for a derivative.
+	// Jobs start in submit order, so a base submitted earlier is always being compiled by then.
+	std::shared_future<VkPipeline> Compile(const PipelineKey& key, VkPipelineCreateFlags flags = 0, std::shared_future<VkPipeline> base = std::shared_future<VkPipeline>());
+
+	// Blocks until everything submitted so far has finished
+	void WaitIdle();
+
+	PipelineCompileStats GetStats();
+	void LogStats();
+
+	// Fills in the fixed function state for key and creates the pipeline on the calling thread
+	static VkResult CreateGraphicsPipeline(PipelineCache& cache, const PipelineKey& key, VkPipelineCreateFlags flags, VkPipeline basePipeline, VkPipeline* pipeline);
+
+private:
+	void OnCompiled(double compileMs, bool succeeded);
+
+private:
+	VkDevice m_device = VK_NULL_HANDLE;
+	PipelineCache* m_cache = nullptr;
+	JobSystem m_jobs;
+	JobCounter m_pending;
+
+	std::mutex m_statsMutex;
+	PipelineCompileStats m_stats;
+	std::chrono::high_resolution_clock::time_point m_firstSubmit;
+	bool m_idle = true;
+};
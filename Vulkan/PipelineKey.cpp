@@ -0,0 +1,90 @@
+#include "PipelineKey.h"
+#include "Log.h"
+
+#include <cstddef>
+#include <cstring>
+
+static_assert(sizeof(VertexBindingKey) == 4, "VertexBindingKey must not have padding");
+static_assert(sizeof(VertexAttributeKey) == 8, "VertexAttributeKey must not have padding");
+static_assert(sizeof(PipelineKey) == 136, "PipelineKey must not have padding");
+
+static uint64_t HashBytes(const void* data, size_t size)
+{
+	// FNV-1a, the key is small enough that anything fancier wouldn't pay off
+	const uint8_t* bytes = (const uint8_t*)data;
+	uint64_t hash = 14695981039346656037ull;
+
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+PipelineKey::PipelineKey()
+{
+	memset(this, 0, sizeof(*this));
+
+	topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	polygonMode = VK_POLYGON_MODE_FILL;
+	cullMode = VK_CULL_MODE_BACK_BIT;
+	frontFace = VK_FRONT_FACE_CLOCKWISE;
+	depthCompareOp = VK_COMPARE_OP_LESS;
+	blendMode = BlendMode::Opaque;
+	samples = VK_SAMPLE_COUNT_1_BIT;
+}
+
+bool PipelineKey::AddVertexBinding(uint32_t binding, uint32_t stride, VkVertexInputRate inputRate)
+{
+	if (bindingCount >= MAX_PIPELINE_VERTEX_BINDINGS || binding > UINT8_MAX || stride > UINT16_MAX)
+	{
+		LOG_ERROR("Vertex binding doesn't fit in a pipeline key");
+		return false;
+	}
+
+	VertexBindingKey& key = bindings[bindingCount++];
+	key.binding = (uint8_t)binding;
+	key.stride = (uint16_t)stride;
+	key.inputRate = (uint8_t)inputRate;
+
+	return true;
+}
+
+bool PipelineKey::AddVertexAttribute(uint32_t location, uint32_t binding, VkFormat format, uint32_t offset)
+{
+	if (attributeCount >= MAX_PIPELINE_VERTEX_ATTRIBUTES || location > UINT8_MAX || binding > UINT8_MAX || offset > UINT16_MAX)
+	{
+		LOG_ERROR("Vertex attribute doesn't fit in a pipeline key");
+		return false;
+	}
+
+	VertexAttributeKey& key = attributes[attributeCount++];
+	key.location = (uint8_t)location;
+	key.binding = (uint8_t)binding;
+	key.offset = (uint16_t)offset;
+	key.format = format;
+
+	return true;
+}
+
+uint64_t PipelineKey::Hash() const
+{
+	return HashBytes(this, sizeof(*this));
+}
+
+uint64_t PipelineKey::FamilyHash() const
+{
+	// The four handles lead the struct, subpass is mixed in on top
+	uint64_t hash = HashBytes(this, offsetof(PipelineKey, bindings));
+	hash ^= subpass;
+	hash *= 1099511628211ull;
+
+	return hash;
+}
+
+bool PipelineKey::operator==(const PipelineKey& other) const
+{
+	return memcmp(this, &other, sizeof(*this)) == 0;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+
+const uint32_t MAX_PIPELINE_VERTEX_BINDINGS = 2;
+const uint32_t MAX_PIPELINE_VERTEX_ATTRIBUTES = 8;
+
+enum class BlendMode : uint8_t
+{
+	Opaque,
+	Alpha,		// src * srcAlpha + dst * (1 - srcAlpha)
+	Additive	// src + dst
+};
+
+struct VertexBindingKey
+{
+	uint16_t stride;
+	uint8_t binding;
+	uint8_t inputRate; // VkVertexInputRate
+};
+
+struct VertexAttributeKey
+{
+	uint8_t location;
+	uint8_t binding;
+	uint16_t offset;
+	VkFormat format;
+};
+
+// Everything that varies between our graphics pipelines, viewport and scissor are always dynamic. Hashed
+// and compared as raw bytes, so it has no padding and the constructor zeroes the parts nobody sets.
+struct PipelineKey
+{
+	VkShaderModule vertexShader;
+	VkShaderModule fragmentShader;
+	VkPipelineLayout layout;
+	VkRenderPass renderPass;
+
+	VertexBindingKey bindings[MAX_PIPELINE_VERTEX_BINDINGS];
+	VertexAttributeKey attributes[MAX_PIPELINE_VERTEX_ATTRIBUTES];
+
+	VkPrimitiveTopology topology;
+	VkPolygonMode polygonMode;
+	VkCullModeFlags cullMode;
+	VkFrontFace frontFace;
+	VkCompareOp depthCompareOp;
+	uint32_t subpass;
+
+	uint8_t bindingCount;
+	uint8_t attributeCount;
+	BlendMode blendMode;
+	bool depthTest;
+	bool depthWrite;
+	uint8_t samples; // VkSampleCountFlagBits, has to match the render pass's attachments
+	uint8_t reserved[2];
+
+	PipelineKey();
+
+	bool AddVertexBinding(uint32_t binding, uint32_t stride, VkVertexInputRate inputRate);
+	bool AddVertexAttribute(uint32_t location, uint32_t binding, VkFormat format, uint32_t offset);
+
+	uint64_t Hash() const;
+	// Pipelines sharing shaders, layout and render pass, the ones worth deriving from each other
+	uint64_t FamilyHash() const;
+
+	bool operator==(const PipelineKey& other) const;
+	bool operator!=(const PipelineKey& other) const { return !(*this == other); }
+};
@@ -0,0 +1,244 @@
+#include "PipelineStateCache.h"
+#include "Log.h"
+
+bool PipelineStateCache::Initialize(VkDevice device, PipelineCache& cache, PipelineCompiler& compiler, bool useDerivatives)
+{
+	m_device = device;
+	m_cache = &cache;
+	m_compiler = &compiler;
+	m_useDerivatives = useDerivatives;
+	m_stats = PipelineStateStats();
+
+	m_entries.assign(PIPELINE_STATE_INITIAL_CAPACITY, Entry());
+	m_count = 0;
+	m_families.clear();
+
+	return true;
+}
+
+void PipelineStateCache::Shutdown()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	Clear();
+	m_entries.clear();
+
+	m_device = VK_NULL_HANDLE;
+}
+
+VkPipeline PipelineStateCache::Get(const PipelineKey& key)
+{
+	m_stats.lookups++;
+
+	uint64_t hash = key.Hash();
+
+	Entry* entry = Find(key, hash);
+	if (entry != nullptr)
+	{
+		m_stats.hits++;
+
+		if (entry->pending.valid())
+		{
+			if (entry->pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			{
+				m_stats.pendingWaits++;
+			}
+
+			entry->pipeline = entry->pending.get();
+			entry->pending = std::shared_future<VkPipeline>();
+		}
+
+		return entry->pipeline;
+	}
+
+	// First time we see this state, nothing to do but compile it right here
+	uint64_t familyHash = key.FamilyHash();
+	const Family* family = m_useDerivatives ? FindFamily(familyHash) : nullptr;
+
+	VkPipelineCreateFlags flags = GetCreateFlags(family);
+	VkPipeline basePipeline = family != nullptr ? family->base.get() : VK_NULL_HANDLE;
+	if (basePipeline == VK_NULL_HANDLE)
+	{
+		flags &= ~VK_PIPELINE_CREATE_DERIVATIVE_BIT;
+	}
+
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	if (PipelineCompiler::CreateGraphicsPipeline(*m_cache, key, flags, basePipeline, &pipeline) != VK_SUCCESS)
+	{
+		// Cached anyway so a broken state doesn't recompile every frame
+		LOG_ERROR("Unable to create a pipeline for a new state");
+		pipeline = VK_NULL_HANDLE;
+	}
+
+	m_stats.created++;
+	if (basePipeline != VK_NULL_HANDLE)
+	{
+		m_stats.derivatives++;
+	}
+
+	if (m_useDerivatives && family == nullptr && pipeline != VK_NULL_HANDLE)
+	{
+		std::promise<VkPipeline> base;
+		base.set_value(pipeline);
+		m_families.push_back(Family{ familyHash, base.get_future().share() });
+	}
+
+	Insert(key, hash).pipeline = pipeline;
+
+	return pipeline;
+}
+
+void PipelineStateCache::Prepare(const PipelineKey* keys, uint32_t count)
+{
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		const PipelineKey& key = keys[i];
+		uint64_t hash = key.Hash();
+
+		if (Find(key, hash) != nullptr)
+		{
+			m_stats.deduped++;
+			continue;
+		}
+
+		uint64_t familyHash = key.FamilyHash();
+		const Family* family = m_useDerivatives ? FindFamily(familyHash) : nullptr;
+
+		std::shared_future<VkPipeline> base;
+		if (family != nullptr)
+		{
+			base = family->base;
+			m_stats.derivatives++;
+		}
+
+		std::shared_future<VkPipeline> pipeline = m_compiler->Compile(key, GetCreateFlags(family), base);
+
+		if (m_useDerivatives && family == nullptr)
+		{
+			m_families.push_back(Family{ familyHash, pipeline });
+		}
+
+		Insert(key, hash).pending = pipeline;
+		m_stats.prepared++;
+	}
+}
+
+void PipelineStateCache::Clear()
+{
+	for (auto& entry : m_entries)
+	{
+		if (!entry.used)
+		{
+			continue;
+		}
+
+		VkPipeline pipeline = entry.pending.valid() ? entry.pending.get() : entry.pipeline;
+		if (pipeline != VK_NULL_HANDLE)
+		{
+			vkDestroyPipeline(m_device, pipeline, nullptr);
+		}
+
+		entry = Entry();
+	}
+
+	m_count = 0;
+	m_families.clear();
+}
+
+void PipelineStateCache::LogStats() const
+{
+	double hitRate = m_stats.lookups > 0 ? 100.0 * m_stats.hits / m_stats.lookups : 0.0;
+
+	LOG_INFO("Pipeline states: %u pipelines, %llu lookups (%.1f%% hits), %u created on lookup, %u prepared, %u deduped, %u derivatives, %u waits on compiles",
+		m_count, (unsigned long long)m_stats.lookups, hitRate, m_stats.created, m_stats.prepared, m_stats.deduped, m_stats.derivatives, m_stats.pendingWaits);
+}
+
+PipelineStateCache::Entry* PipelineStateCache::Find(const PipelineKey& key, uint64_t hash)
+{
+	uint32_t mask = (uint32_t)m_entries.size() - 1;
+
+	// Never full, so the probe always runs into a free slot
+	for (uint32_t i = (uint32_t)hash & mask; m_entries[i].used; i = (i + 1) & mask)
+	{
+		if (m_entries[i].hash == hash && m_entries[i].key == key)
+		{
+			return &m_entries[i];
+		}
+	}
+
+	return nullptr;
+}
+
+PipelineStateCache::Entry& PipelineStateCache::Insert(const PipelineKey& key, uint64_t hash)
+{
+	if ((m_count + 1) * 2 > m_entries.size())
+	{
+		Grow();
+	}
+
+	uint32_t mask = (uint32_t)m_entries.size() - 1;
+
+	uint32_t i = (uint32_t)hash & mask;
+	while (m_entries[i].used)
+	{
+		i = (i + 1) & mask;
+	}
+
+	Entry& entry = m_entries[i];
+	entry.used = true;
+	entry.hash = hash;
+	entry.key = key;
+	m_count++;
+
+	return entry;
+}
+
+void PipelineStateCache::Grow()
+{
+	std::vector<Entry> entries(m_entries.size() * 2);
+	entries.swap(m_entries);
+	m_count = 0;
+
+	for (auto& old : entries)
+	{
+		if (old.used)
+		{
+			Entry& entry = Insert(old.key, old.hash);
+			entry.pipeline = old.pipeline;
+			entry.pending = std::move(old.pending);
+		}
+	}
+}
+
+const PipelineStateCache::Family* PipelineStateCache::FindFamily(uint64_t familyHash) const
+{
+	for (const auto& family : m_families)
+	{
+		if (family.hash == familyHash)
+		{
+			return &family;
+		}
+	}
+
+	return nullptr;
+}
+
+VkPipelineCreateFlags PipelineStateCache::GetCreateFlags(const Family* family) const
+{
+	if (!m_useDerivatives)
+	{
+		return 0;
+	}
+
+	// Every pipeline may become a base, only the first of a family actually does
+	VkPipelineCreateFlags flags = VK_PIPELINE_CREATE_ALLOW_DERIVATIVES_BIT;
+	if (family != nullptr)
+	{
+		flags |= VK_PIPELINE_CREATE_DERIVATIVE_BIT;
+	}
+
+	return flags;
+}
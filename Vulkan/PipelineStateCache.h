@@ -0,0 +1,83 @@
+#pragma once
+
+#include "PipelineCompiler.h"
+#include "PipelineKey.h"
+
+#include <vulkan/vulkan.h>
+#include <future>
+#include <vector>
+
+// Slots in the lookup table up front, it doubles whenever it gets half full
+const uint32_t PIPELINE_STATE_INITIAL_CAPACITY = 256;
+
+struct PipelineStateStats
+{
+	uint64_t lookups = 0;
+	uint64_t hits = 0;
+	uint32_t created = 0;		// Compiled on the calling thread by a Get that missed
+	uint32_t prepared = 0;		// Handed to the compiler by Prepare
+	uint32_t deduped = 0;		// Prepare calls for a state that was already there
+	uint32_t derivatives = 0;	// Created with a base pipeline from the same family
+	uint32_t pendingWaits = 0;	// Gets that had to block on a pipeline still compiling
+};
+
+// Pipelines by state. Get hands back the pipeline for a key, creating it the first time the key is seen,
+// so every identical state shares one pipeline. A hit is a hash and a probe of a flat table and never
+// allocates. The first pipeline of a family (same shaders, layout and render pass) allows derivatives and
+// later ones derive from it, which lets drivers that care share work between them. Owns every pipeline
+// it returns. Not thread safe, call everything from the render thread.
+class PipelineStateCache
+{
+public:
+	bool Initialize(VkDevice device, PipelineCache& cache, PipelineCompiler& compiler, bool useDerivatives = true);
+	void Shutdown();
+
+	// VK_NULL_HANDLE if the pipeline failed to compile. Blocks if the key was prepared and is still compiling.
+	VkPipeline Get(const PipelineKey& key);
+
+	// Starts compiling the keys that aren't cached yet on the compiler's workers
+	void Prepare(const PipelineKey* keys, uint32_t count);
+
+	// Destroys every pipeline, for when the shaders, layouts or render passes keys point at go away
+	void Clear();
+
+	const PipelineStateStats& GetStats() const { return m_stats; }
+	uint32_t GetCount() const { return m_count; }
+	void LogStats() const;
+
+private:
+	struct Entry
+	{
+		uint64_t hash = 0;
+		PipelineKey key;
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		std::shared_future<VkPipeline> pending; // Valid until the compiler is done and Get collects it
+		bool used = false;
+	};
+
+	struct Family
+	{
+		uint64_t hash;
+		std::shared_future<VkPipeline> base;
+	};
+
+	Entry* Find(const PipelineKey& key, uint64_t hash);
+	Entry& Insert(const PipelineKey& key, uint64_t hash);
+	void Grow();
+
+	// The first pipeline of a family is the base for the rest of it
+	const Family* FindFamily(uint64_t familyHash) const;
+	VkPipelineCreateFlags GetCreateFlags(const Family* family) const;
+
+private:
+	VkDevice m_device = VK_NULL_HANDLE;
+	PipelineCache* m_cache = nullptr;
+	PipelineCompiler* m_compiler = nullptr;
+	bool m_useDerivatives = true;
+
+	std::vector<Entry> m_entries; // Open addressing, linear probing, the size is a power of two
+	uint32_t m_count = 0;
+	std::vector<Family> m_families;
+
+	PipelineStateStats m_stats;
+};
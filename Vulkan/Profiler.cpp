@@ -0,0 +1,331 @@
+#include "Profiler.h"
+
+#ifdef ENABLE_PROFILER
+
+#include "Log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+
+static thread_local uint32_t s_depth = 0;
+static thread_local uint32_t s_threadId = 0;
+static std::atomic<uint32_t> s_nextThreadId{ 1 };
+
+static const uint32_t GPU_TRACK_ID = 0xFFFF;
+static const uint32_t COMPUTE_TRACK_ID = 0xFFFE;
+
+static uint32_t GetThreadId()
+{
+	if (s_threadId == 0)
+	{
+		s_threadId = s_nextThreadId++;
+	}
+
+	return s_threadId;
+}
+
+Profiler& Profiler::Get()
+{
+	static Profiler profiler;
+	return profiler;
+}
+
+uint64_t Profiler::NowNs()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Profiler::PushScope()
+{
+	s_depth++;
+}
+
+void Profiler::PopScope(const char* name, uint64_t startNs)
+{
+	s_depth--;
+
+	ProfileEvent event;
+	event.name = name;
+	event.startNs = startNs;
+	event.durationNs = NowNs() - startNs;
+	event.thread = GetThreadId();
+	event.depth = s_depth;
+
+	AddEvent(event);
+}
+
+bool Profiler::InitializeGpu(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t slotCount)
+{
+	m_device = device;
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	m_timestampPeriod = properties.limits.timestampPeriod;
+
+	uint32_t familyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> families(familyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+
+	// Assume the graphics family, which is the one scopes are recorded on
+	uint32_t validBits = 0;
+	for (const auto& family : families)
+	{
+		if (family.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+		{
+			validBits = family.timestampValidBits;
+			break;
+		}
+	}
+
+	if (validBits == 0)
+	{
+		LOG_INFO("Timestamps not supported, GPU scopes disabled");
+		return true;
+	}
+
+	m_timestampMask = validBits >= 64 ? ~0ull : ((1ull << validBits) - 1);
+
+	VkQueryPoolCreateInfo createInfo = {};
+	createInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	createInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	createInfo.queryCount = MAX_GPU_SCOPES * 2;
+
+	m_gpuSlots.resize(slotCount);
+	for (auto& slot : m_gpuSlots)
+	{
+		if (vkCreateQueryPool(m_device, &createInfo, nullptr, &slot.queryPool) != VK_SUCCESS)
+		{
+			LOG_ERROR("Unable to create timestamp query pool");
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void Profiler::ShutdownGpu()
+{
+	for (auto& slot : m_gpuSlots)
+	{
+		if (slot.queryPool != VK_NULL_HANDLE)
+		{
+			vkDestroyQueryPool(m_device, slot.queryPool, nullptr);
+		}
+	}
+
+	m_gpuSlots.clear();
+}
+
+void Profiler::CollectGpu(uint32_t slot)
+{
+	if (slot >= m_gpuSlots.size())
+	{
+		return;
+	}
+
+	GpuSlot& gpuSlot = m_gpuSlots[slot];
+	uint32_t queryCount = (uint32_t)gpuSlot.scopes.size() * 2;
+	if (queryCount == 0)
+	{
+		return;
+	}
+
+	// No WAIT bit, the slot's fence has signaled so this never stalls. NOT_READY means the slot
+	// was recorded but hasn't been submitted yet.
+	uint64_t timestamps[MAX_GPU_SCOPES * 2];
+	VkResult result = vkGetQueryPoolResults(m_device, gpuSlot.queryPool, 0, queryCount, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+	if (result != VK_SUCCESS)
+	{
+		return;
+	}
+
+	uint64_t base = timestamps[0] & m_timestampMask;
+
+	for (size_t i = 0; i < gpuSlot.scopes.size(); ++i)
+	{
+		uint64_t begin = timestamps[i * 2] & m_timestampMask;
+		uint64_t end = timestamps[i * 2 + 1] & m_timestampMask;
+
+		ProfileEvent event;
+		event.name = gpuSlot.scopes[i].name;
+		event.startNs = gpuSlot.submittedNs + (uint64_t)((begin - base) * m_timestampPeriod);
+		event.durationNs = (uint64_t)((end - begin) * m_timestampPeriod);
+		event.thread = GPU_TRACK_ID;
+		event.depth = gpuSlot.scopes[i].depth;
+
+		AddEvent(event);
+	}
+}
+
+void Profiler::ResetGpu(VkCommandBuffer commandBuffer, uint32_t slot)
+{
+	if (slot >= m_gpuSlots.size())
+	{
+		return;
+	}
+
+	GpuSlot& gpuSlot = m_gpuSlots[slot];
+	gpuSlot.scopes.clear();
+	gpuSlot.depth = 0;
+
+	vkCmdResetQueryPool(commandBuffer, gpuSlot.queryPool, 0, MAX_GPU_SCOPES * 2);
+}
+
+void Profiler::MarkSubmitted(uint32_t slot)
+{
+	if (slot < m_gpuSlots.size())
+	{
+		m_gpuSlots[slot].submittedNs = NowNs();
+	}
+}
+
+uint32_t Profiler::BeginGpuScope(VkCommandBuffer commandBuffer, uint32_t slot, const char* name)
+{
+	if (slot >= m_gpuSlots.size() || m_gpuSlots[slot].scopes.size() >= MAX_GPU_SCOPES)
+	{
+		return MAX_GPU_SCOPES;
+	}
+
+	GpuSlot& gpuSlot = m_gpuSlots[slot];
+	uint32_t scope = (uint32_t)gpuSlot.scopes.size();
+
+	gpuSlot.scopes.push_back(GpuScope{ name, gpuSlot.depth++ });
+
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, gpuSlot.queryPool, scope * 2);
+
+	return scope;
+}
+
+void Profiler::EndGpuScope(VkCommandBuffer commandBuffer, uint32_t slot, uint32_t scope)
+{
+	if (scope >= MAX_GPU_SCOPES)
+	{
+		return;
+	}
+
+	GpuSlot& gpuSlot = m_gpuSlots[slot];
+	gpuSlot.depth--;
+
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, gpuSlot.queryPool, scope * 2 + 1);
+}
+
+void Profiler::AddComputeEvent(const char* name, uint64_t submittedNs, uint64_t durationNs)
+{
+	ProfileEvent event;
+	event.name = name;
+	event.startNs = submittedNs;
+	event.durationNs = durationNs;
+	event.thread = COMPUTE_TRACK_ID;
+	event.depth = 0;
+
+	AddEvent(event);
+}
+
+ScopeStats Profiler::GetScopeStats(const std::string& name)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	ScopeStats stats;
+
+	auto it = m_history.find(name);
+	if (it == m_history.end() || it->second.count == 0)
+	{
+		return stats;
+	}
+
+	const ScopeHistory& history = it->second;
+
+	double total = 0.0;
+	stats.minMs = history.samples[0];
+	stats.maxMs = history.samples[0];
+
+	for (uint32_t i = 0; i < history.count; ++i)
+	{
+		total += history.samples[i];
+		stats.minMs = std::min(stats.minMs, history.samples[i]);
+		stats.maxMs = std::max(stats.maxMs, history.samples[i]);
+	}
+
+	stats.avgMs = total / history.count;
+	stats.samples = history.count;
+
+	return stats;
+}
+
+void Profiler::LogStats()
+{
+	std::vector<std::string> names;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (const auto& entry : m_history)
+		{
+			names.push_back(entry.first);
+		}
+	}
+
+	std::sort(names.begin(), names.end());
+
+	for (const auto& name : names)
+	{
+		ScopeStats stats = GetScopeStats(name);
+
+		LOG_INFO("Scope %s: avg %.3fms min %.3fms max %.3fms over %u samples", name.c_str(), stats.avgMs, stats.minMs, stats.maxMs, stats.samples);
+	}
+}
+
+bool Profiler::ExportChromeTrace(const std::string& filename)
+{
+	std::ofstream file(filename, std::ios::trunc);
+	if (!file.is_open())
+	{
+		LOG_ERROR("Unable to open trace file: %s", filename.c_str());
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	uint64_t origin = ~0ull;
+	for (const auto& event : m_events)
+	{
+		origin = std::min(origin, event.startNs);
+	}
+
+	file << "{\"traceEvents\":[\n";
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << GPU_TRACK_ID << ",\"args\":{\"name\":\"GPU\"}},\n";
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << COMPUTE_TRACK_ID << ",\"args\":{\"name\":\"Compute queue\"}}";
+
+	char line[256];
+	for (const auto& event : m_events)
+	{
+		// Chrome wants microseconds
+		snprintf(line, sizeof(line), ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+			event.name, event.thread, (event.startNs - origin) / 1000.0, event.durationNs / 1000.0);
+		file << line;
+	}
+
+	file << "\n]}\n";
+
+	LOG_INFO("Wrote %u profile events to %s", (uint32_t)m_events.size(), filename.c_str());
+
+	return file.good();
+}
+
+void Profiler::AddEvent(const ProfileEvent& event)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (m_events.size() < MAX_PROFILE_EVENTS)
+	{
+		m_events.push_back(event);
+	}
+
+	ScopeHistory& history = m_history[event.name];
+	history.samples[history.next] = event.durationNs / 1000000.0;
+	history.next = (history.next + 1) % PROFILER_STATS_WINDOW;
+	history.count = std::min(history.count + 1, PROFILER_STATS_WINDOW);
+}
+
+#endif
@@ -0,0 +1,172 @@
+#pragma once
+
+// Everything in here compiles away unless ENABLE_PROFILER is defined (Debug builds define it).
+// Use the PROFILE_* macros rather than the classes so call sites disappear too.
+
+// GPU slots reserved for the pre-recorded per swap chain image command buffers, per frame slots follow
+#define PROFILER_IMAGE_SLOTS 8
+
+#ifdef ENABLE_PROFILER
+
+#include <vulkan/vulkan.h>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+const uint32_t MAX_GPU_SCOPES = 64;
+const uint32_t PROFILER_STATS_WINDOW = 120; // Frames of history kept per scope
+const size_t MAX_PROFILE_EVENTS = 1000000;
+
+struct ProfileEvent
+{
+	const char* name; // String literal, never freed
+	uint64_t startNs;
+	uint64_t durationNs;
+	uint32_t thread;
+	uint32_t depth;
+};
+
+struct ScopeStats
+{
+	double avgMs = 0.0;
+	double minMs = 0.0;
+	double maxMs = 0.0;
+	uint32_t samples = 0;
+};
+
+class Profiler
+{
+public:
+	static Profiler& Get();
+
+	// CPU scopes
+	void PushScope();
+	void PopScope(const char* name, uint64_t startNs);
+
+	// GPU scopes use one timestamp query pool per slot. A slot is whatever the caller uses to know the
+	// commands have finished, e.g. a frame in flight or a swap chain image.
+	bool InitializeGpu(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t slotCount);
+	void ShutdownGpu();
+	void CollectGpu(uint32_t slot); // Call once the slot's fence has signaled
+	void ResetGpu(VkCommandBuffer commandBuffer, uint32_t slot); // Records the query reset, outside a render pass
+	void MarkSubmitted(uint32_t slot);
+	uint32_t BeginGpuScope(VkCommandBuffer commandBuffer, uint32_t slot, const char* name);
+	void EndGpuScope(VkCommandBuffer commandBuffer, uint32_t slot, uint32_t scope);
+
+	// Work timed on the compute queue gets a track of its own. submittedNs is NowNs() at the submit, the
+	// batch is placed there like GPU scopes are placed at their slot's submit.
+	void AddComputeEvent(const char* name, uint64_t submittedNs, uint64_t durationNs);
+
+	ScopeStats GetScopeStats(const std::string& name);
+	void LogStats();
+
+	bool ExportChromeTrace(const std::string& filename);
+
+	static uint64_t NowNs();
+
+private:
+	struct GpuScope
+	{
+		const char* name;
+		uint32_t depth;
+	};
+
+	struct GpuSlot
+	{
+		VkQueryPool queryPool = VK_NULL_HANDLE;
+		std::vector<GpuScope> scopes;
+		uint32_t depth = 0;
+		uint64_t submittedNs = 0; // CPU time the slot was last submitted, anchors the GPU track to the CPU timeline
+	};
+
+	struct ScopeHistory
+	{
+		double samples[PROFILER_STATS_WINDOW];
+		uint32_t next = 0;
+		uint32_t count = 0;
+	};
+
+	void AddEvent(const ProfileEvent& event);
+
+private:
+	std::mutex m_mutex;
+	std::vector<ProfileEvent> m_events;
+	std::unordered_map<std::string, ScopeHistory> m_history;
+
+	VkDevice m_device = VK_NULL_HANDLE;
+	double m_timestampPeriod = 1.0; // Nanoseconds per tick
+	uint64_t m_timestampMask = ~0ull;
+	std::vector<GpuSlot> m_gpuSlots;
+};
+
+class CpuProfileScope
+{
+public:
+	explicit CpuProfileScope(const char* name)
+		: m_name(name), m_start(Profiler::NowNs())
+	{
+		Profiler::Get().PushScope();
+	}
+
+	~CpuProfileScope()
+	{
+		Profiler::Get().PopScope(m_name, m_start);
+	}
+
+private:
+	const char* m_name;
+	uint64_t m_start;
+};
+
+class GpuProfileScope
+{
+public:
+	GpuProfileScope(VkCommandBuffer commandBuffer, uint32_t slot, const char* name)
+		: m_commandBuffer(commandBuffer), m_slot(slot)
+	{
+		m_scope = Profiler::Get().BeginGpuScope(commandBuffer, slot, name);
+	}
+
+	~GpuProfileScope()
+	{
+		Profiler::Get().EndGpuScope(m_commandBuffer, m_slot, m_scope);
+	}
+
+private:
+	VkCommandBuffer m_commandBuffer;
+	uint32_t m_slot;
+	uint32_t m_scope;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#define PROFILE_SCOPE(name) CpuProfileScope PROFILE_CONCAT(cpuProfileScope, __LINE__)(name)
+#define PROFILE_GPU_SCOPE(commandBuffer, slot, name) GpuProfileScope PROFILE_CONCAT(gpuProfileScope, __LINE__)(commandBuffer, slot, name)
+#define PROFILE_GPU_INITIALIZE(physicalDevice, device, slotCount) Profiler::Get().InitializeGpu(physicalDevice, device, slotCount)
+#define PROFILE_GPU_SHUTDOWN() Profiler::Get().ShutdownGpu()
+#define PROFILE_GPU_COLLECT(slot) Profiler::Get().CollectGpu(slot)
+#define PROFILE_GPU_RESET(commandBuffer, slot) Profiler::Get().ResetGpu(commandBuffer, slot)
+#define PROFILE_GPU_SUBMITTED(slot) Profiler::Get().MarkSubmitted(slot)
+#define PROFILE_NOW_NS() Profiler::NowNs()
+#define PROFILE_COMPUTE_EVENT(name, submittedNs, durationNs) Profiler::Get().AddComputeEvent(name, submittedNs, durationNs)
+#define PROFILE_LOG_STATS() Profiler::Get().LogStats()
+#define PROFILE_EXPORT(filename) Profiler::Get().ExportChromeTrace(filename)
+
+#else
+
+#define PROFILE_SCOPE(name)
+#define PROFILE_GPU_SCOPE(commandBuffer, slot, name)
+#define PROFILE_GPU_INITIALIZE(physicalDevice, device, slotCount) true
+#define PROFILE_GPU_SHUTDOWN()
+#define PROFILE_GPU_COLLECT(slot)
+#define PROFILE_GPU_RESET(commandBuffer, slot)
+#define PROFILE_GPU_SUBMITTED(slot)
+#define PROFILE_NOW_NS() 0
+#define PROFILE_COMPUTE_EVENT(name, submittedNs, durationNs)
+#define PROFILE_LOG_STATS()
+#define PROFILE_EXPORT(filename)
+
+#endif
@@ -0,0 +1,990 @@
+#include "RenderGraph.h"
+#include "Log.h"
+
+#include <algorithm>
+
+namespace
+{
+	struct UsageInfo
+	{
+		VkImageLayout layout;
+		VkPipelineStageFlags stages;
+		VkAccessFlags access;
+		VkImageUsageFlags imageUsage;
+		bool write;
+		bool attachment;
+	};
+
+	// In ResourceUsage order
+	const UsageInfo USAGE_INFOS[] = {
+		{ VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, true, true },
+		{ VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, true, true },
+		{ VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, true, true },
+		{ VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, false, true },
+		{ VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_USAGE_SAMPLED_BIT, false, false },
+		{ VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_USAGE_STORAGE_BIT, false, false },
+		{ VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_USAGE_STORAGE_BIT, true, false },
+		{ VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_USAGE_TRANSFER_SRC_BIT, false, false },
+		{ VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_USAGE_TRANSFER_DST_BIT, true, false },
+	};
+
+	const VkImageUsageFlags ATTACHMENT_USAGE = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+		VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+
+	const VkAccessFlags WRITE_ACCESS = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT |
+		VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	const UsageInfo& GetUsageInfo(ResourceUsage usage)
+	{
+		return USAGE_INFOS[(uint32_t)usage];
+	}
+
+	// A clear or a resolve replaces the whole image, nothing earlier passes left is needed
+	bool Overwrites(ResourceUsage usage, bool clear)
+	{
+		return clear || usage == ResourceUsage::ResolveAttachment;
+	}
+
+	bool IsDepthFormat(VkFormat format)
+	{
+		switch (format)
+		{
+		case VK_FORMAT_D16_UNORM:
+		case VK_FORMAT_X8_D24_UNORM_PACK32:
+		case VK_FORMAT_D32_SFLOAT:
+		case VK_FORMAT_D16_UNORM_S8_UINT:
+		case VK_FORMAT_D24_UNORM_S8_UINT:
+		case VK_FORMAT_D32_SFLOAT_S8_UINT:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	VkImageAspectFlags GetAspectMask(VkFormat format)
+	{
+		switch (format)
+		{
+		case VK_FORMAT_D16_UNORM_S8_UINT:
+		case VK_FORMAT_D24_UNORM_S8_UINT:
+		case VK_FORMAT_D32_SFLOAT_S8_UINT:
+			return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+		default:
+			return IsDepthFormat(format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+		}
+	}
+
+	// Where an image stands while the passes are walked in order
+	struct ResourceState
+	{
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkPipelineStageFlags writeStages = 0;	// Last write, or layout transition
+		VkAccessFlags writeAccess = 0;
+		VkPipelineStageFlags readStages = 0;	// Reads since then, a write has to wait for them
+		VkPipelineStageFlags visibleStages = 0;	// Stages the last write has been made visible to
+		bool hasContents = false;				// Written earlier in the execution
+	};
+}
+
+void RenderGraph::Initialize(VkDevice device, MemoryAllocator& allocator, DeletionQueue& deletions)
+{
+	m_device = device;
+	m_allocator = &allocator;
+	m_deletions = &deletions;
+}
+
+void RenderGraph::Shutdown()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	// The device is idle, nothing has to wait for the frames
+	DestroyTargets(false);
+	DestroyRenderPasses(false);
+	Reset();
+
+	m_device = VK_NULL_HANDLE;
+}
+
+void RenderGraph::Reset()
+{
+	DestroyTargets(true);
+	DestroyRenderPasses(true);
+
+	m_passes.clear();
+	m_resources.clear();
+	m_after = BarrierBatch();
+	m_compiled = false;
+	m_stats = RenderGraphStats();
+}
+
+RenderResource RenderGraph::ImportImage(const std::string& name, VkFormat format, VkImageLayout finalLayout, VkPipelineStageFlags waitStage)
+{
+	Resource resource;
+	resource.name = name;
+	resource.format = format;
+	resource.samples = VK_SAMPLE_COUNT_1_BIT;
+	resource.imported = true;
+	resource.finalLayout = finalLayout;
+	resource.waitStage = waitStage;
+
+	m_resources.push_back(resource);
+	return (RenderResource)m_resources.size() - 1;
+}
+
+RenderResource RenderGraph::CreateImage(const std::string& name, VkFormat format, VkSampleCountFlagBits samples)
+{
+	Resource resource;
+	resource.name = name;
+	resource.format = format;
+	resource.samples = samples;
+	resource.imported = false;
+	resource.finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	resource.waitStage = 0;
+
+	m_resources.push_back(resource);
+	return (RenderResource)m_resources.size() - 1;
+}
+
+uint32_t RenderGraph::AddPass(const std::string& name, RenderPassCallback callback)
+{
+	Pass pass;
+	pass.name = name;
+	pass.callback = callback;
+
+	m_passes.push_back(pass);
+	return (uint32_t)m_passes.size() - 1;
+}
+
+void RenderGraph::Use(uint32_t pass, RenderResource resource, ResourceUsage usage)
+{
+	m_passes[pass].uses.push_back(ResourceUse{ resource, usage, false, {} });
+}
+
+void RenderGraph::Clear(uint32_t pass, RenderResource resource, ResourceUsage usage, const VkClearValue& clearValue)
+{
+	m_passes[pass].uses.push_back(ResourceUse{ resource, usage, true, clearValue });
+}
+
+void RenderGraph::Cull()
+{
+	// Walked backwards, a pass is needed if it writes something a later needed pass or the output reads
+	std::vector<bool> needed(m_resources.size(), false);
+	for (size_t r = 0; r < m_resources.size(); ++r)
+	{
+		needed[r] = m_resources[r].imported;
+	}
+
+	for (size_t p = m_passes.size(); p-- > 0;)
+	{
+		Pass& pass = m_passes[p];
+
+		// Passes that write no images have effects the graph can't see, they always stay
+		bool writesImage = false;
+		bool writesNeeded = false;
+		for (const ResourceUse& use : pass.uses)
+		{
+			if (GetUsageInfo(use.usage).write)
+			{
+				writesImage = true;
+				writesNeeded = writesNeeded || needed[use.resource];
+			}
+		}
+
+		pass.culled = writesImage && !writesNeeded;
+		if (pass.culled)
+		{
+			continue;
+		}
+
+		// A clear or resolve overwrites everything earlier passes left, anything else builds on it
+		for (const ResourceUse& use : pass.uses)
+		{
+			if (Overwrites(use.usage, use.clear))
+			{
+				needed[use.resource] = false;
+			}
+		}
+
+		for (const ResourceUse& use : pass.uses)
+		{
+			if (!Overwrites(use.usage, use.clear))
+			{
+				needed[use.resource] = true;
+			}
+		}
+	}
+}
+
+bool RenderGraph::Compile()
+{
+	for (const Pass& pass : m_passes)
+	{
+		for (const ResourceUse& use : pass.uses)
+		{
+			if (use.resource >= m_resources.size())
+			{
+				LOG_ERROR("Render graph pass %s uses an image that was never declared", pass.name.c_str());
+				return false;
+			}
+		}
+	}
+
+	// Frames in flight may still be using the last compile's render passes and the frame buffers made for
+	// them, CreateTargets makes new ones
+	DestroyTargets(true);
+	DestroyRenderPasses(true);
+	m_compiled = false;
+
+	Cull();
+
+	m_stats = RenderGraphStats();
+	m_stats.passes = (uint32_t)m_passes.size();
+
+	for (Resource& resource : m_resources)
+	{
+		resource.usage = 0;
+		resource.firstPass = ~0u;
+		resource.lastPass = 0;
+	}
+
+	// Transient images are shared by the frames in flight and may be aliased, so whatever comes first in a
+	// frame waits for everything the transient images did in the last one
+	VkPipelineStageFlags transientStages = 0;
+	VkPipelineStageFlags transientWriteStages = 0;
+	VkAccessFlags transientWriteAccess = 0;
+
+	for (uint32_t p = 0; p < m_passes.size(); ++p)
+	{
+		if (m_passes[p].culled)
+		{
+			m_stats.culledPasses++;
+			continue;
+		}
+
+		for (const ResourceUse& use : m_passes[p].uses)
+		{
+			const UsageInfo& info = GetUsageInfo(use.usage);
+			Resource& resource = m_resources[use.resource];
+
+			resource.usage |= info.imageUsage;
+			resource.firstPass = std::min(resource.firstPass, p);
+			resource.lastPass = std::max(resource.lastPass, p);
+
+			if (!resource.imported)
+			{
+				transientStages |= info.stages;
+				if (info.write)
+				{
+					transientWriteStages |= info.stages;
+					transientWriteAccess |= info.access & WRITE_ACCESS;
+				}
+			}
+		}
+	}
+
+	std::vector<ResourceState> states(m_resources.size());
+	for (size_t r = 0; r < m_resources.size(); ++r)
+	{
+		if (m_resources[r].imported)
+		{
+			states[r].readStages = m_resources[r].waitStage;
+		}
+		else
+		{
+			states[r].readStages = transientStages;
+			states[r].writeStages = transientWriteStages;
+			states[r].writeAccess = transientWriteAccess;
+		}
+	}
+
+	for (uint32_t p = 0; p < m_passes.size(); ++p)
+	{
+		Pass& pass = m_passes[p];
+		pass.before = BarrierBatch();
+		pass.attachments.clear();
+		pass.clearValues.clear();
+
+		if (pass.culled)
+		{
+			continue;
+		}
+
+		// Per use, whether an earlier pass wrote something this one builds on
+		std::vector<bool> hadContents(pass.uses.size());
+
+		for (size_t u = 0; u < pass.uses.size(); ++u)
+		{
+			const ResourceUse& use = pass.uses[u];
+			const UsageInfo& info = GetUsageInfo(use.usage);
+			ResourceState& state = states[use.resource];
+			hadContents[u] = state.hasContents && !Overwrites(use.usage, use.clear);
+
+			bool layoutChange = state.layout != info.layout;
+			bool hazard = info.write ? (state.writeStages | state.readStages) != 0 : state.writeStages != 0 && (info.stages & ~state.visibleStages) != 0;
+
+			if (layoutChange || hazard)
+			{
+				Barrier barrier;
+				barrier.resource = use.resource;
+				// Contents nothing reads are dropped rather than transitioned
+				barrier.oldLayout = hadContents[u] ? state.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+				barrier.newLayout = info.layout;
+				barrier.srcAccess = state.writeAccess;
+				barrier.dstAccess = info.access;
+				pass.before.barriers.push_back(barrier);
+
+				pass.before.srcStages |= state.writeStages | state.readStages;
+				pass.before.dstStages |= info.stages;
+
+				if (info.write || layoutChange)
+				{
+					// A layout transition is a write as far as later uses are concerned
+					state.writeStages = info.stages;
+					state.writeAccess = info.write ? info.access & WRITE_ACCESS : 0;
+					state.readStages = info.write ? 0 : info.stages;
+				}
+				else
+				{
+					state.readStages |= info.stages;
+				}
+
+				state.visibleStages = info.stages;
+				state.layout = info.layout;
+			}
+			else
+			{
+				state.readStages |= info.stages;
+			}
+
+			if (info.write)
+			{
+				state.hasContents = true;
+			}
+		}
+
+		if (!pass.before.barriers.empty())
+		{
+			m_stats.barrierBatches++;
+			m_stats.imageBarriers += (uint32_t)pass.before.barriers.size();
+		}
+
+		if (!CreateRenderPass(pass, p, hadContents))
+		{
+			return false;
+		}
+
+		// An imported image's last render pass leaves it in its final layout, which saves the barrier after
+		for (size_t u = 0; u < pass.uses.size(); ++u)
+		{
+			const Resource& resource = m_resources[pass.uses[u].resource];
+			if (pass.renderPass != VK_NULL_HANDLE && GetUsageInfo(pass.uses[u].usage).attachment && resource.imported && resource.lastPass == p)
+			{
+				states[pass.uses[u].resource].layout = resource.finalLayout;
+			}
+		}
+	}
+
+	m_after = BarrierBatch();
+	for (size_t r = 0; r < m_resources.size(); ++r)
+	{
+		const Resource& resource = m_resources[r];
+		ResourceState& state = states[r];
+
+		// Also covers images no pass ended up using, they still have to be presentable
+		if (resource.imported && state.layout != resource.finalLayout)
+		{
+			m_after.barriers.push_back(Barrier{ (RenderResource)r, state.hasContents ? state.layout : VK_IMAGE_LAYOUT_UNDEFINED, resource.finalLayout, state.writeAccess, 0 });
+			m_after.srcStages |= state.writeStages | state.readStages;
+			m_after.dstStages |= VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+		}
+	}
+
+	if (!m_after.barriers.empty())
+	{
+		m_stats.barrierBatches++;
+		m_stats.imageBarriers += (uint32_t)m_after.barriers.size();
+	}
+
+	m_compiled = true;
+	return true;
+}
+
+bool RenderGraph::CreateRenderPass(Pass& pass, uint32_t passIndex, const std::vector<bool>& loadContents)
+{
+	std::vector<VkAttachmentDescription> attachments;
+	std::vector<VkAttachmentReference> colorRefs;
+	std::vector<VkAttachmentReference> resolveRefs;
+	VkAttachmentReference depthRef = {};
+	bool hasDepth = false;
+	bool hasSamples = false;
+	VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+
+	// Colors first, then what they resolve into, then depth
+	enum { COLOR_GROUP, RESOLVE_GROUP, DEPTH_GROUP };
+
+	for (int group = COLOR_GROUP; group <= DEPTH_GROUP; ++group)
+	{
+		for (size_t u = 0; u < pass.uses.size(); ++u)
+		{
+			const ResourceUse& use = pass.uses[u];
+			const UsageInfo& info = GetUsageInfo(use.usage);
+			const Resource& resource = m_resources[use.resource];
+
+			bool depth = use.usage == ResourceUsage::DepthAttachment || use.usage == ResourceUsage::DepthRead;
+			bool resolve = use.usage == ResourceUsage::ResolveAttachment;
+			if (!info.attachment || group != (depth ? DEPTH_GROUP : (resolve ? RESOLVE_GROUP : COLOR_GROUP)))
+			{
+				continue;
+			}
+
+			if (resolve)
+			{
+				if (resource.samples != VK_SAMPLE_COUNT_1_BIT || samples == VK_SAMPLE_COUNT_1_BIT || resolveRefs.size() >= colorRefs.size())
+				{
+					LOG_ERROR("Render graph pass %s resolves into %s without a multisampled color attachment to resolve",
+						pass.name.c_str(), resource.name.c_str());
+					return false;
+				}
+			}
+			else
+			{
+				if (hasSamples && resource.samples != samples)
+				{
+					LOG_ERROR("Render graph pass %s mixes sample counts across its attachments", pass.name.c_str());
+					return false;
+				}
+
+				samples = resource.samples;
+				hasSamples = true;
+			}
+
+			// Earlier passes' contents are loaded, only what a later pass or the output reads is stored
+			bool store = resource.imported || resource.lastPass > passIndex;
+
+			VkAttachmentDescription attachment = {};
+			attachment.format = resource.format;
+			attachment.samples = resource.samples;
+			attachment.loadOp = use.clear ? VK_ATTACHMENT_LOAD_OP_CLEAR : (loadContents[u] ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_DONT_CARE);
+			attachment.storeOp = store ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			// The barrier ahead of the pass already did the transition
+			attachment.initialLayout = info.layout;
+			attachment.finalLayout = resource.imported && resource.lastPass == passIndex ? resource.finalLayout : info.layout;
+
+			VkAttachmentReference ref = {};
+			ref.attachment = (uint32_t)attachments.size();
+			ref.layout = info.layout;
+
+			if (depth)
+			{
+				depthRef = ref;
+				hasDepth = true;
+			}
+			else if (resolve)
+			{
+				resolveRefs.push_back(ref);
+			}
+			else
+			{
+				colorRefs.push_back(ref);
+			}
+
+			attachments.push_back(attachment);
+			pass.attachments.push_back(use.resource);
+			pass.clearValues.push_back(use.clearValue);
+		}
+	}
+
+	if (attachments.empty())
+	{
+		return true;
+	}
+
+	// Color attachments past the last resolve aren't resolved
+	if (!resolveRefs.empty())
+	{
+		resolveRefs.resize(colorRefs.size(), VkAttachmentReference{ VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_UNDEFINED });
+	}
+
+	VkSubpassDescription subPass = {};
+	subPass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subPass.colorAttachmentCount = (uint32_t)colorRefs.size();
+	subPass.pColorAttachments = colorRefs.data();
+	subPass.pResolveAttachments = resolveRefs.empty() ? nullptr : resolveRefs.data();
+	subPass.pDepthStencilAttachment = hasDepth ? &depthRef : nullptr;
+
+	VkRenderPassCreateInfo createInfo = {};
+	createInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	createInfo.attachmentCount = (uint32_t)attachments.size();
+	createInfo.pAttachments = attachments.data();
+	createInfo.subpassCount = 1;
+	createInfo.pSubpasses = &subPass;
+
+	if (vkCreateRenderPass(m_device, &createInfo, nullptr, &pass.renderPass) != VK_SUCCESS)
+	{
+		LOG_ERROR("Unable to create the render pass for %s", pass.name.c_str());
+		return false;
+	}
+
+	m_stats.renderPasses++;
+
+	return true;
+}
+
+void RenderGraph::SetImportedImages(RenderResource resource, const std::vector<VkImage>& images, const std::vector<VkImageView>& views)
+{
+	m_resources[resource].images = images;
+	m_resources[resource].views = views;
+}
+
+bool RenderGraph::CreateTargets(VkExtent2D extent)
+{
+	if (!m_compiled)
+	{
+		LOG_ERROR("Render graph targets requested before it was compiled");
+		return false;
+	}
+
+	DestroyTargets(true);
+
+	m_extent = extent;
+	m_imageCount = 1;
+
+	for (const Resource& resource : m_resources)
+	{
+		if (resource.imported)
+		{
+			if (resource.views.empty())
+			{
+				LOG_ERROR("Render graph image %s was never bound to an image", resource.name.c_str());
+				return false;
+			}
+
+			m_imageCount = std::max(m_imageCount, (uint32_t)resource.views.size());
+		}
+	}
+
+	if (!CreateTransientImages(extent))
+	{
+		return false;
+	}
+
+	for (Pass& pass : m_passes)
+	{
+		if (pass.culled || pass.renderPass == VK_NULL_HANDLE)
+		{
+			continue;
+		}
+
+		pass.framebuffers.assign(m_imageCount, VK_NULL_HANDLE);
+		std::vector<VkImageView> views(pass.attachments.size());
+
+		for (uint32_t i = 0; i < m_imageCount; ++i)
+		{
+			for (size_t a = 0; a < pass.attachments.size(); ++a)
+			{
+				views[a] = GetView(pass.attachments[a], i);
+			}
+
+			VkFramebufferCreateInfo createInfo = {};
+			createInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+			createInfo.renderPass = pass.renderPass;
+			createInfo.attachmentCount = (uint32_t)views.size();
+			createInfo.pAttachments = views.data();
+			createInfo.width = extent.width;
+			createInfo.height = extent.height;
+			createInfo.layers = 1;
+
+			if (vkCreateFramebuffer(m_device, &createInfo, nullptr, &pass.framebuffers[i]) != VK_SUCCESS)
+			{
+				LOG_ERROR("Unable to create the frame buffer for %s", pass.name.c_str());
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+bool RenderGraph::CreateTransientImages(VkExtent2D extent)
+{
+	std::vector<RenderResource> transients;
+	std::vector<VkMemoryRequirements> requirements(m_resources.size());
+	std::vector<bool> lazy(m_resources.size(), false);
+
+	m_stats.transientImages = 0;
+	m_stats.lazyImages = 0;
+	m_stats.transientBytes = 0;
+	m_stats.lazyBytes = 0;
+
+	for (RenderResource r = 0; r < m_resources.size(); ++r)
+	{
+		Resource& resource = m_resources[r];
+		if (resource.imported || resource.firstPass == ~0u)
+		{
+			continue;
+		}
+
+		// Attachments of a single render pass are neither loaded nor stored, tilers can keep them in tile memory
+		bool tileOnly = resource.firstPass == resource.lastPass && (resource.usage & ~ATTACHMENT_USAGE) == 0;
+
+		VkImageCreateInfo imageInfo = {};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = resource.format;
+		imageInfo.extent = { extent.width, extent.height, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = resource.samples;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = tileOnly ? resource.usage | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : resource.usage;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		resource.images.assign(1, VK_NULL_HANDLE);
+		if (vkCreateImage(m_device, &imageInfo, nullptr, &resource.images[0]) != VK_SUCCESS)
+		{
+			LOG_ERROR("Unable to create render graph image %s", resource.name.c_str());
+			return false;
+		}
+
+		vkGetImageMemoryRequirements(m_device, resource.images[0], &requirements[r]);
+		transients.push_back(r);
+
+		uint32_t memoryType;
+		lazy[r] = tileOnly && m_allocator->FindMemoryType(requirements[r].memoryTypeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, memoryType);
+
+		m_stats.transientImages++;
+		m_stats.transientBytes += requirements[r].size;
+
+		if (lazy[r])
+		{
+			m_stats.lazyImages++;
+			m_stats.lazyBytes += requirements[r].size;
+		}
+	}
+
+	// Largest first, so the smaller images fill in behind them. An image joins the first slot whose images
+	// are all done before it starts or start after it's done.
+	std::sort(transients.begin(), transients.end(), [&requirements](RenderResource a, RenderResource b)
+	{
+		return requirements[a].size > requirements[b].size;
+	});
+
+	for (RenderResource r : transients)
+	{
+		const Resource& resource = m_resources[r];
+		MemorySlot* slot = nullptr;
+
+		// Lazily allocated memory is only committed if the tiles spill, which is tracked per allocation
+		if (lazy[r])
+		{
+			m_memory.push_back(MemorySlot());
+			m_memory.back().requirements = requirements[r];
+			m_memory.back().resources.push_back(r);
+			m_memory.back().lazy = true;
+			continue;
+		}
+
+		for (MemorySlot& candidate : m_memory)
+		{
+			bool fits = !candidate.lazy && (candidate.requirements.memoryTypeBits & requirements[r].memoryTypeBits) != 0;
+
+			for (size_t i = 0; i < candidate.resources.size() && fits; ++i)
+			{
+				const Resource& other = m_resources[candidate.resources[i]];
+				fits = resource.lastPass < other.firstPass || other.lastPass < resource.firstPass;
+			}
+
+			if (fits)
+			{
+				slot = &candidate;
+				break;
+			}
+		}
+
+		if (slot == nullptr)
+		{
+			m_memory.push_back(MemorySlot());
+			slot = &m_memory.back();
+			slot->requirements = requirements[r];
+		}
+		else
+		{
+			slot->requirements.size = std::max(slot->requirements.size, requirements[r].size);
+			slot->requirements.alignment = std::max(slot->requirements.alignment, requirements[r].alignment);
+			slot->requirements.memoryTypeBits &= requirements[r].memoryTypeBits;
+		}
+
+		slot->resources.push_back(r);
+	}
+
+	m_stats.memorySlots = (uint32_t)m_memory.size();
+	m_stats.allocatedBytes = 0;
+
+	for (MemorySlot& slot : m_memory)
+	{
+		VkMemoryPropertyFlags properties = slot.lazy ? VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		if (!m_allocator->Allocate(slot.requirements, properties, AllocationStrategy::Buddy, ResourceKind::Optimal, slot.allocation))
+		{
+			LOG_ERROR("Unable to allocate memory for render graph image %s", m_resources[slot.resources[0]].name.c_str());
+			return false;
+		}
+
+		if (!slot.lazy)
+		{
+			m_stats.allocatedBytes += slot.requirements.size;
+		}
+
+		for (RenderResource r : slot.resources)
+		{
+			if (vkBindImageMemory(m_device, m_resources[r].images[0], slot.allocation.memory, slot.allocation.offset) != VK_SUCCESS)
+			{
+				LOG_ERROR("Unable to bind memory for render graph image %s", m_resources[r].name.c_str());
+				return false;
+			}
+		}
+	}
+
+	for (RenderResource r : transients)
+	{
+		Resource& resource = m_resources[r];
+
+		VkImageViewCreateInfo createInfo = {};
+		createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		createInfo.image = resource.images[0];
+		createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		createInfo.format = resource.format;
+		createInfo.components = { VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY };
+		createInfo.subresourceRange = { GetAspectMask(resource.format), 0, 1, 0, 1 };
+
+		resource.views.assign(1, VK_NULL_HANDLE);
+		if (vkCreateImageView(m_device, &createInfo, nullptr, &resource.views[0]) != VK_SUCCESS)
+		{
+			LOG_ERROR("Unable to create the view of render graph image %s", resource.name.c_str());
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void RenderGraph::DestroyTargets(bool retire)
+{
+	for (Pass& pass : m_passes)
+	{
+		for (VkFramebuffer framebuffer : pass.framebuffers)
+		{
+			if (retire)
+			{
+				m_deletions->RetireFramebuffer(framebuffer);
+			}
+			else if (framebuffer != VK_NULL_HANDLE)
+			{
+				vkDestroyFramebuffer(m_device, framebuffer, nullptr);
+			}
+		}
+
+		pass.framebuffers.clear();
+	}
+
+	for (Resource& resource : m_resources)
+	{
+		if (resource.imported)
+		{
+			continue;
+		}
+
+		for (VkImageView view : resource.views)
+		{
+			if (retire)
+			{
+				m_deletions->RetireImageView(view);
+			}
+			else if (view != VK_NULL_HANDLE)
+			{
+				vkDestroyImageView(m_device, view, nullptr);
+			}
+		}
+
+		for (VkImage image : resource.images)
+		{
+			if (retire)
+			{
+				m_deletions->RetireImage(image);
+			}
+			else if (image != VK_NULL_HANDLE)
+			{
+				vkDestroyImage(m_device, image, nullptr);
+			}
+		}
+
+		resource.views.clear();
+		resource.images.clear();
+	}
+
+	for (MemorySlot& slot : m_memory)
+	{
+		if (retire)
+		{
+			m_deletions->RetireAllocation(slot.allocation);
+		}
+		else if (slot.allocation.memory != VK_NULL_HANDLE)
+		{
+			m_allocator->Free(slot.allocation);
+		}
+	}
+
+	m_memory.clear();
+}
+
+void RenderGraph::DestroyRenderPasses(bool retire)
+{
+	for (Pass& pass : m_passes)
+	{
+		if (retire)
+		{
+			m_deletions->RetireRenderPass(pass.renderPass);
+		}
+		else if (pass.renderPass != VK_NULL_HANDLE)
+		{
+			vkDestroyRenderPass(m_device, pass.renderPass, nullptr);
+		}
+
+		pass.renderPass = VK_NULL_HANDLE;
+	}
+}
+
+void RenderGraph::Execute(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+	RenderGraphContext context;
+	context.extent = m_extent;
+	context.imageIndex = imageIndex;
+
+	for (const Pass& pass : m_passes)
+	{
+		if (pass.culled)
+		{
+			continue;
+		}
+
+		RecordBarriers(commandBuffer, pass.before, imageIndex);
+
+		context.renderPass = pass.renderPass;
+		context.framebuffer = pass.renderPass != VK_NULL_HANDLE ? pass.framebuffers[imageIndex] : VK_NULL_HANDLE;
+		context.contents = pass.contents;
+
+		if (pass.renderPass != VK_NULL_HANDLE)
+		{
+			VkRenderPassBeginInfo renderPassInfo = {};
+			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+			renderPassInfo.renderPass = pass.renderPass;
+			renderPassInfo.framebuffer = context.framebuffer;
+			renderPassInfo.renderArea.offset = { 0, 0 };
+			renderPassInfo.renderArea.extent = m_extent;
+			renderPassInfo.clearValueCount = (uint32_t)pass.clearValues.size();
+			renderPassInfo.pClearValues = pass.clearValues.data();
+
+			vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, pass.contents);
+		}
+
+		if (pass.callback)
+		{
+			pass.callback(commandBuffer, context);
+		}
+
+		if (pass.renderPass != VK_NULL_HANDLE)
+		{
+			vkCmdEndRenderPass(commandBuffer);
+		}
+	}
+
+	RecordBarriers(commandBuffer, m_after, imageIndex);
+}
+
+void RenderGraph::RecordBarriers(VkCommandBuffer commandBuffer, const BarrierBatch& batch, uint32_t imageIndex)
+{
+	if (batch.barriers.empty())
+	{
+		return;
+	}
+
+	m_barrierScratch.resize(batch.barriers.size());
+
+	for (size_t i = 0; i < batch.barriers.size(); ++i)
+	{
+		const Barrier& barrier = batch.barriers[i];
+
+		VkImageMemoryBarrier& imageBarrier = m_barrierScratch[i];
+		imageBarrier = {};
+		imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		imageBarrier.srcAccessMask = barrier.srcAccess;
+		imageBarrier.dstAccessMask = barrier.dstAccess;
+		imageBarrier.oldLayout = barrier.oldLayout;
+		imageBarrier.newLayout = barrier.newLayout;
+		imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.image = GetImage(barrier.resource, imageIndex);
+		imageBarrier.subresourceRange = { GetAspectMask(m_resources[barrier.resource].format), 0, 1, 0, 1 };
+	}
+
+	VkPipelineStageFlags srcStages = batch.srcStages != 0 ? batch.srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, srcStages, batch.dstStages, 0, 0, nullptr, 0, nullptr, (uint32_t)m_barrierScratch.size(), m_barrierScratch.data());
+}
+
+VkImage RenderGraph::GetImage(RenderResource resource, uint32_t imageIndex) const
+{
+	const Resource& r = m_resources[resource];
+	return r.images[r.imported ? imageIndex : 0];
+}
+
+VkImageView RenderGraph::GetView(RenderResource resource, uint32_t imageIndex) const
+{
+	const Resource& r = m_resources[resource];
+	return r.views[r.imported ? imageIndex : 0];
+}
+
+void RenderGraph::SetPassContents(uint32_t pass, VkSubpassContents contents)
+{
+	m_passes[pass].contents = contents;
+}
+
+VkRenderPass RenderGraph::GetRenderPass(uint32_t pass) const
+{
+	return m_passes[pass].renderPass;
+}
+
+bool RenderGraph::IsCulled(uint32_t pass) const
+{
+	return m_passes[pass].culled;
+}
+
+void RenderGraph::LogStats() const
+{
+	// What the driver had to back the lazily allocated images with so far
+	VkDeviceSize committedBytes = 0;
+	for (const MemorySlot& slot : m_memory)
+	{
+		if (slot.lazy)
+		{
+			VkDeviceSize committed = 0;
+			vkGetDeviceMemoryCommitment(m_device, slot.allocation.memory, &committed);
+			committedBytes += committed;
+		}
+	}
+
+	LOG_INFO("Render graph: %u passes, %u culled, %u render passes, %u barriers in %u batches, %u transient images in %u allocations, %.2fMB instead of %.2fMB, %u lazily allocated with %.2fMB of %.2fMB committed",
+		m_stats.passes, m_stats.culledPasses, m_stats.renderPasses, m_stats.imageBarriers, m_stats.barrierBatches, m_stats.transientImages, m_stats.memorySlots,
+		m_stats.allocatedBytes / (1024.0 * 1024.0), (m_stats.transientBytes - m_stats.lazyBytes) / (1024.0 * 1024.0), m_stats.lazyImages,
+		committedBytes / (1024.0 * 1024.0), m_stats.lazyBytes / (1024.0 * 1024.0));
+}
@@ -0,0 +1,200 @@
+#pragma once
+
+#include "DeletionQueue.h"
+#include "MemoryAllocator.h"
+
+#include <vulkan/vulkan.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Index of an image declared to the graph
+typedef uint32_t RenderResource;
+
+const RenderResource INVALID_RENDER_RESOURCE = ~0u;
+
+// How a pass touches an image. Each one implies the layout, stages and access the graph synchronizes with.
+enum class ResourceUsage
+{
+	ColorAttachment,	// Read and written, blending may read
+	ResolveAttachment,	// Written by resolving the pass's multisampled color attachments, paired in the order they were added
+	DepthAttachment,	// Tested and written
+	DepthRead,			// Tested only
+	Sampled,			// Read by fragment or compute shaders
+	StorageRead,		// Compute only
+	StorageWrite,
+	TransferSource,
+	TransferDestination
+};
+
+struct RenderGraphContext
+{
+	VkRenderPass renderPass = VK_NULL_HANDLE;	// Null for passes without attachments
+	VkFramebuffer framebuffer = VK_NULL_HANDLE;
+	VkExtent2D extent = {};
+	uint32_t imageIndex = 0;
+	VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE;
+};
+
+// Called with the render pass begun if the pass has attachments, after the barriers it needs
+typedef std::function<void(VkCommandBuffer commandBuffer, const RenderGraphContext& context)> RenderPassCallback;
+
+struct RenderGraphStats
+{
+	uint32_t passes = 0;
+	uint32_t culledPasses = 0;		// Nothing they wrote was used
+	uint32_t renderPasses = 0;
+	uint32_t barrierBatches = 0;	// vkCmdPipelineBarrier calls per execution
+	uint32_t imageBarriers = 0;
+	uint32_t transientImages = 0;
+	uint32_t memorySlots = 0;		// Transient images whose lifetimes don't overlap share one
+	uint32_t lazyImages = 0;		// Attachments that never leave tile memory, backed by lazily allocated memory
+	VkDeviceSize transientBytes = 0;	// What the transient images would take without aliasing
+	VkDeviceSize allocatedBytes = 0;	// Lazily allocated memory not included
+	VkDeviceSize lazyBytes = 0;
+};
+
+// Passes declare the images they use, Compile works out the rest. Passes nothing depends on are culled.
+// Every remaining pass with attachments gets a single subpass render pass whose load and store ops only
+// keep what a later pass reads, and the layout transitions and hazards between passes become one batched
+// vkCmdPipelineBarrier ahead of each pass, skipped when nothing changes. Transient images are owned by the
+// graph and live from their first to their last pass, those whose lifetimes don't overlap are bound to the
+// same memory. Attachments used by a single render pass are neither loaded nor stored, they are created as
+// transient attachments and get their own lazily allocated memory where the device has it, so on tilers
+// they only ever take tile memory.
+// Imported images, such as the swap chain's, are the graph's outputs. One is bound per image index and it
+// ends every execution in its final layout. Their contents aren't kept across executions.
+// Transient images are shared by every frame in flight, their first barrier of a frame waits for the last
+// frame's uses. Render thread only.
+class RenderGraph
+{
+public:
+	void Initialize(VkDevice device, MemoryAllocator& allocator, DeletionQueue& deletions);
+	void Shutdown();
+
+	// Drops every pass and image. The render passes, frame buffers and transient images are retired, frames in
+	// flight can still finish with them.
+	void Reset();
+
+	// waitStage is where the first use waits for the image to be available, e.g. the swap chain acquire semaphore's stage
+	RenderResource ImportImage(const std::string& name, VkFormat format, VkImageLayout finalLayout, VkPipelineStageFlags waitStage);
+	RenderResource CreateImage(const std::string& name, VkFormat format, VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT);
+
+	// Passes run in the order they are added
+	uint32_t AddPass(const std::string& name, RenderPassCallback callback);
+	void Use(uint32_t pass, RenderResource resource, ResourceUsage usage);
+	// An attachment the pass clears, its earlier contents aren't needed
+	void Clear(uint32_t pass, RenderResource resource, ResourceUsage usage, const VkClearValue& clearValue);
+
+	// Culls passes and creates the render passes. Doesn't depend on the size, only needs redoing when the passes change.
+	bool Compile();
+
+	// The imported image for every image index, not owned
+	void SetImportedImages(RenderResource resource, const std::vector<VkImage>& images, const std::vector<VkImageView>& views);
+	// (Re)creates the transient images at extent and the framebuffers. Anything replaced is retired.
+	bool CreateTargets(VkExtent2D extent);
+
+	void Execute(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+
+	// Secondary command buffers have to be recorded against the pass's render pass and framebuffer
+	void SetPassContents(uint32_t pass, VkSubpassContents contents);
+	VkRenderPass GetRenderPass(uint32_t pass) const;
+	bool IsCulled(uint32_t pass) const;
+
+	const RenderGraphStats& GetStats() const { return m_stats; }
+	void LogStats() const;
+
+private:
+	struct ResourceUse
+	{
+		RenderResource resource;
+		ResourceUsage usage;
+		bool clear;
+		VkClearValue clearValue;
+	};
+
+	struct Barrier
+	{
+		RenderResource resource;
+		VkImageLayout oldLayout;
+		VkImageLayout newLayout;
+		VkAccessFlags srcAccess;
+		VkAccessFlags dstAccess;
+	};
+
+	struct BarrierBatch
+	{
+		std::vector<Barrier> barriers;
+		VkPipelineStageFlags srcStages = 0;
+		VkPipelineStageFlags dstStages = 0;
+	};
+
+	struct Pass
+	{
+		std::string name;
+		RenderPassCallback callback;
+		std::vector<ResourceUse> uses;
+		VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE;
+
+		// Compiled
+		bool culled = false;
+		BarrierBatch before;
+		VkRenderPass renderPass = VK_NULL_HANDLE;
+		std::vector<RenderResource> attachments;	// In attachment order
+		std::vector<VkClearValue> clearValues;
+		std::vector<VkFramebuffer> framebuffers;	// Per image index
+	};
+
+	struct Resource
+	{
+		std::string name;
+		VkFormat format;
+		VkSampleCountFlagBits samples;
+		bool imported;
+		VkImageLayout finalLayout;
+		VkPipelineStageFlags waitStage;
+
+		// Imported ones have one per image index, transient ones have one owned image
+		std::vector<VkImage> images;
+		std::vector<VkImageView> views;
+
+		// Compiled, over the passes that weren't culled
+		VkImageUsageFlags usage = 0;
+		uint32_t firstPass = ~0u;
+		uint32_t lastPass = 0;
+	};
+
+	struct MemorySlot
+	{
+		VkMemoryRequirements requirements;
+		std::vector<RenderResource> resources;
+		Allocation allocation;
+		bool lazy = false;	// One image, never aliased
+	};
+
+	void Cull();
+	bool CreateRenderPass(Pass& pass, uint32_t passIndex, const std::vector<bool>& loadContents);
+	bool CreateTransientImages(VkExtent2D extent);
+	void DestroyTargets(bool retire);
+	void DestroyRenderPasses(bool retire);
+	void RecordBarriers(VkCommandBuffer commandBuffer, const BarrierBatch& batch, uint32_t imageIndex);
+	VkImage GetImage(RenderResource resource, uint32_t imageIndex) const;
+	VkImageView GetView(RenderResource resource, uint32_t imageIndex) const;
+
+private:
+	VkDevice m_device = VK_NULL_HANDLE;
+	MemoryAllocator* m_allocator = nullptr;
+	DeletionQueue* m_deletions = nullptr;
+
+	std::vector<Pass> m_passes;
+	std::vector<Resource> m_resources;
+	std::vector<MemorySlot> m_memory;
+	BarrierBatch m_after;	// Imported images into their final layout
+	VkExtent2D m_extent = {};
+	uint32_t m_imageCount = 0;
+	bool m_compiled = false;
+
+	std::vector<VkImageMemoryBarrier> m_barrierScratch;	// Reused by every batch so recording doesn't allocate
+
+	RenderGraphStats m_stats;
+};
@@ -10,7 +10,23 @@ bool Renderer::Initialize(GLFWwindow* window, unsigned int width, unsigned int h
 	result = m_vulkan->Initialize(window, width, height);
 	if (!result)
 	{
-		Log::Error("Unable to initialize vulkan");
+		LOG_ERROR("Unable to initialize vulkan");
+		return false;
+	}
+
+	return true;
+}
+
+bool Renderer::InitializeHeadless(unsigned int width, unsigned int height, bool enableReadback)
+{
+	bool result;
+
+	m_vulkan = new Vulkan();
+
+	result = m_vulkan->InitializeHeadless(width, height, DEFAULT_FRAMES_IN_FLIGHT, enableReadback);
+	if (!result)
+	{
+		LOG_ERROR("Unable to initialize headless vulkan");
 		return false;
 	}
 
@@ -26,7 +42,32 @@ void Renderer::Shutdown()
 	}
 }
 
-void Renderer::Draw()
+bool Renderer::Draw()
+{
+	return m_vulkan->DrawFrame();
+}
+
+void Renderer::SetPresentPolicy(PresentPolicy policy)
+{
+	m_vulkan->SetPresentPolicy(policy);
+}
+
+void Renderer::SetMaxQueuedFrames(uint32_t maxQueuedFrames)
+{
+	m_vulkan->SetMaxQueuedFrames(maxQueuedFrames);
+}
+
+void Renderer::SetMultisampling(VkSampleCountFlagBits samples)
+{
+	m_vulkan->SetMultisampling(samples);
+}
+
+void Renderer::SetDepthBuffer(bool enabled)
+{
+	m_vulkan->SetDepthBuffer(enabled);
+}
+
+void Renderer::Resize(unsigned int width, unsigned int height)
 {
-	m_vulkan->DrawFrame();
+	m_vulkan->Resize(width, height);
 }
@@ -6,9 +6,15 @@ class Renderer
 {
 public:
 	bool Initialize(GLFWwindow* window, unsigned int width, unsigned int height);
+	bool InitializeHeadless(unsigned int width, unsigned int height, bool enableReadback = false);
 	void Shutdown();
 
-	void Draw();
+	bool Draw();
+	void SetPresentPolicy(PresentPolicy policy);
+	void SetMaxQueuedFrames(uint32_t maxQueuedFrames);
+	void SetMultisampling(VkSampleCountFlagBits samples);
+	void SetDepthBuffer(bool enabled);
+	void Resize(unsigned int width, unsigned int height);
 
 private:
 	Vulkan* m_vulkan;
@@ -0,0 +1,107 @@
+#include "ShaderLoader.h"
+#include "EmbeddedShaders.h"
+#include "Log.h"
+
+#include <chrono>
+
+static const uint32_t SPIRV_HEADER_WORDS = 5;
+
+void ShaderLoader::Initialize(VkDevice device, const std::string& directory)
+{
+	m_device = device;
+	m_directory = directory;
+	m_stats = ShaderLoaderStats();
+}
+
+bool ShaderLoader::Load(const std::string& name, ShaderCode& code)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	const EmbeddedShader* embedded = FindEmbeddedShader(name);
+	if (embedded != nullptr)
+	{
+		code.words = embedded->code;
+		code.size = embedded->size;
+		code.source = ShaderSource::Embedded;
+		code.mapping.Close();
+		m_stats.embedded++;
+	}
+	else
+	{
+		if (!code.mapping.Open(m_directory + "/" + name + ".spv"))
+		{
+			return false;
+		}
+
+		code.words = (const uint32_t*)code.mapping.GetData();
+		code.size = code.mapping.GetSize();
+		code.source = ShaderSource::Mapped;
+		m_stats.mapped++;
+	}
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	m_stats.loadMs += elapsed.count();
+	m_stats.bytes += code.size;
+
+	return Validate(name, code.words, code.size);
+}
+
+bool ShaderLoader::CreateModule(const std::string& name, VkShaderModule* shaderModule)
+{
+	ShaderCode code;
+	if (!Load(name, code))
+	{
+		return false;
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	VkShaderModuleCreateInfo createInfo = {};
+	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	createInfo.codeSize = code.size;
+	createInfo.pCode = code.words;
+
+	VkResult result = vkCreateShaderModule(m_device, &createInfo, nullptr, shaderModule);
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	m_stats.moduleMs += elapsed.count();
+
+	if (result != VK_SUCCESS)
+	{
+		LOG_ERROR("Unable to create module from shader %s", name.c_str());
+		return false;
+	}
+
+	// The driver has its own copy now, the mapping closes with code
+	return true;
+}
+
+void ShaderLoader::LogStats() const
+{
+	LOG_INFO("Shaders: %u embedded, %u mapped, %llu bytes, load %.3fms, modules %.3fms",
+		m_stats.embedded, m_stats.mapped, (unsigned long long)m_stats.bytes, m_stats.loadMs, m_stats.moduleMs);
+}
+
+bool ShaderLoader::Validate(const std::string& name, const void* code, size_t size)
+{
+	if (((uintptr_t)code & (sizeof(uint32_t) - 1)) != 0)
+	{
+		LOG_ERROR("Shader %s isn't 4 byte aligned", name.c_str());
+		return false;
+	}
+
+	if (size < SPIRV_HEADER_WORDS * sizeof(uint32_t) || size % sizeof(uint32_t) != 0)
+	{
+		LOG_ERROR("Shader %s is %llu bytes, not a whole SPIR-V module", name.c_str(), (unsigned long long)size);
+		return false;
+	}
+
+	uint32_t magic = *(const uint32_t*)code;
+	if (magic != SPIRV_MAGIC)
+	{
+		LOG_ERROR("Shader %s%s", name.c_str(), magic == 0x03022307 ? " has the wrong endianness" : " is not SPIR-V");
+		return false;
+	}
+
+	return true;
+}
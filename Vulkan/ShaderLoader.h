@@ -0,0 +1,55 @@
+#pragma once
+
+#include "MappedFile.h"
+
+#include <vulkan/vulkan.h>
+#include <string>
+
+const uint32_t SPIRV_MAGIC = 0x07230203;
+
+enum class ShaderSource
+{
+	Embedded,	// Compiled into the executable
+	Mapped		// Memory mapped .spv file
+};
+
+// Points straight at the SPIR-V words, either in the executable or in a mapping owned by this object
+struct ShaderCode
+{
+	const uint32_t* words = nullptr;
+	size_t size = 0; // Bytes
+	ShaderSource source = ShaderSource::Mapped;
+	MappedFile mapping;
+};
+
+struct ShaderLoaderStats
+{
+	uint32_t embedded = 0;
+	uint32_t mapped = 0;
+	size_t bytes = 0;
+	double loadMs = 0.0;	// Finding or mapping the code
+	double moduleMs = 0.0;	// vkCreateShaderModule
+};
+
+// Hands SPIR-V to vkCreateShaderModule without copying it. Embedded shaders win when the build has them,
+// otherwise <directory>/<name>.spv is memory mapped for as long as the module is being created.
+class ShaderLoader
+{
+public:
+	void Initialize(VkDevice device, const std::string& directory);
+
+	bool Load(const std::string& name, ShaderCode& code);
+	bool CreateModule(const std::string& name, VkShaderModule* shaderModule);
+
+	const ShaderLoaderStats& GetStats() const { return m_stats; }
+	void LogStats() const;
+
+	// Checks what vkCreateShaderModule assumes but doesn't check: whole, aligned words and the SPIR-V magic
+	static bool Validate(const std::string& name, const void* code, size_t size);
+
+private:
+	VkDevice m_device = VK_NULL_HANDLE;
+	std::string m_directory;
+
+	ShaderLoaderStats m_stats;
+};
@@ -1,4 +1,5 @@
 #include "System.h"
+#include "Log.h"
 
 bool System::Initialize()
 {
@@ -9,8 +10,12 @@ bool System::Initialize()
 	glfwInit();
 
 	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+	glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 	m_window = glfwCreateWindow(width, height, "Vulkan Window", nullptr, nullptr);
 
+	glfwSetWindowUserPointer(m_window, this);
+	glfwSetFramebufferSizeCallback(m_window, FramebufferSizeCallback);
+
 	m_renderer = new Renderer();
 	result = m_renderer->Initialize(m_window, width, height);
 	if (!result)
@@ -18,14 +23,34 @@ bool System::Initialize()
 		return false;
 	}
 
+	SetFramePacing(FramePacingSettings());
+
 	return true;
 }
 
 void System::Run()
 {
+	m_clock.Initialize();
+
 	while (!glfwWindowShouldClose(m_window))
 	{
+		// Before polling, so a capped frame is built from the freshest input
+		m_pacer.WaitForNextFrame();
+
 		glfwPollEvents();
+		m_pacer.MarkInput();
+
+		int width = 0;
+		int height = 0;
+		glfwGetFramebufferSize(m_window, &width, &height);
+
+		// Nothing to render into while minimized, sleep until something happens
+		if (width == 0 || height == 0)
+		{
+			glfwWaitEvents();
+			m_clock.Restart();
+			continue;
+		}
 
 		Update();
 	}
@@ -33,6 +58,12 @@ void System::Run()
 
 void System::Release()
 {
+	if (m_clock.GetFrameCount() > 0)
+	{
+		m_clock.LogStats();
+		m_pacer.LogStats();
+	}
+
 	if (m_renderer)
 	{
 		m_renderer->Shutdown();
@@ -48,5 +79,36 @@ void System::Release()
 
 void System::Update()
 {
-	m_renderer->Draw();
+	if (m_renderer->Draw())
+	{
+		m_pacer.MarkPresented();
+	}
+
+	if (m_clock.Tick())
+	{
+		LOG_WARNING("Hitch: frame %llu took %.3fms", (unsigned long long)m_clock.GetFrameCount(), m_clock.GetFrameTimeMs());
+	}
+}
+
+void System::OnResize(int width, int height)
+{
+	m_renderer->Resize((unsigned int)width, (unsigned int)height);
+}
+
+void System::SetFramePacing(const FramePacingSettings& settings)
+{
+	m_pacer.Initialize(settings);
+	m_renderer->SetPresentPolicy(settings.policy);
+	m_renderer->SetMaxQueuedFrames(settings.maxQueuedFrames);
+
+	LOG_INFO("Frame pacing: %s, %.1f fps target", GetPresentPolicyName(settings.policy), settings.targetFps);
+}
+
+void System::FramebufferSizeCallback(GLFWwindow* window, int width, int height)
+{
+	System* system = (System*)glfwGetWindowUserPointer(window);
+	if (system)
+	{
+		system->OnResize(width, height);
+	}
 }
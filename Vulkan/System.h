@@ -1,5 +1,7 @@
 #pragma once
 #include "Renderer.h"
+#include "FrameClock.h"
+#include "FramePacer.h"
 
 class System
 {
@@ -10,8 +12,18 @@ public:
 
 	void Update();
 
+	void OnResize(int width, int height);
+
+	// Present mode, frame cap and queue depth, takes effect from the next frame
+	void SetFramePacing(const FramePacingSettings& settings);
+
+private:
+	static void FramebufferSizeCallback(GLFWwindow* window, int width, int height);
+
 private:
 	GLFWwindow* m_window; // Is included from vulkan.h. If glfw3.h is included I get macro redefintions. Should put this in its own class
 	Renderer* m_renderer;
+	FrameClock m_clock;
+	FramePacer m_pacer;
 };
 
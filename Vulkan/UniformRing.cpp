@@ -0,0 +1,171 @@
+#include "UniformRing.h"
+#include "Log.h"
+
+#include <algorithm>
+
+bool UniformRing::Initialize(VkPhysicalDevice physicalDevice, VkDevice device, MemoryAllocator& allocator, DescriptorLayoutCache& layouts, uint32_t framesInFlight,
+	VkDeviceSize frameSize, uint32_t range)
+{
+	m_device = device;
+	m_allocator = &allocator;
+	m_stats = UniformRingStats();
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	// Both are powers of two
+	m_alignment = std::max<VkDeviceSize>(16, properties.limits.minUniformBufferOffsetAlignment);
+	m_range = std::min(range, properties.limits.maxUniformBufferRange);
+	m_frameSize = (frameSize + m_alignment - 1) & ~(m_alignment - 1);
+
+	// Every dynamic offset sees range bytes past it, so the last region needs that much slack after it
+	if (!m_allocator->CreateBuffer(m_frameSize * framesInFlight + m_range, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, AllocationStrategy::Buddy, m_buffer))
+	{
+		LOG_ERROR("Unable to create the uniform ring");
+		return false;
+	}
+
+	m_mapped = (uint8_t*)m_buffer.allocation.mapped;
+
+	VkDescriptorSetLayoutBinding binding = {};
+	binding.binding = 0;
+	binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	binding.descriptorCount = 1;
+	binding.stageFlags = VK_SHADER_STAGE_ALL;
+
+	m_layout = layouts.Get({ binding });
+	if (m_layout == VK_NULL_HANDLE)
+	{
+		return false;
+	}
+
+	VkDescriptorPoolSize poolSize = {};
+	poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	poolSize.descriptorCount = 1;
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = 1;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+
+	if (vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &m_pool) != VK_SUCCESS)
+	{
+		LOG_ERROR("Unable to create the uniform ring descriptor pool");
+		return false;
+	}
+
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = m_pool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &m_layout;
+
+	if (vkAllocateDescriptorSets(m_device, &allocInfo, &m_set) != VK_SUCCESS)
+	{
+		LOG_ERROR("Unable to allocate the uniform ring descriptor set");
+		return false;
+	}
+
+	// Written once, the dynamic offset picks the allocation
+	VkDescriptorBufferInfo bufferInfo = {};
+	bufferInfo.buffer = m_buffer.buffer;
+	bufferInfo.offset = 0;
+	bufferInfo.range = m_range;
+
+	VkWriteDescriptorSet write = {};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet = m_set;
+	write.dstBinding = 0;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	write.pBufferInfo = &bufferInfo;
+
+	vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+
+	m_frameBase = 0;
+	m_head = 0;
+	m_allocations = 0;
+	m_failedAllocations = 0;
+	m_failedBefore = 0;
+
+	LOG_INFO("Uniform ring: %llu bytes per frame, %llu byte alignment, %u byte range",
+		(unsigned long long)m_frameSize, (unsigned long long)m_alignment, m_range);
+
+	return true;
+}
+
+void UniformRing::Shutdown()
+{
+	if (m_allocator == nullptr)
+	{
+		return;
+	}
+
+	if (m_pool != VK_NULL_HANDLE)
+	{
+		vkDestroyDescriptorPool(m_device, m_pool, nullptr);
+		m_pool = VK_NULL_HANDLE;
+	}
+
+	m_allocator->DestroyBuffer(m_buffer);
+	m_mapped = nullptr;
+	m_layout = VK_NULL_HANDLE;
+	m_set = VK_NULL_HANDLE;
+	m_allocator = nullptr;
+}
+
+void UniformRing::BeginFrame(uint32_t frame)
+{
+	// Close out whatever frame used the ring last
+	VkDeviceSize used = std::min(m_head.load(), m_frameSize);
+	uint64_t failed = m_failedAllocations.load();
+
+	m_stats.allocations = m_allocations.load();
+	m_stats.failedAllocations = failed;
+	m_stats.peakFrameBytes = std::max(m_stats.peakFrameBytes, used);
+
+	if (failed > m_failedBefore)
+	{
+		m_stats.exhaustedFrames++;
+		LOG_ERROR("Uniform ring exhausted: %llu allocations didn't fit in %llu bytes",
+			(unsigned long long)(failed - m_failedBefore), (unsigned long long)m_frameSize);
+	}
+
+	m_failedBefore = failed;
+	m_frameBase = frame * m_frameSize;
+	m_head = 0;
+}
+
+bool UniformRing::Allocate(uint32_t size, uint32_t& dynamicOffset, void*& data)
+{
+	if (size > m_range)
+	{
+		LOG_ERROR("Uniform allocation of %llu bytes is over the ring's %u byte range", (unsigned long long)size, m_range);
+		return false;
+	}
+
+	// Sizes are rounded up to the alignment, so every bump leaves the head aligned
+	VkDeviceSize alignedSize = (size + m_alignment - 1) & ~(m_alignment - 1);
+	VkDeviceSize offset = m_head.fetch_add(alignedSize);
+
+	if (offset + alignedSize > m_frameSize)
+	{
+		m_failedAllocations++;
+		return false;
+	}
+
+	m_allocations++;
+
+	dynamicOffset = (uint32_t)(m_frameBase + offset);
+	data = m_mapped + m_frameBase + offset;
+
+	return true;
+}
+
+void UniformRing::LogStats() const
+{
+	LOG_INFO("Uniform ring: %llu allocations, %llu failed in %u exhausted frames, peak of %llu bytes in a frame",
+		(unsigned long long)m_stats.allocations, (unsigned long long)m_stats.failedAllocations, m_stats.exhaustedFrames, (unsigned long long)m_stats.peakFrameBytes);
+}
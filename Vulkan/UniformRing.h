@@ -0,0 +1,83 @@
+#pragma once
+
+#include "DescriptorLayoutCache.h"
+#include "MemoryAllocator.h"
+
+#include <vulkan/vulkan.h>
+#include <atomic>
+#include <cstring>
+
+const VkDeviceSize DEFAULT_UNIFORM_RING_FRAME_SIZE = 4 * 1024 * 1024;
+
+// Largest single allocation, the descriptor's range. 16KB is the most every device guarantees.
+const uint32_t DEFAULT_UNIFORM_RING_RANGE = 16 * 1024;
+
+struct UniformRingStats
+{
+	uint64_t allocations = 0;
+	uint64_t failedAllocations = 0;	// Didn't fit in what was left of the frame's region
+	uint32_t exhaustedFrames = 0;
+	VkDeviceSize peakFrameBytes = 0;
+};
+
+// Per frame uniforms and per draw constants. One persistently mapped, host coherent buffer split into a
+// region per frame in flight. Allocations bump a pointer through the frame's region, aligned to
+// minUniformBufferOffsetAlignment, and are bound through a single dynamic uniform buffer descriptor with
+// the allocation's offset as the dynamic offset, so an update is a memcpy with no mapping or descriptor
+// writes. A frame that runs out of room fails its allocations and is reported once.
+// Allocate is thread safe, so recording workers can share the frame's region. Everything else is render thread only.
+class UniformRing
+{
+public:
+	bool Initialize(VkPhysicalDevice physicalDevice, VkDevice device, MemoryAllocator& allocator, DescriptorLayoutCache& layouts, uint32_t framesInFlight,
+		VkDeviceSize frameSize = DEFAULT_UNIFORM_RING_FRAME_SIZE, uint32_t range = DEFAULT_UNIFORM_RING_RANGE);
+	void Shutdown();
+
+	// Once the frame's fence has signaled, the region is free to overwrite
+	void BeginFrame(uint32_t frame);
+
+	// Room for size bytes, data is write only. False once the frame's region is exhausted or size is over the range.
+	bool Allocate(uint32_t size, uint32_t& dynamicOffset, void*& data);
+
+	template<typename T>
+	bool Push(const T& value, uint32_t& dynamicOffset)
+	{
+		void* data;
+		if (!Allocate(sizeof(T), dynamicOffset, data))
+		{
+			return false;
+		}
+
+		memcpy(data, &value, sizeof(T));
+		return true;
+	}
+
+	// One UNIFORM_BUFFER_DYNAMIC at binding 0, visible to every stage
+	VkDescriptorSetLayout GetLayout() const { return m_layout; }
+	VkDescriptorSet GetSet() const { return m_set; }
+
+	const UniformRingStats& GetStats() const { return m_stats; }
+	void LogStats() const;
+
+private:
+	VkDevice m_device = VK_NULL_HANDLE;
+	MemoryAllocator* m_allocator = nullptr;
+
+	AllocatedBuffer m_buffer;
+	uint8_t* m_mapped = nullptr;
+	VkDeviceSize m_alignment = 256;
+	VkDeviceSize m_frameSize = 0;
+	uint32_t m_range = 0;
+
+	VkDescriptorSetLayout m_layout = VK_NULL_HANDLE; // Owned by the layout cache
+	VkDescriptorPool m_pool = VK_NULL_HANDLE;
+	VkDescriptorSet m_set = VK_NULL_HANDLE;
+
+	VkDeviceSize m_frameBase = 0;
+	std::atomic<VkDeviceSize> m_head{ 0 }; // Relative to m_frameBase
+	std::atomic<uint64_t> m_allocations{ 0 };
+	std::atomic<uint64_t> m_failedAllocations{ 0 };
+	uint64_t m_failedBefore = 0; // m_failedAllocations when the frame began
+
+	UniformRingStats m_stats;
+};
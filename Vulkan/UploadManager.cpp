@@ -0,0 +1,476 @@
+#include "UploadManager.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+bool UploadManager::Initialize(VkPhysicalDevice physicalDevice, VkDevice device, MemoryAllocator& allocator, uint32_t transferFamily, uint32_t graphicsFamily, VkQueue transferQueue, VkDeviceSize ringSize)
+{
+	m_device = device;
+	m_allocator = &allocator;
+	m_transferQueue = transferQueue;
+	m_transferFamily = transferFamily;
+	m_graphicsFamily = graphicsFamily;
+	m_stats = UploadStats();
+
+	// Image copies need the source offset aligned to the texel size as well, 16 covers every format we upload
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	m_copyAlignment = std::max<VkDeviceSize>(16, properties.limits.optimalBufferCopyOffsetAlignment);
+
+	if (!m_allocator->CreateBuffer(ringSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, AllocationStrategy::Buddy, m_ring))
+	{
+		LOG_ERROR("Unable to create the staging ring");
+		return false;
+	}
+
+	m_ringArena.reset(new LinearArena(ringSize));
+
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.queueFamilyIndex = m_transferFamily;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+	VkSemaphoreCreateInfo semaphoreInfo = {};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	m_batches.resize(UPLOAD_BATCH_COUNT);
+
+	for (auto& batch : m_batches)
+	{
+		if (vkCreateCommandPool(m_device, &poolInfo, nullptr, &batch.pool) != VK_SUCCESS)
+		{
+			LOG_ERROR("Unable to create the upload command pool");
+			return false;
+		}
+
+		VkCommandBufferAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = batch.pool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+
+		if (vkAllocateCommandBuffers(m_device, &allocInfo, &batch.commandBuffer) != VK_SUCCESS)
+		{
+			LOG_ERROR("Unable to allocate the upload command buffer");
+			return false;
+		}
+
+		if (vkCreateFence(m_device, &fenceInfo, nullptr, &batch.fence) != VK_SUCCESS ||
+			vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &batch.semaphore) != VK_SUCCESS)
+		{
+			LOG_ERROR("Unable to create the upload sync objects");
+			return false;
+		}
+	}
+
+	LOG_INFO("Uploads on queue family %u%s, staging ring %llu bytes",
+		m_transferFamily, m_transferFamily != m_graphicsFamily ? " (dedicated transfer)" : " (shared with graphics)", (unsigned long long)ringSize);
+
+	return true;
+}
+
+void UploadManager::Shutdown()
+{
+	if (m_device == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	vkQueueWaitIdle(m_transferQueue);
+
+	LogStats();
+
+	for (auto& batch : m_batches)
+	{
+		vkDestroySemaphore(m_device, batch.semaphore, nullptr);
+		vkDestroyFence(m_device, batch.fence, nullptr);
+		vkDestroyCommandPool(m_device, batch.pool, nullptr);
+	}
+	m_batches.clear();
+	m_inFlight.clear();
+	m_recordingBatch = -1;
+	m_pending.clear();
+
+	m_allocator->DestroyBuffer(m_ring);
+	m_ringArena.reset();
+
+	m_device = VK_NULL_HANDLE;
+}
+
+UploadTicket UploadManager::UploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size, VkAccessFlags dstAccess, VkPipelineStageFlags dstStages)
+{
+	if (buffer == VK_NULL_HANDLE || data == nullptr || size == 0)
+	{
+		LOG_ERROR("Invalid buffer upload");
+		return 0;
+	}
+
+	UploadRequest request;
+	request.buffer = buffer;
+	request.offset = offset;
+	request.data = (const uint8_t*)data;
+	request.size = size;
+	request.dstAccess = dstAccess;
+	request.dstStages = dstStages;
+
+	return Enqueue(request);
+}
+
+UploadTicket UploadManager::UploadImage(VkImage image, VkImageAspectFlags aspect, VkExtent3D extent, VkImageLayout finalLayout, const void* data, VkDeviceSize size, VkAccessFlags dstAccess, VkPipelineStageFlags dstStages)
+{
+	if (image == VK_NULL_HANDLE || data == nullptr || size == 0)
+	{
+		LOG_ERROR("Invalid image upload");
+		return 0;
+	}
+
+	if (size > m_ringArena->GetSize())
+	{
+		LOG_ERROR("Image upload of %llu bytes doesn't fit in the staging ring", (unsigned long long)size);
+		return 0;
+	}
+
+	UploadRequest request;
+	request.image = image;
+	request.aspect = aspect;
+	request.extent = extent;
+	request.finalLayout = finalLayout;
+	request.data = (const uint8_t*)data;
+	request.size = size;
+	request.dstAccess = dstAccess;
+	request.dstStages = dstStages;
+
+	return Enqueue(request);
+}
+
+UploadTicket UploadManager::Enqueue(UploadRequest& request)
+{
+	request.ticket = ++m_nextTicket;
+
+	Retire();
+
+	// Anything already waiting goes first so tickets complete in order
+	VkDeviceSize unlimited = std::numeric_limits<VkDeviceSize>::max();
+	if (m_pending.empty() && Stage(request, unlimited))
+	{
+		return request.ticket;
+	}
+
+	// The caller's pointer is only good until we return, keep a copy of what didn't make it into the ring
+	const uint8_t* source = request.Source();
+	VkDeviceSize remaining = request.size - request.staged;
+
+	request.owned.assign(source, source + remaining);
+	request.ownedBase = request.staged;
+	request.data = nullptr;
+
+	m_stats.bytesDeferred += remaining;
+
+	UploadTicket ticket = request.ticket;
+	m_pending.push_back(std::move(request));
+
+	return ticket;
+}
+
+bool UploadManager::Stage(UploadRequest& request, VkDeviceSize& budget)
+{
+	bool ownershipTransfer = m_transferFamily != m_graphicsFamily;
+
+	while (request.staged < request.size)
+	{
+		if (budget == 0)
+		{
+			return false;
+		}
+
+		UploadBatch* batch = GetRecordingBatch();
+		if (batch == nullptr)
+		{
+			return false;
+		}
+
+		VkDeviceSize remaining = request.size - request.staged;
+		VkDeviceSize chunk = remaining;
+		VkDeviceSize stagingOffset = 0;
+
+		if (request.image != VK_NULL_HANDLE)
+		{
+			if (!AllocateStaging(chunk, stagingOffset))
+			{
+				return false;
+			}
+		}
+		else
+		{
+			// Big buffers go over in pieces so they start moving before the whole thing fits
+			chunk = std::min(std::min(remaining, budget), m_ringArena->GetSize() / 2);
+			while (!AllocateStaging(chunk, stagingOffset))
+			{
+				if (chunk <= MIN_STAGING_CHUNK_SIZE)
+				{
+					return false;
+				}
+				chunk = std::max(chunk / 2, MIN_STAGING_CHUNK_SIZE);
+			}
+		}
+
+		memcpy((uint8_t*)m_ring.allocation.mapped + stagingOffset, request.Source(), (size_t)chunk);
+		batch->stagingOffsets.push_back(stagingOffset);
+
+		if (request.image != VK_NULL_HANDLE)
+		{
+			VkImageMemoryBarrier barrier = {};
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.image = request.image;
+			barrier.subresourceRange = { request.aspect, 0, 1, 0, 1 };
+
+			// The whole image is overwritten, so its old contents can be discarded
+			vkCmdPipelineBarrier(batch->commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+			VkBufferImageCopy region = {};
+			region.bufferOffset = stagingOffset;
+			region.imageSubresource = { request.aspect, 0, 0, 1 };
+			region.imageExtent = request.extent;
+
+			vkCmdCopyBufferToImage(batch->commandBuffer, m_ring.buffer, request.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+			// Stored in its acquire form, the release half is derived when the batch is submitted
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = request.dstAccess;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			barrier.newLayout = request.finalLayout;
+			barrier.srcQueueFamilyIndex = ownershipTransfer ? m_transferFamily : VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = ownershipTransfer ? m_graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+
+			batch->imageAcquires.push_back(barrier);
+		}
+		else
+		{
+			VkBufferCopy region = {};
+			region.srcOffset = stagingOffset;
+			region.dstOffset = request.offset + request.staged;
+			region.size = chunk;
+
+			vkCmdCopyBuffer(batch->commandBuffer, m_ring.buffer, request.buffer, 1, &region);
+
+			// On a shared family the semaphore alone makes the copy visible
+			if (ownershipTransfer)
+			{
+				VkBufferMemoryBarrier barrier = {};
+				barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+				barrier.srcAccessMask = 0;
+				barrier.dstAccessMask = request.dstAccess;
+				barrier.srcQueueFamilyIndex = m_transferFamily;
+				barrier.dstQueueFamilyIndex = m_graphicsFamily;
+				barrier.buffer = request.buffer;
+				barrier.offset = region.dstOffset;
+				barrier.size = chunk;
+
+				batch->bufferAcquires.push_back(barrier);
+			}
+		}
+
+		request.staged += chunk;
+		budget -= std::min(budget, chunk);
+		batch->dstStages |= request.dstStages;
+
+		m_stats.bytesUploaded += chunk;
+		m_stats.copies++;
+	}
+
+	m_batches[m_recordingBatch].lastTicket = request.ticket;
+
+	return true;
+}
+
+void UploadManager::StagePending()
+{
+	VkDeviceSize budget = m_frameBudget;
+
+	while (!m_pending.empty() && Stage(m_pending.front(), budget))
+	{
+		m_pending.pop_front();
+	}
+}
+
+void UploadManager::Retire()
+{
+	while (!m_inFlight.empty())
+	{
+		UploadBatch& batch = m_batches[m_inFlight.front()];
+
+		if (vkGetFenceStatus(m_device, batch.fence) != VK_SUCCESS)
+		{
+			break;
+		}
+
+		// The semaphore wait belongs to the graphics submission, it must have run before the semaphore is signaled again
+		if (batch.graphicsFence != VK_NULL_HANDLE && vkGetFenceStatus(m_device, batch.graphicsFence) != VK_SUCCESS)
+		{
+			break;
+		}
+
+		DropBatch(batch);
+
+		m_completedTicket = std::max(m_completedTicket, batch.lastTicket);
+
+		batch.submitted = false;
+		batch.graphicsFence = VK_NULL_HANDLE;
+		m_inFlight.pop_front();
+	}
+}
+
+void UploadManager::DropBatch(UploadBatch& batch)
+{
+	for (VkDeviceSize offset : batch.stagingOffsets)
+	{
+		m_ringArena->Free(offset);
+	}
+	batch.stagingOffsets.clear();
+}
+
+UploadManager::UploadBatch* UploadManager::GetRecordingBatch()
+{
+	if (m_recordingBatch >= 0)
+	{
+		return &m_batches[m_recordingBatch];
+	}
+
+	for (uint32_t i = 0; i < m_batches.size(); ++i)
+	{
+		UploadBatch& batch = m_batches[i];
+		if (batch.submitted)
+		{
+			continue;
+		}
+
+		vkResetCommandPool(m_device, batch.pool, 0);
+		vkResetFences(m_device, 1, &batch.fence);
+
+		batch.lastTicket = 0;
+		batch.dstStages = 0;
+		batch.stagingOffsets.clear();
+		batch.bufferAcquires.clear();
+		batch.imageAcquires.clear();
+
+		VkCommandBufferBeginInfo beginInfo = {};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		vkBeginCommandBuffer(batch.commandBuffer, &beginInfo);
+
+		batch.recording = true;
+		m_recordingBatch = (int)i;
+
+		return &batch;
+	}
+
+	// Every batch is still in flight, whatever comes next waits in the pending queue
+	return nullptr;
+}
+
+bool UploadManager::AllocateStaging(VkDeviceSize size, VkDeviceSize& offset)
+{
+	if (!m_ringArena->Allocate(size, m_copyAlignment, offset))
+	{
+		return false;
+	}
+
+	m_stats.peakRingUsed = std::max(m_stats.peakRingUsed, m_ringArena->GetUsed());
+
+	return true;
+}
+
+VkSemaphore UploadManager::Flush(VkCommandBuffer acquireCommands, VkFence graphicsFence, VkPipelineStageFlags& waitStages)
+{
+	Retire();
+	StagePending();
+
+	if (m_recordingBatch < 0)
+	{
+		return VK_NULL_HANDLE;
+	}
+
+	UploadBatch& batch = m_batches[m_recordingBatch];
+	m_recordingBatch = -1;
+	batch.recording = false;
+
+	std::vector<VkBufferMemoryBarrier> bufferReleases(batch.bufferAcquires);
+	std::vector<VkImageMemoryBarrier> imageReleases(batch.imageAcquires);
+
+	for (auto& barrier : bufferReleases)
+	{
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = 0;
+	}
+
+	for (auto& barrier : imageReleases)
+	{
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = 0;
+	}
+
+	// Releases ownership, or just finishes the layout transitions when graphics and transfer share a family
+	if (!bufferReleases.empty() || !imageReleases.empty())
+	{
+		vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+			0, nullptr, (uint32_t)bufferReleases.size(), bufferReleases.data(), (uint32_t)imageReleases.size(), imageReleases.data());
+	}
+
+	if (vkEndCommandBuffer(batch.commandBuffer) != VK_SUCCESS)
+	{
+		LOG_ERROR("Unable to record the upload command buffer");
+		DropBatch(batch);
+		return VK_NULL_HANDLE;
+	}
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &batch.commandBuffer;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &batch.semaphore;
+
+	if (vkQueueSubmit(m_transferQueue, 1, &submitInfo, batch.fence) != VK_SUCCESS)
+	{
+		LOG_ERROR("Unable to submit uploads");
+		DropBatch(batch);
+		return VK_NULL_HANDLE;
+	}
+
+	batch.submitted = true;
+	batch.graphicsFence = graphicsFence;
+	m_inFlight.push_back((uint32_t)(&batch - m_batches.data()));
+	m_stats.batchesSubmitted++;
+
+	// Without a hint from the caller the whole graphics submission has to wait
+	waitStages = batch.dstStages != 0 ? batch.dstStages : VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+	if (m_transferFamily != m_graphicsFamily && (!batch.bufferAcquires.empty() || !batch.imageAcquires.empty()))
+	{
+		vkCmdPipelineBarrier(acquireCommands, waitStages, waitStages, 0,
+			0, nullptr, (uint32_t)batch.bufferAcquires.size(), batch.bufferAcquires.data(), (uint32_t)batch.imageAcquires.size(), batch.imageAcquires.data());
+
+		m_stats.ownershipTransfers += batch.bufferAcquires.size() + batch.imageAcquires.size();
+	}
+
+	return batch.semaphore;
+}
+
+void UploadManager::LogStats() const
+{
+	LOG_INFO("Uploads: %llu bytes in %llu copies over %llu submits, %llu bytes deferred, %llu ownership transfers, peak ring use %llu bytes",
+		(unsigned long long)m_stats.bytesUploaded, (unsigned long long)m_stats.copies, (unsigned long long)m_stats.batchesSubmitted,
+		(unsigned long long)m_stats.bytesDeferred, (unsigned long long)m_stats.ownershipTransfers, (unsigned long long)m_stats.peakRingUsed);
+}
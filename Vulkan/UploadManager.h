@@ -0,0 +1,133 @@
+#pragma once
+
+#include "MemoryAllocator.h"
+
+#include <vulkan/vulkan.h>
+#include <deque>
+#include <vector>
+
+typedef uint64_t UploadTicket;
+
+const VkDeviceSize DEFAULT_STAGING_RING_SIZE = 32 * 1024 * 1024;
+
+// Caps how much deferred data is copied into the ring per frame so a big asset is spread over several frames
+const VkDeviceSize DEFAULT_UPLOAD_FRAME_BUDGET = 8 * 1024 * 1024;
+
+// Smallest piece a large buffer upload is split into when the ring is nearly full
+const VkDeviceSize MIN_STAGING_CHUNK_SIZE = 64 * 1024;
+
+// Transfer submissions that can be in flight at once, each owns a command buffer, fence and semaphore
+const uint32_t UPLOAD_BATCH_COUNT = 4;
+
+struct UploadStats
+{
+	uint64_t bytesUploaded = 0;
+	uint64_t copies = 0;
+	uint64_t batchesSubmitted = 0;
+	uint64_t bytesDeferred = 0;	// Had to wait in the pending queue for ring space
+	uint64_t ownershipTransfers = 0;
+	VkDeviceSize peakRingUsed = 0;
+};
+
+// Streams data to device local resources through a persistently mapped staging ring. Copies run on a
+// transfer only queue when the device has one, are batched into one submission per frame and handed to
+// the graphics queue with a semaphore and queue family ownership transfer barriers. Nothing here waits
+// on the GPU, data that doesn't fit in the ring is queued and staged as space is retired.
+// Not thread safe, call everything from the render thread.
+class UploadManager
+{
+public:
+	bool Initialize(VkPhysicalDevice physicalDevice, VkDevice device, MemoryAllocator& allocator, uint32_t transferFamily, uint32_t graphicsFamily, VkQueue transferQueue, VkDeviceSize ringSize = DEFAULT_STAGING_RING_SIZE);
+	void Shutdown();
+
+	// dstAccess and dstStages describe the first graphics use of the data. Returns 0 on failure.
+	UploadTicket UploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size, VkAccessFlags dstAccess, VkPipelineStageFlags dstStages);
+
+	// Fills mip 0, layer 0 of a whole image and leaves it in finalLayout. The image can't be split across
+	// batches, so it has to fit in the ring in one piece.
+	UploadTicket UploadImage(VkImage image, VkImageAspectFlags aspect, VkExtent3D extent, VkImageLayout finalLayout, const void* data, VkDeviceSize size, VkAccessFlags dstAccess, VkPipelineStageFlags dstStages);
+
+	// True once the copy has finished and a graphics submission has taken ownership of the data
+	bool IsComplete(UploadTicket ticket) const { return ticket != 0 && ticket <= m_completedTicket; }
+
+	// Submits everything staged since the last call. If a semaphore comes back the caller must wait on it at
+	// waitStages in its next graphics submission, execute acquireCommands in that submission before anything
+	// that reads the uploads, and signal graphicsFence with it. acquireCommands must be recording.
+	VkSemaphore Flush(VkCommandBuffer acquireCommands, VkFence graphicsFence, VkPipelineStageFlags& waitStages);
+
+	void SetFrameBudget(VkDeviceSize bytes) { m_frameBudget = bytes; }
+
+	const UploadStats& GetStats() const { return m_stats; }
+	void LogStats() const;
+
+private:
+	struct UploadRequest
+	{
+		UploadTicket ticket = 0;
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkImage image = VK_NULL_HANDLE;
+		VkImageAspectFlags aspect = 0;
+		VkExtent3D extent = {};
+		VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkAccessFlags dstAccess = 0;
+		VkPipelineStageFlags dstStages = 0;
+
+		const uint8_t* data = nullptr;	// Caller's memory, only valid during the Upload call
+		std::vector<uint8_t> owned;		// Copy of whatever was left over when the request had to be deferred
+		VkDeviceSize ownedBase = 0;
+		VkDeviceSize size = 0;
+		VkDeviceSize staged = 0;
+
+		const uint8_t* Source() const { return owned.empty() ? data + staged : owned.data() + (staged - ownedBase); }
+	};
+
+	struct UploadBatch
+	{
+		VkCommandPool pool = VK_NULL_HANDLE;
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		VkFence fence = VK_NULL_HANDLE;
+		VkSemaphore semaphore = VK_NULL_HANDLE;
+		VkFence graphicsFence = VK_NULL_HANDLE; // The semaphore can't be signaled again until this submission ran
+
+		bool recording = false;
+		bool submitted = false;
+		UploadTicket lastTicket = 0;
+		VkPipelineStageFlags dstStages = 0;
+
+		std::vector<VkDeviceSize> stagingOffsets;
+		std::vector<VkBufferMemoryBarrier> bufferAcquires;
+		std::vector<VkImageMemoryBarrier> imageAcquires;
+	};
+
+	UploadTicket Enqueue(UploadRequest& request);
+	bool Stage(UploadRequest& request, VkDeviceSize& budget);
+	void StagePending();
+	void Retire();
+	void DropBatch(UploadBatch& batch); // Gives the batch's staging space back to the ring
+
+	UploadBatch* GetRecordingBatch();
+	bool AllocateStaging(VkDeviceSize size, VkDeviceSize& offset);
+
+private:
+	VkDevice m_device = VK_NULL_HANDLE;
+	MemoryAllocator* m_allocator = nullptr;
+	VkQueue m_transferQueue = VK_NULL_HANDLE;
+	uint32_t m_transferFamily = 0;
+	uint32_t m_graphicsFamily = 0;
+	VkDeviceSize m_copyAlignment = 16;
+	VkDeviceSize m_frameBudget = DEFAULT_UPLOAD_FRAME_BUDGET;
+
+	AllocatedBuffer m_ring;
+	std::unique_ptr<LinearArena> m_ringArena; // Offsets into m_ring, frees come back in submission order
+
+	std::vector<UploadBatch> m_batches;
+	std::deque<uint32_t> m_inFlight; // Submitted batches, oldest first
+	int m_recordingBatch = -1;
+
+	std::deque<UploadRequest> m_pending;
+	UploadTicket m_nextTicket = 0;
+	UploadTicket m_completedTicket = 0;
+
+	UploadStats m_stats;
+};
@@ -1,124 +1,1073 @@
 #include "Vulkan.h"
 
+#include <cmath>
 
-bool Vulkan::Initialize(GLFWwindow* window, uint32_t width, uint32_t height)
+
+bool Vulkan::Initialize(GLFWwindow* window, uint32_t width, uint32_t height, uint32_t framesInFlight)
 {
+	m_headless = false;
+
+	return InitializeCommon(window, width, height, framesInFlight);
+}
+
+bool Vulkan::InitializeHeadless(uint32_t width, uint32_t height, uint32_t framesInFlight, bool enableReadback)
+{
+	m_headless = true;
+	m_readbackEnabled = enableReadback;
+
+	return InitializeCommon(nullptr, width, height, framesInFlight);
+}
+
+bool Vulkan::InitializeCommon(GLFWwindow* window, uint32_t width, uint32_t height, uint32_t framesInFlight)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	m_startTime = start;
+	m_lastFrameTime = start;
+
+	m_framesInFlight = std::max(1u, framesInFlight);
+	m_windowExtent = { width, height };
+
 	if (!CreateInstance())
 	{
-		return false;
+		return false;
+	}
+
+	if (!SetupDebugCallback())
+	{
+		return false;
+	}
+
+	if (!m_headless && !CreateSurface(window))
+	{
+		return false;
+	}
+
+	if (!SelectDevice())
+	{
+		return false;
+	}
+
+	if (!CreateDevice())
+	{
+		return false;
+	}
+
+	if (!m_allocator.Initialize(m_physcalDevice, m_device))
+	{
+		return false;
+	}
+
+	m_deletions.Initialize(m_device, m_allocator, m_framesInFlight);
+	m_renderGraph.Initialize(m_device, m_allocator, m_deletions);
+
+	m_shaders.Initialize(m_device, SHADER_DIRECTORY);
+
+	QueueFamilyIndices inds = FindQueueFamilies(m_physcalDevice);
+	if (!m_uploads.Initialize(m_physcalDevice, m_device, m_allocator, inds.transferFamily, inds.graphicsFamily, m_transferQueue))
+	{
+		return false;
+	}
+
+	m_descriptorLayouts.Initialize(m_device);
+
+	if (!m_frameDescriptors.Initialize(m_device, m_framesInFlight))
+	{
+		return false;
+	}
+
+	// The graphics pipeline layout is built against the table
+	if (m_bindlessEnabled)
+	{
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(m_physcalDevice, &properties);
+
+		// The uniform ring's dynamic buffer is the only other descriptor the graphics pipeline layout has
+		const uint32_t otherDescriptors = 1;
+
+		if (!CreateBindlessDefaults())
+		{
+			return false;
+		}
+
+		VkDescriptorImageInfo defaultImage = { m_bindlessDefaultSampler, m_bindlessDefaultView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		if (!m_bindless.Initialize(m_device, m_descriptorLayouts, properties.limits, m_framesInFlight, m_bindlessDefaultBuffer.buffer, defaultImage, otherDescriptors))
+		{
+			LOG_ERROR("Unable to create the bindless table");
+			return false;
+		}
+	}
+
+	if (!m_uniforms.Initialize(m_physcalDevice, m_device, m_allocator, m_descriptorLayouts, m_framesInFlight))
+	{
+		return false;
+	}
+
+	if (m_headless)
+	{
+		if (!CreateHeadlessTargets(width, height))
+		{
+			return false;
+		}
+	}
+	else if (!CreateSwapChain(width, height))
+	{
+		return false;
+	}
+
+	if (!CreateImageViews())
+	{
+		return false;
+	}
+
+	if (!m_pipelineCache.Initialize(m_physcalDevice, m_device, m_pipelineCacheEnabled ? PIPELINE_CACHE_FILE : "", m_pipelineCreationFeedback))
+	{
+		return false;
+	}
+
+	if (!m_pipelineCompiler.Initialize(m_device, m_pipelineCache, m_pipelineWorkerCount))
+	{
+		return false;
+	}
+
+	if (!m_pipelineStates.Initialize(m_device, m_pipelineCache, m_pipelineCompiler))
+	{
+		return false;
+	}
+
+	// The pipeline is built against the main pass's render pass, so the graph has to be compiled first
+	if (!BuildRenderGraph())
+	{
+		return false;
+	}
+
+	if (!CreateGraphicPipeline())
+	{
+		return false;
+	}
+
+	if (!CreateRenderTargets())
+	{
+		return false;
+	}
+
+	if (!CreateCommandPool())
+	{
+		return false;
+	}
+
+	if (!m_jobs.Initialize())
+	{
+		return false;
+	}
+
+	if (!CreateFrameCommandPools())
+	{
+		return false;
+	}
+
+	if (!CreateSyncObjects())
+	{
+		return false;
+	}
+
+	if (!m_meshes.Initialize(m_allocator, m_uploads))
+	{
+		return false;
+	}
+
+	// One triangle in the middle of the screen until someone sets a scene
+	const Mesh& triangle = m_meshes.GetBuiltinMesh(BuiltinMesh::Triangle);
+	m_drawList.assign(1, DrawCommand{ triangle.indexCount, 1, triangle.firstIndex, triangle.vertexOffset, 0 });
+
+	if (!SetInstances(std::vector<InstanceData>(1, InstanceData{ { 0.0f, 0.0f }, 1.0f, 0xFF0000FF })))
+	{
+		return false;
+	}
+
+	// Optional, the draw list still works on devices that can't cull on the GPU
+	m_gpuDrivenSupported = m_culling.Initialize(m_device, m_allocator, m_deletions, m_uploads, m_descriptorLayouts, m_frameDescriptors, m_framesInFlight, m_enabledFeatures, m_drawIndirectCount) &&
+		CreateComputePipeline("cull", { m_culling.GetSetLayout() }, sizeof(GpuCulling::PushConstants), m_cullPipeline) &&
+		CreateComputePipeline("compact", { m_culling.GetSetLayout() }, sizeof(GpuCulling::PushConstants), m_compactPipeline);
+
+	if (m_gpuDrivenSupported)
+	{
+		m_culling.SetPipelines(m_cullPipeline, m_compactPipeline);
+	}
+	else
+	{
+		LOG_INFO("GPU driven drawing is not available on this device");
+	}
+
+	// Static buffers bind the instance buffer, so they are recorded once it exists
+	if (m_commandBuffers.empty() && !CreateCommandBuffers())
+	{
+		return false;
+	}
+
+	if (!m_compute.Initialize(m_physcalDevice, m_device, inds.computeFamily, inds.graphicsFamily, m_computeQueue, m_framesInFlight))
+	{
+		return false;
+	}
+
+	if (!PROFILE_GPU_INITIALIZE(m_physcalDevice, m_device, PROFILER_IMAGE_SLOTS + m_framesInFlight))
+	{
+		return false;
+	}
+
+	if (m_readbackEnabled && !CreateReadbackBuffer())
+	{
+		return false;
+	}
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	m_startupStats.startupMs = elapsed.count();
+	m_shaders.LogStats();
+	LOG_INFO("Startup: %.3fms, %.3fms waiting on pipelines", elapsed.count(), m_startupStats.criticalPipelineMs);
+
+	return true;
+}
+
+void Vulkan::Shutdown()
+{
+	if (m_device != VK_NULL_HANDLE)
+	{
+		// Frames may still be in flight, nothing can be destroyed until the GPU is done with them
+		vkDeviceWaitIdle(m_device);
+	}
+
+	m_jobs.Shutdown();
+
+	// The device is idle, so everything retired by the last frames can go
+	m_deletions.LogStats();
+	m_deletions.Shutdown();
+	m_renderGraph.LogStats();
+	m_renderGraph.Shutdown();
+
+	// Anything still compiling goes into the cache before it is saved
+	m_pipelineStates.LogStats();
+	m_pipelineStates.Shutdown();
+	m_pipelineCompiler.LogStats();
+	m_pipelineCompiler.Shutdown();
+
+	PROFILE_LOG_STATS();
+	PROFILE_EXPORT(PROFILE_TRACE_FILE);
+	PROFILE_GPU_SHUTDOWN();
+
+	m_pipelineCache.Shutdown();
+	m_uploads.Shutdown();
+	m_compute.Shutdown();
+
+	m_allocator.DestroyBuffer(m_particleBuffer);
+	m_particlePool.Reset();
+	m_particleSet = VK_NULL_HANDLE;
+	DestroyComputePipeline(m_particlePipeline);
+
+	DestroyComputePipeline(m_cullPipeline);
+	DestroyComputePipeline(m_compactPipeline);
+	m_culling.Shutdown();
+
+	m_bindless.Shutdown();
+	m_allocator.DestroyBuffer(m_bindlessDefaultBuffer);
+	m_bindlessDefaultSampler.Reset();
+	m_bindlessDefaultView.Reset();
+	m_bindlessDefaultImage.Reset();
+	m_allocator.Free(m_bindlessDefaultImageMemory);
+	m_uniforms.LogStats();
+	m_uniforms.Shutdown();
+	m_frameDescriptors.LogStats();
+	m_frameDescriptors.Shutdown();
+	m_descriptorLayouts.LogStats();
+	m_descriptorLayouts.Shutdown();
+
+	m_meshes.Shutdown();
+	m_allocator.DestroyBuffer(m_instanceBuffer);
+	m_allocator.DestroyBuffer(m_readbackBuffer);
+	for (auto& allocation : m_headlessImageMemory)
+	{
+		m_allocator.Free(allocation);
+	}
+
+	m_allocator.LogStats();
+	m_allocator.Shutdown();
+
+	LOG_INFO("Frames: %llu Frames in flight: %u Avg fence wait: %.3fms Max fence wait: %.3fms Avg record: %.3fms",
+		(unsigned long long)m_syncStats.frameCount, m_framesInFlight, m_syncStats.AverageFenceWaitMs(), m_syncStats.maxFenceWaitMs, m_syncStats.AverageRecordMs());
+}
+
+bool Vulkan::DrawFrame()
+{
+	PROFILE_SCOPE("DrawFrame");
+
+	// The slot's fence will never signal, waiting on it would hang
+	if (m_deviceLost)
+	{
+		return false;
+	}
+
+	if (m_swapChainDirty && !RecreateSwapChain())
+	{
+		// Minimized, nothing to draw into until the window has an area again
+		return false;
+	}
+
+	VkFence frameFence = m_inFlightFences[m_currentFrame];
+
+	// Only blocks if the GPU is still working on the frame that last used this slot
+	double fenceWaitMs = WaitForFence(frameFence);
+
+	// With fewer frames queued than slots, the frame that many back has to be done as well. It went out
+	// after this slot's last frame, so once it signals this one has too.
+	uint32_t maxQueuedFrames = GetMaxQueuedFrames();
+	if (maxQueuedFrames < m_framesInFlight)
+	{
+		fenceWaitMs += WaitForFence(m_inFlightFences[(m_currentFrame + m_framesInFlight - maxQueuedFrames) % m_framesInFlight]);
+	}
+
+	uint32_t imageIndex;
+	if (m_headless)
+	{
+		// One target per frame slot, so the slot's fence already covers the image
+		imageIndex = m_currentFrame;
+	}
+	else
+	{
+		VkResult result = vkAcquireNextImageKHR(m_device, m_swapChain, std::numeric_limits<uint64_t>::max(), m_imageAvailableSems[m_currentFrame], VK_NULL_HANDLE, &imageIndex);
+
+		if (result == VK_ERROR_OUT_OF_DATE_KHR)
+		{
+			// Nothing was submitted, so the frame fence is still signaled for the next attempt
+			m_swapChainDirty = true;
+			return false;
+		}
+		else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+		{
+			LOG_ERROR("Unable to acquire a swap chain image");
+			return false;
+		}
+	}
+
+	// The swap chain may hand back an image that an older frame slot is still rendering to
+	if (m_imagesInFlight[imageIndex] != VK_NULL_HANDLE && m_imagesInFlight[imageIndex] != frameFence)
+	{
+		fenceWaitMs += WaitForFence(m_imagesInFlight[imageIndex]);
+	}
+	m_imagesInFlight[imageIndex] = frameFence;
+
+	// Nothing is drawn until the geometry and instances the draws read have arrived, until then even the
+	// static mode records an empty pass every frame
+	if (!m_drawDataReady)
+	{
+		m_drawDataReady = m_uploads.IsComplete(m_drawDataTicket);
+	}
+	bool staticFrame = m_recordMode == RecordMode::Static && m_drawDataReady;
+
+	// Both fences above have signaled, so last use of this frame's and this image's queries is done. Images
+	// past the reserved slots aren't profiled, like their static command buffers.
+	PROFILE_GPU_COLLECT(staticFrame ? (imageIndex < PROFILER_IMAGE_SLOTS ? imageIndex : ~0u) : PROFILER_IMAGE_SLOTS + m_currentFrame);
+	m_compute.CollectGraphicsFrame(m_currentFrame);
+	m_culling.CollectStats(m_currentFrame);
+
+	// Nothing the GPU runs for this slot is left, so what was retired while it was last recorded can go and
+	// its descriptors can be reset and rewritten
+	m_deletions.BeginFrame(m_currentFrame);
+	m_frameDescriptors.BeginFrame(m_currentFrame);
+	if (m_bindlessEnabled)
+	{
+		m_bindless.BeginFrame(m_currentFrame);
+	}
+
+	m_uniforms.BeginFrame(m_currentFrame);
+	UpdateFrameUniforms();
+
+	m_syncStats.frameCount++;
+	m_syncStats.totalFenceWaitMs += fenceWaitMs;
+	m_syncStats.lastRecordMs = 0.0;
+	m_syncStats.maxFenceWaitMs = std::max(m_syncStats.maxFenceWaitMs, fenceWaitMs);
+
+	// The frame fence has signaled, so everything allocated from this frame's pool is free to reuse
+	vkResetCommandPool(m_device, m_framePools[m_currentFrame], 0);
+
+	m_submitWaitSemaphores.clear();
+	m_submitWaitStages.clear();
+	m_submitSignalSemaphores.clear();
+
+	if (!m_headless)
+	{
+		m_submitWaitSemaphores.push_back(m_imageAvailableSems[m_currentFrame]);
+		m_submitWaitStages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+		m_submitSignalSemaphores.push_back(m_renderFinishedSems[m_currentFrame]);
+	}
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	VkCommandBuffer prologue = m_framePrologueBuffers[m_currentFrame];
+	vkBeginCommandBuffer(prologue, &beginInfo);
+
+	m_compute.BeginGraphicsFrame(prologue, m_currentFrame);
+
+	// Kicks off whatever was staged since the last frame, this frame takes ownership of the results
+	VkPipelineStageFlags uploadWaitStages = 0;
+	VkSemaphore uploadSemaphore = m_uploads.Flush(prologue, frameFence, uploadWaitStages);
+	if (uploadSemaphore != VK_NULL_HANDLE)
+	{
+		m_submitWaitSemaphores.push_back(uploadSemaphore);
+		m_submitWaitStages.push_back(uploadWaitStages);
+	}
+
+	// After the flush, so this frame's scene uploads have been acquired
+	if (m_gpuDriven && m_drawDataReady)
+	{
+		m_culling.RecordCulling(prologue, m_currentFrame);
+	}
+
+	vkEndCommandBuffer(prologue);
+
+	VkCommandBuffer epilogue = m_frameEpilogueBuffers[m_currentFrame];
+	vkBeginCommandBuffer(epilogue, &beginInfo);
+	m_compute.EndGraphicsFrame(epilogue, m_currentFrame);
+	vkEndCommandBuffer(epilogue);
+
+	// Goes out right ahead of the frame so the two can overlap
+	StepParticles();
+
+	m_compute.GetGraphicsSync(frameFence, m_submitWaitSemaphores, m_submitWaitStages, m_submitSignalSemaphores);
+
+	VkCommandBuffer commandBuffers[] = {
+		prologue,
+		staticFrame ? m_commandBuffers[imageIndex] : RecordFrame(imageIndex),
+		epilogue
+	};
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.waitSemaphoreCount = (uint32_t)m_submitWaitSemaphores.size();
+	submitInfo.pWaitSemaphores = m_submitWaitSemaphores.data();
+	submitInfo.pWaitDstStageMask = m_submitWaitStages.data();
+	submitInfo.commandBufferCount = 3;
+	submitInfo.pCommandBuffers = commandBuffers;
+	submitInfo.signalSemaphoreCount = (uint32_t)m_submitSignalSemaphores.size();
+	submitInfo.pSignalSemaphores = m_submitSignalSemaphores.data();
+
+	vkResetFences(m_device, 1, &frameFence);
+
+	auto submitStart = std::chrono::high_resolution_clock::now();
+
+	if (vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, frameFence) != VK_SUCCESS)
+	{
+		LOG_ERROR("Unable to submit draw call.");
+
+		// A failed submit leaves its semaphores waiting and the fence unsignaled, and the next wait on this slot
+		// would never return. An empty submit consumes the waits and signals the fence instead. The image that
+		// was acquired is never presented, rebuilding the swap chain gives it back.
+		VkSubmitInfo recoverInfo = {};
+		recoverInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		recoverInfo.waitSemaphoreCount = (uint32_t)m_submitWaitSemaphores.size();
+		recoverInfo.pWaitSemaphores = m_submitWaitSemaphores.data();
+		recoverInfo.pWaitDstStageMask = m_submitWaitStages.data();
+
+		if (vkQueueSubmit(m_graphicsQueue, 1, &recoverInfo, frameFence) != VK_SUCCESS)
+		{
+			LOG_ERROR("Unable to signal the frame fence after a failed submit, treating the device as lost");
+			m_deviceLost = true;
+		}
+
+		m_swapChainDirty = !m_headless;
+		return false;
+	}
+
+	// Compute batches that were waiting on this frame can go now
+	m_compute.SubmitDeferred();
+
+	PROFILE_GPU_SUBMITTED(staticFrame ? (imageIndex < PROFILER_IMAGE_SLOTS ? imageIndex : ~0u) : PROFILER_IMAGE_SLOTS + m_currentFrame);
+
+	m_lastImageIndex = imageIndex;
+
+	if (m_headless)
+	{
+		RecordSubmitTime(submitStart);
+		m_currentFrame = (m_currentFrame + 1) % m_framesInFlight;
+		return true;
+	}
+
+	VkSwapchainKHR swapChains[] = { m_swapChain };
+	VkSemaphore renderFinished = m_renderFinishedSems[m_currentFrame];
+
+	VkPresentInfoKHR presentInfo = {};
+	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+	presentInfo.waitSemaphoreCount = 1;
+	presentInfo.pWaitSemaphores = &renderFinished;
+	presentInfo.swapchainCount = 1;
+	presentInfo.pSwapchains = swapChains;
+	presentInfo.pImageIndices = &imageIndex;
+
+	VkResult result = vkQueuePresentKHR(m_presentQueue, &presentInfo);
+	RecordSubmitTime(submitStart);
+
+	// Suboptimal still presented, rebuild before the next frame rather than dropping this one
+	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+	{
+		m_swapChainDirty = true;
+	}
+	else if (result != VK_SUCCESS)
+	{
+		LOG_ERROR("Unable to present swap chain image");
+	}
+
+	m_currentFrame = (m_currentFrame + 1) % m_framesInFlight;
+
+	return result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR;
+}
+
+bool Vulkan::ReadbackFrame(std::vector<uint8_t>& pixels)
+{
+	if (!m_headless || !m_readbackEnabled || m_syncStats.frameCount == 0)
+	{
+		LOG_ERROR("Readback requires a headless device created with readback enabled and at least one drawn frame");
+		return false;
+	}
+
+	VkFence imageFence = m_imagesInFlight[m_lastImageIndex];
+	if (imageFence != VK_NULL_HANDLE)
+	{
+		WaitForFence(imageFence);
+	}
+
+	VkCommandBufferAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = m_commandPool;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = 1;
+
+	VkCommandBuffer commandBuffer;
+	if (vkAllocateCommandBuffers(m_device, &allocInfo, &commandBuffer) != VK_SUCCESS)
+	{
+		LOG_ERROR("Unable to allocate readback command buffer");
+		return false;
+	}
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+	// The render pass leaves the target in TRANSFER_SRC_OPTIMAL
+	VkBufferImageCopy region = {};
+	region.bufferOffset = 0;
+	region.bufferRowLength = 0;
+	region.bufferImageHeight = 0;
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.mipLevel = 0;
+	region.imageSubresource.baseArrayLayer = 0;
+	region.imageSubresource.layerCount = 1;
+	region.imageOffset = { 0, 0, 0 };
+	region.imageExtent = { m_swapChainExtent.width, m_swapChainExtent.height, 1 };
+
+	vkCmdCopyImageToBuffer(commandBuffer, m_swapChainImages[m_lastImageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_readbackBuffer.buffer, 1, &region);
+
+	VkBufferMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = m_readbackBuffer.buffer;
+	barrier.offset = 0;
+	barrier.size = VK_WHOLE_SIZE;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+	vkEndCommandBuffer(commandBuffer);
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+
+	bool result = vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) == VK_SUCCESS;
+	if (result)
+	{
+		vkQueueWaitIdle(m_graphicsQueue);
+	}
+	else
+	{
+		LOG_ERROR("Unable to submit readback copy");
+	}
+
+	vkFreeCommandBuffers(m_device, m_commandPool, 1, &commandBuffer);
+
+	if (!result)
+	{
+		return false;
+	}
+
+	// The readback buffer is host coherent and persistently mapped by the allocator
+	pixels.resize((size_t)m_readbackBuffer.size);
+	memcpy(pixels.data(), m_readbackBuffer.allocation.mapped, (size_t)m_readbackBuffer.size);
+
+	return true;
+}
+
+void Vulkan::Resize(uint32_t width, uint32_t height)
+{
+	if (width != m_windowExtent.width || height != m_windowExtent.height)
+	{
+		m_windowExtent = { width, height };
+		m_swapChainDirty = true;
+	}
+}
+
+void Vulkan::SetPresentPolicy(PresentPolicy policy)
+{
+	if (policy == m_presentPolicy)
+	{
+		return;
+	}
+
+	m_presentPolicy = policy;
+
+	// Before Initialize the swap chain is created with it anyway
+	if (!m_headless && m_swapChain != VK_NULL_HANDLE)
+	{
+		m_swapChainDirty = true;
+	}
+}
+
+void Vulkan::SetMultisampling(VkSampleCountFlagBits samples)
+{
+	if (samples == m_msaaRequested)
+	{
+		return;
+	}
+
+	m_msaaRequested = samples;
+
+	// Before Initialize the graph is built with it anyway. The rebuild rides on the swap chain's.
+	if (m_device != VK_NULL_HANDLE)
+	{
+		m_renderGraphDirty = true;
+		m_swapChainDirty = true;
+	}
+}
+
+void Vulkan::SetDepthBuffer(bool enabled)
+{
+	if (enabled == m_depthEnabled)
+	{
+		return;
+	}
+
+	m_depthEnabled = enabled;
+
+	if (m_device != VK_NULL_HANDLE)
+	{
+		m_renderGraphDirty = true;
+		m_swapChainDirty = true;
+	}
+}
+
+uint32_t Vulkan::GetMaxQueuedFrames() const
+{
+	return m_maxQueuedFrames == 0 ? m_framesInFlight : std::min(m_maxQueuedFrames, m_framesInFlight);
+}
+
+void Vulkan::SetDrawList(const std::vector<DrawCommand>& drawList)
+{
+	m_drawList = drawList;
+
+	if (m_recordMode == RecordMode::Static)
+	{
+		// Pre-recorded buffers may be executing, this is the slow path the per frame modes avoid
+		m_deletions.RetireCommandBuffers(m_commandPool, m_commandBuffers);
+		CreateCommandBuffers();
+	}
+}
+
+bool Vulkan::SetInstances(const std::vector<InstanceData>& instances)
+{
+	if (instances.empty())
+	{
+		return false;
+	}
+
+	// Overwriting data a copy is still writing would race it, and there is no waiting on the transfer queue here
+	if (m_instanceTicket != 0 && !m_uploads.IsComplete(m_instanceTicket))
+	{
+		LOG_ERROR("Instances can't be replaced while the previous ones are still uploading");
+		return false;
+	}
+
+	// Frames in flight may still be reading the old instances, so they go into a new buffer and the old one
+	// is retired instead of overwritten
+	VkDeviceSize size = instances.size() * sizeof(InstanceData);
+	m_deletions.RetireBuffer(m_instanceBuffer);
+
+	if (!m_allocator.CreateBuffer(size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, AllocationStrategy::Buddy, m_instanceBuffer))
+	{
+		LOG_ERROR("Unable to create the instance buffer");
+		return false;
+	}
+
+	UploadTicket ticket = m_uploads.UploadBuffer(m_instanceBuffer.buffer, 0, instances.data(), size, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+	if (ticket == 0)
+	{
+		return false;
+	}
+
+	// Tickets complete in order, so the newest one covers the meshes as well
+	m_instanceTicket = ticket;
+	m_drawDataTicket = ticket;
+	m_drawDataReady = false;
+
+	// Static buffers bind the old one
+	if (!m_commandBuffers.empty())
+	{
+		m_deletions.RetireCommandBuffers(m_commandPool, m_commandBuffers);
+		return CreateCommandBuffers();
+	}
+
+	return true;
+}
+
+bool Vulkan::AddMesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, Mesh& mesh)
+{
+	if (!m_meshes.AddMesh(vertices.data(), (uint32_t)vertices.size(), indices.data(), (uint32_t)indices.size(), mesh))
+	{
+		return false;
+	}
+
+	m_drawDataTicket = m_meshes.GetLastTicket();
+	m_drawDataReady = false;
+
+	return true;
+}
+
+bool Vulkan::SetGpuScene(const std::vector<Mesh>& meshes, const std::vector<GpuObject>& objects)
+{
+	if (!m_gpuDrivenSupported)
+	{
+		LOG_ERROR("GPU driven drawing is not supported on this device");
+		return false;
+	}
+
+	if (m_gpuSceneTicket != 0 && !m_uploads.IsComplete(m_gpuSceneTicket))
+	{
+		LOG_ERROR("The GPU scene can't be replaced while the previous one is still uploading");
+		return false;
+	}
+
+	bool recreated = false;
+	UploadTicket ticket = m_culling.SetScene(meshes, objects, recreated);
+	if (ticket == 0)
+	{
+		return false;
+	}
+
+	m_gpuSceneTicket = ticket;
+	m_drawDataTicket = ticket;
+	m_drawDataReady = false;
+
+	// Static buffers draw from the old buffers, which stay alive until the frames in flight are done with them
+	if (m_gpuDriven && recreated && !m_commandBuffers.empty())
+	{
+		m_deletions.RetireCommandBuffers(m_commandPool, m_commandBuffers);
+		return CreateCommandBuffers();
+	}
+
+	return true;
+}
+
+void Vulkan::SetGpuDriven(bool enabled)
+{
+	if (enabled == m_gpuDriven || (enabled && !m_gpuDrivenSupported))
+	{
+		return;
+	}
+
+	m_gpuDriven = enabled;
+
+	if (!m_commandBuffers.empty())
+	{
+		m_deletions.RetireCommandBuffers(m_commandPool, m_commandBuffers);
+		CreateCommandBuffers();
 	}
+}
 
-	if (!SetupDebugCallback())
+bool Vulkan::SetPipelineVariant(VkCullModeFlags cullMode, VkFrontFace frontFace, BlendMode blendMode)
+{
+	PipelineKey key = m_graphicsPipelineKey;
+	key.cullMode = cullMode;
+	key.frontFace = frontFace;
+	key.blendMode = blendMode;
+
+	// Every variant was prepared with the base pipeline, so this is a lookup unless it's still compiling
+	VkPipeline pipeline = m_pipelineStates.Get(key);
+	if (pipeline == VK_NULL_HANDLE)
 	{
+		LOG_ERROR("Unable to create the graphics pipeline variant");
 		return false;
 	}
 
-	if (!CreateSurface(window))
+	if (pipeline == m_graphicsPipeline)
 	{
-		return false;
+		return true;
 	}
 
-	if (!SelectDevice())
+	m_graphicsPipeline = pipeline;
+
+	if (!m_commandBuffers.empty())
 	{
-		return false;
+		m_deletions.RetireCommandBuffers(m_commandPool, m_commandBuffers);
+		return CreateCommandBuffers();
 	}
 
-	if (!CreateDevice())
+	return true;
+}
+
+uint32_t Vulkan::GetDrawCount() const
+{
+	// All of the culled draws go through one indirect call
+	return m_gpuDriven ? 1 : (uint32_t)m_drawList.size();
+}
+
+VkCommandBuffer Vulkan::RecordFrame(uint32_t imageIndex)
+{
+	PROFILE_SCOPE("RecordFrame");
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// The frame fence has signaled, so the worker pools are free to reuse. DrawFrame already reset the frame pool.
+	uint32_t threadCount = m_jobs.GetThreadCount();
+
+	for (uint32_t t = 0; m_recordMode == RecordMode::Threaded && t < threadCount; ++t)
 	{
-		return false;
+		uint32_t pool = m_currentFrame * threadCount + t;
+		vkResetCommandPool(m_device, m_workerPools[pool], 0);
+		m_workerSecondariesUsed[pool] = 0;
 	}
 
-	if (!CreateSwapChain(width, height))
+	VkCommandBuffer commandBuffer = m_frameCommandBuffers[m_currentFrame];
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+	PROFILE_GPU_RESET(commandBuffer, PROFILER_IMAGE_SLOTS + m_currentFrame);
+
 	{
-		return false;
+		PROFILE_GPU_SCOPE(commandBuffer, PROFILER_IMAGE_SLOTS + m_currentFrame, "Main pass");
+
+		m_renderGraph.SetPassContents(m_mainPass, m_recordMode == RecordMode::Dynamic ? VK_SUBPASS_CONTENTS_INLINE : VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		m_renderGraph.Execute(commandBuffer, imageIndex);
 	}
 
-	if (!CreateImageViews())
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
 	{
-		return false;
+		LOG_ERROR("Unable to record the frame command buffer");
 	}
 
-	if (!CreateGraphicPipeline())
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	m_syncStats.totalRecordMs += elapsed.count();
+	m_syncStats.lastRecordMs = elapsed.count();
+	m_syncStats.recordedDraws += m_drawDataReady ? GetDrawCount() : 0;
+
+	return commandBuffer;
+}
+
+void Vulkan::RecordMainPass(VkCommandBuffer commandBuffer, const RenderGraphContext& context)
+{
+	// Static buffers are recorded once and stay valid while the draw data changes, so they draw whatever is set
+	uint32_t drawCount = m_recordingStatic || m_drawDataReady ? GetDrawCount() : 0;
+
+	if (context.contents == VK_SUBPASS_CONTENTS_INLINE)
 	{
-		return false;
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
+		SetViewportAndScissor(commandBuffer);
+		if (!m_recordingStatic)
+		{
+			BindFrameDescriptors(commandBuffer);
+		}
+
+		RecordDraws(commandBuffer, 0, drawCount);
+		return;
 	}
 
-	if (!CreateRenderPass())
+	uint32_t threadCount = m_jobs.GetThreadCount();
+
+	// A few batches per thread so stealing can even out uneven slices
+	uint32_t batchSize = std::max(MIN_DRAWS_PER_SECONDARY, (drawCount + threadCount * 4 - 1) / (threadCount * 4));
+	uint32_t batchCount = (drawCount + batchSize - 1) / batchSize;
+
+	m_secondaries.resize(batchCount);
+
+	m_jobs.ParallelFor(batchCount, [this, &context, batchSize, drawCount](uint32_t batch, uint32_t threadIndex)
 	{
-		return false;
+		uint32_t firstDraw = batch * batchSize;
+		m_secondaries[batch] = RecordSecondary(threadIndex, context, firstDraw, std::min(batchSize, drawCount - firstDraw));
+	});
+
+	// A batch whose command buffer couldn't be allocated is dropped for this frame. The pass was begun for
+	// secondaries, so it can't be recorded inline instead.
+	m_secondaries.erase(std::remove(m_secondaries.begin(), m_secondaries.end(), (VkCommandBuffer)VK_NULL_HANDLE), m_secondaries.end());
+
+	if (!m_secondaries.empty())
+	{
+		vkCmdExecuteCommands(commandBuffer, (uint32_t)m_secondaries.size(), m_secondaries.data());
 	}
+}
+
+VkCommandBuffer Vulkan::RecordSecondary(uint32_t threadIndex, const RenderGraphContext& context, uint32_t firstDraw, uint32_t drawCount)
+{
+	uint32_t pool = m_currentFrame * m_jobs.GetThreadCount() + threadIndex;
+
+	std::vector<VkCommandBuffer>& secondaries = m_workerSecondaries[pool];
+	uint32_t& used = m_workerSecondariesUsed[pool];
 
-	if (!CreateFrameBuffer())
+	if (used == secondaries.size())
 	{
-		return false;
+		VkCommandBufferAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = m_workerPools[pool];
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer commandBuffer;
+		if (vkAllocateCommandBuffers(m_device, &allocInfo, &commandBuffer) != VK_SUCCESS)
+		{
+			LOG_ERROR("Unable to allocate a secondary command buffer");
+			return VK_NULL_HANDLE;
+		}
+
+		secondaries.push_back(commandBuffer);
 	}
 
-	if (!CreateCommandPool())
+	VkCommandBuffer commandBuffer = secondaries[used++];
+
+	PROFILE_SCOPE("RecordSecondary");
+
+	VkCommandBufferInheritanceInfo inheritanceInfo = {};
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.renderPass = context.renderPass;
+	inheritanceInfo.subpass = 0;
+	inheritanceInfo.framebuffer = context.framebuffer;
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+	// Secondary command buffers don't inherit dynamic state
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
+	SetViewportAndScissor(commandBuffer);
+	BindFrameDescriptors(commandBuffer);
+
+	RecordDraws(commandBuffer, firstDraw, drawCount);
+
+	vkEndCommandBuffer(commandBuffer);
+
+	return commandBuffer;
+}
+
+void Vulkan::RecordDraws(VkCommandBuffer commandBuffer, uint32_t firstDraw, uint32_t drawCount)
+{
+	const DrawCommand* draws = m_drawList.data() + firstDraw;
+
+	m_meshes.Bind(commandBuffer);
+
+	if (m_gpuDriven)
 	{
-		return false;
+		m_culling.RecordDraws(commandBuffer);
+		return;
 	}
 
-	if (!CreateCommandBuffers())
+	VkDeviceSize instanceOffset = 0;
+	vkCmdBindVertexBuffers(commandBuffer, INSTANCE_BINDING, 1, &m_instanceBuffer.buffer, &instanceOffset);
+
+	for (uint32_t i = 0; i < drawCount; ++i)
 	{
-		return false;
+		vkCmdDrawIndexed(commandBuffer, draws[i].indexCount, draws[i].instanceCount, draws[i].firstIndex, draws[i].vertexOffset, draws[i].firstInstance);
 	}
+}
+
+void Vulkan::BindFrameDescriptors(VkCommandBuffer commandBuffer)
+{
+	// Once per command buffer, draws only pass slot indices and uniform offsets
+	VkDescriptorSet sets[2];
+	uint32_t setCount = 0;
 
-	if (!CreateSemaphores())
+	if (m_bindlessEnabled)
 	{
-		return false;
+		sets[setCount++] = m_bindless.GetSet(m_currentFrame);
 	}
+	sets[setCount++] = m_uniforms.GetSet();
 
-	return true;
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, setCount, sets, 1, &m_frameUniformOffset);
 }
 
-void Vulkan::Shutdown()
+void Vulkan::UpdateFrameUniforms()
 {
+	auto now = std::chrono::high_resolution_clock::now();
+	std::chrono::duration<float> time = now - m_startTime;
+	std::chrono::duration<float> deltaTime = now - m_lastFrameTime;
+	m_lastFrameTime = now;
+
+	FrameUniforms uniforms = {};
+	uniforms.time = time.count();
+	uniforms.deltaTime = deltaTime.count();
+	uniforms.frameNumber = (uint32_t)m_syncStats.frameCount;
+	uniforms.viewportSize[0] = (float)m_swapChainExtent.width;
+	uniforms.viewportSize[1] = (float)m_swapChainExtent.height;
+	uniforms.inverseViewportSize[0] = 1.0f / m_swapChainExtent.width;
+	uniforms.inverseViewportSize[1] = 1.0f / m_swapChainExtent.height;
+
+	// An exhausted ring is reported when the frame comes around again, offset 0 is still safe to bind
+	if (!m_uniforms.Push(uniforms, m_frameUniformOffset))
+	{
+		m_frameUniformOffset = 0;
+	}
 }
 
-void Vulkan::DrawFrame()
+void Vulkan::SetViewportAndScissor(VkCommandBuffer commandBuffer)
 {
-	uint32_t imageIndex;
-	vkAcquireNextImageKHR(m_device, m_swapChain, std::numeric_limits<uint64_t>::max(), m_imageAvailableSem, VK_NULL_HANDLE, &imageIndex);
-
-	VkSemaphore waitSemaphores[] = { m_imageAvailableSem };
-	VkSemaphore signalSemaphores[] = { m_renderFinishedSem };
-	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+	VkViewport viewport = {};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = (float)m_swapChainExtent.width;
+	viewport.height = (float)m_swapChainExtent.height;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
 
-	VkSubmitInfo submitInfo = {};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = waitSemaphores;
-	submitInfo.pWaitDstStageMask = waitStages;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &m_commandBuffers[imageIndex];
-	submitInfo.signalSemaphoreCount = 1;
-	submitInfo.pSignalSemaphores = signalSemaphores;
+	VkRect2D scissor = {};
+	scissor.offset = { 0, 0 };
+	scissor.extent = m_swapChainExtent;
 
-	if (vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
-	{
-		Log::Error("Unable to submit draw call.");
-	}
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+}
 
-	VkSwapchainKHR swapChains[] = { m_swapChain };
+double Vulkan::WaitForFence(VkFence fence)
+{
+	PROFILE_SCOPE("WaitForFence");
 
-	VkPresentInfoKHR presentInfo = {};
-	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-	presentInfo.waitSemaphoreCount = 1;
-	presentInfo.pWaitSemaphores = signalSemaphores;
-	presentInfo.swapchainCount = 1;
-	presentInfo.pSwapchains = swapChains;
-	presentInfo.pImageIndices = &imageIndex;
+	auto start = std::chrono::high_resolution_clock::now();
 
-	vkQueuePresentKHR(m_presentQueue, &presentInfo);
+	vkWaitForFences(m_device, 1, &fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
 
-	vkDeviceWaitIdle(m_device);
+	std::chrono::duration<double, std::milli> waited = std::chrono::high_resolution_clock::now() - start;
+	return waited.count();
 }
 
 bool Vulkan::CreateInstance()
 {
 	if(validationEnabled && !CheckValidationLayerSupport())
 	{
-		Log::Error("Validation Layer requested but is not available!");
+		LOG_ERROR("Validation Layer requested but is not available!");
 
 		return false;
 	}
@@ -141,10 +1090,10 @@ bool Vulkan::CreateInstance()
 	createInfo.ppEnabledExtensionNames = extensions.data();
 	createInfo.enabledLayerCount = 0;
 
-	VkResult result = vkCreateInstance(&createInfo, nullptr, &m_instance);
+	VkResult result = vkCreateInstance(&createInfo, nullptr, m_instance.Replace());
 	if (result != VK_SUCCESS)
 	{
-		Log::Error("Failed to create vk instance");
+		LOG_ERROR("Failed to create vk instance");
 		return false;
 	}
 
@@ -194,8 +1143,8 @@ bool Vulkan::SetupDebugCallback()
 	createInfo.flags = VK_DEBUG_REPORT_ERROR_BIT_EXT | VK_DEBUG_REPORT_WARNING_BIT_EXT;
 	createInfo.pfnCallback = (PFN_vkDebugReportCallbackEXT)debugCallback;
 
-	if (CreateDebugReportCallbackEXT(m_instance, &createInfo, nullptr, &m_callback) != VK_SUCCESS) {
-		Log::Error("Unable to setup the debug callback");
+	if (CreateDebugReportCallbackEXT(m_instance, &createInfo, nullptr, m_callback.Replace(m_instance)) != VK_SUCCESS) {
+		LOG_ERROR("Unable to setup the debug callback");
 		return false;
 	}
 
@@ -204,9 +1153,9 @@ bool Vulkan::SetupDebugCallback()
 
 bool Vulkan::CreateSurface(GLFWwindow * window)
 {
-	if (glfwCreateWindowSurface(m_instance, window, nullptr, &m_surface) != VK_SUCCESS)
+	if (glfwCreateWindowSurface(m_instance, window, nullptr, m_surface.Replace(m_instance)) != VK_SUCCESS)
 	{
-		Log::Error("Unable to create the surface");
+		LOG_ERROR("Unable to create the surface");
 		return false;
 	}
 
@@ -222,7 +1171,7 @@ bool Vulkan::SelectDevice()
 
 	if (deviceCount == 0)
 	{
-		Log::Error("Failed to find gpu that supports vulkan.");
+		LOG_ERROR("Failed to find gpu that supports vulkan.");
 		return false;
 	}
 
@@ -240,7 +1189,7 @@ bool Vulkan::SelectDevice()
 
 	if (m_physcalDevice == VK_NULL_HANDLE)
 	{
-		Log::Error("No valid GPUs");
+		LOG_ERROR("No valid GPUs");
 		return false;
 	}
 
@@ -252,12 +1201,13 @@ bool Vulkan::CreateDevice()
 	QueueFamilyIndices inds = FindQueueFamilies(m_physcalDevice);
 
 	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-	std::set<int> uniqueQueueFamilies = { inds.graphicsFamily, inds.presentFamily };
+	std::set<int> uniqueQueueFamilies = { inds.graphicsFamily, inds.presentFamily, inds.transferFamily, inds.computeFamily };
+
+	// Has to outlive the loop, the create infos only keep a pointer to it
+	float queuePriority = 1.0f;
 
 	for (int queueFamily : uniqueQueueFamilies)
 	{
-		float queuePriority = 1.0f;
-
 		VkDeviceQueueCreateInfo queueInfo = {};
 		queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
 		queueInfo.queueFamilyIndex = queueFamily;
@@ -267,7 +1217,15 @@ bool Vulkan::CreateDevice()
 		queueCreateInfos.push_back(queueInfo);
 	}
 
+	// Only the features something uses, GPU driven drawing checks for them at startup
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(m_physcalDevice, &supportedFeatures);
+
 	VkPhysicalDeviceFeatures features = {};
+	features.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+	features.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+	m_enabledFeatures = features;
+
 	VkDeviceCreateInfo createInfo = {};
 
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -275,8 +1233,45 @@ bool Vulkan::CreateDevice()
 	createInfo.queueCreateInfoCount = (uint32_t)queueCreateInfos.size();
 	createInfo.pEnabledFeatures = &features;
 
-	createInfo.enabledExtensionCount = (uint32_t)deviceExtensions.size();
-	createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+	auto extensions = GetDeviceExtensions();
+
+	// Optional, without it the culled draws are issued for every mesh instead of just the visible ones
+	const char* const drawIndirectCount[][2] = {
+		{ "VK_KHR_draw_indirect_count", "vkCmdDrawIndexedIndirectCountKHR" },
+		{ "VK_AMD_draw_indirect_count", "vkCmdDrawIndexedIndirectCountAMD" }
+	};
+	const char* drawIndirectCountFunction = nullptr;
+
+	uint32_t extensionCount;
+	vkEnumerateDeviceExtensionProperties(m_physcalDevice, nullptr, &extensionCount, nullptr);
+
+	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(m_physcalDevice, nullptr, &extensionCount, availableExtensions.data());
+
+	for (const auto& candidate : drawIndirectCount)
+	{
+		for (const auto& extension : availableExtensions)
+		{
+			if (drawIndirectCountFunction == nullptr && candidate[0] == std::string(extension.extensionName))
+			{
+				extensions.push_back(candidate[0]);
+				drawIndirectCountFunction = candidate[1];
+			}
+		}
+	}
+
+	m_pipelineCreationFeedback = false;
+	for (const auto& extension : availableExtensions)
+	{
+		if (PIPELINE_CREATION_FEEDBACK_EXTENSION == std::string(extension.extensionName))
+		{
+			extensions.push_back(PIPELINE_CREATION_FEEDBACK_EXTENSION);
+			m_pipelineCreationFeedback = true;
+		}
+	}
+
+	createInfo.enabledExtensionCount = (uint32_t)extensions.size();
+	createInfo.ppEnabledExtensionNames = extensions.data();
 
 	if (validationEnabled)
 	{
@@ -288,14 +1283,18 @@ bool Vulkan::CreateDevice()
 		createInfo.enabledLayerCount = 0;
 	}
 
-	if (vkCreateDevice(m_physcalDevice, &createInfo, nullptr, &m_device) != VK_SUCCESS)
+	if (vkCreateDevice(m_physcalDevice, &createInfo, nullptr, m_device.Replace()) != VK_SUCCESS)
 	{
-		Log::Error("Unable to create the logical graphic device");
+		LOG_ERROR("Unable to create the logical graphic device");
 		return false;
 	}
 
+	m_drawIndirectCount = drawIndirectCountFunction != nullptr ? (DrawIndexedIndirectCountFn)vkGetDeviceProcAddr(m_device, drawIndirectCountFunction) : nullptr;
+
 	vkGetDeviceQueue(m_device, inds.graphicsFamily, 0, &m_graphicsQueue);
-	vkGetDeviceQueue(m_device, inds.graphicsFamily, 0, &m_presentQueue);
+	vkGetDeviceQueue(m_device, inds.presentFamily, 0, &m_presentQueue);
+	vkGetDeviceQueue(m_device, inds.transferFamily, 0, &m_transferQueue);
+	vkGetDeviceQueue(m_device, inds.computeFamily, 0, &m_computeQueue);
 
 	return true;
 }
@@ -327,44 +1326,289 @@ bool Vulkan::CreateSwapChain(uint32_t width, uint32_t height)
 	QueueFamilyIndices inds = FindQueueFamilies(m_physcalDevice);
 	uint32_t queueFamilyInds[] = { (uint32_t)inds.graphicsFamily, (uint32_t)inds.presentFamily };
 
-	if (inds.graphicsFamily != inds.presentFamily)
+	if (inds.graphicsFamily != inds.presentFamily)
+	{
+		createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
+		createInfo.queueFamilyIndexCount = 2;
+		createInfo.pQueueFamilyIndices = queueFamilyInds;
+	}
+	else
+	{
+		createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		createInfo.queueFamilyIndexCount = 0;
+		createInfo.pQueueFamilyIndices = nullptr;
+	}
+
+	createInfo.preTransform = swapChainSupport.capabilities.currentTransform;
+	createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+	createInfo.presentMode = presentMode;
+	createInfo.clipped = VK_TRUE;
+	// Handing over the old swap chain lets the driver recycle its resources and keep presenting during the switch
+	createInfo.oldSwapchain = m_swapChain;
+
+	VkSwapchainKHR swapChain;
+	if (vkCreateSwapchainKHR(m_device, &createInfo, nullptr, &swapChain) != VK_SUCCESS)
+	{
+		LOG_ERROR("Unable to create the swap chain");
+		return false;
+	}
+
+	// Frames in flight may still present from the retired swap chain
+	m_deletions.RetireSwapChain(m_swapChain.Release());
+	m_swapChain.Reset(m_device, swapChain);
+
+	vkGetSwapchainImagesKHR(m_device, m_swapChain, &imageCount, nullptr);
+	m_swapChainImages.resize(imageCount);
+	vkGetSwapchainImagesKHR(m_device, m_swapChain, &imageCount, m_swapChainImages.data());
+
+	m_swapChainImageFormat = surfaceFormat.format;
+	m_swapChainExtent = extent;
+	m_presentMode = presentMode;
+
+	return true;
+}
+
+bool Vulkan::RecreateSwapChain()
+{
+	uint32_t width = m_windowExtent.width;
+	uint32_t height = m_windowExtent.height;
+
+	if (!m_headless)
+	{
+		SwapChainSupportDetails swapChainSupport = QuerySwapChainSupport(m_physcalDevice);
+		VkExtent2D extent = ChooseSwapExtent(swapChainSupport.capabilities, width, height);
+		width = extent.width;
+		height = extent.height;
+	}
+
+	if (width == 0 || height == 0)
+	{
+		return false;
+	}
+
+	PROFILE_SCOPE("RecreateSwapChain");
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	VkFormat oldFormat = m_swapChainImageFormat;
+
+	// Frames in flight may still be drawing into the old targets, so they are retired rather than destroyed.
+	// The graph retires its own framebuffers and images when the targets are recreated.
+	for (VkImageView view : m_swapChainImageViews.Release())
+	{
+		m_deletions.RetireImageView(view);
+	}
+
+	if (m_headless)
+	{
+		for (VkImage image : m_headlessImages.Release())
+		{
+			m_deletions.RetireImage(image);
+		}
+
+		for (auto& allocation : m_headlessImageMemory)
+		{
+			m_deletions.RetireAllocation(allocation);
+		}
+
+		if (!CreateHeadlessTargets(width, height))
+		{
+			return false;
+		}
+
+		if (m_readbackEnabled)
+		{
+			m_deletions.RetireBuffer(m_readbackBuffer);
+			if (!CreateReadbackBuffer())
+			{
+				return false;
+			}
+		}
+	}
+	else if (!CreateSwapChain(width, height))
+	{
+		return false;
+	}
+
+	if (!CreateImageViews())
+	{
+		return false;
+	}
+
+	// Viewport and scissor are dynamic, so the render passes and pipeline survive unless the format or the
+	// passes changed. They are replaced in place, which is rare enough to wait for the frames still using them.
+	if (m_swapChainImageFormat != oldFormat || m_renderGraphDirty)
+	{
+		WaitForAllFrames();
+
+		if (!BuildRenderGraph() || !CreateGraphicPipeline())
+		{
+			return false;
+		}
+
+		m_renderGraphDirty = false;
+	}
+
+	if (!CreateRenderTargets())
+	{
+		return false;
+	}
+
+	m_deletions.RetireCommandBuffers(m_commandPool, m_commandBuffers);
+	if (!CreateCommandBuffers())
+	{
+		return false;
+	}
+
+	m_imagesInFlight.assign(m_swapChainImages.size(), VK_NULL_HANDLE);
+	m_swapChainDirty = false;
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	LOG_INFO("Swap chain recreated at %ux%u in %.3fms", m_swapChainExtent.width, m_swapChainExtent.height, elapsed.count());
+
+	return true;
+}
+
+void Vulkan::RecordSubmitTime(std::chrono::high_resolution_clock::time_point start)
+{
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	m_syncStats.totalSubmitMs += elapsed.count();
+	m_syncStats.lastSubmitMs = elapsed.count();
+}
+
+void Vulkan::WaitForAllFrames()
+{
+	vkWaitForFences(m_device, (uint32_t)m_inFlightFences.Size(), m_inFlightFences.Data(), VK_TRUE, std::numeric_limits<uint64_t>::max());
+}
+
+bool Vulkan::CreateHeadlessTargets(uint32_t width, uint32_t height)
+{
+	m_swapChainImageFormat = VK_FORMAT_B8G8R8A8_UNORM;
+	m_swapChainExtent = { width, height };
+
+	m_headlessImages.Resize(m_device, m_framesInFlight);
+	m_headlessImageMemory.resize(m_framesInFlight);
+	m_swapChainImages.resize(m_framesInFlight);
+
+	for (uint32_t i = 0; i < m_framesInFlight; ++i)
+	{
+		VkImageCreateInfo imageInfo = {};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = m_swapChainImageFormat;
+		imageInfo.extent = { width, height, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		if (vkCreateImage(m_device, &imageInfo, nullptr, m_headlessImages.Replace(i)) != VK_SUCCESS)
+		{
+			LOG_ERROR("Unable to create headless render target: %u", i);
+			return false;
+		}
+
+		if (!m_allocator.AllocateForImage(m_headlessImages[i], VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_headlessImageMemory[i]))
+		{
+			LOG_ERROR("Unable to allocate memory for headless render target: %u", i);
+			return false;
+		}
+
+		m_swapChainImages[i] = m_headlessImages[i];
+	}
+
+	return true;
+}
+
+bool Vulkan::CreateReadbackBuffer()
+{
+	VkDeviceSize size = (VkDeviceSize)m_swapChainExtent.width * m_swapChainExtent.height * 4;
+
+	if (!m_allocator.CreateBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, AllocationStrategy::Buddy, m_readbackBuffer))
 	{
-		createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
-		createInfo.queueFamilyIndexCount = 2;
-		createInfo.pQueueFamilyIndices = queueFamilyInds;
+		LOG_ERROR("Unable to create readback buffer");
+		return false;
 	}
-	else
+
+	return true;
+}
+
+bool Vulkan::CreateBindlessDefaults()
+{
+	if (!m_allocator.CreateBuffer(BINDLESS_DEFAULT_BUFFER_SIZE, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, AllocationStrategy::Buddy, m_bindlessDefaultBuffer))
 	{
-		createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		createInfo.queueFamilyIndexCount = 0;
-		createInfo.pQueueFamilyIndices = nullptr;
+		LOG_ERROR("Unable to create the default bindless buffer");
+		return false;
 	}
 
-	createInfo.preTransform = swapChainSupport.capabilities.currentTransform;
-	createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-	createInfo.presentMode = presentMode;
-	createInfo.clipped = VK_TRUE;
-	createInfo.oldSwapchain = VK_NULL_HANDLE;
+	VkImageCreateInfo imageInfo = {};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+	imageInfo.extent = { 1, 1, 1 };
+	imageInfo.mipLevels = 1;
+	imageInfo.arrayLayers = 1;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	if (vkCreateImage(m_device, &imageInfo, nullptr, m_bindlessDefaultImage.Replace(m_device)) != VK_SUCCESS ||
+		!m_allocator.AllocateForImage(m_bindlessDefaultImage, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_bindlessDefaultImageMemory))
+	{
+		LOG_ERROR("Unable to create the default bindless image");
+		return false;
+	}
 
-	if (vkCreateSwapchainKHR(m_device, &createInfo, nullptr, &m_swapChain) != VK_SUCCESS)
+	// Goes out with the first frame, which waits for it like any other upload
+	const uint32_t pixel = 0xFFFFFFFF;
+	if (m_uploads.UploadImage(m_bindlessDefaultImage, VK_IMAGE_ASPECT_COLOR_BIT, imageInfo.extent, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, &pixel, sizeof(pixel),
+		VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT) == 0)
 	{
-		Log::Error("Unable to create the swap chain");
 		return false;
 	}
 
-	vkGetSwapchainImagesKHR(m_device, m_swapChain, &imageCount, nullptr);
-	m_swapChainImages.resize(imageCount);
-	vkGetSwapchainImagesKHR(m_device, m_swapChain, &imageCount, m_swapChainImages.data());
+	VkImageViewCreateInfo viewInfo = {};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = m_bindlessDefaultImage;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = imageInfo.format;
+	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.subresourceRange.levelCount = 1;
+	viewInfo.subresourceRange.layerCount = 1;
 
-	m_swapChainImageFormat = surfaceFormat.format;
-	m_swapChainExtent = extent;
+	if (vkCreateImageView(m_device, &viewInfo, nullptr, m_bindlessDefaultView.Replace(m_device)) != VK_SUCCESS)
+	{
+		LOG_ERROR("Unable to create the default bindless image view");
+		return false;
+	}
+
+	VkSamplerCreateInfo samplerInfo = {};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+
+	if (vkCreateSampler(m_device, &samplerInfo, nullptr, m_bindlessDefaultSampler.Replace(m_device)) != VK_SUCCESS)
+	{
+		LOG_ERROR("Unable to create the default bindless sampler");
+		return false;
+	}
 
 	return true;
 }
 
 bool Vulkan::CreateImageViews()
 {
-	m_swapChainImageViews.resize(m_swapChainImages.size(), VDeleter<VkImageView>{m_device, vkDestroyImageView});
+	m_swapChainImageViews.Resize(m_device, m_swapChainImages.size());
 
 	for (uint32_t i = 0; i < m_swapChainImages.size(); ++i)
 	{
@@ -385,9 +1629,9 @@ bool Vulkan::CreateImageViews()
 		createInfo.subresourceRange.baseArrayLayer = 0;
 		createInfo.subresourceRange.layerCount = 1;
 
-		if (vkCreateImageView(m_device, &createInfo, nullptr, &m_swapChainImageViews[i]) != VK_SUCCESS)
+		if (vkCreateImageView(m_device, &createInfo, nullptr, m_swapChainImageViews.Replace(i)) != VK_SUCCESS)
 		{
-			Log::Error("Failed to create image view: " + std::to_string(i));
+			LOG_ERROR("Failed to create image view: %u", i);
 			return false;
 		}
 	}
@@ -395,190 +1639,359 @@ bool Vulkan::CreateImageViews()
 	return true;
 }
 
-bool Vulkan::CreateRenderPass()
+bool Vulkan::BuildRenderGraph()
+{
+	m_renderGraph.Reset();
+
+	// Headless targets are never presented, leave them ready to be copied out
+	VkImageLayout backBufferLayout = m_headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	// The acquire semaphore is waited on at the color output stage, the first use has to wait there too
+	m_backBuffer = m_renderGraph.ImportImage("Back buffer", m_swapChainImageFormat, backBufferLayout, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+
+	m_mainPass = m_renderGraph.AddPass("Main pass", [this](VkCommandBuffer commandBuffer, const RenderGraphContext& context)
+	{
+		RecordMainPass(commandBuffer, context);
+	});
+
+	m_msaaSamples = ChooseSampleCount(m_msaaRequested);
+
+	VkClearValue clearColor = { 0.0f, 0.0f, 0.0f, 1.0f };
+	if (m_msaaSamples == VK_SAMPLE_COUNT_1_BIT)
+	{
+		m_renderGraph.Clear(m_mainPass, m_backBuffer, ResourceUsage::ColorAttachment, clearColor);
+	}
+	else
+	{
+		// Resolved at the end of the subpass, the samples are never stored
+		RenderResource color = m_renderGraph.CreateImage("Multisampled color", m_swapChainImageFormat, m_msaaSamples);
+		m_renderGraph.Clear(m_mainPass, color, ResourceUsage::ColorAttachment, clearColor);
+		m_renderGraph.Use(m_mainPass, m_backBuffer, ResourceUsage::ResolveAttachment);
+	}
+
+	if (m_depthEnabled)
+	{
+		VkFormat depthFormat = ChooseDepthFormat();
+		if (depthFormat == VK_FORMAT_UNDEFINED)
+		{
+			LOG_ERROR("No depth format supports depth attachments");
+			return false;
+		}
+
+		VkClearValue clearDepth = {};
+		clearDepth.depthStencil = { 1.0f, 0 };
+
+		RenderResource depth = m_renderGraph.CreateImage("Depth", depthFormat, m_msaaSamples);
+		m_renderGraph.Clear(m_mainPass, depth, ResourceUsage::DepthAttachment, clearDepth);
+	}
+
+	return m_renderGraph.Compile();
+}
+
+bool Vulkan::CreateGraphicPipeline() 
 {
-	VkAttachmentDescription colorAttachment = {};
-	colorAttachment.format = m_swapChainImageFormat;
-	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	// Every cached pipeline points at the modules, layout and render pass that are about to be replaced
+	m_pipelineStates.Clear();
+
+	if (!CreateShaderModule("vert", m_vertexShaderModule) || !CreateShaderModule("frag", m_fragmentShaderModule))
+	{
+		return false;
+	}
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	std::vector<VkDescriptorSetLayout> setLayouts;
+	if (m_bindlessEnabled)
+	{
+		setLayouts.push_back(m_bindless.GetLayout());
+	}
+	setLayouts.push_back(m_uniforms.GetLayout());
+
+	pipelineLayoutInfo.setLayoutCount = (uint32_t)setLayouts.size();
+	pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+	pipelineLayoutInfo.pushConstantRangeCount = 0;
 
-	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, m_pipelineLayout.Replace(m_device)) != VK_SUCCESS) 
+	{
+		LOG_ERROR("Unable to create the pipeline layout");
+		return false;
+	}
 
-	VkAttachmentReference colorRef = {};
-	colorRef.attachment = 0;
-	colorRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	PipelineKey key;
+	if (!MeshBuffer::DescribeVertexInput(key))
+	{
+		return false;
+	}
+	key.vertexShader = m_vertexShaderModule;
+	key.fragmentShader = m_fragmentShaderModule;
+	key.layout = m_pipelineLayout;
+	key.renderPass = m_renderGraph.GetRenderPass(m_mainPass);
+	key.samples = (uint8_t)m_msaaSamples;
+	key.depthTest = m_depthEnabled;
+	key.depthWrite = m_depthEnabled;
+	// Everything is drawn at the same depth for now, so equal depths have to pass for draw order to still decide
+	key.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+	m_graphicsPipelineKey = key;
+
+	// The pipeline we draw with goes first so the workers pick it up before the variants, and the
+	// variants derive from it
+	std::vector<PipelineKey> keys = { key };
+
+	const VkCullModeFlags cullModes[] = { VK_CULL_MODE_NONE, VK_CULL_MODE_BACK_BIT, VK_CULL_MODE_FRONT_BIT };
+	const VkFrontFace frontFaces[] = { VK_FRONT_FACE_CLOCKWISE, VK_FRONT_FACE_COUNTER_CLOCKWISE };
+	const BlendMode blendModes[] = { BlendMode::Opaque, BlendMode::Alpha, BlendMode::Additive };
+
+	for (VkCullModeFlags cullMode : cullModes)
+	{
+		for (VkFrontFace frontFace : frontFaces)
+		{
+			for (BlendMode blendMode : blendModes)
+			{
+				PipelineKey variant = key;
+				variant.cullMode = cullMode;
+				variant.frontFace = frontFace;
+				variant.blendMode = blendMode;
+				keys.push_back(variant);
+			}
+		}
+	}
 
-	VkSubpassDescription subPass = {};
-	subPass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-	subPass.colorAttachmentCount = 1;
-	subPass.pColorAttachments = &colorRef;
+	auto start = std::chrono::high_resolution_clock::now();
 
-	VkRenderPassCreateInfo createInfo = {};
+	// The variant matching key is deduped
+	m_pipelineStates.Prepare(keys.data(), (uint32_t)keys.size());
+	m_graphicsPipeline = m_pipelineStates.Get(m_graphicsPipelineKey);
 
-	createInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-	createInfo.attachmentCount = 1;
-	createInfo.pAttachments = &colorAttachment;
-	createInfo.subpassCount = 1;
-	createInfo.pSubpasses = &subPass;
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	m_startupStats.criticalPipelineMs += elapsed.count();
 
-	if (vkCreateRenderPass(m_device, &createInfo, nullptr, &m_renderPass) != VK_SUCCESS)
+	if (m_graphicsPipeline == VK_NULL_HANDLE)
 	{
-		Log::Error("Unable to create the render pass");
+		LOG_ERROR("Unable to create the graphic's pipeline");
 		return false;
 	}
 
 	return true;
 }
 
-bool Vulkan::CreateGraphicPipeline() 
+void Vulkan::WaitForPipelines()
+{
+	m_pipelineCompiler.WaitIdle();
+}
+
+bool Vulkan::SetParticleCount(uint32_t count)
 {
-	auto vertShaderCode = ReadFile("../shaders/vert.spv");
-	auto fragShaderCode = ReadFile("../shaders/frag.spv");
+	// The last step may still be writing the old buffer
+	if (m_particleTicket != 0 && !m_compute.Wait(m_particleTicket))
+	{
+		return false;
+	}
+
+	m_particleTicket = 0;
+	m_particleCount = 0;
+	m_allocator.DestroyBuffer(m_particleBuffer);
+
+	if (count == 0)
+	{
+		return true;
+	}
+
+	if (m_particlePipeline.pipeline == VK_NULL_HANDLE && !CreateParticlePipeline())
+	{
+		return false;
+	}
 
-	VDeleter<VkShaderModule> vertShaderModule{ m_device, vkDestroyShaderModule };
-	VDeleter<VkShaderModule> fragShaderModule{ m_device, vkDestroyShaderModule };
-	CreateShaderModule(vertShaderCode, vertShaderModule);
-	CreateShaderModule(fragShaderCode, fragShaderModule);
+	struct Particle
+	{
+		float position[4];
+		float velocity[4];
+	};
 
-	VkPipelineShaderStageCreateInfo vertShaderStageInfo = {};
-	vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-	vertShaderStageInfo.module = vertShaderModule;
-	vertShaderStageInfo.pName = "main";
+	// Only the compute queue touches it, so it is written in place rather than uploaded and handed over
+	if (!m_allocator.CreateBuffer(count * sizeof(Particle), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		AllocationStrategy::Buddy, m_particleBuffer))
+	{
+		LOG_ERROR("Unable to create the particle buffer for %u particles", count);
+		return false;
+	}
 
-	VkPipelineShaderStageCreateInfo fragShaderStageInfo = {};
-	fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-	fragShaderStageInfo.module = fragShaderModule;
-	fragShaderStageInfo.pName = "main";
+	// A square of particles thrown up and outwards, faster towards the edges
+	Particle* particles = (Particle*)m_particleBuffer.allocation.mapped;
+	uint32_t side = (uint32_t)ceil(sqrt((double)count));
 
-	VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		float x = ((i % side) + 0.5f) / side * 2.0f - 1.0f;
+		float z = ((i / side) + 0.5f) / side * 2.0f - 1.0f;
 
-	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
-	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputInfo.vertexBindingDescriptionCount = 0;
-	vertexInputInfo.vertexAttributeDescriptionCount = 0;
+		particles[i] = Particle{ { x, 0.0f, z, 1.0f }, { x, 2.0f + (i % 7) * 0.25f, z, 0.0f } };
+	}
 
-	VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
-	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-	inputAssembly.primitiveRestartEnable = VK_FALSE;
+	VkDescriptorBufferInfo bufferInfo = { m_particleBuffer.buffer, 0, VK_WHOLE_SIZE };
 
-	VkViewport viewport = {};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = (float)m_swapChainExtent.width;
-	viewport.height = (float)m_swapChainExtent.height;
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
+	VkWriteDescriptorSet write = {};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet = m_particleSet;
+	write.dstBinding = 0;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	write.pBufferInfo = &bufferInfo;
 
-	VkRect2D scissor = {};
-	scissor.offset = { 0, 0 };
-	scissor.extent = m_swapChainExtent;
+	vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+
+	m_particleCount = count;
+	m_lastParticleStep = std::chrono::high_resolution_clock::now();
+
+	return true;
+}
+
+bool Vulkan::CreateParticlePipeline()
+{
+	VkDescriptorSetLayoutBinding binding = {};
+	binding.binding = 0;
+	binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	binding.descriptorCount = 1;
+	binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkDescriptorSetLayout layout = m_descriptorLayouts.Get({ binding });
+	if (layout == VK_NULL_HANDLE)
+	{
+		return false;
+	}
+
+	// The one set is only rewritten between steps, see SetParticleCount
+	VkDescriptorPoolSize poolSize = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1 };
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = 1;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+
+	if (vkCreateDescriptorPool(m_device, &poolInfo, nullptr, m_particlePool.Replace(m_device)) != VK_SUCCESS)
+	{
+		LOG_ERROR("Unable to create the particle descriptor pool");
+		return false;
+	}
 
-	VkPipelineViewportStateCreateInfo viewportState = {};
-	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-	viewportState.viewportCount = 1;
-	viewportState.pViewports = &viewport;
-	viewportState.scissorCount = 1;
-	viewportState.pScissors = &scissor;
-
-	VkPipelineRasterizationStateCreateInfo rasterizer = {};
-	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-	rasterizer.depthClampEnable = VK_FALSE;
-	rasterizer.rasterizerDiscardEnable = VK_FALSE;
-	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-	rasterizer.lineWidth = 1.0f;
-	rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-	rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
-	rasterizer.depthBiasEnable = VK_FALSE;
-
-	VkPipelineMultisampleStateCreateInfo multisampling = {};
-	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	multisampling.sampleShadingEnable = VK_FALSE;
-	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-
-	VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
-	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-	colorBlendAttachment.blendEnable = VK_FALSE;
-
-	VkPipelineColorBlendStateCreateInfo colorBlending = {};
-	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	colorBlending.logicOpEnable = VK_FALSE;
-	colorBlending.logicOp = VK_LOGIC_OP_COPY;
-	colorBlending.attachmentCount = 1;
-	colorBlending.pAttachments = &colorBlendAttachment;
-	colorBlending.blendConstants[0] = 0.0f;
-	colorBlending.blendConstants[1] = 0.0f;
-	colorBlending.blendConstants[2] = 0.0f;
-	colorBlending.blendConstants[3] = 0.0f;
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = m_particlePool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &layout;
+
+	if (vkAllocateDescriptorSets(m_device, &allocInfo, &m_particleSet) != VK_SUCCESS)
+	{
+		LOG_ERROR("Unable to allocate the particle descriptor set");
+		return false;
+	}
+
+	return CreateComputePipeline("particles", { layout }, sizeof(ParticleStep), m_particlePipeline);
+}
+
+void Vulkan::StepParticles()
+{
+	// One step at a time, the next one covers however long this one took
+	if (m_particleCount == 0 || (m_particleTicket != 0 && !m_compute.IsComplete(m_particleTicket)))
+	{
+		return;
+	}
+
+	auto now = std::chrono::high_resolution_clock::now();
+	std::chrono::duration<float> elapsed = now - m_lastParticleStep;
+
+	ParticleStep step = { std::min(elapsed.count(), MAX_PARTICLE_STEP_SECONDS), m_particleCount };
+
+	ComputeTicket ticket = m_compute.Submit("Particles", [&](VkCommandBuffer commandBuffer)
+	{
+		// Batches on the queue may overlap, the previous step's writes have to land first
+		VkMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_particlePipeline.pipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_particlePipeline.layout, 0, 1, &m_particleSet, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, m_particlePipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(step), &step);
+		vkCmdDispatch(commandBuffer, (m_particleCount + PARTICLE_GROUP_SIZE - 1) / PARTICLE_GROUP_SIZE, 1, 1);
+	});
+
+	// 0 when every batch is busy, try again next frame
+	if (ticket != 0)
+	{
+		m_particleTicket = ticket;
+		m_lastParticleStep = now;
+	}
+}
+
+bool Vulkan::CreateComputePipeline(const std::string& shaderName, const std::vector<VkDescriptorSetLayout>& setLayouts, uint32_t pushConstantSize, ComputePipeline& pipeline)
+{
+	// Only needed while the pipeline is built
+	ShaderModuleHandle shaderModule;
+	if (!CreateShaderModule(shaderName, shaderModule))
+	{
+		return false;
+	}
+
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = pushConstantSize;
 
 	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
 	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo.setLayoutCount = 0;
-	pipelineLayoutInfo.pushConstantRangeCount = 0;
+	pipelineLayoutInfo.setLayoutCount = (uint32_t)setLayouts.size();
+	pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+	pipelineLayoutInfo.pushConstantRangeCount = pushConstantSize > 0 ? 1 : 0;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
 
-	if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_pipelineLayout) != VK_SUCCESS) 
+	if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &pipeline.layout) != VK_SUCCESS)
 	{
-		Log::Error("Unable to create the pipeline layout");
+		LOG_ERROR("Unable to create the compute pipeline layout for %s", shaderName.c_str());
 		return false;
 	}
 
-	VkGraphicsPipelineCreateInfo pipelineInfo = {};
-	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-	pipelineInfo.stageCount = 2;
-	pipelineInfo.pStages = shaderStages;
-	pipelineInfo.pVertexInputState = &vertexInputInfo;
-	pipelineInfo.pInputAssemblyState = &inputAssembly;
-	pipelineInfo.pViewportState = &viewportState;
-	pipelineInfo.pRasterizationState = &rasterizer;
-	pipelineInfo.pMultisampleState = &multisampling;
-	pipelineInfo.pColorBlendState = &colorBlending;
-	pipelineInfo.layout = m_pipelineLayout;
-	pipelineInfo.renderPass = m_renderPass;
-	pipelineInfo.subpass = 0;
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = shaderModule;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = pipeline.layout;
 	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-	if (vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_graphicsPipeline) != VK_SUCCESS) 
+	if (m_pipelineCache.CreateComputePipeline(pipelineInfo, &pipeline.pipeline) != VK_SUCCESS)
 	{
-		Log::Error("Unable to create the graphic's pipeline");
+		LOG_ERROR("Unable to create the compute pipeline for %s", shaderName.c_str());
+		DestroyComputePipeline(pipeline);
 		return false;
 	}
 
 	return true;
 }
 
-bool Vulkan::CreateFrameBuffer()
+void Vulkan::DestroyComputePipeline(ComputePipeline& pipeline)
 {
-	m_swapChainFrameBuffers.resize(m_swapChainImages.size(), VDeleter<VkFramebuffer>{m_device, vkDestroyFramebuffer});
+	if (pipeline.pipeline != VK_NULL_HANDLE)
+	{
+		vkDestroyPipeline(m_device, pipeline.pipeline, nullptr);
+	}
 
-	for (size_t i = 0; i < m_swapChainImageViews.size(); ++i)
+	if (pipeline.layout != VK_NULL_HANDLE)
 	{
-		VkImageView attachments[] = {
-			m_swapChainImageViews[i]
-		};
+		vkDestroyPipelineLayout(m_device, pipeline.layout, nullptr);
+	}
 
-		VkFramebufferCreateInfo createInfo = {};
-		createInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-		createInfo.renderPass = m_renderPass;
-		createInfo.attachmentCount = 1;
-		createInfo.pAttachments = attachments;
-		createInfo.width = m_swapChainExtent.width;
-		createInfo.height = m_swapChainExtent.height;
-		createInfo.layers = 1;
+	pipeline = ComputePipeline();
+}
 
-		if (vkCreateFramebuffer(m_device, &createInfo, nullptr, &m_swapChainFrameBuffers[i]) != VK_SUCCESS)
-		{
-			Log::Error("Unable to create frame buffer");
-			return false;
-		}
-	}
+bool Vulkan::CreateRenderTargets()
+{
+	std::vector<VkImageView> views(m_swapChainImageViews.Data(), m_swapChainImageViews.Data() + m_swapChainImageViews.Size());
+	m_renderGraph.SetImportedImages(m_backBuffer, m_swapChainImages, views);
 
-	return true;
+	return m_renderGraph.CreateTargets(m_swapChainExtent);
 }
 
 bool Vulkan::CreateCommandPool()
@@ -590,9 +2003,9 @@ bool Vulkan::CreateCommandPool()
 	poolInfo.queueFamilyIndex = inds.graphicsFamily;
 	poolInfo.flags = 0;
 
-	if (vkCreateCommandPool(m_device, &poolInfo, nullptr, &m_commandPool) != VK_SUCCESS)
+	if (vkCreateCommandPool(m_device, &poolInfo, nullptr, m_commandPool.Replace(m_device)) != VK_SUCCESS)
 	{
-		Log::Error("Unable to create command pool.");
+		LOG_ERROR("Unable to create command pool.");
 		return false;
 	}
 
@@ -601,7 +2014,7 @@ bool Vulkan::CreateCommandPool()
 
 bool Vulkan::CreateCommandBuffers()
 {
-	m_commandBuffers.resize(m_swapChainFrameBuffers.size());
+	m_commandBuffers.resize(m_swapChainImages.size());
 
 	VkCommandBufferAllocateInfo allocInfo = {};
 	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -611,7 +2024,7 @@ bool Vulkan::CreateCommandBuffers()
 
 	if (vkAllocateCommandBuffers(m_device, &allocInfo, m_commandBuffers.data()) != VK_SUCCESS)
 	{
-		Log::Error("Unable to create command buffers)");
+		LOG_ERROR("Unable to create command buffers)");
 	}
 
 	for (uint32_t i = 0; i < m_commandBuffers.size(); ++i)
@@ -623,43 +2036,111 @@ bool Vulkan::CreateCommandBuffers()
 
 		vkBeginCommandBuffer(m_commandBuffers[i], &beginInfo);
 
-		VkRenderPassBeginInfo renderPassInfo = {};
-		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassInfo.renderPass = m_renderPass;
-		renderPassInfo.framebuffer = m_swapChainFrameBuffers[i];
-		renderPassInfo.renderArea.offset = { 0, 0 };
-		renderPassInfo.renderArea.extent = m_swapChainExtent;
+		// Pre-recorded buffers are replayed, so their queries are reset on every replay too
+		PROFILE_GPU_RESET(m_commandBuffers[i], i < PROFILER_IMAGE_SLOTS ? i : ~0u);
 
-		VkClearValue clearColor = { 0.0f, 0.0f, 0.0f, 1.0f };
-		renderPassInfo.clearValueCount = 1;
-		renderPassInfo.pClearValues = &clearColor;
+		{
+			PROFILE_GPU_SCOPE(m_commandBuffers[i], i < PROFILER_IMAGE_SLOTS ? i : ~0u, "Main pass");
 
-		vkCmdBeginRenderPass(m_commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+			m_recordingStatic = true;
+			m_renderGraph.SetPassContents(m_mainPass, VK_SUBPASS_CONTENTS_INLINE);
+			m_renderGraph.Execute(m_commandBuffers[i], i);
+			m_recordingStatic = false;
+		}
 
-		vkCmdBindPipeline(m_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
+		if (vkEndCommandBuffer(m_commandBuffers[i]) != VK_SUCCESS) {
+			throw std::runtime_error("failed to record command buffer!");
+		}
+	}
 
-		vkCmdDraw(m_commandBuffers[i], 3, 1, 0, 0);
+	return true;
+}
 
-		vkCmdEndRenderPass(m_commandBuffers[i]);
+bool Vulkan::CreateFrameCommandPools()
+{
+	QueueFamilyIndices inds = FindQueueFamilies(m_physcalDevice);
+	uint32_t threadCount = m_jobs.GetThreadCount();
 
-		if (vkEndCommandBuffer(m_commandBuffers[i]) != VK_SUCCESS) {
-			throw std::runtime_error("failed to record command buffer!");
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.queueFamilyIndex = inds.graphicsFamily;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+	m_framePools.Resize(m_device, m_framesInFlight);
+	m_frameCommandBuffers.resize(m_framesInFlight);
+	m_framePrologueBuffers.resize(m_framesInFlight);
+	m_frameEpilogueBuffers.resize(m_framesInFlight);
+	m_workerPools.Resize(m_device, m_framesInFlight * threadCount);
+	m_workerSecondaries.resize(m_workerPools.Size());
+	m_workerSecondariesUsed.resize(m_workerPools.Size(), 0);
+
+	for (uint32_t i = 0; i < m_framesInFlight; ++i)
+	{
+		if (vkCreateCommandPool(m_device, &poolInfo, nullptr, m_framePools.Replace(i)) != VK_SUCCESS)
+		{
+			LOG_ERROR("Unable to create the command pool for frame: %u", i);
+			return false;
+		}
+
+		VkCommandBufferAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = m_framePools[i];
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 3;
+
+		VkCommandBuffer commandBuffers[3];
+		if (vkAllocateCommandBuffers(m_device, &allocInfo, commandBuffers) != VK_SUCCESS)
+		{
+			LOG_ERROR("Unable to allocate the command buffers for frame: %u", i);
+			return false;
+		}
+
+		m_frameCommandBuffers[i] = commandBuffers[0];
+		m_framePrologueBuffers[i] = commandBuffers[1];
+		m_frameEpilogueBuffers[i] = commandBuffers[2];
+	}
+
+	for (size_t i = 0; i < m_workerPools.Size(); ++i)
+	{
+		if (vkCreateCommandPool(m_device, &poolInfo, nullptr, m_workerPools.Replace(i)) != VK_SUCCESS)
+		{
+			LOG_ERROR("Unable to create worker command pool: %u", (uint32_t)i);
+			return false;
 		}
 	}
 
 	return true;
 }
 
-bool Vulkan::CreateSemaphores()
+bool Vulkan::CreateSyncObjects()
 {
-	VkSemaphoreCreateInfo createInfo = {};
-	createInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	m_imageAvailableSems.Resize(m_device, m_framesInFlight);
+	m_renderFinishedSems.Resize(m_device, m_framesInFlight);
+	m_inFlightFences.Resize(m_device, m_framesInFlight);
+	m_imagesInFlight.resize(m_swapChainImages.size(), VK_NULL_HANDLE);
+
+	VkSemaphoreCreateInfo semInfo = {};
+	semInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-	if ((vkCreateSemaphore(m_device, &createInfo, nullptr, &m_imageAvailableSem) != VK_SUCCESS) ||
-		(vkCreateSemaphore(m_device, &createInfo, nullptr, &m_renderFinishedSem) != VK_SUCCESS))
+	// Start signaled so the first wait on each frame slot doesn't block forever
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+	for (uint32_t i = 0; i < m_framesInFlight; ++i)
 	{
-		Log::Error("Unable to create semaphores");
-		return false;
+		if ((vkCreateSemaphore(m_device, &semInfo, nullptr, m_imageAvailableSems.Replace(i)) != VK_SUCCESS) ||
+			(vkCreateSemaphore(m_device, &semInfo, nullptr, m_renderFinishedSems.Replace(i)) != VK_SUCCESS))
+		{
+			LOG_ERROR("Unable to create semaphores");
+			return false;
+		}
+
+		if (vkCreateFence(m_device, &fenceInfo, nullptr, m_inFlightFences.Replace(i)) != VK_SUCCESS)
+		{
+			LOG_ERROR("Unable to create fence for frame: %u", i);
+			return false;
+		}
 	}
 
 	return true;
@@ -669,14 +2150,18 @@ std::vector<const char*> Vulkan::GetRequiredExtensions()
 {
 	std::vector<const char*> extensions;
 
-	uint32_t glfwExtensionCount = 0;
-	const char** glfwExtensions;
+	// Headless instances have no surface, so don't ask glfw (which may not even be initialized)
+	if (!m_headless)
+	{
+		uint32_t glfwExtensionCount = 0;
+		const char** glfwExtensions;
 
-	glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+		glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
-	for (unsigned int i = 0; i < glfwExtensionCount; ++i)
-	{
-		extensions.push_back(glfwExtensions[i]);
+		for (unsigned int i = 0; i < glfwExtensionCount; ++i)
+		{
+			extensions.push_back(glfwExtensions[i]);
+		}
 	}
 
 	if (validationEnabled)
@@ -687,15 +2172,25 @@ std::vector<const char*> Vulkan::GetRequiredExtensions()
 	return extensions;
 }
 
+std::vector<const char*> Vulkan::GetDeviceExtensions()
+{
+	if (m_headless)
+	{
+		return std::vector<const char*>();
+	}
+
+	return deviceExtensions;
+}
+
 bool Vulkan::IsDeviceValid(VkPhysicalDevice device)
 {
 	QueueFamilyIndices inds = FindQueueFamilies(device);
 
 	bool extensionsSupported = CheckDeviceExtensionsSupport(device);
 
-	bool swapChainAdequate = false;
+	bool swapChainAdequate = m_headless;
 
-	if (extensionsSupported)
+	if (extensionsSupported && !m_headless)
 	{
 		SwapChainSupportDetails swapChainSupport = QuerySwapChainSupport(device);
 		swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
@@ -712,7 +2207,8 @@ bool Vulkan::CheckDeviceExtensionsSupport(VkPhysicalDevice device)
 	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
 	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
 
-	std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
+	auto extensions = GetDeviceExtensions();
+	std::set<std::string> requiredExtensions(extensions.begin(), extensions.end());
 
 	for (const auto& extension : availableExtensions)
 	{
@@ -737,28 +2233,61 @@ QueueFamilyIndices Vulkan::FindQueueFamilies(VkPhysicalDevice device)
 
 	for (const auto& prop : properties)
 	{
-		if (prop.queueCount > 0 && prop.queueFlags & VK_QUEUE_COMPUTE_BIT)
+		if (prop.queueCount == 0)
+		{
+			i++;
+			continue;
+		}
+
+		if (inds.graphicsFamily < 0 && prop.queueFlags & VK_QUEUE_GRAPHICS_BIT)
 		{
 			inds.graphicsFamily = i;
 		}
 
-		VkBool32 presentSupport = false;
+		// Transfer only families map to the copy engines and run alongside graphics work
+		if (inds.transferFamily < 0 && prop.queueFlags & VK_QUEUE_TRANSFER_BIT && !(prop.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+		{
+			inds.transferFamily = i;
+		}
+
+		// Compute without graphics runs on its own hardware queue and can overlap the frame
+		if (inds.computeFamily < 0 && prop.queueFlags & VK_QUEUE_COMPUTE_BIT && !(prop.queueFlags & VK_QUEUE_GRAPHICS_BIT))
+		{
+			inds.computeFamily = i;
+		}
 
-		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, m_surface, &presentSupport);
+		VkBool32 presentSupport = false;
 
-		if (prop.queueCount > 0 && presentSupport)
+		if (m_headless)
 		{
-			inds.presentFamily = i;
+			// Nothing is presented, so the graphics queue doubles as the present queue
+			presentSupport = inds.graphicsFamily == i;
+		}
+		else
+		{
+			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, m_surface, &presentSupport);
 		}
 
-		if (inds.IsComplete())
+		// Prefer presenting from the graphics family, it saves sharing the swap chain images
+		if (presentSupport && (inds.presentFamily < 0 || inds.graphicsFamily == i))
 		{
-			break;
+			inds.presentFamily = i;
 		}
 
 		i++;
 	}
 
+	// Graphics queues can always transfer, and Vulkan requires one family with both graphics and compute
+	if (inds.transferFamily < 0)
+	{
+		inds.transferFamily = inds.graphicsFamily;
+	}
+
+	if (inds.computeFamily < 0)
+	{
+		inds.computeFamily = inds.graphicsFamily;
+	}
+
 	return inds;
 }
 
@@ -809,13 +2338,37 @@ VkSurfaceFormatKHR Vulkan::ChooseSwapSurfaceFormat(const std::vector<VkSurfaceFo
 	return availableFormats[0];
 }
 
-VkPresentModeKHR Vulkan::ChooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes)
+VkPresentModeKHR Vulkan::ChooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes) const
 {
-	for (const auto& availablePresentMode : availablePresentModes)
+	// In order of preference, FIFO is always supported so every list ends there
+	static const std::vector<VkPresentModeKHR> vsyncModes = { VK_PRESENT_MODE_FIFO_KHR };
+	static const std::vector<VkPresentModeKHR> lowLatencyModes = { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_KHR };
+	static const std::vector<VkPresentModeKHR> immediateModes = { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_KHR };
+	// The limiter does the pacing, so the display shouldn't block it on top
+	static const std::vector<VkPresentModeKHR> cappedModes = { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_FIFO_KHR };
+
+	const std::vector<VkPresentModeKHR>* preferredModes = &lowLatencyModes;
+
+	switch (m_presentPolicy)
+	{
+	case PresentPolicy::VSync:
+		preferredModes = &vsyncModes;
+		break;
+	case PresentPolicy::LowLatency:
+		break;
+	case PresentPolicy::Immediate:
+		preferredModes = &immediateModes;
+		break;
+	case PresentPolicy::Capped:
+		preferredModes = &cappedModes;
+		break;
+	}
+
+	for (VkPresentModeKHR mode : *preferredModes)
 	{
-		if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR)
+		if (std::find(availablePresentModes.begin(), availablePresentModes.end(), mode) != availablePresentModes.end())
 		{
-			return availablePresentMode;
+			return mode;
 		}
 	}
 
@@ -839,38 +2392,49 @@ VkExtent2D Vulkan::ChooseSwapExtent(const VkSurfaceCapabilitiesKHR & capabilitie
 	}
 }
 
-void Vulkan::CreateShaderModule(const std::vector<char>& shaderSrc, VDeleter<VkShaderModule>& shaderModule)
+VkSampleCountFlagBits Vulkan::ChooseSampleCount(VkSampleCountFlagBits requested) const
 {
-	VkShaderModuleCreateInfo createInfo = {};
-	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	createInfo.codeSize = shaderSrc.size();
-	createInfo.pCode = (uint32_t*)shaderSrc.data();
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(m_physcalDevice, &properties);
 
-	if (vkCreateShaderModule(m_device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
+	VkSampleCountFlags supported = properties.limits.framebufferColorSampleCounts;
+	if (m_depthEnabled)
 	{
-		Log::Error("Unable to create module from shader source.");
-		return;
+		supported &= properties.limits.framebufferDepthSampleCounts;
 	}
-}
-
-std::vector<char> Vulkan::ReadFile(const std::string filename)
-{
-	std::ifstream file(filename, std::ios::ate | std::ios::binary);
 
-	if (!file.is_open())
+	// The most samples that don't exceed the request, one is always supported
+	for (uint32_t samples = requested; samples > VK_SAMPLE_COUNT_1_BIT; samples >>= 1)
 	{
-		Log::Error("Unable to open file: " + filename);
-		return std::vector<char>();
+		if ((supported & samples) != 0)
+		{
+			return (VkSampleCountFlagBits)samples;
+		}
 	}
 
-	size_t fileSize = (size_t)file.tellg();
-	std::vector<char> buffer(fileSize);
+	return VK_SAMPLE_COUNT_1_BIT;
+}
+
+VkFormat Vulkan::ChooseDepthFormat() const
+{
+	// No stencil needed, D16 is the only one every device has to support but the precision is poor
+	const VkFormat candidates[] = { VK_FORMAT_D32_SFLOAT, VK_FORMAT_X8_D24_UNORM_PACK32, VK_FORMAT_D24_UNORM_S8_UINT, VK_FORMAT_D16_UNORM };
 
-	file.seekg(0);
-	file.read(buffer.data(), fileSize);
+	for (VkFormat format : candidates)
+	{
+		VkFormatProperties properties;
+		vkGetPhysicalDeviceFormatProperties(m_physcalDevice, format, &properties);
 
-	file.close();
+		if ((properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) != 0)
+		{
+			return format;
+		}
+	}
 
+	return VK_FORMAT_UNDEFINED;
+}
 
-	return buffer;
+bool Vulkan::CreateShaderModule(const std::string& name, ShaderModuleHandle& shaderModule)
+{
+	return m_shaders.CreateModule(name, shaderModule.Replace(m_device));
 }
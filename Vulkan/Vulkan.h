@@ -1,14 +1,35 @@
 #pragma once
 #define NOMINMAX
 #include "Log.h"
-
-#include <vulkan\vulkan.h>
+#include "PipelineCache.h"
+#include "PipelineCompiler.h"
+#include "PipelineStateCache.h"
+#include "MemoryAllocator.h"
+#include "DeletionQueue.h"
+#include "RenderGraph.h"
+#include "MeshBuffer.h"
+#include "GpuCulling.h"
+#include "DescriptorLayoutCache.h"
+#include "DescriptorAllocator.h"
+#include "BindlessTable.h"
+#include "UniformRing.h"
+#include "UploadManager.h"
+#include "AsyncCompute.h"
+#include "ShaderLoader.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+#include "FramePacer.h"
+#include "VulkanHandle.h"
+
+#include <vulkan/vulkan.h>
 #include <algorithm>
-#include <functional>
-#include <GLFW\glfw3.h>
+#include <GLFW/glfw3.h>
 #include <vector>
 #include <set>
 #include <fstream>
+#include <chrono>
+#include <limits>
+#include <string>
 
 const std::vector<const char*> validationLayers = {
 	"VK_LAYER_LUNARG_standard_validation"
@@ -41,65 +62,127 @@ static void DestroyDebugReportCallbackEXT(VkInstance instance, VkDebugReportCall
 	}
 }
 
+const char* const PIPELINE_CACHE_FILE = "pipeline.cache";
+const char* const PROFILE_TRACE_FILE = "profile.json";
+// What unused bindless buffer slots point at, unused image slots get a 1x1 image
+const VkDeviceSize BINDLESS_DEFAULT_BUFFER_SIZE = 256;
+
+const char* const SHADER_DIRECTORY = "../shaders"; // Only read when the shaders aren't embedded
+
+// local_size_x in particles.comp
+const uint32_t PARTICLE_GROUP_SIZE = 256;
+
+// The push constants of particles.comp
+struct ParticleStep
+{
+	float deltaTime;
+	uint32_t count;
+};
+// A hitch doesn't launch the particles through the floor
+const float MAX_PARTICLE_STEP_SECONDS = 0.1f;
+
+// Number of frames the CPU is allowed to record ahead of the GPU
+const uint32_t DEFAULT_FRAMES_IN_FLIGHT = 2;
+
 #ifdef _DEBUG
 const bool validationEnabled = true;
 #else
 const bool validationEnabled = false;
 #endif
 
-template <typename T>
-class VDeleter {
-public:
-	VDeleter() : VDeleter([](T _) {}) {}
+// Destroyed through the instance like the surface, but the extension's entry point has to be looked up
+struct DebugReportCallbackTraits
+{
+	typedef VkDebugReportCallbackEXT Handle;
+	typedef VkInstance Parent;
 
-	VDeleter(std::function<void(T, VkAllocationCallbacks*)> deletef) {
-		this->deleter = [=](T obj) { deletef(obj, nullptr); };
+	static void Destroy(VkInstance instance, VkDebugReportCallbackEXT callback)
+	{
+		DestroyDebugReportCallbackEXT(instance, callback, nullptr);
 	}
+};
 
-	VDeleter(const VDeleter<VkInstance>& instance, std::function<void(VkInstance, T, VkAllocationCallbacks*)> deletef) {
-		this->deleter = [&instance, deletef](T obj) { deletef(instance, obj, nullptr); };
-	}
+typedef VulkanHandle<DebugReportCallbackTraits> DebugReportCallbackHandle;
 
-	VDeleter(const VDeleter<VkDevice>& device, std::function<void(VkDevice, T, VkAllocationCallbacks*)> deletef) {
-		this->deleter = [&device, deletef](T obj) { deletef(device, obj, nullptr); };
-	}
+struct QueueFamilyIndices
+{
+	int graphicsFamily = -1;
+	int presentFamily = -1;
+	int transferFamily = -1; // Falls back to the graphics family when there is no transfer only family
+	int computeFamily = -1; // Same, when there is no compute family without graphics
 
-	~VDeleter() {
-		cleanup();
+	bool IsComplete()
+	{
+		return graphicsFamily >= 0 && presentFamily >= 0;
 	}
+};
 
-	T* operator &() {
-		cleanup();
-		return &object;
+struct FrameSyncStats
+{
+	uint64_t frameCount = 0;
+	double totalFenceWaitMs = 0.0; // Time the CPU spent blocked waiting for the GPU to release a frame
+	double maxFenceWaitMs = 0.0;
+	double totalRecordMs = 0.0; // Time spent recording command buffers in per frame record modes
+	uint64_t recordedDraws = 0;
+	double totalSubmitMs = 0.0; // Queue submit and present
+
+	// The newest frame alone, for per frame distributions. Record is 0 for frames that used static buffers.
+	double lastRecordMs = 0.0;
+	double lastSubmitMs = 0.0;
+
+	double AverageFenceWaitMs() const
+	{
+		return frameCount > 0 ? totalFenceWaitMs / frameCount : 0.0;
 	}
 
-	operator T() const {
-		return object;
+	double AverageRecordMs() const
+	{
+		return frameCount > 0 ? totalRecordMs / frameCount : 0.0;
 	}
 
-private:
-	T object{ VK_NULL_HANDLE };
-	std::function<void(T)> deleter;
-
-	void cleanup() {
-		if (object != VK_NULL_HANDLE) {
-			deleter(object);
-		}
-		object = VK_NULL_HANDLE;
+	double RecordNsPerDraw() const
+	{
+		return recordedDraws > 0 ? totalRecordMs * 1000000.0 / recordedDraws : 0.0;
 	}
 };
 
-struct QueueFamilyIndices
+struct StartupStats
 {
-	int graphicsFamily = -1;
-	int presentFamily = -1;
+	double startupMs = 0.0;
+	double criticalPipelineMs = 0.0; // Time startup spent blocked on the pipelines it draws with
+};
 
-	bool IsComplete()
-	{
-		return graphicsFamily >= 0 && presentFamily >= 0;
-	}
+// Pushed into the uniform ring at the start of every frame
+struct FrameUniforms
+{
+	float time; // Seconds since Initialize
+	float deltaTime;
+	uint32_t frameNumber;
+	uint32_t padding;
+	float viewportSize[2];
+	float inverseViewportSize[2];
 };
 
+// One mesh, drawn for a range of the instance buffer. Laid out like VkDrawIndexedIndirectCommand.
+struct DrawCommand
+{
+	uint32_t indexCount;
+	uint32_t instanceCount;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+	uint32_t firstInstance;
+};
+
+enum class RecordMode
+{
+	Static,		// Command buffers are recorded once per swap chain image and replayed
+	Dynamic,	// Recorded every frame on the calling thread, inline into the frame's primary buffer
+	Threaded	// Recorded every frame, worker threads fill secondary command buffers in parallel
+};
+
+// Don't bother splitting the draw list finer than this, a secondary command buffer isn't free either
+const uint32_t MIN_DRAWS_PER_SECONDARY = 256;
+
 struct SwapChainSupportDetails
 {
 	VkSurfaceCapabilitiesKHR capabilities;
@@ -110,12 +193,122 @@ struct SwapChainSupportDetails
 class Vulkan
 {
 public:
-	bool Initialize(GLFWwindow* window, uint32_t width, uint32_t height);
+	bool Initialize(GLFWwindow* window, uint32_t width, uint32_t height, uint32_t framesInFlight = DEFAULT_FRAMES_IN_FLIGHT);
+	// Renders into device local images instead of a swap chain, no window, surface or glfw required
+	bool InitializeHeadless(uint32_t width, uint32_t height, uint32_t framesInFlight = DEFAULT_FRAMES_IN_FLIGHT, bool enableReadback = false);
 	void Shutdown();
 
-	void DrawFrame();
+	// False when no frame went out, the swap chain was out of date, the window minimized or the submit failed
+	bool DrawFrame();
+
+	// Flags the size dependent objects for a rebuild before the next frame
+	void Resize(uint32_t width, uint32_t height);
+
+	// Copies the last rendered headless image into pixels as tightly packed BGRA8. Blocks until the frame is done.
+	bool ReadbackFrame(std::vector<uint8_t>& pixels);
+
+	bool IsHeadless() const { return m_headless; }
+
+	// Rebuilds the swap chain with the policy's present mode before the next frame, or the closest one the
+	// surface supports. Headless rendering never presents, so it's only kept.
+	void SetPresentPolicy(PresentPolicy policy);
+	PresentPolicy GetPresentPolicy() const { return m_presentPolicy; }
+	VkPresentModeKHR GetPresentMode() const { return m_presentMode; }
+
+	// Frames the CPU may record ahead of the GPU, 1 to the frames in flight, 0 for all of them. Fewer
+	// queued frames cut latency at the cost of the CPU and GPU overlapping less.
+	void SetMaxQueuedFrames(uint32_t maxQueuedFrames) { m_maxQueuedFrames = maxQueuedFrames; }
+	uint32_t GetMaxQueuedFrames() const;
+
+	// Samples per pixel of the main pass, resolved into the back buffer at the end of it. Clamped to what the
+	// device supports with the depth buffer. The multisampled targets never leave tile memory where the
+	// device can keep them there. Both rebuild the render graph and pipelines before the next frame.
+	void SetMultisampling(VkSampleCountFlagBits samples);
+	VkSampleCountFlagBits GetMultisampling() const { return m_msaaSamples; }
+	void SetDepthBuffer(bool enabled);
+	bool HasDepthBuffer() const { return m_depthEnabled; }
+
+	const FrameSyncStats& GetFrameSyncStats() const { return m_syncStats; }
+	const StartupStats& GetStartupStats() const { return m_startupStats; }
+
+	// Both have to be set before Initialize. 0 workers picks one per hardware thread, disabling the cache
+	// file makes every startup compile from scratch.
+	void SetPipelineWorkerCount(uint32_t workerCount) { m_pipelineWorkerCount = workerCount; }
+	void SetPipelineCacheEnabled(bool enabled) { m_pipelineCacheEnabled = enabled; }
+
+	// Has to be set before Initialize. Without the table the graphics pipeline layout has no sets.
+	void SetBindlessEnabled(bool enabled) { m_bindlessEnabled = enabled; }
+	bool IsBindlessEnabled() const { return m_bindlessEnabled; }
+
+	// Set 0 of the graphics pipeline layout when enabled, the uniform ring is the set after it. Per frame
+	// recording binds both once per command buffer, the static buffers bind neither since any frame slot
+	// may replay them.
+	BindlessTable& GetBindless() { return m_bindless; }
+	uint32_t GetUniformSetIndex() const { return m_bindlessEnabled ? 1 : 0; }
+
+	// Per draw constants are allocated here while a frame is recorded, FrameUniforms is at GetFrameUniformOffset
+	UniformRing& GetUniforms() { return m_uniforms; }
+	uint32_t GetFrameUniformOffset() const { return m_frameUniformOffset; }
+
+	DescriptorLayoutCache& GetDescriptorLayouts() { return m_descriptorLayouts; }
+	// Sets from here only live until their frame slot comes around again, allocate them while recording
+	FrameDescriptorAllocator& GetFrameDescriptors() { return m_frameDescriptors; }
+
+	// Startup only blocks on the pipelines it draws with, the warm-up variants keep compiling after it returns
+	void WaitForPipelines();
+	PipelineCompileStats GetPipelineCompileStats() { return m_pipelineCompiler.GetStats(); }
+
+	// Pipelines by state, created the first time a key is looked up
+	PipelineStateCache& GetPipelineStates() { return m_pipelineStates; }
+
+	void SetDrawList(const std::vector<DrawCommand>& drawList);
+
+	// Replaces the whole instance buffer the draw list indexes into. The instances go into a new buffer and the
+	// old one is retired, so nothing waits on frames in flight. Fails while the last call is uploading.
+	bool SetInstances(const std::vector<InstanceData>& instances);
+
+	bool AddMesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, Mesh& mesh);
+	const Mesh& GetBuiltinMesh(BuiltinMesh mesh) const { return m_meshes.GetBuiltinMesh(mesh); }
+
+	// False until every mesh and instance has reached the GPU, frames before that draw nothing
+	bool IsDrawDataReady() const { return m_drawDataReady; }
+
+	// GPU driven mode draws an object table culled by compute every frame instead of the draw list.
+	// SetGpuScene uploads into new scene buffers and retires the old ones, so frames in flight keep culling
+	// the previous scene. It fails while the last call is uploading.
+	bool IsGpuDrivenSupported() const { return m_gpuDrivenSupported; }
+	bool SetGpuScene(const std::vector<Mesh>& meshes, const std::vector<GpuObject>& objects);
+	void SetGpuDriven(bool enabled);
+	bool IsGpuDriven() const { return m_gpuDriven; }
+	// From the newest frame whose fence has signaled
+	const CullingStats& GetCullingStats() const { return m_culling.GetStats(); }
+
+	void SetRecordMode(RecordMode mode) { m_recordMode = mode; }
+	// Draws with the warmed up variant of the graphics pipeline for this state, static buffers are re-recorded
+	bool SetPipelineVariant(VkCullModeFlags cullMode, VkFrontFace frontFace, BlendMode blendMode);
+	RecordMode GetRecordMode() const { return m_recordMode; }
+
+	// Everything the renderer allocates comes from here, so stats cover the whole device
+	MemoryAllocator& GetAllocator() { return m_allocator; }
+
+	// Uploads staged here are handed to the graphics queue with the next DrawFrame
+	UploadManager& GetUploads() { return m_uploads; }
+
+	// Compute batches can be submitted at any time, see AsyncCompute::Submit
+	AsyncCompute& GetCompute() { return m_compute; }
+
+	// Simulates count particles with the particles shader, one batch on the compute queue per frame that
+	// overlaps the graphics work. Nothing draws them yet. 0 stops the simulation.
+	bool SetParticleCount(uint32_t count);
+	uint32_t GetParticleCount() const { return m_particleCount; }
+
+	// Builds a compute pipeline from a shader through the pipeline cache. Destroy it with DestroyComputePipeline.
+	bool CreateComputePipeline(const std::string& shaderName, const std::vector<VkDescriptorSetLayout>& setLayouts, uint32_t pushConstantSize, ComputePipeline& pipeline);
+	void DestroyComputePipeline(ComputePipeline& pipeline);
 
 private:
+	bool InitializeCommon(GLFWwindow* window, uint32_t width, uint32_t height, uint32_t framesInFlight);
+
 	bool CreateInstance();
 	bool CheckValidationLayerSupport();
 	bool SetupDebugCallback();
@@ -126,70 +319,197 @@ private:
 	bool CreateDevice();
 
 	bool CreateSwapChain(uint32_t width, uint32_t height);
+	bool RecreateSwapChain();
+	void WaitForAllFrames();
+	void RecordSubmitTime(std::chrono::high_resolution_clock::time_point start);
+	bool CreateHeadlessTargets(uint32_t width, uint32_t height);
+	bool CreateReadbackBuffer();
 
 	bool CreateImageViews();
 
-	bool CreateRenderPass();
+	bool CreateBindlessDefaults();
+	bool CreateParticlePipeline();
+	void StepParticles();
+
+	bool BuildRenderGraph();
 
 	bool CreateGraphicPipeline();
-	bool CreateFrameBuffer();
+	bool CreateRenderTargets();
 	bool CreateCommandPool();
 	bool CreateCommandBuffers();
+	bool CreateFrameCommandPools();
+
+	VkCommandBuffer RecordFrame(uint32_t imageIndex);
+	void RecordMainPass(VkCommandBuffer commandBuffer, const RenderGraphContext& context);
+	// VK_NULL_HANDLE if no command buffer could be allocated
+	VkCommandBuffer RecordSecondary(uint32_t threadIndex, const RenderGraphContext& context, uint32_t firstDraw, uint32_t drawCount);
+	void RecordDraws(VkCommandBuffer commandBuffer, uint32_t firstDraw, uint32_t drawCount);
+	uint32_t GetDrawCount() const;
+	void SetViewportAndScissor(VkCommandBuffer commandBuffer);
+	void BindFrameDescriptors(VkCommandBuffer commandBuffer);
+	void UpdateFrameUniforms();
 
-	bool CreateSemaphores();
+	bool CreateSyncObjects();
+
+	double WaitForFence(VkFence fence);
 
 	std::vector<const char*> GetRequiredExtensions();
+	std::vector<const char*> GetDeviceExtensions();
 	bool IsDeviceValid(VkPhysicalDevice device);
 	bool CheckDeviceExtensionsSupport(VkPhysicalDevice device);
 	QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice device);
 
 	SwapChainSupportDetails QuerySwapChainSupport(VkPhysicalDevice device);
 	VkSurfaceFormatKHR ChooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats);
-	VkPresentModeKHR ChooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes);
+	VkPresentModeKHR ChooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes) const;
 	VkExtent2D ChooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities, uint32_t width, uint32_t height);
+	VkSampleCountFlagBits ChooseSampleCount(VkSampleCountFlagBits requested) const;
+	VkFormat ChooseDepthFormat() const;
 
-	void CreateShaderModule(const std::vector<char>& shaderSrc, VDeleter<VkShaderModule>& shaderModule);
+	bool CreateShaderModule(const std::string& name, ShaderModuleHandle& shaderModule);
 
-	std::vector<char> ReadFile(const std::string filename);
 
 private:
-	VDeleter<VkInstance> m_instance{ vkDestroyInstance };
-	VDeleter<VkDebugReportCallbackEXT> m_callback{ m_instance, DestroyDebugReportCallbackEXT };
-	VDeleter<VkDevice> m_device{ vkDestroyDevice };
-	VkPhysicalDevice m_physcalDevice = VK_NULL_HANDLE; // Since this will get disposed with the VkInstance does, we don't need to make this a VDeleter
+	InstanceHandle m_instance;
+	DebugReportCallbackHandle m_callback;
+	DeviceHandle m_device;
+	VkPhysicalDevice m_physcalDevice = VK_NULL_HANDLE; // Since this will get disposed with the VkInstance does, we don't need to own it
+
+	MemoryAllocator m_allocator; // Blocks are released in Shutdown, before the device goes away
+	DeletionQueue m_deletions;
+	UploadManager m_uploads;
+	MeshBuffer m_meshes;
+	AllocatedBuffer m_instanceBuffer;
+	UploadTicket m_instanceTicket = 0;
+	UploadTicket m_drawDataTicket = 0; // Newest mesh or instance upload
+	bool m_drawDataReady = false;
+	AsyncCompute m_compute;
+	ComputePipeline m_particlePipeline;
+	DescriptorPoolHandle m_particlePool;
+	VkDescriptorSet m_particleSet = VK_NULL_HANDLE;
+	AllocatedBuffer m_particleBuffer;
+	uint32_t m_particleCount = 0;
+	ComputeTicket m_particleTicket = 0; // Newest step
+	std::chrono::high_resolution_clock::time_point m_lastParticleStep;
+
+	DescriptorLayoutCache m_descriptorLayouts;
+	FrameDescriptorAllocator m_frameDescriptors;
+	BindlessTable m_bindless;
+	AllocatedBuffer m_bindlessDefaultBuffer;
+	ImageHandle m_bindlessDefaultImage;
+	Allocation m_bindlessDefaultImageMemory;
+	ImageViewHandle m_bindlessDefaultView;
+	SamplerHandle m_bindlessDefaultSampler;
+	bool m_bindlessEnabled = true;
+	UniformRing m_uniforms;
+	uint32_t m_frameUniformOffset = 0;
+	std::chrono::high_resolution_clock::time_point m_startTime;
+	std::chrono::high_resolution_clock::time_point m_lastFrameTime;
+
+	VkPhysicalDeviceFeatures m_enabledFeatures = {};
+	DrawIndexedIndirectCountFn m_drawIndirectCount = nullptr; // From whichever draw_indirect_count extension is enabled
+	bool m_pipelineCreationFeedback = false;
+	GpuCulling m_culling;
+	ComputePipeline m_cullPipeline;
+	ComputePipeline m_compactPipeline;
+	UploadTicket m_gpuSceneTicket = 0;
+	bool m_gpuDrivenSupported = false;
+	bool m_gpuDriven = false;
 	
-	VDeleter<VkSurfaceKHR> m_surface{ m_instance, vkDestroySurfaceKHR };
-
-	VDeleter<VkSwapchainKHR> m_swapChain{ m_device, vkDestroySwapchainKHR };
-	std::vector<VkImage> m_swapChainImages;
-	VkFormat m_swapChainImageFormat;
-	VkExtent2D m_swapChainExtent;
-	std::vector<VDeleter<VkImageView>> m_swapChainImageViews;
+	SurfaceHandle m_surface;
 
-	VDeleter<VkPipelineLayout> m_pipelineLayout{ m_device, vkDestroyPipelineLayout };
+	SwapChainHandle m_swapChain;
 
-	VDeleter<VkRenderPass> m_renderPass{ m_device, vkDestroyRenderPass };
+	// Headless render targets stand in for the swap chain images, m_swapChainImages holds their raw handles
+	bool m_headless = false;
+	ImageArray m_headlessImages;
+	std::vector<Allocation> m_headlessImageMemory;
+	uint32_t m_lastImageIndex = 0;
 
-	VDeleter<VkPipeline> m_graphicsPipeline{ m_device, vkDestroyPipeline };
+	bool m_readbackEnabled = false;
+	AllocatedBuffer m_readbackBuffer;
 
-	std::vector<VDeleter<VkFramebuffer>> m_swapChainFrameBuffers;
-
-	VDeleter<VkCommandPool> m_commandPool{ m_device, vkDestroyCommandPool };
+	std::vector<VkImage> m_swapChainImages;
+	VkFormat m_swapChainImageFormat;
+	VkExtent2D m_swapChainExtent;
+	VkExtent2D m_windowExtent; // Requested size, the surface may override it
+	bool m_swapChainDirty = false;
+	PresentPolicy m_presentPolicy = PresentPolicy::LowLatency;
+	VkPresentModeKHR m_presentMode = VK_PRESENT_MODE_FIFO_KHR;
+	ImageViewArray m_swapChainImageViews;
+
+	PipelineCache m_pipelineCache;
+	PipelineCompiler m_pipelineCompiler;
+	PipelineStateCache m_pipelineStates;
+	uint32_t m_pipelineWorkerCount = 0;
+	bool m_pipelineCacheEnabled = true;
+	ShaderLoader m_shaders;
+
+	PipelineLayoutHandle m_pipelineLayout;
+
+	// Passes, their render passes and framebuffers, and the intermediate targets. Rebuilt when the swap
+	// chain format changes, resized with it otherwise.
+	RenderGraph m_renderGraph;
+	RenderResource m_backBuffer = INVALID_RENDER_RESOURCE;
+	uint32_t m_mainPass = 0;
+	bool m_recordingStatic = false; // The main pass is being recorded into a static buffer
+	VkSampleCountFlagBits m_msaaRequested = VK_SAMPLE_COUNT_1_BIT;
+	VkSampleCountFlagBits m_msaaSamples = VK_SAMPLE_COUNT_1_BIT; // What the graph was built with
+	bool m_depthEnabled = false;
+	bool m_renderGraphDirty = false;
+
+	PipelineKey m_graphicsPipelineKey;
+	VkPipeline m_graphicsPipeline = VK_NULL_HANDLE; // Owned by m_pipelineStates
+
+	CommandPoolHandle m_commandPool;
 	std::vector<VkCommandBuffer> m_commandBuffers;
 
+	RecordMode m_recordMode = RecordMode::Static;
+	std::vector<DrawCommand> m_drawList;
+
+	// Per frame recording. Every pool is transient, only touched by one thread and reset as a whole with
+	// vkResetCommandPool once the frame's fence signals, individual buffers are never reset or freed.
+	JobSystem m_jobs;
+	CommandPoolArray m_framePools;
+	std::vector<VkCommandBuffer> m_frameCommandBuffers;
+	std::vector<VkCommandBuffer> m_framePrologueBuffers; // Upload ownership acquires and the frame's first timestamp
+	std::vector<VkCommandBuffer> m_frameEpilogueBuffers; // The frame's last timestamp
+
+	// Reused every frame so building the graphics submit doesn't allocate
+	std::vector<VkSemaphore> m_submitWaitSemaphores;
+	std::vector<VkPipelineStageFlags> m_submitWaitStages;
+	std::vector<VkSemaphore> m_submitSignalSemaphores;
+	CommandPoolArray m_workerPools; // [frame * threadCount + thread]
+	std::vector<std::vector<VkCommandBuffer>> m_workerSecondaries;
+	std::vector<uint32_t> m_workerSecondariesUsed;
+	std::vector<VkCommandBuffer> m_secondaries;
+
 	VkQueue m_graphicsQueue; // Cleaned up when the logical devices is disposed
 	VkQueue m_presentQueue;
-
-	VDeleter<VkShaderModule> m_vertexShaderModule{ m_device, vkDestroyShaderModule };
-	VDeleter<VkShaderModule> m_fragmentShaderModule{ m_device, vkDestroyShaderModule };
-
-	VDeleter<VkSemaphore> m_imageAvailableSem{ m_device, vkDestroySemaphore };
-	VDeleter<VkSemaphore> m_renderFinishedSem{ m_device, vkDestroySemaphore };
+	VkQueue m_transferQueue;
+	VkQueue m_computeQueue;
+
+	// Kept alive while pipelines built from them may still be compiling
+	ShaderModuleHandle m_vertexShaderModule;
+	ShaderModuleHandle m_fragmentShaderModule;
+
+	// One set of sync objects per frame in flight so the CPU can record frame N+1 while the GPU runs frame N
+	uint32_t m_framesInFlight = DEFAULT_FRAMES_IN_FLIGHT;
+	uint32_t m_currentFrame = 0;
+	uint32_t m_maxQueuedFrames = 0;
+	SemaphoreArray m_imageAvailableSems;
+	SemaphoreArray m_renderFinishedSems;
+	FenceArray m_inFlightFences;
+	std::vector<VkFence> m_imagesInFlight; // Fence of the frame currently using each swap chain image, not owned
+	bool m_deviceLost = false; // A frame fence could not be signaled again after a failed submit, nothing more is drawn
+
+	FrameSyncStats m_syncStats;
+	StartupStats m_startupStats;
 
 };
 
 static VkBool32 debugCallback(VkDebugReportFlagsEXT flags, VkDebugReportObjectTypeEXT objType, uint64_t obj, size_t location, int32_t code, const char* layerPrefix, const char* msg, void* userData) 
 {
-	Log::Error("Validation Layer: " + std::string(msg));
+	LOG_ERROR("Validation Layer: %s", msg);
 	return VK_FALSE;
 }
\ No newline at end of file
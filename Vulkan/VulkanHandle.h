@@ -0,0 +1,246 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Owning wrappers for Vulkan handles. Each handle type gets a traits struct naming its handle, the parent it
+// is destroyed through and the destroy call, so destruction is a direct, inlinable call picked at compile time.
+// The traits are separate structs rather than specializations on the handle type because non-dispatchable
+// handles are all uint64_t on 32-bit builds, where VkImage and VkBuffer are the same type.
+// Handles are move only and hold nothing beyond the handle and its parent, the device or instance, by value.
+
+// Instances and devices have no parent
+struct NoParentTraits
+{
+	typedef std::nullptr_t Parent;
+};
+
+#define VULKAN_ROOT_HANDLE(Name, Type, DestroyFn) \
+	struct Name##Traits : NoParentTraits \
+	{ \
+		typedef Type Handle; \
+		static void Destroy(Parent, Type handle) { DestroyFn(handle, nullptr); } \
+	};
+
+#define VULKAN_CHILD_HANDLE(Name, Type, ParentType, DestroyFn) \
+	struct Name##Traits \
+	{ \
+		typedef Type Handle; \
+		typedef ParentType Parent; \
+		static void Destroy(ParentType parent, Type handle) { DestroyFn(parent, handle, nullptr); } \
+	};
+
+VULKAN_ROOT_HANDLE(Instance, VkInstance, vkDestroyInstance)
+VULKAN_ROOT_HANDLE(Device, VkDevice, vkDestroyDevice)
+VULKAN_CHILD_HANDLE(Surface, VkSurfaceKHR, VkInstance, vkDestroySurfaceKHR)
+VULKAN_CHILD_HANDLE(SwapChain, VkSwapchainKHR, VkDevice, vkDestroySwapchainKHR)
+VULKAN_CHILD_HANDLE(Image, VkImage, VkDevice, vkDestroyImage)
+VULKAN_CHILD_HANDLE(ImageView, VkImageView, VkDevice, vkDestroyImageView)
+VULKAN_CHILD_HANDLE(Framebuffer, VkFramebuffer, VkDevice, vkDestroyFramebuffer)
+VULKAN_CHILD_HANDLE(RenderPass, VkRenderPass, VkDevice, vkDestroyRenderPass)
+VULKAN_CHILD_HANDLE(PipelineLayout, VkPipelineLayout, VkDevice, vkDestroyPipelineLayout)
+VULKAN_CHILD_HANDLE(Pipeline, VkPipeline, VkDevice, vkDestroyPipeline)
+VULKAN_CHILD_HANDLE(ShaderModule, VkShaderModule, VkDevice, vkDestroyShaderModule)
+VULKAN_CHILD_HANDLE(CommandPool, VkCommandPool, VkDevice, vkDestroyCommandPool)
+VULKAN_CHILD_HANDLE(Semaphore, VkSemaphore, VkDevice, vkDestroySemaphore)
+VULKAN_CHILD_HANDLE(Fence, VkFence, VkDevice, vkDestroyFence)
+VULKAN_CHILD_HANDLE(Buffer, VkBuffer, VkDevice, vkDestroyBuffer)
+VULKAN_CHILD_HANDLE(Sampler, VkSampler, VkDevice, vkDestroySampler)
+VULKAN_CHILD_HANDLE(DescriptorPool, VkDescriptorPool, VkDevice, vkDestroyDescriptorPool)
+
+template<typename Traits>
+class VulkanHandle
+{
+public:
+	typedef typename Traits::Handle Handle;
+	typedef typename Traits::Parent Parent;
+
+	VulkanHandle() = default;
+	VulkanHandle(Parent parent, Handle handle) : m_handle(handle), m_parent(parent) {}
+
+	~VulkanHandle()
+	{
+		Reset();
+	}
+
+	VulkanHandle(const VulkanHandle&) = delete;
+	VulkanHandle& operator=(const VulkanHandle&) = delete;
+
+	VulkanHandle(VulkanHandle&& other) noexcept : m_handle(other.m_handle), m_parent(other.m_parent)
+	{
+		other.m_handle = VK_NULL_HANDLE;
+	}
+
+	VulkanHandle& operator=(VulkanHandle&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Reset();
+			m_handle = other.m_handle;
+			m_parent = other.m_parent;
+			other.m_handle = VK_NULL_HANDLE;
+		}
+
+		return *this;
+	}
+
+	operator Handle() const { return m_handle; }
+	Handle Get() const { return m_handle; }
+	Parent GetParent() const { return m_parent; }
+
+	// For arrays of one, e.g. pWaitSemaphores. Taking the address never touches the handle.
+	const Handle* GetAddress() const { return &m_handle; }
+
+	// Destroys whatever is held and hands out the slot for a vkCreate* call to fill in
+	Handle* Replace(Parent parent = Parent())
+	{
+		Reset();
+		m_parent = parent;
+		return &m_handle;
+	}
+
+	// Takes over handle, destroying the old one after, so the old one can still be used to create it
+	void Reset(Parent parent, Handle handle)
+	{
+		Reset();
+		m_handle = handle;
+		m_parent = parent;
+	}
+
+	void Reset()
+	{
+		if (m_handle != VK_NULL_HANDLE)
+		{
+			Traits::Destroy(m_parent, m_handle);
+			m_handle = VK_NULL_HANDLE;
+		}
+	}
+
+	// Gives up ownership without destroying anything
+	Handle Release()
+	{
+		Handle handle = m_handle;
+		m_handle = VK_NULL_HANDLE;
+		return handle;
+	}
+
+private:
+	Handle m_handle = VK_NULL_HANDLE;
+	Parent m_parent = Parent();
+};
+
+// A run of handles sharing one parent, stored as plain handles so Data() can go straight to calls like
+// vkWaitForFences. Everything is destroyed together in Clear.
+template<typename Traits>
+class VulkanHandleArray
+{
+public:
+	typedef typename Traits::Handle Handle;
+	typedef typename Traits::Parent Parent;
+
+	VulkanHandleArray() = default;
+
+	~VulkanHandleArray()
+	{
+		Clear();
+	}
+
+	VulkanHandleArray(const VulkanHandleArray&) = delete;
+	VulkanHandleArray& operator=(const VulkanHandleArray&) = delete;
+
+	VulkanHandleArray(VulkanHandleArray&& other) noexcept : m_handles(std::move(other.m_handles)), m_parent(other.m_parent)
+	{
+		other.m_handles.clear();
+	}
+
+	VulkanHandleArray& operator=(VulkanHandleArray&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Clear();
+			m_handles = std::move(other.m_handles);
+			m_parent = other.m_parent;
+			other.m_handles.clear();
+		}
+
+		return *this;
+	}
+
+	// Destroys everything held, then makes count empty slots owned through parent
+	void Resize(Parent parent, size_t count)
+	{
+		Clear();
+		m_parent = parent;
+		m_handles.assign(count, VK_NULL_HANDLE);
+	}
+
+	// Destroys every handle in one pass and empties the array
+	void Clear()
+	{
+		for (Handle handle : m_handles)
+		{
+			if (handle != VK_NULL_HANDLE)
+			{
+				Traits::Destroy(m_parent, handle);
+			}
+		}
+
+		m_handles.clear();
+	}
+
+	// Destroys handle i and hands out its slot for a vkCreate* call to fill in
+	Handle* Replace(size_t i)
+	{
+		if (m_handles[i] != VK_NULL_HANDLE)
+		{
+			Traits::Destroy(m_parent, m_handles[i]);
+			m_handles[i] = VK_NULL_HANDLE;
+		}
+
+		return &m_handles[i];
+	}
+
+	// Gives up ownership of every handle without destroying any, e.g. to hand them to a deletion queue
+	std::vector<Handle> Release()
+	{
+		std::vector<Handle> handles;
+		handles.swap(m_handles);
+		return handles;
+	}
+
+	Handle operator[](size_t i) const { return m_handles[i]; }
+	const Handle* Data() const { return m_handles.data(); }
+	size_t Size() const { return m_handles.size(); }
+	bool Empty() const { return m_handles.empty(); }
+
+	typename std::vector<Handle>::const_iterator begin() const { return m_handles.begin(); }
+	typename std::vector<Handle>::const_iterator end() const { return m_handles.end(); }
+
+private:
+	std::vector<Handle> m_handles;
+	Parent m_parent = Parent();
+};
+
+typedef VulkanHandle<InstanceTraits> InstanceHandle;
+typedef VulkanHandle<DeviceTraits> DeviceHandle;
+typedef VulkanHandle<SurfaceTraits> SurfaceHandle;
+typedef VulkanHandle<SwapChainTraits> SwapChainHandle;
+typedef VulkanHandle<RenderPassTraits> RenderPassHandle;
+typedef VulkanHandle<PipelineLayoutTraits> PipelineLayoutHandle;
+typedef VulkanHandle<PipelineTraits> PipelineHandle;
+typedef VulkanHandle<ShaderModuleTraits> ShaderModuleHandle;
+typedef VulkanHandle<CommandPoolTraits> CommandPoolHandle;
+typedef VulkanHandle<BufferTraits> BufferHandle;
+typedef VulkanHandle<ImageTraits> ImageHandle;
+typedef VulkanHandle<ImageViewTraits> ImageViewHandle;
+typedef VulkanHandle<SamplerTraits> SamplerHandle;
+typedef VulkanHandle<DescriptorPoolTraits> DescriptorPoolHandle;
+
+typedef VulkanHandleArray<ImageTraits> ImageArray;
+typedef VulkanHandleArray<ImageViewTraits> ImageViewArray;
+typedef VulkanHandleArray<FramebufferTraits> FramebufferArray;
+typedef VulkanHandleArray<CommandPoolTraits> CommandPoolArray;
+typedef VulkanHandleArray<SemaphoreTraits> SemaphoreArray;
+typedef VulkanHandleArray<FenceTraits> FenceArray;